@@ -0,0 +1,112 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the block header is padded so the data after it stays aligned */
+#define BLOCK_HEADER \
+    ((sizeof(libsign_arena_block) + LIBSIGN_ARENA_ALIGN - 1) & ~(size_t)(LIBSIGN_ARENA_ALIGN - 1))
+
+void arena_init(libsign_arena *arena)
+{
+    memset(arena, 0, sizeof(libsign_arena));
+    arena->next_size = LIBSIGN_ARENA_MIN_BLOCK;
+}
+
+void arena_destroy(libsign_arena *arena)
+{
+    libsign_arena_block *block = arena->blocks, *next;
+
+    while(block) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena_init(arena);
+}
+
+void arena_reset(libsign_arena *arena)
+{
+    libsign_arena_block *block = arena->blocks, *next, *largest = NULL;
+
+    /* keep the largest block, it is what the arena grew into */
+    for(; block; block = next) {
+        next = block->next;
+        if(!largest || block->size > largest->size) {
+            free(largest);
+            largest = block;
+        }
+        else
+            free(block);
+    }
+
+    arena->blocks = largest;
+    arena->allocated = 0;
+    if(largest) {
+        largest->next = NULL;
+        largest->used = BLOCK_HEADER;
+        arena->allocated = largest->size;
+    }
+}
+
+static libsign_arena_block *new_block(libsign_arena *arena, size_t size)
+{
+    libsign_arena_block *block;
+    size_t block_size = arena->next_size;
+
+    /* the size classes double, an allocation larger than the next class
+       gets a block of exactly its size */
+    if(size > block_size - BLOCK_HEADER)
+        block_size = size + BLOCK_HEADER;
+    else if(arena->next_size < LIBSIGN_ARENA_MAX_BLOCK)
+        arena->next_size *= 2;
+
+    block = malloc(block_size);
+    if(!block)
+        return NULL;
+
+    block->size = block_size;
+    block->used = BLOCK_HEADER;
+    arena->allocated += block_size;
+
+    return block;
+}
+
+void *arena_alloc(libsign_arena *arena, size_t size)
+{
+    libsign_arena_block *block = arena->blocks;
+    void *ptr;
+
+    size = (size + LIBSIGN_ARENA_ALIGN - 1) & ~(size_t)(LIBSIGN_ARENA_ALIGN - 1);
+    if(!size)
+        size = LIBSIGN_ARENA_ALIGN;
+
+    if(!block || block->size - block->used < size) {
+        block = new_block(arena, size);
+        if(!block)
+            return NULL;
+
+        /* a block of its own goes behind the current one, so the space left
+           in that is not lost */
+        if(arena->blocks && block->size - size - BLOCK_HEADER <
+                            arena->blocks->size - arena->blocks->used) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        }
+        else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    ptr = (uint8_t*)block + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+size_t arena_size(const libsign_arena *arena)
+{
+    return arena->allocated;
+}
@@ -0,0 +1,50 @@
+#ifndef __LIBSIGN_ARENA_H
+#define __LIBSIGN_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the first block of an arena, later blocks double in size up to the
+   largest size class. larger allocations get a block of their own. */
+#define LIBSIGN_ARENA_MIN_BLOCK (16 * 1024)
+#define LIBSIGN_ARENA_MAX_BLOCK (1024 * 1024)
+/* every allocation is aligned to this */
+#define LIBSIGN_ARENA_ALIGN     16
+
+typedef struct libsign_arena_block {
+    struct libsign_arena_block *next;
+    size_t size;
+    size_t used;
+} libsign_arena_block;
+
+/* A bump allocator for parse results. Keys and signatures set up with
+   public_key_init_arena() and signature_init_arena() take all of their
+   memory from it, and everything parsed into them is released at once by
+   arena_reset() or arena_destroy() rather than by their destroy functions. */
+typedef struct libsign_arena {
+    /* the block being allocated from comes first */
+    libsign_arena_block *blocks;
+    /* size of the next block to be allocated */
+    size_t next_size;
+    size_t allocated;
+} libsign_arena;
+
+void arena_init(libsign_arena *arena);
+void arena_destroy(libsign_arena *arena);
+/* release everything allocated, the largest block is kept for reuse */
+void arena_reset(libsign_arena *arena);
+
+/* returns NULL when out of memory */
+void *arena_alloc(libsign_arena *arena, size_t size);
+/* total size of the blocks held by the arena */
+size_t arena_size(const libsign_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_ARENA_H */
@@ -1,19 +1,37 @@
 #include "armor.h"
 #include "pgp.h"
-#include "b64/cdecode.h"
+#include "base64.h"
+#include "crc24.h"
+#include "probes.h"
+#include "stats.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
-int decode_armor(const uint8_t *armor_in, uint32_t armor_len, uint8_t **plain_out,
-                 uint32_t *plain_len)
+/* input is checksummed and encoded this many octets at a time */
+#define ARMOR_ENCODE_BLOCK  3072
+
+/* find str at the start of a line in [p, end), armor is the start of the
+   whole input */
+static const uint8_t *find_line(const uint8_t *armor, const uint8_t *p, const uint8_t *end,
+                                const char *str, size_t len)
 {
-    int ret = -EINVAL;
-    const uint8_t *armor_start, *crc_start;
-    uint8_t *pgp_plain, *pgp_realloced;
-    uint32_t actual_crc24, expected_crc24, crc_plain;
-    uint32_t i, encoded_armor_len, plain_armor_len;
-    base64_decodestate state;
+    while(p < end && (p = memchr(p, str[0], end - p))) {
+        if((p == armor || p[-1] == '\n') && (size_t)(end - p) >= len &&
+           memcmp(p, str, len) == 0)
+            return p;
+        p++;
+    }
+
+    return NULL;
+}
+
+int armor_next_block(const uint8_t *armor, uint32_t armor_len, uint32_t *pos,
+                     libsign_armor_block *block)
+{
+    const uint8_t *end = armor + armor_len, *p, *line_end, *tail, *data_end, *checksum;
 
     /* (6.2) ASCII armor shall be the concatenation of the following data:
       - armor header line
@@ -23,84 +41,541 @@ int decode_armor(const uint8_t *armor_in, uint32_t armor_len, uint8_t **plain_ou
       - the armor checksum
       - the armor tail */
 
-    /* find the start of the armor */
-    i = 1;
-    while(i++ < armor_len-1) {
-        /* test for both unix style endings and windows style */
-        if(armor_in[i-1] == '\n' && armor_in[i] == '\n')
+    if(*pos >= armor_len)
+        return -ENOENT;
+
+    /* the header line, anything between blocks is ignored */
+    p = find_line(armor, armor + *pos, end, "-----BEGIN PGP ", 15);
+    if(!p)
+        return -ENOENT;
+
+    block->start = p;
+    block->type = p + 15;
+
+    line_end = memchr(p, '\n', end - p);
+    if(!line_end)
+        return -EINVAL;
+
+    p = memchr(block->type, '-', line_end - block->type);
+    if(!p)
+        return -EINVAL;
+    block->type_len = p - block->type;
+
+    /* the armor headers, up to the blank line */
+    for(p = line_end + 1;; p = line_end + 1) {
+        line_end = memchr(p, '\n', end - p);
+        if(!line_end)
+            return -EINVAL;
+        if(line_end == p || (line_end == p + 1 && *p == '\r'))
             break;
-        else if(i >= 3) {
-            if((armor_in[i-3] == '\r' && armor_in[i-2] == '\n' &&
-                armor_in[i-1] == '\r' && armor_in[i] == '\n'))
-                break;
-        }
     }
-    /* did we find it? */
-    if(i == armor_len)
-        goto exit;
 
-    armor_start = armor_in + i;
+    block->data = line_end + 1;
 
-    /* find the armor checksum and encrypted packet length */
-    i = armor_len;
-    while(--i) {
-        if(armor_in[i] == '=')
-            break;
+    /* the base64 alphabet has no '-', so the tail is the first line starting
+       with it. missing tails are tolerated at the end of the input. */
+    tail = find_line(armor, block->data, end, "-----END PGP ", 13);
+    if(tail) {
+        if((uint32_t)(end - tail) < 13 + block->type_len ||
+           memcmp(tail + 13, block->type, block->type_len) != 0)
+            return -EINVAL;
+
+        data_end = tail;
+        line_end = memchr(tail, '\n', end - tail);
+        block->len = (line_end ? line_end + 1 : end) - block->start;
     }
-    /* did we find it? */
-    if(!i)
-        goto exit;
+    else {
+        data_end = end;
+        block->len = end - block->start;
+    }
+
+    /* the checksum is the last line of the data */
+    while(data_end > block->data && (data_end[-1] == '\n' || data_end[-1] == '\r' ||
+                                     data_end[-1] == ' ' || data_end[-1] == '\t'))
+        data_end--;
+    checksum = data_end;
+    while(checksum > block->data && checksum[-1] != '\n')
+        checksum--;
+
+    /* CRC is 5 characters long ('=' and CRC) - 3 octets - 24 bits */
+    if(*checksum != '=' || data_end - checksum < 5)
+        return -EINVAL;
+
+    block->checksum = checksum;
+    block->data_len = checksum - block->data;
 
-    crc_start = armor_in + i;
-    encoded_armor_len = crc_start - armor_start;
+    *pos = block->start + block->len - armor;
 
-    /* do we have enough data for the CRC too?
-       CRC is 5 characters long ('=' and CRC) - 3 octets - 24 bits */
-    if(encoded_armor_len + 5 > armor_len)
+    return 0;
+}
+
+/* find the armored data and the checksum of the first block of the armor */
+static int locate_armor(const uint8_t *armor_in, uint32_t armor_len,
+                        const uint8_t **armor_start, uint32_t *encoded_len,
+                        const uint8_t **crc_start)
+{
+    int ret;
+    uint32_t pos = 0;
+    libsign_armor_block block;
+
+    ret = armor_next_block(armor_in, armor_len, &pos, &block);
+    if(ret < 0)
+        return -EINVAL;
+
+    *armor_start = block.data;
+    *encoded_len = block.data_len;
+    *crc_start = block.checksum;
+
+    return 0;
+}
+
+/* decode the armor located by locate_armor into plain_out, which may be the
+   armor itself since the output never overtakes the input. */
+static int decode_located_armor(const uint8_t *armor_start, uint32_t encoded_len,
+                                const uint8_t *crc_start, uint8_t *plain_out,
+                                uint32_t *plain_len)
+{
+    int ret = -EINVAL;
+    uint8_t crc_plain[3];
+    uint32_t actual_crc24, expected_crc24, plain_armor_len;
+    LIBSIGN_STAT_BEGIN(start);
+
+    LIBSIGN_PROBE1(decode_armor__entry, encoded_len);
+
+    /* decode the CRC first, ignore '='... */
+    if(base64_decode(crc_start + 1, 4, crc_plain) != 3)
         goto exit;
 
-    /* allocate buffers for plaintext (this is slightly bigger
-       than strictly necessary, but will be realloc'ed) */
-    pgp_plain = malloc(encoded_armor_len);
-    if(!pgp_plain) {
-        ret = -ENOMEM;
+    expected_crc24 = (crc_plain[0] << 16) | (crc_plain[1] << 8) | crc_plain[2];
+
+    /* decode the data, line breaks are skipped by the decoder */
+    plain_armor_len = base64_decode(armor_start, encoded_len, plain_out);
+
+    actual_crc24 = pgp_crc24(plain_armor_len, plain_out);
+    if(actual_crc24 != expected_crc24)
         goto exit;
-    }
 
-    /* decode the data */
-    base64_init_decodestate(&state);
-    plain_armor_len = base64_decode_block((char*)armor_start, encoded_armor_len, (char*)pgp_plain, &state);
+    *plain_len = plain_armor_len;
+    ret = 0;
 
-    /* give back the memory we don't need, note that realloc is not responsible for cleaning up
-       the original malloc'ed memory if it fails, so we need to keep the original pointer for cleaning
-       purposes in case realloc fails (by returning NULL). */
-    pgp_realloced = realloc(pgp_plain, plain_armor_len);
-    if(!pgp_realloced)
-        goto free_pgp;
+exit:
+    LIBSIGN_STAT_END(LIBSIGN_STAT_DECODE_ARMOR, start, encoded_len);
+    LIBSIGN_PROBE2(decode_armor__return, ret, ret < 0 ? 0 : *plain_len);
 
-    pgp_plain = pgp_realloced;
+    return ret;
+}
 
-    actual_crc24 = pgp_crc24(plain_armor_len, pgp_plain);
+int decode_armor_size(const uint8_t *armor_in, uint32_t armor_len, uint32_t *plain_size)
+{
+    int ret;
+    const uint8_t *armor_start, *crc_start;
+    uint32_t encoded_len;
 
-    /* decode the CRC */
-    base64_init_decodestate(&state);
-    /* ignore '='... */
-    base64_decode_block((char*)crc_start + 1, 4, (char*)&crc_plain, &state);
+    ret = locate_armor(armor_in, armor_len, &armor_start, &encoded_len, &crc_start);
+    if(ret < 0)
+        return ret;
 
-    expected_crc24 = (crc_plain & 0xff0000) >> 16 |
-                       (crc_plain & 0x0000ff) << 16 |
-                       (crc_plain & 0x00ff00);
+    *plain_size = BASE64_DECODED_MAX(encoded_len);
 
-    if(actual_crc24 != expected_crc24)
-        goto free_pgp;
+    return 0;
+}
+
+int decode_armor_buffer(const uint8_t *armor_in, uint32_t armor_len, uint8_t *plain_out,
+                        uint32_t plain_size, uint32_t *plain_len)
+{
+    int ret;
+    const uint8_t *armor_start, *crc_start;
+    uint32_t encoded_len;
+
+    ret = locate_armor(armor_in, armor_len, &armor_start, &encoded_len, &crc_start);
+    if(ret < 0)
+        return ret;
+
+    if(plain_size < BASE64_DECODED_MAX(encoded_len))
+        return -ENOSPC;
+
+    return decode_located_armor(armor_start, encoded_len, crc_start, plain_out, plain_len);
+}
+
+int decode_armor_inplace(uint8_t *armor, uint32_t armor_len, uint32_t *plain_len)
+{
+    int ret;
+    const uint8_t *armor_start, *crc_start;
+    uint32_t encoded_len;
+
+    ret = locate_armor(armor, armor_len, &armor_start, &encoded_len, &crc_start);
+    if(ret < 0)
+        return ret;
+
+    return decode_located_armor(armor_start, encoded_len, crc_start, armor, plain_len);
+}
+
+int decode_armor(const uint8_t *armor_in, uint32_t armor_len, uint8_t **plain_out,
+                 uint32_t *plain_len)
+{
+    int ret;
+    const uint8_t *armor_start, *crc_start;
+    uint8_t *pgp_plain;
+    uint32_t encoded_len;
+
+    ret = locate_armor(armor_in, armor_len, &armor_start, &encoded_len, &crc_start);
+    if(ret < 0)
+        return ret;
+
+    /* the buffer is up to a quarter larger than the plaintext, which is
+       not worth a realloc for data that is usually parsed and freed. */
+    pgp_plain = malloc(BASE64_DECODED_MAX(encoded_len) + 1);
+    if(!pgp_plain)
+        return -ENOMEM;
+    LIBSIGN_STAT_ALLOC(LIBSIGN_STAT_DECODE_ARMOR);
+
+    ret = decode_located_armor(armor_start, encoded_len, crc_start, pgp_plain, plain_len);
+    if(ret < 0) {
+        free(pgp_plain);
+        return ret;
+    }
 
     *plain_out = pgp_plain;
-    *plain_len = plain_armor_len;
 
     return 0;
+}
+
+int decode_armor_block(const libsign_armor_block *block, uint8_t *plain_out,
+                       uint32_t plain_size, uint32_t *plain_len)
+{
+    if(plain_size < BASE64_DECODED_MAX(block->data_len))
+        return -ENOSPC;
+
+    return decode_located_armor(block->data, block->data_len, block->checksum, plain_out,
+                                plain_len);
+}
+
+typedef struct scan_job {
+    libsign_armor_block *blocks;
+    uint8_t **plain;
+    uint32_t *plain_len;
+    int *results;
+    uint32_t num_blocks;
+
+    /* next block to be claimed by a worker */
+    uint32_t next;
+} scan_job;
+
+static void *scan_worker(void *arg)
+{
+    scan_job *job = arg;
+
+    for(;;) {
+        uint32_t i = __sync_fetch_and_add(&job->next, 1);
+        uint32_t size;
+        if(i >= job->num_blocks)
+            break;
+
+        size = BASE64_DECODED_MAX(job->blocks[i].data_len);
+        job->plain[i] = malloc(size + 1);
+        if(!job->plain[i]) {
+            job->results[i] = -ENOMEM;
+            continue;
+        }
+        job->results[i] = decode_armor_block(&job->blocks[i], job->plain[i], size,
+                                             &job->plain_len[i]);
+    }
+
+    return NULL;
+}
+
+/* find all the blocks first, decode them on the threads and hand them out
+   in order once they are all done */
+static int scan_threaded(const uint8_t *armor, uint32_t armor_len, unsigned int threads,
+                         libsign_armor_block_fn fn, void *opaque)
+{
+    int ret;
+    pthread_t workers[64];
+    unsigned int i, started = 0;
+    uint32_t pos = 0, allocated = 0;
+    libsign_armor_block block, *tmp;
+    scan_job job;
+
+    memset(&job, 0, sizeof(scan_job));
+
+    while((ret = armor_next_block(armor, armor_len, &pos, &block)) == 0) {
+        if(job.num_blocks == allocated) {
+            allocated = allocated ? allocated * 2 : 16;
+            tmp = realloc(job.blocks, allocated * sizeof(libsign_armor_block));
+            if(!tmp) {
+                ret = -ENOMEM;
+                goto free_blocks;
+            }
+            job.blocks = tmp;
+        }
+        job.blocks[job.num_blocks++] = block;
+    }
+    if(ret != -ENOENT)
+        goto free_blocks;
+
+    job.plain = calloc(job.num_blocks + 1, sizeof(uint8_t*));
+    job.plain_len = calloc(job.num_blocks + 1, sizeof(uint32_t));
+    job.results = calloc(job.num_blocks + 1, sizeof(int));
+    if(!job.plain || !job.plain_len || !job.results) {
+        ret = -ENOMEM;
+        goto free_blocks;
+    }
+
+    if(threads > job.num_blocks)
+        threads = job.num_blocks;
+    if(threads > sizeof(workers) / sizeof(workers[0]))
+        threads = sizeof(workers) / sizeof(workers[0]);
+
+    for(i = 1; i < threads; i++) {
+        if(pthread_create(&workers[started], NULL, scan_worker, &job) != 0)
+            break;
+        started++;
+    }
+
+    scan_worker(&job);
+
+    for(i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    ret = 0;
+    for(i = 0; i < job.num_blocks && ret == 0; i++) {
+        ret = job.results[i];
+        if(ret == 0)
+            ret = fn(opaque, &job.blocks[i], job.plain[i], job.plain_len[i]);
+    }
+
+free_blocks:
+    if(job.plain) {
+        for(i = 0; i < job.num_blocks; i++)
+            free(job.plain[i]);
+    }
+    free(job.plain);
+    free(job.plain_len);
+    free(job.results);
+    free(job.blocks);
+
+    return ret;
+}
+
+int armor_scan(const uint8_t *armor, uint32_t armor_len, unsigned int threads,
+               libsign_armor_block_fn fn, void *opaque)
+{
+    int ret;
+    uint32_t pos = 0, plain_len, size, allocated = 0;
+    uint8_t *plain = NULL, *tmp;
+    libsign_armor_block block;
+
+    if(threads > 1)
+        return scan_threaded(armor, armor_len, threads, fn, opaque);
+
+    /* one buffer, grown to fit the largest block so far */
+    while((ret = armor_next_block(armor, armor_len, &pos, &block)) == 0) {
+        size = BASE64_DECODED_MAX(block.data_len);
+        if(size + 1 > allocated) {
+            tmp = realloc(plain, size + 1);
+            if(!tmp) {
+                ret = -ENOMEM;
+                break;
+            }
+            plain = tmp;
+            allocated = size + 1;
+        }
+
+        ret = decode_armor_block(&block, plain, size, &plain_len);
+        if(ret < 0)
+            break;
+
+        ret = fn(opaque, &block, plain, plain_len);
+        if(ret < 0)
+            break;
+    }
+
+    free(plain);
+
+    return ret == -ENOENT ? 0 : ret;
+}
+
+static int flush_armor(libsign_armor_encoder *enc)
+{
+    int ret;
+
+    if(!enc->out_len)
+        return 0;
+
+    ret = enc->write(enc->opaque, enc->out, enc->out_len);
+    enc->out_len = 0;
 
-free_pgp:
-    free(pgp_plain);
-exit:
     return ret;
 }
+
+static int put_armor(libsign_armor_encoder *enc, const char *str)
+{
+    int ret;
+    size_t len = strlen(str);
+
+    if(enc->out_len + len > sizeof(enc->out)) {
+        ret = flush_armor(enc);
+        if(ret < 0)
+            return ret;
+    }
+
+    memcpy(enc->out + enc->out_len, str, len);
+    enc->out_len += len;
+
+    return 0;
+}
+
+/* encode one line of len octets, a short line is padded */
+static int encode_line(libsign_armor_encoder *enc, const uint8_t *data, uint32_t len)
+{
+    int ret;
+
+    if(enc->out_len + enc->line_width + 1 > sizeof(enc->out)) {
+        ret = flush_armor(enc);
+        if(ret < 0)
+            return ret;
+    }
+
+    enc->out_len += base64_encode(data, len, enc->out + enc->out_len);
+    enc->out[enc->out_len++] = '\n';
+
+    return 0;
+}
+
+static int encode_lines(libsign_armor_encoder *enc, const uint8_t *data, size_t len)
+{
+    int ret;
+    uint32_t line_octets = enc->line_width / 4 * 3;
+
+    /* finish the line started by an earlier write */
+    if(enc->pending_len) {
+        uint32_t n = line_octets - enc->pending_len;
+        if(n > len)
+            n = len;
+
+        memcpy(enc->pending + enc->pending_len, data, n);
+        enc->pending_len += n;
+        data += n;
+        len -= n;
+
+        if(enc->pending_len < line_octets)
+            return 0;
+
+        ret = encode_line(enc, enc->pending, line_octets);
+        if(ret < 0)
+            return ret;
+        enc->pending_len = 0;
+    }
+
+    while(len >= line_octets) {
+        ret = encode_line(enc, data, line_octets);
+        if(ret < 0)
+            return ret;
+        data += line_octets;
+        len -= line_octets;
+    }
+
+    memcpy(enc->pending, data, len);
+    enc->pending_len = len;
+
+    return 0;
+}
+
+int armor_encoder_init(libsign_armor_encoder *enc, const char *type, uint32_t line_width,
+                       libsign_write_fn write, void *opaque)
+{
+    int ret;
+
+    if(!line_width)
+        line_width = ARMOR_LINE_WIDTH;
+    if(line_width % 4 || line_width > ARMOR_MAX_LINE_WIDTH)
+        return -EINVAL;
+    /* the header line has to fit in the buffer */
+    if(strlen(type) > 64)
+        return -EINVAL;
+
+    enc->write = write;
+    enc->opaque = opaque;
+    enc->type = type;
+    enc->line_width = line_width;
+    enc->crc = CRC24_INIT;
+    enc->pending_len = 0;
+    enc->out_len = 0;
+
+    /* (6.2) the header line, no armor headers and the blank line */
+    if((ret = put_armor(enc, "-----BEGIN PGP ")) < 0 ||
+       (ret = put_armor(enc, type)) < 0 ||
+       (ret = put_armor(enc, "-----\n\n")) < 0)
+        return ret;
+
+    return 0;
+}
+
+int armor_encoder_write(void *opaque, const uint8_t *data, size_t len)
+{
+    int ret;
+    libsign_armor_encoder *enc = opaque;
+
+    while(len) {
+        size_t n = len < ARMOR_ENCODE_BLOCK ? len : ARMOR_ENCODE_BLOCK;
+
+        /* the block is encoded right after the checksum has been over it */
+        enc->crc = crc24_update(enc->crc, n, data);
+        ret = encode_lines(enc, data, n);
+        if(ret < 0)
+            return ret;
+
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int armor_encoder_finish(libsign_armor_encoder *enc)
+{
+    int ret;
+    uint8_t crc[3];
+    char checksum[7];
+
+    if(enc->pending_len) {
+        ret = encode_line(enc, enc->pending, enc->pending_len);
+        if(ret < 0)
+            return ret;
+        enc->pending_len = 0;
+    }
+
+    /* (6.1) the checksum line is '=' followed by the encoded CRC */
+    crc[0] = enc->crc >> 16;
+    crc[1] = enc->crc >> 8;
+    crc[2] = enc->crc;
+    checksum[0] = '=';
+    base64_encode(crc, 3, (uint8_t*)checksum + 1);
+    checksum[5] = '\n';
+    checksum[6] = '\0';
+
+    if((ret = put_armor(enc, checksum)) < 0 ||
+       (ret = put_armor(enc, "-----END PGP ")) < 0 ||
+       (ret = put_armor(enc, enc->type)) < 0 ||
+       (ret = put_armor(enc, "-----\n")) < 0)
+        return ret;
+
+    return flush_armor(enc);
+}
+
+int libsign_encode_armor(const char *type, const uint8_t *data, size_t len,
+                         uint32_t line_width, libsign_write_fn write, void *opaque)
+{
+    int ret;
+    libsign_armor_encoder enc;
+
+    ret = armor_encoder_init(&enc, type, line_width, write, opaque);
+    if(ret < 0)
+        return ret;
+
+    ret = armor_encoder_write(&enc, data, len);
+    if(ret < 0)
+        return ret;
+
+    return armor_encoder_finish(&enc);
+}
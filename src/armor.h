@@ -1,14 +1,108 @@
 #ifndef __LIBSIGN_ARMOR_H
 #define __LIBSIGN_ARMOR_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "stream.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* armor up to this size decoded (e.g. a signature) is decoded on the stack
+   by the armor buffer parsers rather than on the heap */
+#define ARMOR_STACK_SIZE    4096
+
+/* the decode functions take the first block of the armor, see armor_scan()
+   for the others */
 int decode_armor(const uint8_t *armor_in, uint32_t armor_len, uint8_t **plain_out,
                  uint32_t *plain_len);
+/* the size of buffer decode_armor_buffer needs for the armor, an upper
+   bound of the decoded size */
+int decode_armor_size(const uint8_t *armor_in, uint32_t armor_len, uint32_t *plain_size);
+/* decode into a buffer of plain_size octets provided by the caller */
+int decode_armor_buffer(const uint8_t *armor_in, uint32_t armor_len, uint8_t *plain_out,
+                        uint32_t plain_size, uint32_t *plain_len);
+/* decode over the armor itself, the decoded data starts at armor */
+int decode_armor_inplace(uint8_t *armor, uint32_t armor_len, uint32_t *plain_len);
+
+/* One block of armor, pointing into the text it was found in. */
+typedef struct libsign_armor_block {
+    /* the header line up to and including the tail line */
+    const uint8_t *start;
+    uint32_t len;
+    /* what follows "-----BEGIN PGP " in the header line */
+    const uint8_t *type;
+    uint32_t type_len;
+    /* the armored data, and the checksum line following it */
+    const uint8_t *data;
+    uint32_t data_len;
+    const uint8_t *checksum;
+} libsign_armor_block;
+
+/* called with the packets of each block in turn, plain is only valid during
+   the call. a negative return value stops the scan and is passed on. */
+typedef int (*libsign_armor_block_fn)(void *opaque, const libsign_armor_block *block,
+                                      const uint8_t *plain, uint32_t plain_len);
+
+/* find the next block of armor from *pos in a single forward pass, *pos is
+   moved past it. returns -ENOENT when there are no more blocks. */
+int armor_next_block(const uint8_t *armor, uint32_t armor_len, uint32_t *pos,
+                     libsign_armor_block *block);
+/* decode a block found by armor_next_block, plain_size must be at least
+   BASE64_DECODED_MAX(block->data_len) */
+int decode_armor_block(const libsign_armor_block *block, uint8_t *plain_out,
+                       uint32_t plain_size, uint32_t *plain_len);
+/* decode every block of e.g. a concatenated keyring. with more than one
+   thread the blocks are decoded in parallel, but fn is still called for them
+   in order from the calling thread. */
+int armor_scan(const uint8_t *armor, uint32_t armor_len, unsigned int threads,
+               libsign_armor_block_fn fn, void *opaque);
+
+/* (6.2) armor header line types, as in "-----BEGIN PGP SIGNATURE-----" */
+#define ARMOR_SIGNATURE         "SIGNATURE"
+#define ARMOR_PUBLIC_KEY_BLOCK  "PUBLIC KEY BLOCK"
+#define ARMOR_MESSAGE           "MESSAGE"
+
+/* line widths are in characters and must be a multiple of 4, no longer than
+   the 76 characters allowed by 6.3. 0 selects the default. */
+#define ARMOR_LINE_WIDTH        64
+#define ARMOR_MAX_LINE_WIDTH    76
+/* encoded lines are collected in a buffer of this size before being passed
+   to the write function */
+#define ARMOR_ENCODER_BUFFER    4096
+
+/* Streaming armor encoder. The data is checksummed and encoded one block at
+   a time while the block is still in the cache, and the output only goes
+   through the fixed size buffer on its way to the write function. */
+typedef struct libsign_armor_encoder {
+    libsign_write_fn write;
+    void *opaque;
+    const char *type;
+
+    uint32_t line_width;
+    uint32_t crc;
+
+    /* the start of a line that was not completed by the last write */
+    uint8_t pending[ARMOR_MAX_LINE_WIDTH / 4 * 3];
+    uint32_t pending_len;
+
+    uint8_t out[ARMOR_ENCODER_BUFFER];
+    uint32_t out_len;
+} libsign_armor_encoder;
+
+/* start the armor by writing the header line */
+int armor_encoder_init(libsign_armor_encoder *enc, const char *type, uint32_t line_width,
+                       libsign_write_fn write, void *opaque);
+/* a libsign_write_fn, so packets can be written straight into the armor */
+int armor_encoder_write(void *enc, const uint8_t *data, size_t len);
+/* write the last line, the checksum and the tail */
+int armor_encoder_finish(libsign_armor_encoder *enc);
+
+/* armor len octets of data in one go */
+int libsign_encode_armor(const char *type, const uint8_t *data, size_t len,
+                         uint32_t line_width, libsign_write_fn write, void *opaque);
 
 #ifdef __cplusplus
 }
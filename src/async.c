@@ -0,0 +1,198 @@
+#include "async.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* wake the loop, the counter is only ever read to reset it */
+static void async_signal(libsign_async *async)
+{
+    uint64_t one = 1;
+    ssize_t len;
+
+    len = write(async->fd, &one, sizeof(one));
+    (void)len;
+}
+
+static int run_job(libsign_verify_job *job, libsign_scratch *scratch)
+{
+    if(job->filename)
+        return verify_scratch(job->pub, job->sig, job->filename, scratch);
+
+    return verify_buffer_scratch(job->pub, job->sig, job->data, job->datalen, scratch);
+}
+
+static void *async_worker(void *arg)
+{
+    libsign_async_worker *worker = arg;
+    libsign_async *async = worker->async;
+    libsign_verify_job *job;
+
+    for(;;) {
+        pthread_mutex_lock(&async->lock);
+        while(!async->pending && !async->stop)
+            pthread_cond_wait(&async->cond, &async->lock);
+        if(async->stop) {
+            pthread_mutex_unlock(&async->lock);
+            break;
+        }
+
+        job = async->pending;
+        async->pending = job->next;
+        if(!async->pending)
+            async->pending_tail = NULL;
+        pthread_mutex_unlock(&async->lock);
+
+        job->result = run_job(job, &worker->scratch);
+        job->next = NULL;
+
+        pthread_mutex_lock(&async->lock);
+        if(async->done_tail)
+            async->done_tail->next = job;
+        else
+            async->done = job;
+        async->done_tail = job;
+        pthread_mutex_unlock(&async->lock);
+
+        /* after the job is on the queue, so a wakeup is never lost */
+        async_signal(async);
+    }
+
+    return NULL;
+}
+
+int libsign_async_init(libsign_async *async, unsigned int threads, unsigned int max_in_flight)
+{
+    /* an errno from pthread_create() */
+    int ret = EAGAIN;
+    unsigned int i;
+
+    memset(async, 0, sizeof(libsign_async));
+
+    if(!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? online : 1;
+    }
+    if(threads > 64)
+        threads = 64;
+
+    async->max_in_flight = max_in_flight ? max_in_flight : LIBSIGN_ASYNC_MAX_IN_FLIGHT;
+
+    async->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(async->fd < 0)
+        return -errno;
+
+    async->workers = calloc(threads, sizeof(libsign_async_worker));
+    if(!async->workers) {
+        close(async->fd);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->cond, NULL);
+
+    for(i = 0; i < threads; i++) {
+        libsign_async_worker *worker = &async->workers[async->num_workers];
+
+        worker->async = async;
+        scratch_init(&worker->scratch);
+        ret = pthread_create(&worker->thread, NULL, async_worker, worker);
+        if(ret != 0)
+            break;
+        async->num_workers++;
+    }
+
+    /* fewer threads than asked for will do, none will not */
+    if(!async->num_workers) {
+        libsign_async_destroy(async);
+        return -ret;
+    }
+
+    return 0;
+}
+
+void libsign_async_destroy(libsign_async *async)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_cond_broadcast(&async->cond);
+    pthread_mutex_unlock(&async->lock);
+
+    for(i = 0; i < async->num_workers; i++) {
+        pthread_join(async->workers[i].thread, NULL);
+        scratch_destroy(&async->workers[i].scratch);
+    }
+
+    pthread_mutex_destroy(&async->lock);
+    pthread_cond_destroy(&async->cond);
+
+    free(async->workers);
+    close(async->fd);
+
+    memset(async, 0, sizeof(libsign_async));
+    async->fd = -1;
+}
+
+int libsign_async_fd(const libsign_async *async)
+{
+    return async->fd;
+}
+
+int libsign_async_submit(libsign_async *async, libsign_verify_job *job)
+{
+    int ret = 0;
+
+    job->next = NULL;
+    job->result = 0;
+
+    pthread_mutex_lock(&async->lock);
+    if(async->in_flight >= async->max_in_flight) {
+        ret = -EAGAIN;
+    }
+    else {
+        if(async->pending_tail)
+            async->pending_tail->next = job;
+        else
+            async->pending = job;
+        async->pending_tail = job;
+        async->in_flight++;
+        pthread_cond_signal(&async->cond);
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    return ret;
+}
+
+int libsign_poll_completions(libsign_async *async, libsign_verify_job **jobs, unsigned int max)
+{
+    unsigned int count = 0;
+    uint64_t value;
+    int more;
+
+    /* reset the counter before looking, a job done after this sets it
+       again. nothing to read is not an error. */
+    if(read(async->fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        return -errno;
+
+    pthread_mutex_lock(&async->lock);
+    while(count < max && async->done) {
+        jobs[count++] = async->done;
+        async->done = async->done->next;
+    }
+    if(!async->done)
+        async->done_tail = NULL;
+    async->in_flight -= count;
+    more = async->done != NULL;
+    pthread_mutex_unlock(&async->lock);
+
+    /* keep the descriptor readable for the jobs left behind */
+    if(more)
+        async_signal(async);
+
+    return count;
+}
@@ -0,0 +1,94 @@
+#ifndef __LIBSIGN_ASYNC_H
+#define __LIBSIGN_ASYNC_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "public_key.h"
+#include "scratch.h"
+#include "signature.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* jobs in flight when no maximum is given to libsign_async_init() */
+#define LIBSIGN_ASYNC_MAX_IN_FLIGHT 256
+
+/* One verification for libsign_async_submit(). The data is the file named
+   by filename, or data if there is none. The job, and the key, signature
+   and data it refers to, belong to the caller and must stay as they are
+   until the job is handed back by libsign_poll_completions(). */
+typedef struct libsign_verify_job {
+    libsign_public_key *pub;
+    libsign_signature *sig;
+    const char *filename;
+    const uint8_t *data;
+    uint32_t datalen;
+
+    /* for the caller, to find its request again */
+    void *opaque;
+
+    /* the outcome, as verify() */
+    int result;
+
+    /* private, the queue the job is on */
+    struct libsign_verify_job *next;
+} libsign_verify_job;
+
+struct libsign_async;
+
+typedef struct libsign_async_worker {
+    struct libsign_async *async;
+    pthread_t thread;
+    /* each thread verifies in its own buffers */
+    libsign_scratch scratch;
+} libsign_async_worker;
+
+/* Verifications for an event loop that must not block. Jobs are queued to
+   threads of their own, and an eventfd becomes readable when some are done,
+   to be added to the poll or epoll set of the loop. Submitting and
+   collecting never wait for a verification, only for the short lock of
+   the queues. */
+typedef struct libsign_async {
+    int fd;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stop;
+
+    /* submitted and not collected yet, done or not */
+    unsigned int in_flight;
+    unsigned int max_in_flight;
+
+    /* in the order they were submitted, and finished */
+    libsign_verify_job *pending;
+    libsign_verify_job *pending_tail;
+    libsign_verify_job *done;
+    libsign_verify_job *done_tail;
+
+    libsign_async_worker *workers;
+    unsigned int num_workers;
+} libsign_async;
+
+/* start the threads, 0 for one per processor. max_in_flight bounds the jobs
+   submitted and not collected yet, 0 for LIBSIGN_ASYNC_MAX_IN_FLIGHT. */
+int libsign_async_init(libsign_async *async, unsigned int threads, unsigned int max_in_flight);
+/* stop the threads. jobs that were not collected are dropped, those being
+   verified are finished first. */
+void libsign_async_destroy(libsign_async *async);
+
+/* a descriptor that is readable while there are jobs to collect */
+int libsign_async_fd(const libsign_async *async);
+
+/* queue a job, -EAGAIN if the maximum number of jobs are in flight */
+int libsign_async_submit(libsign_async *async, libsign_verify_job *job);
+/* hand back up to max of the jobs that are done, in the order they
+   finished, with their result set. returns how many, 0 if none were. */
+int libsign_poll_completions(libsign_async *async, libsign_verify_job **jobs, unsigned int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_ASYNC_H */
@@ -0,0 +1,481 @@
+#include "base64.h"
+#include "cpu.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#ifdef LIBSIGN_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define INVALID 0xff
+
+typedef size_t (*decode_fn)(base64_decoder *state, const uint8_t *in, size_t len,
+                            uint8_t *out);
+typedef size_t (*encode_fn)(const uint8_t *in, size_t len, uint8_t *out);
+
+static const char encode_table[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const uint8_t decode_table[256] = {
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID,      62, INVALID, INVALID, INVALID,      63,
+         52,      53,      54,      55,      56,      57,      58,      59,
+         60,      61, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID,       0,       1,       2,       3,       4,       5,       6,
+          7,       8,       9,      10,      11,      12,      13,      14,
+         15,      16,      17,      18,      19,      20,      21,      22,
+         23,      24,      25, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID,      26,      27,      28,      29,      30,      31,      32,
+         33,      34,      35,      36,      37,      38,      39,      40,
+         41,      42,      43,      44,      45,      46,      47,      48,
+         49,      50,      51, INVALID, INVALID, INVALID, INVALID, INVALID,
+    /* everything above 0x7f is invalid */
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+    INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID
+};
+
+/* Decode characters one at a time, with a fast path for whole quads. If
+   resync is set we return as soon as we are back on a quad boundary after
+   skipping a character outside the alphabet, so a vector loop can take over
+   again after a line break. */
+static const uint8_t *decode_scalar_run(base64_decoder *state, const uint8_t *in,
+                                        const uint8_t *end, uint8_t **out_p, int resync)
+{
+    uint8_t *out = *out_p;
+    uint32_t bits = state->bits, num_bits = state->num_bits;
+    int skipped = 0;
+
+    while(in < end) {
+        uint8_t value;
+
+        if(num_bits == 0) {
+            if(resync && skipped)
+                break;
+
+            if(end - in >= 4) {
+                uint32_t a = decode_table[in[0]], b = decode_table[in[1]],
+                         c = decode_table[in[2]], d = decode_table[in[3]];
+                if(!((a | b | c | d) & 0x80)) {
+                    uint32_t quad = (a << 18) | (b << 12) | (c << 6) | d;
+                    out[0] = quad >> 16;
+                    out[1] = quad >> 8;
+                    out[2] = quad;
+                    out += 3;
+                    in += 4;
+                    continue;
+                }
+            }
+        }
+
+        value = decode_table[*in++];
+        if(value == INVALID) {
+            skipped = 1;
+            continue;
+        }
+
+        bits = (bits << 6) | value;
+        num_bits += 6;
+        if(num_bits >= 8) {
+            num_bits -= 8;
+            *out++ = bits >> num_bits;
+        }
+        bits &= (1 << num_bits) - 1;
+    }
+
+    state->bits = bits;
+    state->num_bits = num_bits;
+    *out_p = out;
+
+    return in;
+}
+
+static size_t decode_scalar(base64_decoder *state, const uint8_t *in, size_t len,
+                            uint8_t *out)
+{
+    uint8_t *start = out;
+
+    decode_scalar_run(state, in, in + len, &out, 0);
+
+    return out - start;
+}
+
+/* encode whole groups of three octets and pad the rest */
+static size_t encode_scalar(const uint8_t *in, size_t len, uint8_t *out)
+{
+    uint8_t *start = out;
+
+    while(len >= 3) {
+        uint32_t triple = (in[0] << 16) | (in[1] << 8) | in[2];
+        out[0] = encode_table[triple >> 18];
+        out[1] = encode_table[(triple >> 12) & 0x3f];
+        out[2] = encode_table[(triple >> 6) & 0x3f];
+        out[3] = encode_table[triple & 0x3f];
+        out += 4;
+        in += 3;
+        len -= 3;
+    }
+
+    if(len) {
+        uint32_t triple = (in[0] << 16) | (len == 2 ? in[1] << 8 : 0);
+        out[0] = encode_table[triple >> 18];
+        out[1] = encode_table[(triple >> 12) & 0x3f];
+        out[2] = len == 2 ? encode_table[(triple >> 6) & 0x3f] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+
+    return out - start;
+}
+
+#ifdef LIBSIGN_X86_SIMD
+/* Vector decoding after Wojciech Muła's method: the high and low nibble of
+   each character index two tables whose AND is non-zero for characters
+   outside the alphabet, and a third table gives the offset that turns a
+   character into its 6-bit value. Blocks with any other character (line
+   breaks, padding) are left to the scalar code. */
+
+__attribute__((target("ssse3")))
+static const uint8_t *decode_ssse3_run(const uint8_t *in, const uint8_t *end, uint8_t **out_p)
+{
+    uint8_t *out = *out_p;
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    while(end - in >= 16) {
+        uint8_t block[16];
+        __m128i str = _mm_loadu_si128((const __m128i*)in);
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        __m128i roll;
+
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)) != 0xffff)
+            break;
+
+        roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask_2f), hi_nibbles));
+        str = _mm_add_epi8(str, roll);
+
+        /* merge 4 x 6 bits into 3 octets per 32 bit lane and pack them */
+        str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+        str = _mm_shuffle_epi8(str, pack);
+
+        /* only 12 of the 16 octets are ours, and the output may overlap input
+           we have yet to read when decoding in place */
+        _mm_storeu_si128((__m128i*)block, str);
+        memcpy(out, block, 12);
+
+        out += 12;
+        in += 16;
+    }
+
+    *out_p = out;
+
+    return in;
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *decode_avx2_run(const uint8_t *in, const uint8_t *end, uint8_t **out_p)
+{
+    uint8_t *out = *out_p;
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+    while(end - in >= 32) {
+        uint8_t block[32];
+        __m256i str = _mm256_loadu_si256((const __m256i*)in);
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        __m256i roll;
+
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero)) != -1)
+            break;
+
+        roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask_2f), hi_nibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+        str = _mm256_shuffle_epi8(str, pack);
+        /* move the 12 octets of each 128 bit lane next to each other */
+        str = _mm256_permutevar8x32_epi32(str, lanes);
+
+        _mm256_storeu_si256((__m256i*)block, str);
+        memcpy(out, block, 24);
+
+        out += 24;
+        in += 32;
+    }
+
+    *out_p = out;
+
+    return in;
+}
+
+/* Vector encoding, also after Wojciech Muła: the 12 input octets of a lane
+   are spread out so each 32 bit lane holds three of them, the four 6-bit
+   fields are moved into place with multiplies and a table indexed by a
+   reduced form of the field gives the offset to the character. */
+
+__attribute__((target("ssse3")))
+static inline __m128i encode_ssse3_lane(__m128i in)
+{
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i lut_shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    __m128i hi, lo, indices, reduced;
+
+    in = _mm_shuffle_epi8(in, spread);
+    hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                         _mm_set1_epi32(0x04000040));
+    lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                         _mm_set1_epi32(0x01000010));
+    indices = _mm_or_si128(hi, lo);
+
+    /* 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12 */
+    reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    reduced = _mm_or_si128(reduced, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices),
+                                                  _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(lut_shift, reduced));
+}
+
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const uint8_t *in, size_t len, uint8_t *out)
+{
+    uint8_t *start = out;
+
+    /* 16 octets are loaded for every 12 encoded */
+    while(len >= 16) {
+        __m128i str = encode_ssse3_lane(_mm_loadu_si128((const __m128i*)in));
+        _mm_storeu_si128((__m128i*)out, str);
+
+        out += 16;
+        in += 12;
+        len -= 12;
+    }
+
+    return (out - start) + encode_scalar(in, len, out);
+}
+
+__attribute__((target("avx2")))
+static size_t encode_avx2(const uint8_t *in, size_t len, uint8_t *out)
+{
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i lut_shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0);
+    uint8_t *start = out;
+
+    /* the second lane is loaded from 12 octets in, 28 octets are read for
+       every 24 encoded */
+    while(len >= 28) {
+        __m256i str, hi, lo, indices, reduced;
+
+        str = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)),
+                                      _mm_loadu_si128((const __m128i*)(in + 12)), 1);
+        str = _mm256_shuffle_epi8(str, spread);
+        hi = _mm256_mulhi_epu16(_mm256_and_si256(str, _mm256_set1_epi32(0x0fc0fc00)),
+                                _mm256_set1_epi32(0x04000040));
+        lo = _mm256_mullo_epi16(_mm256_and_si256(str, _mm256_set1_epi32(0x003f03f0)),
+                                _mm256_set1_epi32(0x01000010));
+        indices = _mm256_or_si256(hi, lo);
+
+        reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        reduced = _mm256_or_si256(reduced,
+                                  _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                                                   _mm256_set1_epi8(13)));
+        str = _mm256_add_epi8(indices, _mm256_shuffle_epi8(lut_shift, reduced));
+        _mm256_storeu_si256((__m256i*)out, str);
+
+        out += 32;
+        in += 24;
+        len -= 24;
+    }
+
+    return (out - start) + encode_ssse3(in, len, out);
+}
+
+static size_t decode_ssse3(base64_decoder *state, const uint8_t *in, size_t len,
+                           uint8_t *out)
+{
+    const uint8_t *end = in + len;
+    uint8_t *start = out;
+
+    while(in < end) {
+        if(state->num_bits == 0)
+            in = decode_ssse3_run(in, end, &out);
+        in = decode_scalar_run(state, in, end, &out, 1);
+    }
+
+    return out - start;
+}
+
+static size_t decode_avx2(base64_decoder *state, const uint8_t *in, size_t len,
+                          uint8_t *out)
+{
+    const uint8_t *end = in + len;
+    uint8_t *start = out;
+
+    while(in < end) {
+        if(state->num_bits == 0) {
+            in = decode_avx2_run(in, end, &out);
+            /* a line break in the 32 octet block may still leave a clean
+               16 octet block in front of it */
+            in = decode_ssse3_run(in, end, &out);
+        }
+        in = decode_scalar_run(state, in, end, &out, 1);
+    }
+
+    return out - start;
+}
+#endif
+
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+static decode_fn decode_impl = decode_scalar;
+static encode_fn encode_impl = encode_scalar;
+static enum base64_impl current_impl = BASE64_IMPL_SCALAR;
+
+static int select_impl(enum base64_impl impl)
+{
+    unsigned int features = cpu_features();
+
+    if(impl == BASE64_IMPL_AUTO) {
+        if(features & CPU_AVX2)
+            impl = BASE64_IMPL_AVX2;
+        else if(features & CPU_SSSE3)
+            impl = BASE64_IMPL_SSSE3;
+        else
+            impl = BASE64_IMPL_SCALAR;
+    }
+
+    switch(impl) {
+    case BASE64_IMPL_SCALAR:
+        decode_impl = decode_scalar;
+        encode_impl = encode_scalar;
+        break;
+#ifdef LIBSIGN_X86_SIMD
+    case BASE64_IMPL_SSSE3:
+        if(!(features & CPU_SSSE3))
+            return -ENOTSUP;
+        decode_impl = decode_ssse3;
+        encode_impl = encode_ssse3;
+        break;
+    case BASE64_IMPL_AVX2:
+        if(!(features & CPU_AVX2))
+            return -ENOTSUP;
+        decode_impl = decode_avx2;
+        encode_impl = encode_avx2;
+        break;
+#endif
+    default:
+        return -ENOTSUP;
+    }
+
+    current_impl = impl;
+
+    return 0;
+}
+
+static void base64_dispatch(void)
+{
+    select_impl(BASE64_IMPL_AUTO);
+}
+
+int base64_set_impl(enum base64_impl impl)
+{
+    /* make sure the automatic selection does not override ours later */
+    pthread_once(&dispatch_once, base64_dispatch);
+
+    return select_impl(impl);
+}
+
+enum base64_impl base64_get_impl(void)
+{
+    pthread_once(&dispatch_once, base64_dispatch);
+
+    return current_impl;
+}
+
+void base64_decoder_init(base64_decoder *state)
+{
+    state->bits = 0;
+    state->num_bits = 0;
+}
+
+size_t base64_decode_update(base64_decoder *state, const uint8_t *in, size_t len,
+                            uint8_t *out)
+{
+    pthread_once(&dispatch_once, base64_dispatch);
+
+    return decode_impl(state, in, len, out);
+}
+
+size_t base64_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    base64_decoder state;
+
+    base64_decoder_init(&state);
+
+    return base64_decode_update(&state, in, len, out);
+}
+
+size_t base64_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    pthread_once(&dispatch_once, base64_dispatch);
+
+    return encode_impl(in, len, out);
+}
@@ -0,0 +1,52 @@
+#ifndef __LIBSIGN_BASE64_H
+#define __LIBSIGN_BASE64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* upper bound for the output of decoding len characters, including any bits
+   left over in the decoder state from earlier input */
+#define BASE64_DECODED_MAX(len) ((((len) * 3) + 3) / 4)
+/* length of the encoding of len octets, including padding */
+#define BASE64_ENCODED_LEN(len) ((((len) + 2) / 3) * 4)
+
+enum base64_impl {
+    BASE64_IMPL_AUTO    = 0,
+    BASE64_IMPL_SCALAR  = 1,
+    BASE64_IMPL_SSSE3   = 2,
+    BASE64_IMPL_AVX2    = 3
+};
+
+/* Characters outside the base64 alphabet (line breaks, padding) are skipped,
+   so armored text can be decoded without stripping it first. The output is
+   identical to the libb64 decoder in cdecode.c. */
+typedef struct base64_decoder {
+    uint32_t bits;
+    uint32_t num_bits;
+} base64_decoder;
+
+void base64_decoder_init(base64_decoder *state);
+/* decode the next part of the input, returns the number of octets written */
+size_t base64_decode_update(base64_decoder *state, const uint8_t *in, size_t len,
+                            uint8_t *out);
+/* decode all of the input at once */
+size_t base64_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+/* encode len octets, padding the last group. no line breaks are written,
+   returns the number of characters written (BASE64_ENCODED_LEN) */
+size_t base64_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+/* select the implementation used by the encoder and decoder, AUTO picks the best one the
+   processor supports. returns -ENOTSUP if the processor lacks support. */
+int base64_set_impl(enum base64_impl impl);
+enum base64_impl base64_get_impl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_BASE64_H */
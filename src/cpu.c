@@ -0,0 +1,47 @@
+#include "cpu.h"
+
+#ifdef LIBSIGN_X86_SIMD
+#include <cpuid.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static uint64_t xgetbv(void)
+{
+    uint32_t eax, edx;
+
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+    return ((uint64_t)edx << 32) | eax;
+}
+
+unsigned int cpu_features(void)
+{
+    unsigned int eax, ebx, ecx, edx, features = 0;
+
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+
+    if(ecx & bit_SSSE3)
+        features |= CPU_SSSE3;
+    if(ecx & bit_SSE4_1)
+        features |= CPU_SSE41;
+    if(ecx & bit_PCLMUL)
+        features |= CPU_PCLMUL;
+
+    /* AVX2 also needs the OS to save the ymm registers (XCR0 bits 1 and 2) */
+    if((ecx & bit_OSXSAVE) && (xgetbv() & 0x06) == 0x06) {
+        if(__get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if(ebx & bit_AVX2)
+                features |= CPU_AVX2;
+        }
+    }
+
+    return features;
+}
+#else
+unsigned int cpu_features(void)
+{
+    return 0;
+}
+#endif
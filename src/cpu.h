@@ -0,0 +1,28 @@
+#ifndef __LIBSIGN_CPU_H
+#define __LIBSIGN_CPU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the SIMD code paths are compiled with per-function target attributes, so
+   they need GCC or clang on x86 but no special compiler flags. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LIBSIGN_X86_SIMD 1
+#endif
+
+enum cpu_feature {
+    CPU_SSSE3   = 0x01,
+    CPU_SSE41   = 0x02,
+    CPU_PCLMUL  = 0x04,
+    CPU_AVX2    = 0x08
+};
+
+/* features supported by both the processor and the operating system */
+unsigned int cpu_features(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_CPU_H */
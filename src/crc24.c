@@ -0,0 +1,235 @@
+#include "crc24.h"
+#include "cpu.h"
+
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef LIBSIGN_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define CRC24_POLY      0x1864CFBL
+/* The table and carry-less paths keep the CRC in the top 24 bits of a 32 bit
+   register, i.e. they compute a CRC32 with the polynomial multiplied by x^8.
+   That keeps the byte lookups aligned and leaves the remainder unchanged. */
+#define CRC24_POLY32    0x864CFB00UL
+
+typedef uint32_t (*crc24_fn)(uint32_t crc, size_t length, const uint8_t *data);
+
+static uint32_t crc24_table[8][256];
+
+static uint32_t crc24_bitwise(uint32_t crc, size_t length, const uint8_t *data)
+{
+    int i;
+
+    while(length--) {
+        crc ^= (*data++) << 16;
+        for(i = 0; i < 8; i++) {
+            crc <<= 1;
+            if(crc & 0x1000000)
+                crc ^= CRC24_POLY;
+        }
+    }
+
+    return crc & 0xFFFFFFL;
+}
+
+static uint32_t crc32_bytes(uint32_t crc, size_t length, const uint8_t *data)
+{
+    while(length--)
+        crc = (crc << 8) ^ crc24_table[0][(crc >> 24) ^ *data++];
+
+    return crc;
+}
+
+static uint32_t crc24_slice8(uint32_t crc, size_t length, const uint8_t *data)
+{
+    uint32_t crc32 = crc << 8;
+
+    /* eight octets per step, table k holds the remainder of an octet
+       followed by k zero octets */
+    while(length >= 8) {
+        uint32_t high = crc32 ^ (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                                 ((uint32_t)data[2] << 8) | data[3]);
+        uint32_t low = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) |
+                       ((uint32_t)data[6] << 8) | data[7];
+
+        crc32 = crc24_table[7][high >> 24] ^ crc24_table[6][(high >> 16) & 0xff] ^
+                crc24_table[5][(high >> 8) & 0xff] ^ crc24_table[4][high & 0xff] ^
+                crc24_table[3][low >> 24] ^ crc24_table[2][(low >> 16) & 0xff] ^
+                crc24_table[1][(low >> 8) & 0xff] ^ crc24_table[0][low & 0xff];
+
+        data += 8;
+        length -= 8;
+    }
+
+    crc32 = crc32_bytes(crc32, length, data);
+
+    return crc32 >> 8;
+}
+
+#ifdef LIBSIGN_X86_SIMD
+/* folding constants, x^n mod P*x^8 */
+static uint64_t fold_128_hi, fold_128_lo, fold_512_hi, fold_512_lo;
+
+static uint32_t xpow_mod(unsigned int n)
+{
+    uint64_t r = 1;
+
+    while(n--) {
+        r <<= 1;
+        if(r & 0x100000000ULL)
+            r ^= 0x100000000ULL | CRC24_POLY32;
+    }
+
+    return r;
+}
+
+__attribute__((target("pclmul,ssse3")))
+static __m128i fold(__m128i x, __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+                         _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+/* Carry-less multiplication folding (Gopal et al., "Fast CRC computation for
+   generic polynomials using PCLMULQDQ"). The data is byte swapped so each
+   128 bit register holds a polynomial with the first octet in the highest
+   coefficients, four of them are folded forward 512 bits at a time and then
+   into one. The final 128 bits are reduced with the table. */
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc24_pclmul(uint32_t crc, size_t length, const uint8_t *data)
+{
+    const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i k128 = _mm_set_epi64x(fold_128_hi, fold_128_lo);
+    const __m128i k512 = _mm_set_epi64x(fold_512_hi, fold_512_lo);
+    __m128i x0, x1, x2, x3;
+    uint8_t tail[16];
+
+    if(length < 64)
+        return crc24_slice8(crc, length, data);
+
+    x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), bswap);
+    x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+    x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+    x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+    /* the running CRC goes into the first 32 bits of the message */
+    x0 = _mm_xor_si128(x0, _mm_slli_si128(_mm_cvtsi32_si128(crc << 8), 12));
+
+    data += 64;
+    length -= 64;
+
+    while(length >= 64) {
+        x0 = _mm_xor_si128(fold(x0, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), bswap));
+        x1 = _mm_xor_si128(fold(x1, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap));
+        x2 = _mm_xor_si128(fold(x2, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap));
+        x3 = _mm_xor_si128(fold(x3, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap));
+
+        data += 64;
+        length -= 64;
+    }
+
+    x1 = _mm_xor_si128(x1, fold(x0, k128));
+    x2 = _mm_xor_si128(x2, fold(x1, k128));
+    x3 = _mm_xor_si128(x3, fold(x2, k128));
+
+    while(length >= 16) {
+        x3 = _mm_xor_si128(fold(x3, k128), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), bswap));
+
+        data += 16;
+        length -= 16;
+    }
+
+    /* what is left is congruent to the message so far, its CRC from a zero
+       register is the CRC of everything folded into it */
+    _mm_storeu_si128((__m128i*)tail, _mm_shuffle_epi8(x3, bswap));
+
+    return crc32_bytes(crc32_bytes(0, 16, tail), length, data) >> 8;
+}
+#endif
+
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+static crc24_fn crc24_impl_fn = crc24_bitwise;
+static enum crc24_impl current_impl = CRC24_IMPL_BITWISE;
+
+static int select_impl(enum crc24_impl impl)
+{
+    unsigned int features = cpu_features();
+
+    if(impl == CRC24_IMPL_AUTO) {
+        if((features & (CPU_PCLMUL | CPU_SSSE3)) == (CPU_PCLMUL | CPU_SSSE3))
+            impl = CRC24_IMPL_PCLMUL;
+        else
+            impl = CRC24_IMPL_SLICE8;
+    }
+
+    switch(impl) {
+    case CRC24_IMPL_BITWISE:
+        crc24_impl_fn = crc24_bitwise;
+        break;
+    case CRC24_IMPL_SLICE8:
+        crc24_impl_fn = crc24_slice8;
+        break;
+#ifdef LIBSIGN_X86_SIMD
+    case CRC24_IMPL_PCLMUL:
+        if((features & (CPU_PCLMUL | CPU_SSSE3)) != (CPU_PCLMUL | CPU_SSSE3))
+            return -ENOTSUP;
+        crc24_impl_fn = crc24_pclmul;
+        break;
+#endif
+    default:
+        return -ENOTSUP;
+    }
+
+    current_impl = impl;
+
+    return 0;
+}
+
+static void crc24_setup(void)
+{
+    int i, j;
+
+    for(i = 0; i < 256; i++) {
+        uint32_t crc = (uint32_t)i << 24;
+        for(j = 0; j < 8; j++)
+            crc = (crc & 0x80000000UL) ? (crc << 1) ^ CRC24_POLY32 : crc << 1;
+        crc24_table[0][i] = crc;
+    }
+
+    for(i = 0; i < 256; i++)
+        for(j = 1; j < 8; j++)
+            crc24_table[j][i] = (crc24_table[j-1][i] << 8) ^
+                                crc24_table[0][crc24_table[j-1][i] >> 24];
+
+#ifdef LIBSIGN_X86_SIMD
+    fold_128_hi = xpow_mod(128 + 64);
+    fold_128_lo = xpow_mod(128);
+    fold_512_hi = xpow_mod(512 + 64);
+    fold_512_lo = xpow_mod(512);
+#endif
+
+    select_impl(CRC24_IMPL_AUTO);
+}
+
+int crc24_set_impl(enum crc24_impl impl)
+{
+    pthread_once(&dispatch_once, crc24_setup);
+
+    return select_impl(impl);
+}
+
+enum crc24_impl crc24_get_impl(void)
+{
+    pthread_once(&dispatch_once, crc24_setup);
+
+    return current_impl;
+}
+
+uint32_t crc24_update(uint32_t crc, size_t length, const uint8_t *data)
+{
+    pthread_once(&dispatch_once, crc24_setup);
+
+    return crc24_impl_fn(crc, length, data);
+}
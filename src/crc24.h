@@ -0,0 +1,35 @@
+#ifndef __LIBSIGN_CRC24_H
+#define __LIBSIGN_CRC24_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 6.1 */
+#define CRC24_INIT  0xB704CEL
+
+enum crc24_impl {
+    CRC24_IMPL_AUTO     = 0,
+    /* one bit at a time, as in the RFC */
+    CRC24_IMPL_BITWISE  = 1,
+    CRC24_IMPL_SLICE8   = 2,
+    CRC24_IMPL_PCLMUL   = 3
+};
+
+/* continue a CRC24 over more data, start with CRC24_INIT. the result is the
+   checksum of everything so far. */
+uint32_t crc24_update(uint32_t crc, size_t length, const uint8_t *data);
+
+/* select the implementation, AUTO picks the fastest one the processor
+   supports. returns -ENOTSUP if the processor lacks support. */
+int crc24_set_impl(enum crc24_impl impl);
+enum crc24_impl crc24_get_impl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_CRC24_H */
@@ -0,0 +1,249 @@
+#include "hash.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+typedef struct fanout_slot {
+    size_t len;
+    /* number of engines that still have to consume this block */
+    unsigned int pending;
+    uint8_t data[LIBSIGN_FANOUT_BLOCK_SIZE];
+} fanout_slot;
+
+typedef struct fanout_ring {
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t drained;
+
+    /* number of blocks published by the reader so far */
+    uint64_t published;
+    int eof;
+
+    fanout_slot slots[LIBSIGN_FANOUT_RING_SIZE];
+} fanout_ring;
+
+typedef struct fanout_worker {
+    pthread_t thread;
+    fanout_ring *ring;
+    libsign_hash_engine *engine;
+} fanout_worker;
+
+static void sha1_engine_update(void *ctx, size_t len, const uint8_t *data)
+{
+    sha1_update((sha1_ctx*)ctx, len, data);
+}
+
+void hash_fanout_init(libsign_hash_fanout *fan, unsigned int flags)
+{
+    memset(fan, 0, sizeof(libsign_hash_fanout));
+    fan->flags = flags;
+}
+
+int hash_fanout_add(libsign_hash_fanout *fan, libsign_hash_update_fn update, void *ctx)
+{
+    if(fan->num_engines == LIBSIGN_FANOUT_MAX_ENGINES)
+        return -ENOSPC;
+
+    fan->engines[fan->num_engines].update = update;
+    fan->engines[fan->num_engines].ctx = ctx;
+    fan->num_engines++;
+
+    return 0;
+}
+
+int hash_fanout_add_sha1(libsign_hash_fanout *fan, sha1_ctx *ctx)
+{
+    return hash_fanout_add(fan, sha1_engine_update, ctx);
+}
+
+int hash_fanout_data(libsign_hash_fanout *fan, const uint8_t *data, size_t datalen)
+{
+    unsigned int i;
+
+    /* walk the buffer block by block so every engine sees a block while it
+       is still cached, rather than streaming the whole buffer once per engine. */
+    while(datalen) {
+        size_t len = datalen < LIBSIGN_FANOUT_BLOCK_SIZE ? datalen : LIBSIGN_FANOUT_BLOCK_SIZE;
+
+        for(i = 0; i < fan->num_engines; i++)
+            fan->engines[i].update(fan->engines[i].ctx, len, data);
+
+        data += len;
+        datalen -= len;
+    }
+
+    return 0;
+}
+
+/* read until the block is full or we hit end of file, read() may return
+   short counts for pipes and large files. */
+static ssize_t read_block(int fd, uint8_t *buffer, size_t len)
+{
+    size_t done = 0;
+
+    while(done < len) {
+        ssize_t num;
+        LIBSIGN_STAT_BEGIN(start);
+
+        num = read(fd, buffer + done, len - done);
+        LIBSIGN_STAT_END(LIBSIGN_STAT_READ, start, num > 0 ? num : 0);
+        if(num < 0) {
+            if(errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if(num == 0)
+            break;
+        done += num;
+    }
+
+    return done;
+}
+
+static int hash_fanout_fd_serial(libsign_hash_fanout *fan, int fd)
+{
+    uint8_t buffer[LIBSIGN_FANOUT_BLOCK_SIZE];
+    ssize_t num;
+    unsigned int i;
+
+    while((num = read_block(fd, buffer, sizeof(buffer))) > 0) {
+        for(i = 0; i < fan->num_engines; i++)
+            fan->engines[i].update(fan->engines[i].ctx, num, buffer);
+    }
+
+    return num < 0 ? (int)num : 0;
+}
+
+static void *fanout_worker_main(void *arg)
+{
+    fanout_worker *worker = arg;
+    fanout_ring *ring = worker->ring;
+    uint64_t seq = 0;
+
+    for(;;) {
+        fanout_slot *slot;
+
+        pthread_mutex_lock(&ring->lock);
+        while(ring->published == seq && !ring->eof)
+            pthread_cond_wait(&ring->filled, &ring->lock);
+        if(ring->published == seq) {
+            /* end of data and nothing left for us */
+            pthread_mutex_unlock(&ring->lock);
+            break;
+        }
+        pthread_mutex_unlock(&ring->lock);
+
+        slot = &ring->slots[seq % LIBSIGN_FANOUT_RING_SIZE];
+        worker->engine->update(worker->engine->ctx, slot->len, slot->data);
+        seq++;
+
+        pthread_mutex_lock(&ring->lock);
+        if(--slot->pending == 0)
+            pthread_cond_signal(&ring->drained);
+        pthread_mutex_unlock(&ring->lock);
+    }
+
+    return NULL;
+}
+
+static int hash_fanout_fd_threaded(libsign_hash_fanout *fan, int fd)
+{
+    int ret = 0;
+    unsigned int i, started = 0;
+    fanout_ring *ring;
+    fanout_worker workers[LIBSIGN_FANOUT_MAX_ENGINES];
+
+    ring = malloc(sizeof(fanout_ring));
+    if(!ring)
+        return -ENOMEM;
+
+    ring->published = 0;
+    ring->eof = 0;
+    for(i = 0; i < LIBSIGN_FANOUT_RING_SIZE; i++)
+        ring->slots[i].pending = 0;
+
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->filled, NULL);
+    pthread_cond_init(&ring->drained, NULL);
+
+    for(i = 0; i < fan->num_engines; i++) {
+        workers[i].ring = ring;
+        workers[i].engine = &fan->engines[i];
+        if(pthread_create(&workers[i].thread, NULL, fanout_worker_main, &workers[i]) != 0) {
+            ret = -EAGAIN;
+            break;
+        }
+        started++;
+    }
+
+    /* the calling thread is the reader */
+    while(ret == 0) {
+        fanout_slot *slot = &ring->slots[ring->published % LIBSIGN_FANOUT_RING_SIZE];
+        ssize_t num;
+
+        /* wait for every engine to be done with the block we are about to reuse */
+        pthread_mutex_lock(&ring->lock);
+        while(slot->pending)
+            pthread_cond_wait(&ring->drained, &ring->lock);
+        pthread_mutex_unlock(&ring->lock);
+
+        num = read_block(fd, slot->data, LIBSIGN_FANOUT_BLOCK_SIZE);
+        if(num <= 0) {
+            ret = (int)num;
+            break;
+        }
+
+        pthread_mutex_lock(&ring->lock);
+        slot->len = num;
+        slot->pending = started;
+        ring->published++;
+        pthread_cond_broadcast(&ring->filled);
+        pthread_mutex_unlock(&ring->lock);
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    ring->eof = 1;
+    pthread_cond_broadcast(&ring->filled);
+    pthread_mutex_unlock(&ring->lock);
+
+    for(i = 0; i < started; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    pthread_cond_destroy(&ring->drained);
+    pthread_cond_destroy(&ring->filled);
+    pthread_mutex_destroy(&ring->lock);
+    free(ring);
+
+    return ret;
+}
+
+int hash_fanout_fd(libsign_hash_fanout *fan, int fd)
+{
+    /* one engine gains nothing from a separate thread */
+    if((fan->flags & LIBSIGN_FANOUT_THREADED) && fan->num_engines > 1)
+        return hash_fanout_fd_threaded(fan, fd);
+
+    return hash_fanout_fd_serial(fan, fd);
+}
+
+int hash_sha1_import(sha1_ctx *ctx, const uint32_t state[5], uint64_t length)
+{
+    if(length % SHA1_BLOCK_LENGTH || length >> 61)
+        return -EINVAL;
+
+    memset(ctx, 0, sizeof(sha1_ctx));
+    memcpy(ctx->state, state, sizeof(ctx->state));
+
+    /* the count is in bits */
+    ctx->count[0] = (uint32_t)(length << 3);
+    ctx->count[1] = (uint32_t)(length >> 29);
+
+    return 0;
+}
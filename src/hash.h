@@ -0,0 +1,57 @@
+#ifndef __LIBSIGN_HASH_H
+#define __LIBSIGN_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha1.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* size of the blocks read from the source. small enough that a block stays
+   in L1/L2 while every engine runs over it. */
+#define LIBSIGN_FANOUT_BLOCK_SIZE   (16 * 1024)
+/* number of blocks in the ring shared by the engine threads */
+#define LIBSIGN_FANOUT_RING_SIZE    8
+#define LIBSIGN_FANOUT_MAX_ENGINES  8
+
+enum libsign_fanout_flags {
+    /* run each engine in its own thread, fed from a shared ring of blocks */
+    LIBSIGN_FANOUT_THREADED = 0x01
+};
+
+typedef void (*libsign_hash_update_fn)(void *ctx, size_t len, const uint8_t *data);
+
+typedef struct libsign_hash_engine {
+    libsign_hash_update_fn update;
+    void *ctx;
+} libsign_hash_engine;
+
+/* feeds every block read from a source to several hash engines, so the data
+   only has to be read (and brought into cache) once. */
+typedef struct libsign_hash_fanout {
+    unsigned int flags;
+    unsigned int num_engines;
+    libsign_hash_engine engines[LIBSIGN_FANOUT_MAX_ENGINES];
+} libsign_hash_fanout;
+
+void hash_fanout_init(libsign_hash_fanout *fan, unsigned int flags);
+int hash_fanout_add(libsign_hash_fanout *fan, libsign_hash_update_fn update, void *ctx);
+int hash_fanout_add_sha1(libsign_hash_fanout *fan, sha1_ctx *ctx);
+
+int hash_fanout_fd(libsign_hash_fanout *fan, int fd);
+int hash_fanout_data(libsign_hash_fanout *fan, const uint8_t *data, size_t datalen);
+
+/* continue the hash of another SHA-1 implementation, from its chaining
+   value (H0 to H4) after length octets. length must be a multiple of the
+   block size, the rest of the data is then added with sha1_update().
+   -EINVAL otherwise. */
+int hash_sha1_import(sha1_ctx *ctx, const uint32_t state[5], uint64_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_HASH_H */
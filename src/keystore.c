@@ -0,0 +1,490 @@
+#include "keystore.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+void keystore_init(libsign_keystore *ks)
+{
+    memset(ks, 0, sizeof(libsign_keystore));
+}
+
+void keystore_destroy(libsign_keystore *ks)
+{
+    free(ks->slots);
+    keystore_init(ks);
+}
+
+/* key IDs are the low bits of a hash already, so they make their own */
+static libsign_keystore_entry *find_slot(libsign_keystore_entry *slots, uint32_t num_slots,
+                                         libsign_key_id key_id)
+{
+    uint32_t i = key_id & (num_slots - 1);
+
+    while(slots[i].key_id && slots[i].key_id != key_id)
+        i = (i + 1) & (num_slots - 1);
+
+    return &slots[i];
+}
+
+static int resize(libsign_keystore *ks, uint32_t num_slots)
+{
+    uint32_t i;
+    libsign_keystore_entry *slots;
+
+    slots = calloc(num_slots, sizeof(libsign_keystore_entry));
+    if(!slots)
+        return -ENOMEM;
+
+    for(i = 0; i < ks->num_slots; i++) {
+        if(ks->slots[i].key_id)
+            *find_slot(slots, num_slots, ks->slots[i].key_id) = ks->slots[i];
+    }
+
+    free(ks->slots);
+    ks->slots = slots;
+    ks->num_slots = num_slots;
+
+    return 0;
+}
+
+int keystore_add(libsign_keystore *ks, libsign_public_key *pub)
+{
+    int ret, i;
+    uint32_t needed = ks->count + 1 + pub->num_subkeys;
+    uint32_t num_slots = ks->num_slots ? ks->num_slots : LIBSIGN_KEYSTORE_MIN_SLOTS;
+    libsign_keystore_entry *slot;
+
+    if(!pub->key_id)
+        return -EINVAL;
+
+    /* check every key ID first, so a duplicate leaves the keystore as it was */
+    if(ks->num_slots) {
+        if(find_slot(ks->slots, ks->num_slots, pub->key_id)->key_id)
+            return -EEXIST;
+        for(i = 0; i < pub->num_subkeys; i++) {
+            if(find_slot(ks->slots, ks->num_slots, pub->subkeys[i].key_id)->key_id)
+                return -EEXIST;
+        }
+    }
+
+    while(needed > num_slots / 2)
+        num_slots *= 2;
+    if(num_slots != ks->num_slots && (ret = resize(ks, num_slots)) < 0)
+        return ret;
+
+    slot = find_slot(ks->slots, ks->num_slots, pub->key_id);
+    slot->key_id = pub->key_id;
+    slot->pub = pub;
+    slot->subkey = NULL;
+    ks->count++;
+
+    for(i = 0; i < pub->num_subkeys; i++) {
+        /* a subkey sharing an ID with another of the same key */
+        slot = find_slot(ks->slots, ks->num_slots, pub->subkeys[i].key_id);
+        if(slot->key_id || !pub->subkeys[i].key_id)
+            continue;
+
+        slot->key_id = pub->subkeys[i].key_id;
+        slot->pub = pub;
+        slot->subkey = &pub->subkeys[i];
+        ks->count++;
+    }
+
+    return 0;
+}
+
+/* remove the entry in slot i, moving up the ones after it that probed past
+   it so no lookup stops short */
+static void remove_slot(libsign_keystore *ks, uint32_t i)
+{
+    uint32_t j = i, home;
+
+    for(;;) {
+        ks->slots[i].key_id = 0;
+
+        for(;;) {
+            j = (j + 1) & (ks->num_slots - 1);
+            if(!ks->slots[j].key_id)
+                return;
+
+            /* an entry between its home slot and j stays where it is */
+            home = ks->slots[j].key_id & (ks->num_slots - 1);
+            if(i <= j ? (i < home && home <= j) : (i < home || home <= j))
+                continue;
+            break;
+        }
+
+        ks->slots[i] = ks->slots[j];
+        i = j;
+    }
+}
+
+int keystore_remove(libsign_keystore *ks, const libsign_public_key *pub)
+{
+    int i;
+    libsign_keystore_entry *slot;
+
+    if(!ks->num_slots)
+        return -ENOENT;
+
+    slot = find_slot(ks->slots, ks->num_slots, pub->key_id);
+    if(!slot->key_id || slot->pub != pub)
+        return -ENOENT;
+
+    remove_slot(ks, slot - ks->slots);
+    ks->count--;
+
+    for(i = 0; i < pub->num_subkeys; i++) {
+        slot = find_slot(ks->slots, ks->num_slots, pub->subkeys[i].key_id);
+        if(!slot->key_id || slot->pub != pub)
+            continue;
+
+        remove_slot(ks, slot - ks->slots);
+        ks->count--;
+    }
+
+    return 0;
+}
+
+int keystore_copy(libsign_keystore *dst, const libsign_keystore *src)
+{
+    keystore_init(dst);
+    if(!src->num_slots)
+        return 0;
+
+    dst->slots = malloc(src->num_slots * sizeof(libsign_keystore_entry));
+    if(!dst->slots)
+        return -ENOMEM;
+
+    memcpy(dst->slots, src->slots, src->num_slots * sizeof(libsign_keystore_entry));
+    dst->num_slots = src->num_slots;
+    dst->count = src->count;
+
+    return 0;
+}
+
+libsign_public_key *keystore_find(const libsign_keystore *ks, libsign_key_id key_id,
+                                  libsign_subkey **subkey)
+{
+    libsign_keystore_entry *slot;
+
+    if(!ks->num_slots || !key_id)
+        return NULL;
+
+    slot = find_slot(ks->slots, ks->num_slots, key_id);
+    if(!slot->key_id)
+        return NULL;
+
+    if(subkey)
+        *subkey = slot->subkey;
+
+    return slot->pub;
+}
+
+libsign_public_key *keystore_find_fingerprint(const libsign_keystore *ks,
+                                              const uint8_t fingerprint[PGP_FINGERPRINT_LEN],
+                                              libsign_subkey **subkey)
+{
+    int i;
+    libsign_key_id key_id = 0;
+    libsign_public_key *pub;
+    libsign_subkey *found;
+
+    /* 12.2, the key ID of a v4 key is the low 64 bits of its fingerprint */
+    for(i = PGP_FINGERPRINT_LEN - 8; i < PGP_FINGERPRINT_LEN; i++)
+        key_id = (key_id << 8) | fingerprint[i];
+
+    pub = keystore_find(ks, key_id, &found);
+    if(!pub)
+        return NULL;
+
+    if(memcmp(found ? found->fingerprint : pub->fingerprint, fingerprint,
+              PGP_FINGERPRINT_LEN) != 0)
+        return NULL;
+
+    if(subkey)
+        *subkey = found;
+
+    return pub;
+}
+
+libsign_keystore_key *keystore_key_new(void)
+{
+    libsign_keystore_key *key = malloc(sizeof(libsign_keystore_key));
+    if(!key)
+        return NULL;
+
+    public_key_init(&key->pub);
+    key->refs = 1;
+
+    return key;
+}
+
+void keystore_key_get(libsign_keystore_key *key)
+{
+    __atomic_add_fetch(&key->refs, 1, __ATOMIC_RELAXED);
+}
+
+void keystore_key_put(libsign_keystore_key *key)
+{
+    /* the last one to let go sees what every other holder did with it */
+    if(__atomic_sub_fetch(&key->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        public_key_destroy(&key->pub);
+        free(key);
+    }
+}
+
+libsign_keystore_generation *keystore_generation_new(void)
+{
+    libsign_keystore_generation *gen = calloc(1, sizeof(libsign_keystore_generation));
+    if(!gen)
+        return NULL;
+
+    keystore_init(&gen->index);
+
+    return gen;
+}
+
+int keystore_generation_add(libsign_keystore_generation *gen, libsign_keystore_key *key)
+{
+    int ret;
+    libsign_keystore_key **keys;
+
+    if(gen->num_keys == gen->keys_size) {
+        uint32_t size = gen->keys_size ? gen->keys_size * 2 : 16;
+
+        keys = realloc(gen->keys, size * sizeof(libsign_keystore_key*));
+        if(!keys)
+            return -ENOMEM;
+        gen->keys = keys;
+        gen->keys_size = size;
+    }
+
+    ret = keystore_add(&gen->index, &key->pub);
+    if(ret < 0)
+        return ret;
+
+    keystore_key_get(key);
+    gen->keys[gen->num_keys++] = key;
+
+    return 0;
+}
+
+int keystore_generation_remove(libsign_keystore_generation *gen, libsign_keystore_key *key)
+{
+    uint32_t i;
+    int ret;
+
+    for(i = 0; i < gen->num_keys && gen->keys[i] != key; i++)
+        ;
+    if(i == gen->num_keys)
+        return -ENOENT;
+
+    ret = keystore_remove(&gen->index, &key->pub);
+    if(ret < 0)
+        return ret;
+
+    gen->keys[i] = gen->keys[--gen->num_keys];
+    keystore_key_put(key);
+
+    return 0;
+}
+
+libsign_keystore_generation *keystore_generation_copy(const libsign_keystore_generation *gen)
+{
+    uint32_t i;
+    libsign_keystore_generation *copy = keystore_generation_new();
+
+    if(!copy)
+        return NULL;
+    if(!gen)
+        return copy;
+
+    /* the index is copied as it is, not rebuilt key by key */
+    copy->keys = malloc((gen->keys_size ? gen->keys_size : 1) * sizeof(libsign_keystore_key*));
+    if(!copy->keys || keystore_copy(&copy->index, &gen->index) < 0) {
+        keystore_generation_free(copy);
+        return NULL;
+    }
+    copy->keys_size = gen->keys_size;
+
+    for(i = 0; i < gen->num_keys; i++) {
+        keystore_key_get(gen->keys[i]);
+        copy->keys[copy->num_keys++] = gen->keys[i];
+    }
+
+    return copy;
+}
+
+int keystore_generation_load(libsign_keystore_generation *gen, const char *filename,
+                             unsigned int profile)
+{
+    int ret;
+    libsign_keystore_key *key;
+
+    key = keystore_key_new();
+    if(!key)
+        return -ENOMEM;
+
+    ret = parse_public_key_profile(&key->pub, filename, profile);
+    if(ret == 0)
+        ret = verify_certifications(&key->pub, NULL);
+    if(ret >= 0)
+        ret = keystore_generation_add(gen, key);
+
+    keystore_key_put(key);
+
+    return ret;
+}
+
+void keystore_generation_free(libsign_keystore_generation *gen)
+{
+    uint32_t i;
+
+    if(!gen)
+        return;
+
+    for(i = 0; i < gen->num_keys; i++)
+        keystore_key_put(gen->keys[i]);
+
+    free(gen->keys);
+    keystore_destroy(&gen->index);
+    free(gen);
+}
+
+void keystore_generation_get(libsign_keystore_generation *gen)
+{
+    __atomic_add_fetch(&gen->refs, 1, __ATOMIC_RELAXED);
+}
+
+/* the generation is only freed by the writer, in shared_keystore_reclaim() */
+void keystore_generation_put(libsign_keystore_generation *gen)
+{
+    __atomic_sub_fetch(&gen->refs, 1, __ATOMIC_RELEASE);
+}
+
+int shared_keystore_init(libsign_shared_keystore *sks, libsign_keystore_generation *gen)
+{
+    memset(sks, 0, sizeof(libsign_shared_keystore));
+
+    if(pthread_mutex_init(&sks->writer, NULL) != 0)
+        return -ENOMEM;
+
+    sks->current = gen;
+    /* 0 marks a reader that is not reading */
+    sks->epoch = 1;
+
+    return 0;
+}
+
+void shared_keystore_destroy(libsign_shared_keystore *sks)
+{
+    libsign_keystore_generation *gen, *next;
+
+    for(gen = sks->retired; gen; gen = next) {
+        next = gen->next_retired;
+        keystore_generation_free(gen);
+    }
+    keystore_generation_free(sks->current);
+
+    pthread_mutex_destroy(&sks->writer);
+}
+
+libsign_keystore_reader *shared_keystore_reader(libsign_shared_keystore *sks)
+{
+    int i;
+
+    for(i = 0; i < LIBSIGN_KEYSTORE_MAX_READERS; i++) {
+        int unused = 0;
+
+        if(__atomic_compare_exchange_n(&sks->readers[i].used, &unused, 1, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return &sks->readers[i];
+    }
+
+    return NULL;
+}
+
+void shared_keystore_reader_release(libsign_keystore_reader *reader)
+{
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&reader->used, 0, __ATOMIC_RELEASE);
+}
+
+libsign_keystore_generation *shared_keystore_enter(libsign_shared_keystore *sks,
+                                                   libsign_keystore_reader *reader)
+{
+    /* the store of the epoch and the load of the generation are sequentially
+       consistent with the writer's swap and its look at the readers: either
+       the writer sees this reader, or this reader sees the generation the
+       writer swapped in before looking */
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&sks->epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&sks->current, __ATOMIC_SEQ_CST);
+}
+
+void shared_keystore_leave(libsign_keystore_reader *reader)
+{
+    /* everything read from the generation is done with first */
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+int shared_keystore_publish(libsign_shared_keystore *sks, libsign_keystore_generation *gen)
+{
+    libsign_keystore_generation *old;
+
+    pthread_mutex_lock(&sks->writer);
+
+    /* the generation is complete before anyone can find it. only writers
+       store the pointer, and they hold the lock. */
+    old = sks->current;
+    __atomic_store_n(&sks->current, gen, __ATOMIC_SEQ_CST);
+
+    if(old) {
+        /* readers entering from the new epoch on can only see gen */
+        old->retired = __atomic_add_fetch(&sks->epoch, 1, __ATOMIC_SEQ_CST);
+        old->next_retired = sks->retired;
+        sks->retired = old;
+    }
+
+    pthread_mutex_unlock(&sks->writer);
+
+    shared_keystore_reclaim(sks);
+
+    return 0;
+}
+
+int shared_keystore_reclaim(libsign_shared_keystore *sks)
+{
+    int i, waiting = 0;
+    uint64_t oldest = UINT64_MAX, epoch;
+    libsign_keystore_generation **link, *gen;
+
+    pthread_mutex_lock(&sks->writer);
+
+    for(i = 0; i < LIBSIGN_KEYSTORE_MAX_READERS; i++) {
+        epoch = __atomic_load_n(&sks->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if(epoch && epoch < oldest)
+            oldest = epoch;
+    }
+
+    link = &sks->retired;
+    while((gen = *link)) {
+        /* references taken before leaving are seen, as the leave was */
+        if(gen->retired <= oldest && __atomic_load_n(&gen->refs, __ATOMIC_ACQUIRE) == 0) {
+            *link = gen->next_retired;
+            keystore_generation_free(gen);
+        }
+        else {
+            link = &gen->next_retired;
+            waiting++;
+        }
+    }
+
+    pthread_mutex_unlock(&sks->writer);
+
+    return waiting;
+}
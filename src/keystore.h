@@ -0,0 +1,157 @@
+#ifndef __LIBSIGN_KEYSTORE_H
+#define __LIBSIGN_KEYSTORE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pgp.h"
+#include "public_key.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the index starts with this many slots, and doubles when half full */
+#define LIBSIGN_KEYSTORE_MIN_SLOTS 64
+
+typedef struct libsign_keystore_entry {
+    libsign_key_id key_id;
+    libsign_public_key *pub;
+    /* NULL for the primary key */
+    libsign_subkey *subkey;
+} libsign_keystore_entry;
+
+/* An index from key IDs, of primary keys and subkeys alike, to the key they
+   belong to. The keys are not owned by the keystore and must outlive it. */
+typedef struct libsign_keystore {
+    /* open addressing with linear probing, key ID 0 marks a free slot */
+    libsign_keystore_entry *slots;
+    uint32_t num_slots;
+    uint32_t count;
+} libsign_keystore;
+
+void keystore_init(libsign_keystore *ks);
+void keystore_destroy(libsign_keystore *ks);
+
+/* index the key and its subkeys. a key ID that is already in the keystore
+   is -EEXIST, and nothing is added. */
+int keystore_add(libsign_keystore *ks, libsign_public_key *pub);
+
+/* remove the key and its subkeys, -ENOENT if it was not added */
+int keystore_remove(libsign_keystore *ks, const libsign_public_key *pub);
+/* a copy of the index, referring to the same keys */
+int keystore_copy(libsign_keystore *dst, const libsign_keystore *src);
+
+/* the key with a primary key or subkey of the given ID, or NULL. subkey, if
+   given, is set to the subkey it names or NULL for the primary key. */
+libsign_public_key *keystore_find(const libsign_keystore *ks, libsign_key_id key_id,
+                                  libsign_subkey **subkey);
+/* as above, by v4 fingerprint */
+libsign_public_key *keystore_find_fingerprint(const libsign_keystore *ks,
+                                              const uint8_t fingerprint[PGP_FINGERPRINT_LEN],
+                                              libsign_subkey **subkey);
+
+/* readers of a shared keystore at the same time, 64 workers and then some */
+#define LIBSIGN_KEYSTORE_MAX_READERS    128
+#define LIBSIGN_KEYSTORE_CACHE_LINE     64
+
+/* A key that may be in several generations of a shared keystore at once,
+   it is destroyed when the last of them lets go of it. */
+typedef struct libsign_keystore_key {
+    libsign_public_key pub;
+    int refs;
+} libsign_keystore_key;
+
+/* An immutable set of keys and the index over them. Once published it is
+   only read, a reload builds a new generation. */
+typedef struct libsign_keystore_generation {
+    libsign_keystore index;
+    libsign_keystore_key **keys;
+    uint32_t num_keys;
+    uint32_t keys_size;
+
+    /* references taken with keystore_generation_get() */
+    int refs;
+    /* the epoch it was replaced in, and the list of those waiting to be
+       freed */
+    uint64_t retired;
+    struct libsign_keystore_generation *next_retired;
+} libsign_keystore_generation;
+
+/* one per reader thread, each on a cache line of its own as it is written
+   on every lookup. the alignment pads it to a full line as well. */
+typedef struct libsign_keystore_reader {
+    /* the epoch the reader entered in, 0 when it is not reading. both are
+       only accessed atomically. */
+    uint64_t epoch;
+    int used;
+} __attribute__((aligned(LIBSIGN_KEYSTORE_CACHE_LINE))) libsign_keystore_reader;
+
+/* A keystore read by many threads while another swaps in new generations.
+   Readers never block or retry: entering announces the current epoch and
+   loads the current generation, which stays valid until they leave. A new
+   generation is published with a single pointer swap, and the one it
+   replaces is freed once every reader that could have seen it has left and
+   its references have been put back. Writers are serialized among
+   themselves only. The readers are aligned to cache lines, a keystore that
+   is not on the stack or static must come from aligned_alloc(). */
+typedef struct libsign_shared_keystore {
+    /* loaded atomically by the readers, stored by the writers */
+    libsign_keystore_generation *current;
+    uint64_t epoch;
+
+    libsign_keystore_reader readers[LIBSIGN_KEYSTORE_MAX_READERS];
+
+    pthread_mutex_t writer;
+    libsign_keystore_generation *retired;
+} libsign_shared_keystore;
+
+/* a key with no generation yet, to be parsed into */
+libsign_keystore_key *keystore_key_new(void);
+void keystore_key_get(libsign_keystore_key *key);
+void keystore_key_put(libsign_keystore_key *key);
+
+libsign_keystore_generation *keystore_generation_new(void);
+/* index the key in a generation that has not been published yet, the
+   generation takes a reference to it */
+int keystore_generation_add(libsign_keystore_generation *gen, libsign_keystore_key *key);
+/* drop the key from a generation that has not been published yet */
+int keystore_generation_remove(libsign_keystore_generation *gen, libsign_keystore_key *key);
+/* a new, unpublished generation with the keys of gen, which may be NULL. the
+   keys are shared, only the index is copied. */
+libsign_keystore_generation *keystore_generation_copy(const libsign_keystore_generation *gen);
+/* parse a key file into a new key, check the certifications the profile
+   kept and add it */
+int keystore_generation_load(libsign_keystore_generation *gen, const char *filename,
+                             unsigned int profile);
+/* free a generation that was never published */
+void keystore_generation_free(libsign_keystore_generation *gen);
+/* keep a generation, and the keys found in it, after leaving the keystore */
+void keystore_generation_get(libsign_keystore_generation *gen);
+void keystore_generation_put(libsign_keystore_generation *gen);
+
+/* gen may be NULL for an empty keystore. no readers may be left when it is
+   destroyed. */
+int shared_keystore_init(libsign_shared_keystore *sks, libsign_keystore_generation *gen);
+void shared_keystore_destroy(libsign_shared_keystore *sks);
+
+/* claim a reader slot for the calling thread, NULL when all are taken */
+libsign_keystore_reader *shared_keystore_reader(libsign_shared_keystore *sks);
+void shared_keystore_reader_release(libsign_keystore_reader *reader);
+
+/* the current generation, valid until shared_keystore_leave() */
+libsign_keystore_generation *shared_keystore_enter(libsign_shared_keystore *sks,
+                                                   libsign_keystore_reader *reader);
+void shared_keystore_leave(libsign_keystore_reader *reader);
+
+/* replace the current generation, the keystore owns gen from then on */
+int shared_keystore_publish(libsign_shared_keystore *sks, libsign_keystore_generation *gen);
+/* free the replaced generations no reader can still see, returns the number
+   left waiting */
+int shared_keystore_reclaim(libsign_shared_keystore *sks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_KEYSTORE_H */
@@ -0,0 +1,477 @@
+#include "manifest.h"
+#include "sha1.h"
+#include "stats.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+typedef struct chunk_job {
+    libsign_verified_reader *reader;
+    uint8_t *buffer;
+    size_t len;
+    uint64_t offset;
+
+    /* next chunk to be claimed by a worker, and the last chunk of the read */
+    uint32_t next;
+    uint32_t last;
+
+    int ret;
+} chunk_job;
+
+void chunk_manifest_init(libsign_chunk_manifest *manifest)
+{
+    memset(manifest, 0, sizeof(libsign_chunk_manifest));
+}
+
+void chunk_manifest_destroy(libsign_chunk_manifest *manifest)
+{
+    free(manifest->digests);
+    manifest->digests = NULL;
+}
+
+static uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void write_be32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+int chunk_manifest_parse(libsign_chunk_manifest *manifest, const uint8_t *data,
+                         uint32_t datalen)
+{
+    uint64_t num_chunks;
+
+    if(datalen < LIBSIGN_MANIFEST_HEADER_SIZE)
+        return -EINVAL;
+
+    if(memcmp(data, LIBSIGN_MANIFEST_MAGIC, 4) != 0)
+        return -EINVAL;
+
+    if(data[4] != LIBSIGN_MANIFEST_VERSION)
+        return -ENOTSUP;
+
+    manifest->hash_algo = data[5];
+    switch(manifest->hash_algo) {
+    case PGP_SHA1:
+        manifest->digest_len = SHA1_DIGEST_LENGTH;
+        break;
+    default:
+        return -ENOTSUP;
+    }
+
+    manifest->chunk_size = read_be32(data + 8);
+    manifest->image_size = ((uint64_t)read_be32(data + 12) << 32) | read_be32(data + 16);
+    if(!manifest->chunk_size)
+        return -EINVAL;
+
+    /* rounded up without adding to image_size, which may be close to 2^64 */
+    num_chunks = manifest->image_size / manifest->chunk_size +
+                 (manifest->image_size % manifest->chunk_size != 0);
+    if(num_chunks > (UINT32_MAX - LIBSIGN_MANIFEST_HEADER_SIZE) / manifest->digest_len)
+        return -EINVAL;
+
+    manifest->num_chunks = num_chunks;
+    if(datalen != LIBSIGN_MANIFEST_HEADER_SIZE + manifest->num_chunks * manifest->digest_len)
+        return -EINVAL;
+
+    manifest->digests = malloc(datalen - LIBSIGN_MANIFEST_HEADER_SIZE + 1);
+    if(!manifest->digests)
+        return -ENOMEM;
+
+    memcpy(manifest->digests, data + LIBSIGN_MANIFEST_HEADER_SIZE,
+           datalen - LIBSIGN_MANIFEST_HEADER_SIZE);
+
+    return 0;
+}
+
+static ssize_t read_full(int fd, uint8_t *buffer, size_t len)
+{
+    size_t done = 0;
+
+    while(done < len) {
+        ssize_t num;
+        LIBSIGN_STAT_BEGIN(start);
+
+        num = read(fd, buffer + done, len - done);
+        LIBSIGN_STAT_END(LIBSIGN_STAT_READ, start, num > 0 ? num : 0);
+        if(num < 0) {
+            if(errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if(num == 0)
+            break;
+        done += num;
+    }
+
+    return done;
+}
+
+static ssize_t pread_full(int fd, uint8_t *buffer, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+
+    while(done < len) {
+        ssize_t num;
+        LIBSIGN_STAT_BEGIN(start);
+
+        num = pread(fd, buffer + done, len - done, offset + done);
+        LIBSIGN_STAT_END(LIBSIGN_STAT_READ, start, num > 0 ? num : 0);
+        if(num < 0) {
+            if(errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if(num == 0)
+            break;
+        done += num;
+    }
+
+    return done;
+}
+
+int chunk_manifest_build_fd(int fd, uint32_t chunk_size, uint8_t **manifest_out,
+                            uint32_t *manifest_len)
+{
+    int ret = -EINVAL;
+    uint8_t *chunk, *manifest, *tmp;
+    uint32_t len = LIBSIGN_MANIFEST_HEADER_SIZE, allocated = 4096;
+    uint64_t image_size = 0;
+    ssize_t num;
+
+    if(!chunk_size)
+        return -EINVAL;
+
+    chunk = malloc(chunk_size);
+    manifest = malloc(allocated);
+    if(!chunk || !manifest) {
+        ret = -ENOMEM;
+        goto free_buffers;
+    }
+
+    while((num = read_full(fd, chunk, chunk_size)) > 0) {
+        sha1_ctx hash;
+
+        if(len + SHA1_DIGEST_LENGTH > allocated) {
+            allocated *= 2;
+            tmp = realloc(manifest, allocated);
+            if(!tmp) {
+                ret = -ENOMEM;
+                goto free_buffers;
+            }
+            manifest = tmp;
+        }
+
+        sha1_init(&hash);
+        sha1_update(&hash, num, chunk);
+        sha1_digest(&hash, manifest + len);
+
+        len += SHA1_DIGEST_LENGTH;
+        image_size += num;
+    }
+
+    if(num < 0) {
+        ret = num;
+        goto free_buffers;
+    }
+
+    memcpy(manifest, LIBSIGN_MANIFEST_MAGIC, 4);
+    manifest[4] = LIBSIGN_MANIFEST_VERSION;
+    manifest[5] = PGP_SHA1;
+    manifest[6] = 0;
+    manifest[7] = 0;
+    write_be32(manifest + 8, chunk_size);
+    write_be32(manifest + 12, image_size >> 32);
+    write_be32(manifest + 16, image_size);
+
+    free(chunk);
+
+    *manifest_out = manifest;
+    *manifest_len = len;
+
+    return 0;
+
+free_buffers:
+    free(chunk);
+    free(manifest);
+    return ret;
+}
+
+static void *reader_worker(void *arg);
+
+int verified_reader_open(libsign_verified_reader *reader, libsign_public_key *pub,
+                         libsign_signature *sig, const uint8_t *manifest,
+                         uint32_t manifest_len, int fd, unsigned int threads)
+{
+    unsigned int i;
+    int ret;
+
+    memset(reader, 0, sizeof(libsign_verified_reader));
+    chunk_manifest_init(&reader->manifest);
+
+    /* the manifest is the only thing the signature covers, check it once
+       up front and trust the digests from here on. */
+    ret = verify_buffer(pub, sig, manifest, manifest_len);
+    if(ret != 0)
+        return ret < 0 ? ret : -EBADMSG;
+
+    ret = chunk_manifest_parse(&reader->manifest, manifest, manifest_len);
+    if(ret < 0)
+        return ret;
+
+    reader->verified = calloc((reader->manifest.num_chunks + 63) / 64 + 1, sizeof(uint64_t));
+    if(!reader->verified) {
+        chunk_manifest_destroy(&reader->manifest);
+        return -ENOMEM;
+    }
+
+    reader->fd = fd;
+    reader->threads = threads ? threads : 1;
+    if(reader->threads > 64)
+        reader->threads = 64;
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->work, NULL);
+    pthread_cond_init(&reader->done, NULL);
+
+    /* fewer workers than asked for will do, the reading thread can check
+       every chunk on its own if need be. */
+    if(reader->threads > 1)
+        reader->workers = calloc(reader->threads - 1, sizeof(pthread_t));
+    for(i = 0; reader->workers && i < reader->threads - 1; i++) {
+        if(pthread_create(&reader->workers[reader->num_workers], NULL, reader_worker, reader) != 0)
+            break;
+        reader->num_workers++;
+    }
+
+    return 0;
+}
+
+void verified_reader_close(libsign_verified_reader *reader)
+{
+    unsigned int i;
+
+    /* nothing was started if the open failed */
+    if(!reader->verified)
+        return;
+
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->work);
+    pthread_mutex_unlock(&reader->lock);
+
+    for(i = 0; i < reader->num_workers; i++)
+        pthread_join(reader->workers[i], NULL);
+
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->work);
+    pthread_cond_destroy(&reader->done);
+    free(reader->workers);
+    reader->workers = NULL;
+    reader->num_workers = 0;
+
+    chunk_manifest_destroy(&reader->manifest);
+    free(reader->verified);
+    reader->verified = NULL;
+}
+
+int verified_reader_chunk_verified(libsign_verified_reader *reader, uint32_t chunk)
+{
+    uint64_t word;
+
+    if(chunk >= reader->manifest.num_chunks)
+        return 0;
+
+    word = __sync_fetch_and_or(&reader->verified[chunk / 64], 0);
+
+    return (word >> (chunk % 64)) & 1;
+}
+
+/* read one chunk of a job, checking it against the manifest unless that has
+   already been done. scratch is a chunk sized buffer for chunks only partly
+   covered by the read. */
+static int read_chunk(chunk_job *job, uint32_t chunk, uint8_t **scratch)
+{
+    libsign_verified_reader *reader = job->reader;
+    libsign_chunk_manifest *manifest = &reader->manifest;
+    uint64_t chunk_start, chunk_end, start, end;
+    uint8_t digest[SHA1_DIGEST_LENGTH], *dest;
+    size_t chunk_len;
+    sha1_ctx hash;
+    ssize_t num;
+
+    chunk_start = (uint64_t)chunk * manifest->chunk_size;
+    chunk_end = chunk_start + manifest->chunk_size;
+    if(chunk_end > manifest->image_size)
+        chunk_end = manifest->image_size;
+    chunk_len = chunk_end - chunk_start;
+
+    /* the part of the chunk that was asked for */
+    start = job->offset > chunk_start ? job->offset : chunk_start;
+    end = job->offset + job->len < chunk_end ? job->offset + job->len : chunk_end;
+
+    if(verified_reader_chunk_verified(reader, chunk)) {
+        num = pread_full(reader->fd, job->buffer + (start - job->offset), end - start, start);
+        if(num < 0)
+            return num;
+        return (uint64_t)num == end - start ? 0 : -EIO;
+    }
+
+    /* chunks covered entirely by the read are hashed in the caller's
+       buffer, the others go through scratch and the wanted part is copied. */
+    if(start == chunk_start && end == chunk_end)
+        dest = job->buffer + (chunk_start - job->offset);
+    else {
+        if(!*scratch) {
+            *scratch = malloc(manifest->chunk_size);
+            if(!*scratch)
+                return -ENOMEM;
+        }
+        dest = *scratch;
+    }
+
+    num = pread_full(reader->fd, dest, chunk_len, chunk_start);
+    if(num < 0)
+        return num;
+    if((size_t)num != chunk_len)
+        return -EIO;
+
+    sha1_init(&hash);
+    sha1_update(&hash, chunk_len, dest);
+    sha1_digest(&hash, digest);
+
+    if(memcmp(digest, manifest->digests + (size_t)chunk * manifest->digest_len,
+              manifest->digest_len) != 0)
+        return -EBADMSG;
+
+    if(dest == *scratch)
+        memcpy(job->buffer + (start - job->offset), dest + (start - chunk_start), end - start);
+
+    __sync_fetch_and_or(&reader->verified[chunk / 64], (uint64_t)1 << (chunk % 64));
+
+    return 0;
+}
+
+static void *chunk_worker(void *arg)
+{
+    chunk_job *job = arg;
+    uint8_t *scratch = NULL;
+
+    for(;;) {
+        int ret;
+        uint32_t chunk = __sync_fetch_and_add(&job->next, 1);
+        if(chunk > job->last)
+            break;
+
+        ret = read_chunk(job, chunk, &scratch);
+        if(ret < 0) {
+            __sync_bool_compare_and_swap(&job->ret, 0, ret);
+            break;
+        }
+    }
+
+    free(scratch);
+
+    return NULL;
+}
+
+/* a worker of the reader, helping with each job posted by a read */
+static void *reader_worker(void *arg)
+{
+    libsign_verified_reader *reader = arg;
+    unsigned long seen = 0;
+    chunk_job *job;
+
+    pthread_mutex_lock(&reader->lock);
+    for(;;) {
+        while(!reader->stop && (!reader->job || reader->generation == seen))
+            pthread_cond_wait(&reader->work, &reader->lock);
+        if(reader->stop)
+            break;
+
+        seen = reader->generation;
+        job = reader->job;
+        reader->active++;
+        pthread_mutex_unlock(&reader->lock);
+
+        chunk_worker(job);
+
+        pthread_mutex_lock(&reader->lock);
+        if(--reader->active == 0)
+            pthread_cond_signal(&reader->done);
+    }
+    pthread_mutex_unlock(&reader->lock);
+
+    return NULL;
+}
+
+ssize_t verified_reader_pread(libsign_verified_reader *reader, uint8_t *buffer,
+                              size_t len, uint64_t offset)
+{
+    libsign_chunk_manifest *manifest = &reader->manifest;
+    int posted = 0;
+    uint64_t last;
+    chunk_job job;
+
+    if(offset >= manifest->image_size || !len)
+        return 0;
+    if(len > manifest->image_size - offset)
+        len = manifest->image_size - offset;
+
+    /* the bitmap and the digests only cover num_chunks chunks */
+    last = (offset + len - 1) / manifest->chunk_size;
+    if(last >= manifest->num_chunks)
+        return -EINVAL;
+
+    job.reader = reader;
+    job.buffer = buffer;
+    job.len = len;
+    job.offset = offset;
+    job.next = offset / manifest->chunk_size;
+    job.last = last;
+    job.ret = 0;
+
+    /* only hand the chunks of this read to the workers if there is more
+       than one of them, and the workers are not busy with another read.
+       the calling thread takes a share as well. */
+    if(reader->num_workers && job.last > job.next) {
+        pthread_mutex_lock(&reader->lock);
+        if(!reader->job) {
+            reader->job = &job;
+            reader->generation++;
+            posted = 1;
+            pthread_cond_broadcast(&reader->work);
+        }
+        pthread_mutex_unlock(&reader->lock);
+    }
+
+    chunk_worker(&job);
+
+    /* the job lives on this stack, wait for the workers to let go of it */
+    if(posted) {
+        pthread_mutex_lock(&reader->lock);
+        reader->job = NULL;
+        while(reader->active)
+            pthread_cond_wait(&reader->done, &reader->lock);
+        pthread_mutex_unlock(&reader->lock);
+    }
+
+    if(job.ret < 0)
+        return job.ret;
+
+    return len;
+}
@@ -0,0 +1,92 @@
+#ifndef __LIBSIGN_MANIFEST_H
+#define __LIBSIGN_MANIFEST_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "pgp.h"
+#include "public_key.h"
+#include "signature.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A chunk manifest is a table of per-chunk digests of an image, signed as a
+   whole with an ordinary detached signature. All integers are big-endian:
+
+     4 octets   magic, "LSCM"
+     1 octet    format version (1)
+     1 octet    hash algorithm (9.4)
+     2 octets   reserved, zero
+     4 octets   chunk size in octets
+     8 octets   image size in octets
+     n octets   one digest per chunk, the last chunk may be short */
+
+#define LIBSIGN_MANIFEST_MAGIC          "LSCM"
+#define LIBSIGN_MANIFEST_VERSION        1
+#define LIBSIGN_MANIFEST_HEADER_SIZE    20
+
+typedef struct libsign_chunk_manifest {
+    enum pgp_hash_algorithm hash_algo;
+    uint32_t chunk_size;
+    uint64_t image_size;
+    uint32_t num_chunks;
+    uint32_t digest_len;
+
+    uint8_t *digests;
+} libsign_chunk_manifest;
+
+void chunk_manifest_init(libsign_chunk_manifest *manifest);
+void chunk_manifest_destroy(libsign_chunk_manifest *manifest);
+
+int chunk_manifest_parse(libsign_chunk_manifest *manifest, const uint8_t *data,
+                         uint32_t datalen);
+/* create the (unsigned) manifest for the image in fd */
+int chunk_manifest_build_fd(int fd, uint32_t chunk_size, uint8_t **manifest_out,
+                            uint32_t *manifest_len);
+
+/* Reads from an image through a signed chunk manifest. Each chunk is hashed
+   and compared with the manifest the first time it is read, and remembered in
+   a bitmap so later reads go straight to the file. The image must not be
+   modified while the reader is open, a chunk is only checked once. */
+struct chunk_job;
+
+typedef struct libsign_verified_reader {
+    libsign_chunk_manifest manifest;
+    int fd;
+    /* number of threads used to check the chunks of a single read */
+    unsigned int threads;
+    uint64_t *verified;
+
+    /* threads - 1 workers started by the open, they help with the chunks of
+       the read in job while the reading thread does its share. */
+    pthread_t *workers;
+    unsigned int num_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    struct chunk_job *job;
+    /* bumped for every job, and the workers still busy with the current one */
+    unsigned long generation;
+    unsigned int active;
+    int stop;
+} libsign_verified_reader;
+
+int verified_reader_open(libsign_verified_reader *reader, libsign_public_key *pub,
+                         libsign_signature *sig, const uint8_t *manifest,
+                         uint32_t manifest_len, int fd, unsigned int threads);
+void verified_reader_close(libsign_verified_reader *reader);
+
+/* read up to len octets at offset, returns the number of octets read or a
+   negative error, -EBADMSG if a chunk does not match the manifest. */
+ssize_t verified_reader_pread(libsign_verified_reader *reader, uint8_t *buffer,
+                              size_t len, uint64_t offset);
+int verified_reader_chunk_verified(libsign_verified_reader *reader, uint32_t chunk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_MANIFEST_H */
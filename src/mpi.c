@@ -1,6 +1,7 @@
 #include "mpi.h"
 
 #include <errno.h>
+#include <string.h>
 
 /* 3.2 */
 int mpi_to_mpz(const uint8_t **data, uint32_t *datalen, mpz_t *i)
@@ -41,3 +42,84 @@ int mpi_to_mpz(const uint8_t **data, uint32_t *datalen, mpz_t *i)
 exit:
     return ret;
 }
+
+int mpi_to_mpz_arena(const uint8_t **data, uint32_t *datalen, mpz_t *i,
+                     libsign_arena *arena)
+{
+    const uint8_t *mpi, *p;
+    uint32_t mpi_len, bytelen, j;
+    mp_size_t num_limbs;
+    mp_limb_t *limbs;
+    int ret;
+
+    ret = mpi_view(data, datalen, &mpi, &mpi_len);
+    if(ret < 0)
+        return ret;
+
+    bytelen = mpi_len - 2;
+    num_limbs = (bytelen + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t);
+
+    limbs = arena_alloc(arena, (num_limbs ? num_limbs : 1) * sizeof(mp_limb_t));
+    if(!limbs)
+        return -ENOMEM;
+
+    /* the least significant limb comes first, built from the last octets */
+    memset(limbs, 0, num_limbs * sizeof(mp_limb_t));
+    p = mpi + mpi_len;
+    for(j = 0; j < bytelen; j++)
+        limbs[j / sizeof(mp_limb_t)] |= (mp_limb_t)*--p << (8 * (j % sizeof(mp_limb_t)));
+
+    /* the integer must never be written to, or cleared */
+    mpz_roinit_n(*i, limbs, num_limbs);
+
+    return 0;
+}
+
+int mpi_view(const uint8_t **data, uint32_t *datalen, const uint8_t **mpi,
+             uint32_t *mpi_len)
+{
+    uint32_t bytelen;
+
+    if(*datalen < 2)
+        return -EINVAL;
+
+    bytelen = 2 + ((((*data)[0] << 8) | (*data)[1]) + 7) / 8;
+    if(*datalen < bytelen)
+        return -EINVAL;
+
+    *mpi = *data;
+    *mpi_len = bytelen;
+    *data += bytelen;
+    *datalen -= bytelen;
+
+    return 0;
+}
+
+uint32_t mpi_size(mpz_t *i)
+{
+    uint32_t bitlen = mpz_sgn(*i) ? mpz_sizeinbase(*i, 2) : 0;
+
+    return 2 + (bitlen + 7) / 8;
+}
+
+int mpz_to_mpi(mpz_t *i, libsign_write_fn write, void *opaque)
+{
+    uint8_t mpi[MPI_MAX_SIZE];
+    uint32_t bitlen, bytelen;
+    size_t count;
+
+    /* only non-negative integers can be represented */
+    if(mpz_sgn(*i) < 0)
+        return -EINVAL;
+
+    bitlen = mpz_sgn(*i) ? mpz_sizeinbase(*i, 2) : 0;
+    bytelen = (bitlen + 7) / 8;
+    if(2 + bytelen > sizeof(mpi))
+        return -EMSGSIZE;
+
+    mpi[0] = bitlen >> 8;
+    mpi[1] = bitlen;
+    mpz_export(mpi + 2, &count, 1, 1, 1, 0, *i);
+
+    return write(opaque, mpi, 2 + bytelen);
+}
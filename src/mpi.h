@@ -4,11 +4,28 @@
 #include <stdint.h>
 #include <gmp.h>
 
+#include "arena.h"
+#include "stream.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* largest MPI mpz_to_mpi writes, a 16384 bit integer */
+#define MPI_MAX_SIZE    (2 + 16384 / 8)
+
 int mpi_to_mpz(const uint8_t **data, uint32_t *datalen, mpz_t *i);
+/* import into limbs allocated from the arena, i is left read-only */
+int mpi_to_mpz_arena(const uint8_t **data, uint32_t *datalen, mpz_t *i,
+                     libsign_arena *arena);
+/* find the extent of the MPI at data without importing it, for mpi_to_mpz
+   to import later */
+int mpi_view(const uint8_t **data, uint32_t *datalen, const uint8_t **mpi,
+             uint32_t *mpi_len);
+/* the number of octets mpz_to_mpi writes for i */
+uint32_t mpi_size(mpz_t *i);
+/* 3.2 */
+int mpz_to_mpi(mpz_t *i, libsign_write_fn write, void *opaque);
 
 #ifdef __cplusplus
 }
@@ -1,4 +1,5 @@
 #include "packet.h"
+#include "stats.h"
 #include "b64/cdecode.h"
 
 #include <errno.h>
@@ -12,44 +13,67 @@
 #include <unistd.h>
 #endif
 
+/* 4.2.2 */
+int packet_length_peek(const uint8_t *data, uint32_t datalen, uint32_t *len, int *len_type)
+{
+    if(datalen < 1)
+        return -EAGAIN;
+
+    *len_type = PACKET_LEN_DEFINITE;
+
+    if(data[0] <= 0xbf) {
+        /* one byte length (4.2.2.1) */
+        *len = data[0];
+        return 1;
+    }
+    else if(data[0] <= 0xdf) {
+        /* two byte length (4.2.2.2) */
+        if(datalen < 2)
+            return -EAGAIN;
+        *len = ((data[0] - 192) << 8) + data[1] + 192;
+        return 2;
+    }
+    else if(data[0] == 0xff) {
+        /* five byte length (4.2.2.3) */
+        if(datalen < 5)
+            return -EAGAIN;
+        *len = ((uint32_t)data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4];
+        return 5;
+    }
+
+    /* partial body length (4.2.2.4), more of the body follows this part */
+    *len = 1 << (data[0] & 0x1f);
+    *len_type = PACKET_LEN_PARTIAL;
+
+    return 1;
+}
+
 /* 4.2 */
-int parse_packet_header(const uint8_t **data, uint32_t *datalen, uint32_t *packet_size)
+int packet_header_peek_length(const uint8_t *data, uint32_t datalen, uint32_t *header_len,
+                              uint32_t *len, int *len_type)
 {
-    int ret = -EINVAL;
+    int ret;
     uint8_t tag;
-    const uint8_t *p = *data;
-    uint32_t newlen = *datalen;
-    /* datalen must be at least two bytes */
-    if(*datalen < 2)
-        goto exit;
+    const uint8_t *p = data;
+
+    if(datalen < 1)
+        return -EAGAIN;
 
     tag = *p++;
 
     if(!(tag & 0x80))
-        goto exit;
+        return -EINVAL;
 
     tag &= ~0x80;
 
     /* is it a new format header? (4.2.2) */
     if(tag & 0x40) {
         tag &= ~0x40;
-        if(*p <= 0xbf) {
-            /* one byte length (4.2.2.1) */
-            *packet_size = *p++;
-        }
-        else if(*p >= 0xc0 && *p <= 0xdf) {
-            /* two byte length (4.2.2.2) */
-            /* datalen must be at least three bytes */
-            if(*datalen < 3)
-                goto exit;
-            *packet_size = (*p++ - 192) << 8;
-            *packet_size += *p++ + 192;
-        }
-        else {
-            /* should probably support more lengths... */
-            ret = -ENOTSUP;
-            goto exit;
-        }
+
+        ret = packet_length_peek(p, datalen - 1, len, len_type);
+        if(ret < 0)
+            return ret;
+        p += ret;
     }
     /* old format packet length (4.2.1) */
     else {
@@ -58,50 +82,157 @@ int parse_packet_header(const uint8_t **data, uint32_t *datalen, uint32_t *packe
         tag &= 0x3C;
         tag >>= 2;
 
+        *len_type = PACKET_LEN_DEFINITE;
+
         switch(length_type) {
         case 0:
             /* one byte length */
-            *packet_size = *p++;
+            if(datalen < 2)
+                return -EAGAIN;
+
+            *len = *p++;
             break;
         case 1:
             /* two byte length */
-            /* datalen must be at least three bytes */
-            if(*datalen < 3)
-                goto exit;
+            if(datalen < 3)
+                return -EAGAIN;
 
-            *packet_size = *p++ << 8;
-            *packet_size |= *p++;
+            *len = *p++ << 8;
+            *len |= *p++;
             break;
         case 2:
             /* four byte length */
-            /* datalen must be at least five bytes */
-            if(*datalen < 5)
-                goto exit;
-
-            *packet_size = *p++ << 24;
-            *packet_size |= *p++ << 16;
-            *packet_size |= *p++ << 8;
-            *packet_size |= *p++;
+            if(datalen < 5)
+                return -EAGAIN;
+
+            *len = (uint32_t)*p++ << 24;
+            *len |= *p++ << 16;
+            *len |= *p++ << 8;
+            *len |= *p++;
             break;
         case 3:
-            /* indeterminate length, we do not support this. */
-        default:
-            ret = -ENOTSUP;
-            goto exit;
+            /* indeterminate length, the packet runs to the end of the data */
+            *len = 0;
+            *len_type = PACKET_LEN_INDETERMINATE;
             break;
         }
     }
 
-    newlen -= (p - *data);
+    *header_len = p - data;
+
+    return tag;
+}
+
+int packet_header_peek(const uint8_t *data, uint32_t datalen, uint32_t *header_len,
+                       uint32_t *packet_size)
+{
+    int len_type, tag = -EAGAIN;
+    LIBSIGN_STAT_BEGIN(start);
+
+    /* we need at least the tag and the first length octet */
+    if(datalen >= 2)
+        tag = packet_header_peek_length(data, datalen, header_len, packet_size, &len_type);
+
+    /* only packets of a known size can be handed out whole, see
+       libsign_body_reader for the rest */
+    if(tag >= 0 && len_type != PACKET_LEN_DEFINITE)
+        tag = -ENOTSUP;
+
+    LIBSIGN_STAT_END(LIBSIGN_STAT_PARSE_PACKET_HEADER, start, tag < 0 ? 0 : *header_len);
+
+    return tag;
+}
+
+int parse_packet_header(const uint8_t **data, uint32_t *datalen, uint32_t *packet_size)
+{
+    uint32_t header_len;
+    int tag = packet_header_peek(*data, *datalen, &header_len, packet_size);
+
+    /* a truncated header is just as invalid as a bad one here */
+    if(tag == -EAGAIN)
+        return -EINVAL;
+    if(tag < 0)
+        return tag;
+
     /* do we have enough data for the given size? */
-    if(newlen < *packet_size)
-        goto exit;
+    if(*datalen - header_len < *packet_size)
+        return -EINVAL;
+
+    *datalen -= header_len;
+    *data += header_len;
+
+    return tag;
+}
+
+void packet_iter_init(libsign_packet_iter *iter, const uint8_t *data, uint32_t datalen)
+{
+    iter->data = data;
+    iter->datalen = datalen;
+    iter->pos = 0;
+}
+
+int packet_iter_next(libsign_packet_iter *iter, libsign_packet *packet)
+{
+    const uint8_t *p = iter->data + iter->pos;
+    uint32_t len = iter->datalen - iter->pos;
+    int tag;
+
+    if(!len)
+        return -ENOENT;
+
+    tag = parse_packet_header(&p, &len, &packet->len);
+    if(tag < 0)
+        return tag;
+
+    packet->tag = tag;
+    packet->header_len = p - (iter->data + iter->pos);
+    packet->body = p;
 
-    *datalen = newlen;
-    *data = p;
+    iter->pos += packet->header_len + packet->len;
 
-    ret = tag;
+    return 0;
+}
+
+int packet_write_header(uint8_t *out, int tag, uint32_t packet_size)
+{
+    uint8_t *p = out;
+
+    /* old format headers where the tag allows, like everyone else (4.2.1) */
+    if(tag < 16) {
+        if(packet_size < 0x100) {
+            *p++ = 0x80 | (tag << 2);
+            *p++ = packet_size;
+        }
+        else if(packet_size < 0x10000) {
+            *p++ = 0x80 | (tag << 2) | 1;
+            *p++ = packet_size >> 8;
+            *p++ = packet_size;
+        }
+        else {
+            *p++ = 0x80 | (tag << 2) | 2;
+            *p++ = packet_size >> 24;
+            *p++ = packet_size >> 16;
+            *p++ = packet_size >> 8;
+            *p++ = packet_size;
+        }
+    }
+    /* new format (4.2.2) */
+    else {
+        *p++ = 0xc0 | tag;
+        if(packet_size < 192)
+            *p++ = packet_size;
+        else if(packet_size < 8384) {
+            *p++ = ((packet_size - 192) >> 8) + 192;
+            *p++ = packet_size - 192;
+        }
+        else {
+            *p++ = 0xff;
+            *p++ = packet_size >> 24;
+            *p++ = packet_size >> 16;
+            *p++ = packet_size >> 8;
+            *p++ = packet_size;
+        }
+    }
 
-exit:
-    return ret;
+    return p - out;
 }
@@ -7,7 +7,52 @@
 extern "C" {
 #endif
 
+/* the longest header packet_write_header writes */
+#define PACKET_HEADER_MAX   6
+
+/* a packet found by the iterator, body points into the iterated data */
+typedef struct libsign_packet {
+    int tag;
+    uint32_t header_len;
+    const uint8_t *body;
+    uint32_t len;
+} libsign_packet;
+
+/* walks over the packets of a buffer without copying any of them */
+typedef struct libsign_packet_iter {
+    const uint8_t *data;
+    uint32_t datalen;
+    uint32_t pos;
+} libsign_packet_iter;
+
+void packet_iter_init(libsign_packet_iter *iter, const uint8_t *data, uint32_t datalen);
+/* returns 0 and the next packet, -ENOENT after the last one */
+int packet_iter_next(libsign_packet_iter *iter, libsign_packet *packet);
+
+/* how the length of a packet body is given (4.2) */
+enum packet_length_type {
+    PACKET_LEN_DEFINITE,
+    /* the body comes in parts, each with a length of its own */
+    PACKET_LEN_PARTIAL,
+    /* the body runs to the end of the data */
+    PACKET_LEN_INDETERMINATE
+};
+
+/* parse a new format length, returns the number of octets it takes up */
+int packet_length_peek(const uint8_t *data, uint32_t datalen, uint32_t *len, int *len_type);
+/* like packet_header_peek, but accepting any type of length. for partial
+   lengths len is the length of the first part. */
+int packet_header_peek_length(const uint8_t *data, uint32_t datalen, uint32_t *header_len,
+                              uint32_t *len, int *len_type);
+
+/* find the tag and lengths of the packet header at data without consuming
+   it. returns the tag, or -EAGAIN if more data is needed to tell. */
+int packet_header_peek(const uint8_t *data, uint32_t datalen, uint32_t *header_len,
+                       uint32_t *packet_size);
 int parse_packet_header(const uint8_t **data, uint32_t *datalen, uint32_t *packet_size);
+/* write a header for a packet of packet_size octets to out, returns the
+   length of the header */
+int packet_write_header(uint8_t *out, int tag, uint32_t packet_size);
 
 #ifdef __cplusplus
 }
@@ -13,6 +13,9 @@ typedef uint32_t libsign_timestamp;
 /* 8 octet key ID */
 typedef uint64_t libsign_key_id;
 
+/* 12.2, a v4 fingerprint is the SHA-1 hash of the key packet */
+#define PGP_FINGERPRINT_LEN 20
+
 /* 5.5.2 */
 enum pgp_key_version {
     PGP_KEY_VER3    = 3,
@@ -34,6 +37,10 @@ enum pgp_public_key_algorithm {
     PGP_DSA                     = 17
 };
 
+/* RSA that signs. sign-only keys and signatures (13.5) are deprecated but
+   have the same MPIs as plain RSA. */
+#define PGP_RSA_SIGNS(algo) ((algo) == PGP_RSA || (algo) == PGP_RSA_SIGN_ONLY)
+
 /* 9.4 */
 enum pgp_hash_algorithm {
     PGP_MD5         = 1,
@@ -91,6 +98,17 @@ enum pgp_signature_subpacket_type {
     PGP_SIG_EMBEDDED_SIGNATURE          = 0x20
 };
 
+/* 5.2.3.21, the first octet */
+enum pgp_key_flags {
+    PGP_KEY_FLAG_CERTIFY            = 0x01,
+    PGP_KEY_FLAG_SIGN               = 0x02,
+    PGP_KEY_FLAG_ENCRYPT_COMMS      = 0x04,
+    PGP_KEY_FLAG_ENCRYPT_STORAGE    = 0x08,
+    PGP_KEY_FLAG_SPLIT              = 0x10,
+    PGP_KEY_FLAG_AUTHENTICATION     = 0x20,
+    PGP_KEY_FLAG_GROUP              = 0x80
+};
+
 /* 4.3 */
 enum pgp_packet_tag {
     PGP_TAG_RESERVED                            = 0,
@@ -108,7 +126,7 @@ enum pgp_packet_tag {
     PGP_TAG_TRUST                               = 12,
     PGP_TAG_USERID                              = 13,
     PGP_TAG_PUBLIC_SUBKEY                       = 14,
-    PGP_TAG_USER_ATTRIBUTE                      = 15,
+    PGP_TAG_USER_ATTRIBUTE                      = 17,
     PGP_TAG_SYMMETRICALLY_ENCRYPTED_SIGNED_DATA = 18,
     PGP_TAG_MODIFICATION_DETECTION_CODE         = 19
 };
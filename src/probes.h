@@ -0,0 +1,39 @@
+#ifndef __LIBSIGN_PROBES_H
+#define __LIBSIGN_PROBES_H
+
+/* USDT probes of the libsign provider, for SystemTap, perf and bpftrace,
+   e.g. usdt:/usr/bin/program:libsign:verify__return. Each is a single nop
+   in the code, with the location of its arguments in a note section, until
+   a tracer attaches to it. Without <sys/sdt.h>, or with LIBSIGN_NO_PROBES,
+   they are not there at all.
+
+   parse_signature__entry    filename or NULL, length of the buffer, armored
+   parse_signature__return   result, issuer, public key and hash algorithm
+   parse_public_key__entry   filename or NULL, length of the buffer, armored
+   parse_public_key__return  result, key ID, public key algorithm, subkeys
+   decode_armor__entry       length of the encoded data
+   decode_armor__return      result, length of the decoded data
+   verify__entry             issuer, filename or NULL, length of the buffer
+   verify__return            issuer, result
+   rsa_sha1_verify__entry    size of the modulus in octets, octets hashed
+   rsa_sha1_verify__return   result */
+
+#if defined(HAVE_SYS_SDT_H) && !defined(LIBSIGN_NO_PROBES)
+
+#include <sys/sdt.h>
+
+#define LIBSIGN_PROBE1(name, a)             DTRACE_PROBE1(libsign, name, a)
+#define LIBSIGN_PROBE2(name, a, b)          DTRACE_PROBE2(libsign, name, a, b)
+#define LIBSIGN_PROBE3(name, a, b, c)       DTRACE_PROBE3(libsign, name, a, b, c)
+#define LIBSIGN_PROBE4(name, a, b, c, d)    DTRACE_PROBE4(libsign, name, a, b, c, d)
+
+#else
+
+#define LIBSIGN_PROBE1(name, a)             do {} while(0)
+#define LIBSIGN_PROBE2(name, a, b)          do {} while(0)
+#define LIBSIGN_PROBE3(name, a, b, c)       do {} while(0)
+#define LIBSIGN_PROBE4(name, a, b, c, d)    do {} while(0)
+
+#endif
+
+#endif /* __LIBSIGN_PROBES_H */
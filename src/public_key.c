@@ -2,6 +2,12 @@
 #include "armor.h"
 #include "packet.h"
 #include "mpi.h"
+#include "probes.h"
+#include "rsa.h"
+#include "sha1.h"
+#include "signature.h"
+#include "stats.h"
+#include "stream.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -18,16 +24,31 @@
 
 void public_key_init(libsign_public_key *pub)
 {
+    memset(pub, 0, sizeof(libsign_public_key));
     mpz_init(pub->n);
     mpz_init(pub->e);
-    pub->userids = NULL;
-    pub->num_userids = 0;
+    pub->profile = LIBSIGN_PARSE_ALL;
+}
+
+void public_key_init_arena(libsign_public_key *pub, libsign_arena *arena)
+{
+    memset(pub, 0, sizeof(libsign_public_key));
+    /* the integers point into the arena once parsed, until then they are
+       read-only zeros */
+    mpz_roinit_n(pub->n, NULL, 0);
+    mpz_roinit_n(pub->e, NULL, 0);
+    pub->profile = LIBSIGN_PARSE_ALL;
+    pub->arena = arena;
 }
 
 void public_key_destroy(libsign_public_key *pub)
 {
     int i;
 
+    /* everything is released with the arena */
+    if(pub->arena)
+        return;
+
     mpz_clear(pub->n);
     mpz_clear(pub->e);
 
@@ -35,16 +56,102 @@ void public_key_destroy(libsign_public_key *pub)
         free(pub->userids[i].userid);
 
     free(pub->userids);
+
+    for(i = 0; i < pub->num_subkeys; i++) {
+        mpz_clear(pub->subkeys[i].n);
+        mpz_clear(pub->subkeys[i].e);
+    }
+
+    free(pub->subkeys);
+
+    for(i = 0; i < (int)pub->num_certs; i++) {
+        signature_destroy(&pub->certs[i].sig);
+        signature_destroy(&pub->certs[i].back);
+    }
+
+    free(pub->certs);
+}
+
+/* the arrays of a key double whenever their count reaches a power of two.
+   arrays in an arena are copied, as it cannot reallocate. */
+static void *grow_array(libsign_public_key *pub, void *array, uint32_t count, size_t size)
+{
+    void *grown;
+
+    if(count & (count - 1))
+        return array;
+
+    if(!pub->arena)
+        return realloc(array, (count ? count * 2 : 1) * size);
+
+    grown = arena_alloc(pub->arena, (count ? count * 2 : 1) * size);
+    if(grown && count)
+        memcpy(grown, array, count * size);
+
+    return grown;
+}
+
+/* handle one packet of a public key file */
+int public_key_packet(void *opaque, int tag, const uint8_t *body, uint32_t len)
+{
+    libsign_public_key *pub = opaque;
+
+    switch(tag) {
+    case PGP_TAG_PUBLIC_KEY:
+    case PGP_TAG_PUBLIC_SUBKEY:
+    case PGP_TAG_SIGNATURE:
+    case PGP_TAG_USERID:
+        /* too large for the parser's working buffer */
+        if(!body)
+            return -EMSGSIZE;
+        break;
+    case PGP_TAG_USER_ATTRIBUTE:
+        /* only the signatures after it are of interest, as they are not
+           over the user ID before it */
+        pub->last_tag = tag;
+        return 0;
+    default:
+        return 0;
+    }
+
+    if(tag != PGP_TAG_SIGNATURE)
+        pub->last_tag = tag;
+
+    switch(tag) {
+    case PGP_TAG_PUBLIC_KEY:
+        return process_public_key_packet(&body, &len, pub);
+    case PGP_TAG_PUBLIC_SUBKEY:
+        return process_public_key_subkey_packet(&body, &len, pub);
+    case PGP_TAG_SIGNATURE:
+        return process_public_key_signature_packet(&body, &len, pub);
+    case PGP_TAG_USERID:
+        return process_public_key_uid_packet(&body, &len, pub);
+    }
+
+    return 0;
 }
 
+/* the packets every profile needs. the signatures are always parsed, as a
+   subkey is only used once its binding checks out and the flags and
+   expiration times decide what a key may sign, and the user ID and attribute
+   packets tell what the signatures are over. anything else is passed over. */
+#define PUBLIC_KEY_TAGS (LIBSIGN_TAG_BIT(PGP_TAG_PUBLIC_KEY) |      \
+                         LIBSIGN_TAG_BIT(PGP_TAG_PUBLIC_SUBKEY) |   \
+                         LIBSIGN_TAG_BIT(PGP_TAG_SIGNATURE) |       \
+                         LIBSIGN_TAG_BIT(PGP_TAG_USERID) |          \
+                         LIBSIGN_TAG_BIT(PGP_TAG_USER_ATTRIBUTE))
+
 int parse_public_key(libsign_public_key *pub, const char *filename)
 {
-    /* open the file pointed to by filename and read contents into memory */
+    return parse_public_key_profile(pub, filename, LIBSIGN_PARSE_ALL);
+}
+
+int parse_public_key_profile(libsign_public_key *pub, const char *filename,
+                             unsigned int profile)
+{
+    /* open the file pointed to by filename and parse it as it is read */
     int armored = 0, fd, ret = -EINVAL;
-    struct stat stbuf;
-    uint32_t filesize, filename_len, plain_len;
-    uint8_t *buffer, *plaintext;
-    const uint8_t *p;
+    uint32_t filename_len;
 
     /* examine the filename to see if the file is armored */
     filename_len = strlen(filename);
@@ -53,49 +160,31 @@ int parse_public_key(libsign_public_key *pub, const char *filename)
     if(filename_len > 4 && strncmp(filename + (filename_len-4), ".asc", 4) == 0)
         armored = 1;
 
+    LIBSIGN_PROBE3(parse_public_key__entry, filename, 0, armored);
+
     fd = open(filename, O_RDONLY | O_BINARY);
     if(fd == -1) {
         goto exit;
     }
 
-    /* find size of file */
-    if(fstat(fd, &stbuf) == -1)
-        goto close_fd;
-
-    filesize = stbuf.st_size;
-    buffer = malloc(filesize);
-    if(!buffer)
-        goto close_fd;
-
-    /* read file into memory */
-    if(read(fd, buffer, filesize) != filesize)
-        goto free_buffer;
-
-    /* do we have to decode the armor? */
-    if(armored) {
-        if(decode_public_key_armor(buffer, filesize, &plaintext, &plain_len) != 0)
-            goto free_buffer;
-        filesize = plain_len;
-        p = plaintext;
-    }
-    else
-        p = buffer;
-
-    ret = parse_public_key_buffer(pub, p, filesize);
-
-    if(armored)
-        free(plaintext);
+    pub->profile = profile;
+    ret = parse_packets_fd_tags(fd, armored, PUBLIC_KEY_TAGS, public_key_packet, pub);
 
-free_buffer:
-    free(buffer);
-close_fd:
     close(fd);
 exit:
+    LIBSIGN_PROBE4(parse_public_key__return, ret, pub->key_id, pub->pk_algo, pub->num_subkeys);
+
     return ret;
 }
 
 int parse_public_key_buffer(libsign_public_key *pub, const uint8_t *buffer,
                             uint32_t datalen)
+{
+    return parse_public_key_buffer_profile(pub, buffer, datalen, LIBSIGN_PARSE_ALL);
+}
+
+static int public_key_buffer(libsign_public_key *pub, const uint8_t *buffer, uint32_t datalen,
+                             unsigned int profile)
 {
     int ret = -EINVAL;
     uint32_t packet_size;
@@ -103,6 +192,8 @@ int parse_public_key_buffer(libsign_public_key *pub, const uint8_t *buffer,
     if(!datalen)
         goto exit;
 
+    pub->profile = profile;
+
     /* parse packet headers */
     while(datalen) {
         int tag = parse_packet_header(&buffer, &datalen, &packet_size);
@@ -111,28 +202,13 @@ int parse_public_key_buffer(libsign_public_key *pub, const uint8_t *buffer,
 
         datalen -= packet_size;
 
-        switch(tag) {
-        case PGP_TAG_PUBLIC_KEY:
-            ret = process_public_key_packet(&buffer, &packet_size, pub);
+        if(PUBLIC_KEY_TAGS & LIBSIGN_TAG_BIT(tag)) {
+            ret = public_key_packet(pub, tag, buffer, packet_size);
             if(ret < 0)
                 goto exit;
-            break;
-        case PGP_TAG_PUBLIC_SUBKEY:
-            ret = process_public_key_subkey_packet(&buffer, &packet_size, pub);
-            if(ret < 0)
-                goto exit;
-            break;
-        case PGP_TAG_SIGNATURE:
-            ret = process_public_key_signature_packet(&buffer, &packet_size, pub);
-            if(ret < 0)
-                goto exit;
-            break;
-        case PGP_TAG_USERID:
-            ret = process_public_key_uid_packet(&buffer, &packet_size, pub);
-            if(ret < 0)
-                goto exit;
-            break;
         }
+
+        buffer += packet_size;
     }
 
     ret = 0;
@@ -141,90 +217,413 @@ exit:
     return ret;
 }
 
+int parse_public_key_buffer_profile(libsign_public_key *pub, const uint8_t *buffer,
+                                    uint32_t datalen, unsigned int profile)
+{
+    int ret;
+
+    LIBSIGN_PROBE3(parse_public_key__entry, NULL, datalen, 0);
+
+    ret = public_key_buffer(pub, buffer, datalen, profile);
+
+    LIBSIGN_PROBE4(parse_public_key__return, ret, pub->key_id, pub->pk_algo, pub->num_subkeys);
+
+    return ret;
+}
+
+static int check_public_key_armor(const uint8_t *data, uint32_t datalen)
+{
+    /* (6.2) for public keys, the armor header line shall be
+       "-----BEGIN PGP PUBLIC KEY BLOCK-----" */
+    if(datalen < 36)
+        return -EINVAL;
+
+    if(strncmp((char*)data, "-----BEGIN PGP PUBLIC KEY BLOCK-----", 36) != 0)
+        return -EINVAL;
+
+    return 0;
+}
+
 int parse_public_key_armor_buffer(libsign_public_key *pub, const uint8_t *buffer,
                                   uint32_t datalen)
+{
+    return parse_public_key_armor_buffer_profile(pub, buffer, datalen, LIBSIGN_PARSE_ALL);
+}
+
+int parse_public_key_armor_buffer_profile(libsign_public_key *pub, const uint8_t *buffer,
+                                          uint32_t datalen, unsigned int profile)
 {
     int ret = -EINVAL;
-    uint8_t *plaintext = NULL;
+    uint8_t stack_plain[ARMOR_STACK_SIZE];
+    uint8_t *plaintext = stack_plain;
+    uint32_t plain_size, plain_len;
+
+    LIBSIGN_PROBE3(parse_public_key__entry, NULL, datalen, 1);
+
+    ret = check_public_key_armor(buffer, datalen);
+    if(ret < 0)
+        goto exit;
+
+    ret = decode_armor_size(buffer, datalen, &plain_size);
+    if(ret < 0)
+        goto exit;
+
+    /* only go to the heap for armor too large for the stack */
+    if(plain_size > sizeof(stack_plain)) {
+        plaintext = malloc(plain_size);
+        if(!plaintext) {
+            ret = -ENOMEM;
+            goto exit;
+        }
+        LIBSIGN_STAT_ALLOC(LIBSIGN_STAT_DECODE_ARMOR);
+    }
+
+    ret = decode_armor_buffer(buffer, datalen, plaintext, plain_size, &plain_len);
+    if(ret < 0)
+        goto free_plain;
+
+    ret = public_key_buffer(pub, plaintext, plain_len, profile);
+
+free_plain:
+    if(plaintext != stack_plain)
+        free(plaintext);
+exit:
+    LIBSIGN_PROBE4(parse_public_key__return, ret, pub->key_id, pub->pk_algo, pub->num_subkeys);
+
+    return ret;
+}
+
+int parse_public_key_armor_inplace(libsign_public_key *pub, uint8_t *buffer, uint32_t datalen)
+{
+    return parse_public_key_armor_inplace_profile(pub, buffer, datalen, LIBSIGN_PARSE_ALL);
+}
+
+int parse_public_key_armor_inplace_profile(libsign_public_key *pub, uint8_t *buffer,
+                                           uint32_t datalen, unsigned int profile)
+{
+    int ret;
     uint32_t plain_len;
 
-    ret = decode_public_key_armor(buffer, datalen, &plaintext, &plain_len);
+    LIBSIGN_PROBE3(parse_public_key__entry, NULL, datalen, 1);
+
+    ret = check_public_key_armor(buffer, datalen);
     if(ret < 0)
         goto exit;
 
-    ret = parse_public_key_buffer(pub, plaintext, plain_len);
+    ret = decode_armor_inplace(buffer, datalen, &plain_len);
+    if(ret < 0)
+        goto exit;
+
+    ret = public_key_buffer(pub, buffer, plain_len, profile);
 
 exit:
-    free(plaintext);
+    LIBSIGN_PROBE4(parse_public_key__return, ret, pub->key_id, pub->pk_algo, pub->num_subkeys);
 
     return ret;
 }
 
 /* 5.5.2 */
-int process_public_key_packet(const uint8_t **data, uint32_t *datalen,
-                              libsign_public_key *ctx)
+static int key_packet_view(libsign_key_view *view, const uint8_t *body, uint32_t len)
 {
-    int ret = -EINVAL;
-    const uint8_t *p = *data;
-    uint32_t tmplen = *datalen;
+    int ret;
+    const uint8_t *p = body;
 
     /* public key packet must be at least 8 bytes:
        version, creation time, pk algorithm, at least one MPI */
-    if(tmplen < 8)
-        goto exit;
+    if(len < 8)
+        return -EINVAL;
 
-    ctx->version = *p++;
-    ctx->created = (*p++ << 24);
-    ctx->created |= (*p++ << 16);
-    ctx->created |= (*p++ << 8);
-    ctx->created |= (*p++);
-    ctx->pk_algo = *p++;
-    tmplen -= 6;
+    view->body = body;
+    view->version = *p++;
+    view->created = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    p += 4;
+    view->pk_algo = *p++;
+    len -= 6;
 
-    switch(ctx->pk_algo) {
+    switch(view->pk_algo) {
     case PGP_RSA:
-        /* RSA public modulus n */
-        if(mpi_to_mpz(&p, &tmplen, &ctx->n) != 0)
-            goto exit;
+    case PGP_RSA_SIGN_ONLY:
+        /* RSA public modulus n and public encryption exponent e */
+        if((ret = mpi_view(&p, &len, &view->n, &view->n_len)) < 0 ||
+           (ret = mpi_view(&p, &len, &view->e, &view->e_len)) < 0)
+            return ret;
+        break;
+    default:
+        return -ENOTSUP;
+    }
 
-        /* RSA public encryption exponent e */
-        if(mpi_to_mpz(&p, &tmplen, &ctx->e) != 0)
-            goto exit;
+    view->body_len = p - body;
+
+    return 0;
+}
+
+int parse_key_view(libsign_key_view *view, const uint8_t *buffer, uint32_t datalen)
+{
+    int ret;
+    libsign_packet_iter iter;
+    libsign_packet packet;
 
+    memset(view, 0, sizeof(libsign_key_view));
+    packet_iter_init(&iter, buffer, datalen);
+
+    /* the public key packet comes first */
+    while((ret = packet_iter_next(&iter, &packet)) == 0) {
+        if(packet.tag == PGP_TAG_PUBLIC_KEY)
+            break;
+    }
+    if(ret < 0)
+        return ret == -ENOENT ? -EINVAL : ret;
+
+    ret = key_packet_view(view, packet.body, packet.len);
+    if(ret < 0)
+        return ret;
+
+    /* and the rest of the key runs up to the next one */
+    view->packets = buffer + iter.pos;
+    while(iter.pos < datalen) {
+        uint32_t pos = iter.pos;
+
+        ret = packet_iter_next(&iter, &packet);
+        if(ret < 0)
+            return ret;
+
+        if(packet.tag == PGP_TAG_PUBLIC_KEY) {
+            iter.pos = pos;
+            break;
+        }
+        if(packet.tag == PGP_TAG_USERID)
+            view->num_userids++;
+    }
+    view->packets_len = buffer + iter.pos - view->packets;
+
+    return 0;
+}
+
+int key_view_userid(const libsign_key_view *view, uint32_t index, const uint8_t **userid,
+                    uint32_t *len)
+{
+    int ret;
+    libsign_packet_iter iter;
+    libsign_packet packet;
+
+    packet_iter_init(&iter, view->packets, view->packets_len);
+
+    while((ret = packet_iter_next(&iter, &packet)) == 0) {
+        if(packet.tag == PGP_TAG_USERID && index-- == 0) {
+            *userid = packet.body;
+            *len = packet.len;
+            return 0;
+        }
+    }
+
+    return ret;
+}
+
+static int key_material_from_view(libsign_arena *arena, const libsign_key_view *view,
+                                  mpz_t *n, mpz_t *e)
+{
+    int ret;
+    const uint8_t *mpi;
+    uint32_t mpi_len;
+
+    if(arena) {
+        mpi = view->n;
+        mpi_len = view->n_len;
+        if((ret = mpi_to_mpz_arena(&mpi, &mpi_len, n, arena)) < 0)
+            return ret;
+
+        mpi = view->e;
+        mpi_len = view->e_len;
+        return mpi_to_mpz_arena(&mpi, &mpi_len, e, arena);
+    }
+
+    mpi = view->n;
+    mpi_len = view->n_len;
+    if((ret = mpi_to_mpz(&mpi, &mpi_len, n)) < 0)
+        return ret;
+
+    mpi = view->e;
+    mpi_len = view->e_len;
+    return mpi_to_mpz(&mpi, &mpi_len, e);
+}
+
+int public_key_from_view(libsign_public_key *pub, const libsign_key_view *view)
+{
+    pub->version = view->version;
+    pub->created = view->created;
+    pub->pk_algo = view->pk_algo;
+
+    return key_material_from_view(pub->arena, view, &pub->n, &pub->e);
+}
+
+/* 5.2.4, a key packet is hashed as 0x99, a two octet length and the body */
+static void hash_key_packet(sha1_ctx *hash, const uint8_t *body, uint32_t len)
+{
+    uint8_t header[3];
+
+    header[0] = 0x99;
+    header[1] = len >> 8;
+    header[2] = len;
+    sha1_update(hash, sizeof(header), header);
+    sha1_update(hash, len, body);
+}
+
+/* 12.2 */
+int key_fingerprint(const uint8_t *body, uint32_t len, uint8_t fingerprint[PGP_FINGERPRINT_LEN],
+                    libsign_key_id *key_id)
+{
+    int i;
+    const uint8_t *p, *n;
+    uint32_t p_len, n_len;
+    sha1_ctx hash;
+
+    memset(fingerprint, 0, PGP_FINGERPRINT_LEN);
+    *key_id = 0;
+
+    if(len < 8 || len > 0xffff)
+        return -EINVAL;
+
+    switch(body[0]) {
+    case PGP_KEY_VER4:
+        /* the SHA-1 hash of the key packet, the key ID is its low 64 bits */
+        sha1_init(&hash);
+        hash_key_packet(&hash, body, len);
+        sha1_digest(&hash, fingerprint);
+
+        for(i = PGP_FINGERPRINT_LEN - 8; i < PGP_FINGERPRINT_LEN; i++)
+            *key_id = (*key_id << 8) | fingerprint[i];
+        break;
+    case PGP_KEY_VER3:
+        /* the low 64 bits of the modulus, which follows the version,
+           creation time, validity period and algorithm (5.5.2) */
+        p = body + 8;
+        p_len = len - 8;
+        if(mpi_view(&p, &p_len, &n, &n_len) < 0 || n_len < 10)
+            return -EINVAL;
+
+        for(i = n_len - 8; i < (int)n_len; i++)
+            *key_id = (*key_id << 8) | n[i];
         break;
     default:
-        ret = -ENOTSUP;
-        goto exit;
+        return -ENOTSUP;
     }
 
-    *datalen -= (p - *data);
-    *data = p;
+    return 0;
+}
 
-    ret = 0;
+libsign_subkey *public_key_subkey(libsign_public_key *pub, libsign_key_id key_id)
+{
+    int i;
 
-exit:
-    return ret;
+    for(i = 0; i < pub->num_subkeys; i++) {
+        if(pub->subkeys[i].key_id == key_id)
+            return &pub->subkeys[i];
+    }
+
+    return NULL;
+}
+
+int public_key_subkey_signs(const libsign_subkey *subkey, libsign_timestamp created)
+{
+    if(subkey->binding != LIBSIGN_CERT_VALID || subkey->back_signature != LIBSIGN_CERT_VALID ||
+       !(subkey->key_flags & PGP_KEY_FLAG_SIGN))
+        return -EKEYREJECTED;
+    if(subkey->expires && created >= subkey->expires)
+        return -EKEYEXPIRED;
+
+    return 0;
+}
+
+libsign_timestamp public_key_expires(libsign_timestamp created, uint32_t expiration)
+{
+    uint64_t expires = (uint64_t)created + expiration;
+
+    if(!expiration)
+        return 0;
+
+    return expires > UINT32_MAX ? UINT32_MAX : (libsign_timestamp)expires;
+}
+
+/* 5.5.2 */
+int process_public_key_packet(const uint8_t **data, uint32_t *datalen,
+                              libsign_public_key *ctx)
+{
+    int ret;
+    libsign_key_view view;
+
+    ret = key_packet_view(&view, *data, *datalen);
+    if(ret < 0)
+        return ret;
+
+    ret = key_fingerprint(*data, *datalen, ctx->fingerprint, &ctx->key_id);
+    if(ret < 0)
+        return ret;
+
+    /* every signature on the key starts with it */
+    sha1_init(&ctx->midstate);
+    hash_key_packet(&ctx->midstate, *data, *datalen);
+    ctx->last_midstate = ctx->midstate;
+
+    ret = public_key_from_view(ctx, &view);
+    if(ret < 0)
+        return ret;
+
+    *datalen -= view.body_len;
+    *data += view.body_len;
+
+    return 0;
 }
 
 int process_public_key_uid_packet(const uint8_t **data, uint32_t *datalen,
                                   libsign_public_key *ctx)
 {
     const uint8_t *p = *data;
+    uint8_t header[5];
+    libsign_userid *userids;
 
-    uint32_t i, index = ctx->num_userids;
+    uint32_t index = ctx->num_userids;
 
-    ctx->num_userids++;
-    ctx->userids = realloc(ctx->userids, ctx->num_userids * sizeof(libsign_userid));
+    /* 5.2.4, 0xb4, a four octet length and the user ID follow the key. the
+       self-signatures over it are kept whatever the profile. */
+    header[0] = 0xb4;
+    header[1] = *datalen >> 24;
+    header[2] = *datalen >> 16;
+    header[3] = *datalen >> 8;
+    header[4] = *datalen;
+
+    ctx->last_midstate = ctx->midstate;
+    sha1_update(&ctx->last_midstate, sizeof(header), header);
+    sha1_update(&ctx->last_midstate, *datalen, p);
+
+    /* only seen to keep track of what the signatures are over */
+    if(!(ctx->profile & LIBSIGN_PARSE_USERIDS)) {
+        *data += *datalen;
+        *datalen = 0;
+        return 0;
+    }
+
+    if(index == UINT8_MAX)
+        return -EMSGSIZE;
 
-    if(!ctx->userids)
+    userids = grow_array(ctx, ctx->userids, index, sizeof(libsign_userid));
+    if(!userids)
         return -ENOMEM;
+    ctx->userids = userids;
 
-    ctx->userids[index].userid = malloc(*datalen);
+    ctx->num_userids++;
+
+    /* (5.11) the user ID is not terminated, add one for convenience */
+    if(ctx->arena)
+        ctx->userids[index].userid = arena_alloc(ctx->arena, *datalen + 1);
+    else
+        ctx->userids[index].userid = malloc(*datalen + 1);
     if(!ctx->userids[index].userid)
         return -ENOMEM;
 
-    for(i = 0; i < *datalen; i++)
-        ctx->userids[index].userid[i] = *p++;
+    memcpy(ctx->userids[index].userid, p, *datalen);
+    ctx->userids[index].userid[*datalen] = '\0';
+    ctx->userids[index].len = *datalen;
+    p += *datalen;
 
     *datalen = 0;
     *data = p;
@@ -232,41 +631,514 @@ int process_public_key_uid_packet(const uint8_t **data, uint32_t *datalen,
     return 0;
 }
 
+/* the key flags (5.2.3.21) and expiration time (5.2.3.6) of a self-signature
+   or binding, whatever the profile */
+static void take_self_signature(const libsign_signature_view *view, libsign_timestamp created,
+                                uint8_t *key_flags, libsign_timestamp *expires)
+{
+    if(view->key_flags)
+        *key_flags = view->key_flags;
+    if(view->key_expiration)
+        *expires = public_key_expires(created, view->key_expiration);
+}
+
+/* check a signature on the key with n and e, the key and user ID or subkey
+   part of the hash is in midstate (5.2.4) */
+static enum libsign_cert_status check_key_signature(mpz_srcptr n, mpz_srcptr e,
+                                                    const sha1_ctx *midstate,
+                                                    const libsign_signature_view *view)
+{
+    enum libsign_cert_status status = LIBSIGN_CERT_INVALID;
+    const uint8_t *mpi = view->s;
+    uint32_t mpi_len = view->s_len;
+    struct rsa_public_key key;
+    sha1_ctx hash;
+    mpz_t s;
+
+    if(view->version != PGP_SIG_VER4 || !PGP_RSA_SIGNS(view->pk_algo) ||
+       view->hash_algo != PGP_SHA1)
+        return LIBSIGN_CERT_UNSUPPORTED;
+
+    /* only read, so the limbs of the key are used where they are */
+    mpz_roinit_n(key.n, mpz_limbs_read(n), mpz_size(n));
+    mpz_roinit_n(key.e, mpz_limbs_read(e), mpz_size(e));
+    if(rsa_public_key_prepare(&key) < 0)
+        return LIBSIGN_CERT_UNSUPPORTED;
+
+    mpz_init(s);
+    if(mpi_to_mpz(&mpi, &mpi_len, &s) == 0) {
+        hash = *midstate;
+        signature_hash_suffix(&hash, view->hashed_data, view->hashed_data_len);
+        if(rsa_sha1_verify(&key, &hash, s) == 0)
+            status = LIBSIGN_CERT_VALID;
+    }
+    mpz_clear(s);
+
+    return status;
+}
+
+/* 5.2.1, the binding of a subkey by the primary key with n and e. a binding
+   that checks out is not undone by a later one that does not, and the flags
+   and expiration time are only taken from one that does. returns the status
+   of the binding. */
+static enum libsign_cert_status bind_subkey(mpz_srcptr n, mpz_srcptr e, libsign_subkey *subkey,
+                                            const libsign_signature_view *view)
+{
+    int ret;
+    enum libsign_cert_status status;
+    libsign_signature_view back;
+
+    status = check_key_signature(n, e, &subkey->midstate, view);
+    if(status != LIBSIGN_CERT_VALID) {
+        if(subkey->binding != LIBSIGN_CERT_VALID)
+            subkey->binding = status;
+        return status;
+    }
+
+    subkey->binding = status;
+    subkey->key_flags = 0;
+    subkey->expires = 0;
+    take_self_signature(view, subkey->created, &subkey->key_flags, &subkey->expires);
+
+    /* a subkey that signs has signed the same data back, so no one can claim
+       someone else's signing key as a subkey of theirs */
+    subkey->back_signature = LIBSIGN_CERT_UNCHECKED;
+    if(!view->embedded)
+        return status;
+
+    ret = signature_view_parse(&back, view->embedded, view->embedded_len);
+    if(ret < 0)
+        subkey->back_signature = ret == -ENOTSUP ? LIBSIGN_CERT_UNSUPPORTED
+                                                 : LIBSIGN_CERT_INVALID;
+    else if(back.type != PGP_SIG_PRIMARY_KEY_BINDING)
+        subkey->back_signature = LIBSIGN_CERT_INVALID;
+    else
+        subkey->back_signature = check_key_signature(subkey->n, subkey->e,
+                                                     &subkey->midstate, &back);
+
+    return status;
+}
+
+/* what a signature on the key is over, from the packets before it. returns
+   the index of the user ID or subkey, -1 for the primary key or a user ID
+   that is not kept, or -ENOENT if the signature is not kept. */
+static int certification_target(libsign_public_key *ctx, int type)
+{
+    switch(type) {
+    case PGP_SIG_GENERIC_CERT:
+    case PGP_SIG_PERSONA_CERT:
+    case PGP_SIG_CASUAL_CERT:
+    case PGP_SIG_POSITIVE_CERT:
+        if(ctx->last_tag == PGP_TAG_USERID)
+            return (ctx->profile & LIBSIGN_PARSE_USERIDS) ? ctx->num_userids - 1 : -1;
+        break;
+    case PGP_SIG_SUBKEY_BINDING:
+        if(ctx->last_tag == PGP_TAG_PUBLIC_SUBKEY && ctx->num_subkeys)
+            return ctx->num_subkeys - 1;
+        break;
+    case PGP_SIG_KEY_DIRECT:
+        if(ctx->last_tag == PGP_TAG_PUBLIC_KEY)
+            return -1;
+        break;
+    default:
+        break;
+    }
+
+    return -ENOENT;
+}
+
+/* keep a self-signature to be checked by verify_certifications(), along
+   with the back-signature of a binding. a back-signature that cannot be
+   parsed is known to be bad already. */
+static int keep_certification(libsign_public_key *ctx, const libsign_signature_view *view,
+                              int target)
+{
+    int ret;
+    libsign_certification *certs, *cert;
+    libsign_signature_view back;
+
+    certs = grow_array(ctx, ctx->certs, ctx->num_certs, sizeof(libsign_certification));
+    if(!certs)
+        return -ENOMEM;
+    ctx->certs = certs;
+
+    cert = &ctx->certs[ctx->num_certs];
+    if(ctx->arena) {
+        signature_init_arena(&cert->sig, ctx->arena);
+        signature_init_arena(&cert->back, ctx->arena);
+    }
+    else {
+        signature_init(&cert->sig);
+        signature_init(&cert->back);
+    }
+    cert->target = target;
+    cert->status = LIBSIGN_CERT_UNCHECKED;
+    cert->midstate = ctx->last_midstate;
+    cert->back_status = LIBSIGN_CERT_UNCHECKED;
+    ctx->num_certs++;
+    ctx->certs_checked = 0;
+
+    ret = signature_from_view(&cert->sig, view);
+    if(ret < 0 || view->type != PGP_SIG_SUBKEY_BINDING || !view->embedded)
+        return ret;
+
+    ret = signature_view_parse(&back, view->embedded, view->embedded_len);
+    if(ret < 0)
+        cert->back_status = ret == -ENOTSUP ? LIBSIGN_CERT_UNSUPPORTED : LIBSIGN_CERT_INVALID;
+    else if(back.type != PGP_SIG_PRIMARY_KEY_BINDING)
+        cert->back_status = LIBSIGN_CERT_INVALID;
+    else
+        return signature_from_view(&cert->back, &back);
+
+    return 0;
+}
+
+/* the signatures are only recorded here, the self-signatures whatever the
+   profile. verify_certifications() checks them and takes the key flags and
+   expiration times from those that check out. */
 int process_public_key_signature_packet(const uint8_t **data, uint32_t *datalen,
                                         libsign_public_key *ctx)
 {
-    /* TODO: parse this properly */
-    (void)ctx;
+    int ret, target, self;
+    libsign_signature_view view;
+
+    /* revocations, signatures over user attributes and the like are passed
+       over by their type, without looking at their subpackets */
+    if(*datalen > 1 && (*data)[0] == PGP_SIG_VER4 &&
+       certification_target(ctx, (*data)[1]) == -ENOENT)
+        goto exit;
+
+    ret = signature_view_parse(&view, *data, *datalen);
+    /* certifications by other keys may use anything */
+    if(ret < 0 && ret != -ENOTSUP)
+        return ret;
+
+    if(ret == 0) {
+        target = certification_target(ctx, view.type);
+        self = !view.issuer || view.issuer == ctx->key_id;
+
+        /* 11.1, each subkey is followed by its binding, made by the key */
+        if(target != -ENOENT && (self || ((ctx->profile & LIBSIGN_PARSE_CERTIFICATIONS) &&
+                                          view.type != PGP_SIG_SUBKEY_BINDING))) {
+            ret = keep_certification(ctx, &view, target);
+            if(ret < 0)
+                return ret;
+        }
+    }
+
+exit:
     *data += *datalen;
     *datalen = 0;
 
     return 0;
 }
 
+/* 5.5.1.2, a subkey packet has the format of a public key packet */
 int process_public_key_subkey_packet(const uint8_t **data, uint32_t *datalen,
                                      libsign_public_key *ctx)
 {
-    /* TODO: parse this properly */
-    (void)ctx;
+    int ret;
+    libsign_key_view view;
+    libsign_subkey *subkeys, *subkey;
+
+    /* subkeys of other algorithms are kept, so their bindings are not taken
+       for the subkey before them, but they have no key material */
+    ret = key_packet_view(&view, *data, *datalen);
+    if(ret < 0 && ret != -ENOTSUP)
+        return ret;
+
+    if(ctx->num_subkeys == UINT8_MAX)
+        return -EMSGSIZE;
+
+    subkeys = grow_array(ctx, ctx->subkeys, ctx->num_subkeys, sizeof(libsign_subkey));
+    if(!subkeys)
+        return -ENOMEM;
+    ctx->subkeys = subkeys;
+
+    subkey = &ctx->subkeys[ctx->num_subkeys];
+    memset(subkey, 0, sizeof(libsign_subkey));
+    subkey->version = view.version;
+    subkey->created = view.created;
+    subkey->pk_algo = view.pk_algo;
+
+    if(ctx->arena) {
+        mpz_roinit_n(subkey->n, NULL, 0);
+        mpz_roinit_n(subkey->e, NULL, 0);
+    }
+    else {
+        mpz_init(subkey->n);
+        mpz_init(subkey->e);
+    }
+    ctx->num_subkeys++;
+
+    if(ret == 0 && (ret = key_material_from_view(ctx->arena, &view, &subkey->n, &subkey->e)) < 0)
+        return ret;
+
+    ret = key_fingerprint(*data, *datalen, subkey->fingerprint, &subkey->key_id);
+    if(ret < 0)
+        return ret;
+
+    /* a binding hashes the primary key and then the subkey */
+    subkey->midstate = ctx->midstate;
+    hash_key_packet(&subkey->midstate, *data, *datalen);
+    ctx->last_midstate = subkey->midstate;
+
     *data += *datalen;
     *datalen = 0;
 
     return 0;
 }
 
+/* find the subkey issuer of the view and bind it as the parser would, from
+   the signatures that follow its packet */
+static int bind_view_subkey(libsign_key_view *view, libsign_key_id issuer)
+{
+    int ret, found = 0;
+    uint8_t fingerprint[PGP_FINGERPRINT_LEN];
+    libsign_key_id primary_id, key_id;
+    libsign_packet_iter iter;
+    libsign_packet packet;
+    libsign_signature_view sig;
+    libsign_key_view signer;
+    libsign_subkey subkey;
+    mpz_t n, e;
+
+    ret = key_fingerprint(view->body, view->body_len, fingerprint, &primary_id);
+    if(ret < 0)
+        return ret;
+
+    memset(&subkey, 0, sizeof(libsign_subkey));
+    mpz_init(subkey.n);
+    mpz_init(subkey.e);
+    mpz_init(n);
+    mpz_init(e);
+
+    packet_iter_init(&iter, view->packets, view->packets_len);
+    while((ret = packet_iter_next(&iter, &packet)) == 0) {
+        if(packet.tag == PGP_TAG_PUBLIC_SUBKEY) {
+            /* the signatures of the subkey end with the next one */
+            if(found)
+                break;
+            if(key_fingerprint(packet.body, packet.len, fingerprint, &key_id) < 0 ||
+               key_id != issuer)
+                continue;
+
+            found = 1;
+            if((ret = key_packet_view(&signer, packet.body, packet.len)) < 0 ||
+               (ret = key_material_from_view(NULL, view, &n, &e)) < 0 ||
+               (ret = key_material_from_view(NULL, &signer, &subkey.n, &subkey.e)) < 0)
+                goto exit;
+
+            subkey.created = signer.created;
+            sha1_init(&subkey.midstate);
+            hash_key_packet(&subkey.midstate, view->body, view->body_len);
+            hash_key_packet(&subkey.midstate, packet.body, packet.len);
+
+            view->subkey.body = packet.body;
+            view->subkey.len = packet.len;
+        }
+        else if(found && packet.tag == PGP_TAG_SIGNATURE &&
+                signature_view_parse(&sig, packet.body, packet.len) == 0 &&
+                sig.type == PGP_SIG_SUBKEY_BINDING && (!sig.issuer || sig.issuer == primary_id)) {
+            bind_subkey(n, e, &subkey, &sig);
+        }
+    }
+    if(ret < 0 && ret != -ENOENT)
+        goto exit;
+
+    ret = -ENOKEY;
+    if(found) {
+        view->subkey.key_id = issuer;
+        view->subkey.key_flags = subkey.key_flags;
+        view->subkey.expires = subkey.expires;
+        view->subkey.binding = subkey.binding;
+        view->subkey.back_signature = subkey.back_signature;
+        ret = 0;
+    }
+
+exit:
+    mpz_clear(subkey.n);
+    mpz_clear(subkey.e);
+    mpz_clear(n);
+    mpz_clear(e);
+
+    return ret;
+}
+
+int key_view_signer(libsign_key_view *view, libsign_key_id issuer,
+                    libsign_timestamp created, libsign_key_view *signer)
+{
+    int ret;
+    uint8_t fingerprint[PGP_FINGERPRINT_LEN];
+    libsign_key_id primary_id;
+    libsign_subkey subkey;
+
+    ret = key_fingerprint(view->body, view->body_len, fingerprint, &primary_id);
+    if(ret < 0)
+        return ret;
+
+    if(!issuer || issuer == primary_id) {
+        *signer = *view;
+        return 0;
+    }
+
+    /* the RSA checks of the binding are made the first time only */
+    if(view->subkey.key_id != issuer) {
+        view->subkey.key_id = 0;
+        ret = bind_view_subkey(view, issuer);
+        if(ret < 0)
+            return ret;
+    }
+
+    memset(signer, 0, sizeof(libsign_key_view));
+    ret = key_packet_view(signer, view->subkey.body, view->subkey.len);
+    if(ret < 0)
+        return ret;
+
+    memset(&subkey, 0, sizeof(libsign_subkey));
+    subkey.key_flags = view->subkey.key_flags;
+    subkey.expires = view->subkey.expires;
+    subkey.binding = view->subkey.binding;
+    subkey.back_signature = view->subkey.back_signature;
+
+    return public_key_subkey_signs(&subkey, created);
+}
+
 int decode_public_key_armor(const uint8_t *data, uint32_t datalen, uint8_t **plain_out,
                             uint32_t *plain_len)
 {
-    /* (6.2) for public keys, the armor header line shall be
-       "-----BEGIN PGP PUBLIC KEY BLOCK-----" */
-    if(datalen < 36)
-        goto error;
+    int ret;
 
-    if(strncmp((char*)data, "-----BEGIN PGP PUBLIC KEY BLOCK-----", 36) != 0)
-        goto error;
+    ret = check_public_key_armor(data, datalen);
+    if(ret < 0)
+        return ret;
 
     return decode_armor(data, datalen, plain_out, plain_len);
+}
+
+/* 5.5.2, a v4 RSA public key or subkey packet */
+static int write_key_packet(int tag, libsign_timestamp created, mpz_t *n, mpz_t *e,
+                            libsign_write_fn write, void *opaque)
+{
+    int ret;
+    uint8_t header[PACKET_HEADER_MAX], key[6];
+    uint32_t header_len;
+
+    key[0] = PGP_KEY_VER4;
+    key[1] = created >> 24;
+    key[2] = created >> 16;
+    key[3] = created >> 8;
+    key[4] = created;
+    key[5] = PGP_RSA;
+
+    header_len = packet_write_header(header, tag, sizeof(key) + mpi_size(n) + mpi_size(e));
+
+    if((ret = write(opaque, header, header_len)) < 0 ||
+       (ret = write(opaque, key, sizeof(key))) < 0 ||
+       (ret = mpz_to_mpi(n, write, opaque)) < 0 ||
+       (ret = mpz_to_mpi(e, write, opaque)) < 0)
+        return ret;
+
+    return 0;
+}
+
+/* the certifications kept over the key (PGP_TAG_PUBLIC_KEY), a user ID or a
+   subkey, by their index. those the writer has no format for are left
+   out. */
+static int write_certifications(libsign_public_key *pub, int over, int target,
+                                libsign_write_fn write, void *opaque)
+{
+    int ret;
+    uint32_t i;
+
+    for(i = 0; i < pub->num_certs; i++) {
+        libsign_certification *cert = &pub->certs[i];
+        int tag;
+
+        switch(cert->sig.type) {
+        case PGP_SIG_KEY_DIRECT:
+            tag = PGP_TAG_PUBLIC_KEY;
+            break;
+        case PGP_SIG_SUBKEY_BINDING:
+            tag = PGP_TAG_PUBLIC_SUBKEY;
+            break;
+        default:
+            tag = PGP_TAG_USERID;
+            break;
+        }
+        if(tag != over || cert->target != target || cert->sig.pk_algo != PGP_RSA)
+            continue;
+
+        if(tag == PGP_TAG_PUBLIC_SUBKEY)
+            ret = signature_write_binding(&cert->sig,
+                                          cert->back.type == PGP_SIG_PRIMARY_KEY_BINDING ?
+                                          &cert->back : NULL, write, opaque);
+        else
+            ret = signature_write(&cert->sig, write, opaque);
+        if(ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* 11.1, the public key packet (5.5.2) with its direct key signatures, each
+   user ID (5.11) followed by its certifications and each subkey by its
+   bindings. subkeys of other algorithms have no key material to write and
+   are left out along with their bindings, as are the certifications of
+   user IDs that were not parsed. */
+int public_key_write(libsign_public_key *pub, libsign_write_fn write, void *opaque)
+{
+    int ret, i;
+    uint8_t header[PACKET_HEADER_MAX];
+    uint32_t header_len;
+
+    if(pub->version != PGP_KEY_VER4 || pub->pk_algo != PGP_RSA)
+        return -ENOTSUP;
+
+    if((ret = write_key_packet(PGP_TAG_PUBLIC_KEY, pub->created, &pub->n, &pub->e,
+                               write, opaque)) < 0 ||
+       (ret = write_certifications(pub, PGP_TAG_PUBLIC_KEY, -1, write, opaque)) < 0)
+        return ret;
+
+    for(i = 0; i < pub->num_userids; i++) {
+        libsign_userid *uid = &pub->userids[i];
+
+        header_len = packet_write_header(header, PGP_TAG_USERID, uid->len);
+        if((ret = write(opaque, header, header_len)) < 0 ||
+           (ret = write(opaque, (const uint8_t*)uid->userid, uid->len)) < 0 ||
+           (ret = write_certifications(pub, PGP_TAG_USERID, i, write, opaque)) < 0)
+            return ret;
+    }
+
+    for(i = 0; i < pub->num_subkeys; i++) {
+        libsign_subkey *subkey = &pub->subkeys[i];
+
+        if(subkey->version != PGP_KEY_VER4 || subkey->pk_algo != PGP_RSA)
+            continue;
+
+        if((ret = write_key_packet(PGP_TAG_PUBLIC_SUBKEY, subkey->created, &subkey->n,
+                                   &subkey->e, write, opaque)) < 0 ||
+           (ret = write_certifications(pub, PGP_TAG_PUBLIC_SUBKEY, i, write, opaque)) < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int public_key_write_armor(libsign_public_key *pub, uint32_t line_width,
+                           libsign_write_fn write, void *opaque)
+{
+    int ret;
+    libsign_armor_encoder enc;
+
+    ret = armor_encoder_init(&enc, ARMOR_PUBLIC_KEY_BLOCK, line_width, write, opaque);
+    if(ret < 0)
+        return ret;
+
+    ret = public_key_write(pub, armor_encoder_write, &enc);
+    if(ret < 0)
+        return ret;
 
-error:
-    return -EINVAL;
+    return armor_encoder_finish(&enc);
 }
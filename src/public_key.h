@@ -4,30 +4,182 @@
 #include <stdint.h>
 #include <gmp.h>
 
+#include "arena.h"
 #include "pgp.h"
+#include "sha1.h"
+#include "signature.h"
+#include "stream.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct libsign_userid {
+    /* NUL terminated, but may contain NULs of its own */
     char *userid;
+    uint32_t len;
 } libsign_userid;
 
+/* What is parsed into a key besides its key material and that of its
+   subkeys. The self-signatures are kept by every profile, as their key
+   flags and expiration times decide what may sign, but nothing is checked
+   as the key is parsed, see verify_certifications(). Of the subpackets only
+   those a self-signature needs are looked at. Packets that are not wanted
+   are passed over by their length, and signatures of types that are not
+   kept by their type. */
+enum libsign_parse_profile {
+    LIBSIGN_PARSE_KEYS              = 0x00,
+    LIBSIGN_PARSE_USERIDS           = 0x01,
+    /* the certifications made by other keys are kept as well */
+    LIBSIGN_PARSE_CERTIFICATIONS    = 0x02,
+    LIBSIGN_PARSE_ALL               = 0x03
+};
+
+enum libsign_cert_status {
+    LIBSIGN_CERT_UNCHECKED = 0,
+    LIBSIGN_CERT_VALID,
+    LIBSIGN_CERT_INVALID,
+    /* an algorithm there is no engine for */
+    LIBSIGN_CERT_UNSUPPORTED
+};
+
+/* A certification (0x10 - 0x13), subkey binding (0x18) or direct key
+   signature (0x1f). Those made by the key itself are kept by every profile,
+   those made by other keys only when certifications are parsed, and are
+   never checked. Nothing is checked before verify_certifications(). */
+typedef struct libsign_certification {
+    libsign_signature sig;
+    /* the user ID or subkey signed, -1 for the primary key alone or a user
+       ID that is not kept */
+    int target;
+    enum libsign_cert_status status;
+    /* the key and the user ID or subkey hashed as for the signature (5.2.4) */
+    sha1_ctx midstate;
+
+    /* the back-signature (0x19) embedded in a binding (5.2.1), its type is
+       PGP_SIG_PRIMARY_KEY_BINDING if there is one */
+    libsign_signature back;
+    enum libsign_cert_status back_status;
+} libsign_certification;
+
+/* 5.5.1.2 */
+typedef struct libsign_subkey {
+    enum pgp_key_version version;
+    libsign_timestamp created;
+    enum pgp_public_key_algorithm pk_algo;
+
+    libsign_key_id key_id;
+    uint8_t fingerprint[PGP_FINGERPRINT_LEN];
+    /* from the newest binding verify_certifications() found valid, 0 until
+       then or if it had none */
+    uint8_t key_flags;
+    /* 0 if the subkey does not expire. it does not sign from then on. */
+    libsign_timestamp expires;
+    /* when the binding the flags come from was made */
+    libsign_timestamp bound;
+
+    mpz_t n;
+    mpz_t e;
+
+    /* the primary key and the subkey hashed as for a binding */
+    sha1_ctx midstate;
+
+    /* 5.2.1, the primary key's binding (0x18) and the back-signature by the
+       subkey embedded in it (0x19), as verify_certifications() found them. a
+       subkey only signs for the primary key when both are valid. */
+    enum libsign_cert_status binding;
+    enum libsign_cert_status back_signature;
+} libsign_subkey;
+
 typedef struct libsign_public_key {
     enum pgp_key_version version;
     libsign_timestamp created;
     enum pgp_public_key_algorithm pk_algo;
 
+    /* the fingerprint is only computed for v4 keys (12.2) */
+    libsign_key_id key_id;
+    uint8_t fingerprint[PGP_FINGERPRINT_LEN];
+    /* from the newest self-signature verify_certifications() found valid, 0
+       until then or if it had none */
+    uint8_t key_flags;
+    /* 0 if the key does not expire, as above. neither it nor its subkeys
+       sign from then on. */
+    libsign_timestamp expires;
+
+    /* what was parsed into the key, from enum libsign_parse_profile */
+    unsigned int profile;
+
     uint8_t num_userids;
     libsign_userid *userids;
 
+    uint8_t num_subkeys;
+    libsign_subkey *subkeys;
+
+    uint32_t num_certs;
+    libsign_certification *certs;
+    /* set by verify_certifications(), cleared when another certification is
+       parsed */
+    int certs_checked;
+    /* the primary key hashed as for a signature over it */
+    sha1_ctx midstate;
+    /* the last key, user ID or user attribute packet, what the signatures
+       that follow are over, and the key and that packet hashed for them */
+    int last_tag;
+    sha1_ctx last_midstate;
+
     /* TODO: should be placed in an RSA-specific struct */
     mpz_t n;
     mpz_t e;
+
+    /* where everything parsed is allocated from, if not the heap */
+    libsign_arena *arena;
 } libsign_public_key;
 
+/* a subkey of a view as key_view_signer() bound it, the packet body is in
+   the view's buffer */
+typedef struct libsign_view_subkey {
+    libsign_key_id key_id;
+    const uint8_t *body;
+    uint32_t len;
+
+    uint8_t key_flags;
+    libsign_timestamp expires;
+    enum libsign_cert_status binding;
+    enum libsign_cert_status back_signature;
+} libsign_view_subkey;
+
+/* A key borrowed from the buffer it was parsed from. Nothing is copied and
+   the MPIs are only imported when a verification needs them. */
+typedef struct libsign_key_view {
+    enum pgp_key_version version;
+    libsign_timestamp created;
+    enum pgp_public_key_algorithm pk_algo;
+
+    /* the public key packet body */
+    const uint8_t *body;
+    uint32_t body_len;
+
+    /* the RSA MPIs, length headers included */
+    const uint8_t *n;
+    uint32_t n_len;
+    const uint8_t *e;
+    uint32_t e_len;
+
+    /* the packets following the public key packet (user IDs, signatures,
+       subkeys), the next key in a keyring starts right after them */
+    const uint8_t *packets;
+    uint32_t packets_len;
+    uint32_t num_userids;
+
+    /* the subkey last asked for by key_view_signer(), so its binding is only
+       checked once per view. a key_id of 0 if there is none. */
+    libsign_view_subkey subkey;
+} libsign_key_view;
+
 void public_key_init(libsign_public_key *pub);
+/* allocate everything parsed into the key from the arena. destroying the
+   key is a no-op, the memory is released with the arena. */
+void public_key_init_arena(libsign_public_key *pub, libsign_arena *arena);
 void public_key_destroy(libsign_public_key *pub);
 
 int parse_public_key(libsign_public_key *pub, const char *filename);
@@ -35,6 +187,23 @@ int parse_public_key_buffer(libsign_public_key *pub, const uint8_t *buffer,
                             uint32_t datalen);
 int parse_public_key_armor_buffer(libsign_public_key *pub, const uint8_t *buffer,
                                   uint32_t datalen);
+/* decode the armor over itself and parse it, buffer is clobbered */
+int parse_public_key_armor_inplace(libsign_public_key *pub, uint8_t *buffer, uint32_t datalen);
+
+/* as above, parsing only what the profile asks for. the functions without a
+   profile parse everything (LIBSIGN_PARSE_ALL). */
+int parse_public_key_profile(libsign_public_key *pub, const char *filename,
+                             unsigned int profile);
+int parse_public_key_buffer_profile(libsign_public_key *pub, const uint8_t *buffer,
+                                    uint32_t datalen, unsigned int profile);
+int parse_public_key_armor_buffer_profile(libsign_public_key *pub, const uint8_t *buffer,
+                                          uint32_t datalen, unsigned int profile);
+int parse_public_key_armor_inplace_profile(libsign_public_key *pub, uint8_t *buffer,
+                                           uint32_t datalen, unsigned int profile);
+
+/* a libsign_packet_fn parsing the packets of a key into the key opaque
+   points to */
+int public_key_packet(void *opaque, int tag, const uint8_t *body, uint32_t len);
 
 int process_public_key_packet(const uint8_t **data, uint32_t *datalen,
                               libsign_public_key *ctx);
@@ -45,6 +214,42 @@ int process_public_key_signature_packet(const uint8_t **data, uint32_t *datalen,
 int process_public_key_subkey_packet(const uint8_t **data, uint32_t *datalen,
                                      libsign_public_key *ctx);
 
+/* parse the first key in a buffer of packets */
+int parse_key_view(libsign_key_view *view, const uint8_t *buffer, uint32_t datalen);
+/* find the user ID packet body of the index'th user ID */
+int key_view_userid(const libsign_key_view *view, uint32_t index, const uint8_t **userid,
+                    uint32_t *len);
+/* the key of the view that made a signature at created, named by its issuer
+   (5.2.3.5) as verify() does: the primary key, or a subkey only if its
+   binding checks out and lets it sign. the subkey packet is put in signer as
+   a view of its own. -ENOKEY if no key has that key ID, -EKEYREJECTED or
+   -EKEYEXPIRED if the subkey may not sign. the subkey's binding is kept in
+   view, a view shared between threads must not be asked for a subkey. */
+int key_view_signer(libsign_key_view *view, libsign_key_id issuer,
+                    libsign_timestamp created, libsign_key_view *signer);
+/* import the key material of a view into a key */
+int public_key_from_view(libsign_public_key *pub, const libsign_key_view *view);
+
+/* 12.2, the fingerprint and key ID of a key packet body. v3 keys only have
+   a key ID, their fingerprint is left zeroed. */
+int key_fingerprint(const uint8_t *body, uint32_t len, uint8_t fingerprint[PGP_FINGERPRINT_LEN],
+                    libsign_key_id *key_id);
+/* the subkey with the given key ID, or NULL */
+libsign_subkey *public_key_subkey(libsign_public_key *pub, libsign_key_id key_id);
+/* 0 if the subkey may sign for the primary key at the given time: its binding
+   and the back-signature in it checked out (5.2.1), the binding allows
+   signing and the subkey had not expired. -EKEYREJECTED or -EKEYEXPIRED
+   otherwise. */
+int public_key_subkey_signs(const libsign_subkey *subkey, libsign_timestamp created);
+/* 5.2.3.6, when a key made at created expires after expiration seconds, 0
+   for a key that does not. a time past 2106 is held at UINT32_MAX. */
+libsign_timestamp public_key_expires(libsign_timestamp created, uint32_t expiration);
+
+/* serialize the key, as binary packets or armored */
+int public_key_write(libsign_public_key *pub, libsign_write_fn write, void *opaque);
+int public_key_write_armor(libsign_public_key *pub, uint32_t line_width,
+                           libsign_write_fn write, void *opaque);
+
 int decode_public_key_armor(const uint8_t *data, uint32_t datalen, uint8_t **plain_out,
                             uint32_t *plain_len);
 
@@ -1,7 +1,9 @@
 #include "rsa.h"
+#include "probes.h"
+#include "stats.h"
 
 #include <errno.h>
-#include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const uint8_t rsa_pkcs1_sha1_prefix[] = {
@@ -27,7 +29,7 @@ int rsa_public_key_prepare(rsa_public_key *key)
     key->size = ((mpz_sizeinbase(key->n, 2) + 7) / 8);
 
     /* for simplicity, don't support keys below 512 bit */
-    if(key->size > 64)
+    if(key->size < 64)
         return -EMSGSIZE;
 
     return 0;
@@ -41,22 +43,19 @@ void rsa_public_key_clear(rsa_public_key *key)
     key->size = 0;
 }
 
-int rsa_sha1_verify(rsa_public_key *key, sha1_ctx *hash, mpz_t signature)
+/* EMSA-PKCS1-v1_5 (RFC 3447, 9.2): 0x00, 0x01, 0xff ... 0xff, 0x00, id, hash */
+static int pkcs1_sha1_em(uint8_t *em, size_t size, const uint8_t *digest)
 {
-    int ret = -EBADMSG, id_idx;
-    uint8_t *prefix, *p;
-    mpz_t msg, expected;
-
-    mpz_init(msg);
+    int id_idx;
+    uint8_t *p;
 
-    /* add PKCS#1 prefix to hash, consists of 0x00, 0x01, 0xff ... 0xff, 0x00, id, hash */
-    prefix = malloc(key->size);
-    if(!prefix)
-        goto exit;
+    /* at least eight octets of padding */
+    if(size < 11 + sizeof(rsa_pkcs1_sha1_prefix) + SHA1_DIGEST_LENGTH)
+        return -EMSGSIZE;
 
-    id_idx = key->size - SHA1_DIGEST_LENGTH - sizeof(rsa_pkcs1_sha1_prefix);
+    id_idx = size - SHA1_DIGEST_LENGTH - sizeof(rsa_pkcs1_sha1_prefix);
 
-    p = prefix;
+    p = em;
     *p++ = 0;
     *p++ = 1;
     memset(p, 0xff, id_idx - 3);
@@ -66,20 +65,224 @@ int rsa_sha1_verify(rsa_public_key *key, sha1_ctx *hash, mpz_t signature)
     memcpy(p, rsa_pkcs1_sha1_prefix, sizeof(rsa_pkcs1_sha1_prefix));
     p += sizeof(rsa_pkcs1_sha1_prefix);
 
-    sha1_digest(hash, p);
-    mpz_import(msg, key->size, 1, 1, 0, 0, prefix);
+    memcpy(p, digest, SHA1_DIGEST_LENGTH);
+
+    return 0;
+}
+
+static int pkcs1_sha1_encode(mpz_t msg, size_t size, const uint8_t *digest)
+{
+    int ret;
+    uint8_t *em;
+
+    em = malloc(size);
+    if(!em)
+        return -ENOMEM;
+
+    ret = pkcs1_sha1_em(em, size, digest);
+    if(ret == 0)
+        mpz_import(msg, size, 1, 1, 0, 0, em);
+
+    free(em);
+
+    return ret;
+}
+
+/* the data and the signature suffix, for the probes */
+static inline uint64_t hashed_octets(const sha1_ctx *hash)
+{
+    return (((uint64_t)hash->count[1] << 32) | hash->count[0]) >> 3;
+}
+
+int rsa_sha1_verify(rsa_public_key *key, sha1_ctx *hash, mpz_t signature)
+{
+    int ret;
+    uint8_t digest[SHA1_DIGEST_LENGTH];
+    mpz_t msg, expected;
+    LIBSIGN_STAT_BEGIN(start);
+
+    LIBSIGN_PROBE2(rsa_sha1_verify__entry, key->size, hashed_octets(hash));
+
+    mpz_init(msg);
+
+    sha1_digest(hash, digest);
+    /* -ENOMEM or a key too small for the encoding, not a bad signature */
+    ret = pkcs1_sha1_encode(msg, key->size, digest);
+    if(ret < 0)
+        goto exit;
+    /* the encoded message went through the heap */
+    LIBSIGN_STAT_ALLOC(LIBSIGN_STAT_RSA_SHA1_VERIFY);
 
     mpz_init(expected);
 
     mpz_powm(expected, signature, key->e, key->n);
 
-    ret = mpz_cmp(msg, expected);
+    ret = mpz_cmp(msg, expected) == 0 ? 0 : -EBADMSG;
 
     mpz_clear(expected);
 
 exit:
     mpz_clear(msg);
-    free(prefix);
+
+    LIBSIGN_STAT_END(LIBSIGN_STAT_RSA_SHA1_VERIFY, start, key->size);
+    LIBSIGN_PROBE1(rsa_sha1_verify__return, ret);
+
+    return ret;
+}
+
+static int verify_scratch(const rsa_public_key *key, sha1_ctx *hash, mpz_srcptr signature,
+                          libsign_scratch *scratch)
+{
+    int ret;
+    uint8_t digest[SHA1_DIGEST_LENGTH];
+
+    sha1_digest(hash, digest);
+
+    /* s must be a representative below n (8.2.2) */
+    if(mpz_sgn(signature) <= 0 || mpz_cmp(signature, key->n) >= 0 || mpz_sgn(key->e) <= 0)
+        return -EBADMSG;
+
+    /* only a key larger than any before it allocates */
+    ret = scratch_reserve(scratch, mpz_sizeinbase(key->n, 2));
+    if(ret < 0)
+        return ret;
+
+    ret = pkcs1_sha1_em(scratch->em, key->size, digest);
+    if(ret < 0)
+        return ret;
+    mpz_import(scratch->msg, key->size, 1, 1, 0, 0, scratch->em);
+
+    mpz_powm(scratch->result, signature, key->e, key->n);
+
+    return mpz_cmp(scratch->result, scratch->msg) == 0 ? 0 : -EBADMSG;
+}
+
+int rsa_sha1_verify_scratch(const rsa_public_key *key, sha1_ctx *hash, mpz_srcptr signature,
+                            libsign_scratch *scratch)
+{
+    int ret;
+    LIBSIGN_STAT_BEGIN(start);
+
+    LIBSIGN_PROBE2(rsa_sha1_verify__entry, key->size, hashed_octets(hash));
+
+    ret = verify_scratch(key, hash, signature, scratch);
+
+    LIBSIGN_STAT_END(LIBSIGN_STAT_RSA_SHA1_VERIFY, start, key->size);
+    LIBSIGN_PROBE1(rsa_sha1_verify__return, ret);
+
+    return ret;
+}
+
+void rsa_private_key_init(rsa_private_key *key)
+{
+    mpz_init(key->d);
+    mpz_init(key->p);
+    mpz_init(key->q);
+    mpz_init(key->dp);
+    mpz_init(key->dq);
+    mpz_init(key->qinv);
+
+    key->size = 0;
+}
+
+int rsa_private_key_prepare(rsa_private_key *key)
+{
+    int ret = 0;
+    mpz_t t;
+
+    mpz_init(t);
+
+    /* the primes must be odd for mpz_powm_sec */
+    if(mpz_cmp_ui(key->p, 3) < 0 || mpz_cmp_ui(key->q, 3) < 0 ||
+       mpz_even_p(key->p) || mpz_even_p(key->q)) {
+        ret = -EINVAL;
+        goto exit;
+    }
+
+    mpz_sub_ui(t, key->p, 1);
+    mpz_fdiv_r(key->dp, key->d, t);
+    mpz_sub_ui(t, key->q, 1);
+    mpz_fdiv_r(key->dq, key->d, t);
+
+    if(!mpz_invert(key->qinv, key->q, key->p)) {
+        ret = -EINVAL;
+        goto exit;
+    }
+
+    mpz_mul(t, key->p, key->q);
+    key->size = (mpz_sizeinbase(t, 2) + 7) / 8;
+
+exit:
+    mpz_clear(t);
+
+    return ret;
+}
+
+/* overwrite the limbs before they go back to the allocator. the whole
+   allocation is cleared, a value that shrank leaves its old limbs above
+   its size */
+static void wipe(mpz_t x)
+{
+    size_t size = x->_mp_alloc;
+
+    if(size)
+        memset(mpz_limbs_modify(x, size), 0, size * sizeof(mp_limb_t));
+    mpz_clear(x);
+}
+
+void rsa_private_key_clear(rsa_private_key *key)
+{
+    wipe(key->d);
+    wipe(key->p);
+    wipe(key->q);
+    wipe(key->dp);
+    wipe(key->dq);
+    wipe(key->qinv);
+
+    key->size = 0;
+}
+
+int rsa_sha1_sign_digest(const rsa_public_key *pub, const rsa_private_key *key,
+                         const uint8_t *digest, mpz_t signature)
+{
+    int ret;
+    mpz_t msg, m1, m2, h;
+
+    mpz_init(msg);
+    mpz_init(m1);
+    mpz_init(m2);
+    mpz_init(h);
+
+    ret = pkcs1_sha1_encode(msg, key->size, digest);
+    if(ret < 0)
+        goto exit;
+
+    /* two exponentiations of half the size instead of one with d */
+    mpz_fdiv_r(h, msg, key->p);
+    mpz_powm_sec(m1, h, key->dp, key->p);
+    mpz_fdiv_r(h, msg, key->q);
+    mpz_powm_sec(m2, h, key->dq, key->q);
+
+    /* h = qinv * (m1 - m2) mod p, s = m2 + h * q */
+    mpz_sub(h, m1, m2);
+    mpz_mul(h, h, key->qinv);
+    mpz_fdiv_r(h, h, key->p);
+    mpz_mul(signature, h, key->q);
+    mpz_add(signature, signature, m2);
+
+    /* a fault in either half gives a factor of n away, so the signature is
+       checked before it is let out */
+    mpz_powm(h, signature, pub->e, pub->n);
+    if(mpz_cmp(h, msg) != 0) {
+        mpz_set_ui(signature, 0);
+        ret = -EFAULT;
+    }
+
+exit:
+    wipe(msg);
+    wipe(m1);
+    wipe(m2);
+    wipe(h);
 
     return ret;
 }
@@ -7,6 +7,7 @@
 
 #include <gmp.h>
 
+#include "scratch.h"
 #include "sha1.h"
 
 #ifdef __cplusplus
@@ -24,10 +25,38 @@ typedef struct rsa_public_key {
     mpz_t e;
 } rsa_public_key;
 
+typedef struct rsa_private_key {
+    /* Size of the modulo in octets */
+    size_t size;
+    /* Private exponent and the primes, p * q = n */
+    mpz_t d;
+    mpz_t p;
+    mpz_t q;
+    /* d mod (p - 1), d mod (q - 1) and q^-1 mod p, to sign with the
+       Chinese remainder theorem */
+    mpz_t dp;
+    mpz_t dq;
+    mpz_t qinv;
+} rsa_private_key;
+
 void rsa_public_key_init(rsa_public_key *key);
 int  rsa_public_key_prepare(rsa_public_key *key);
 void rsa_public_key_clear(rsa_public_key *key);
+/* 0 or -EBADMSG */
 int  rsa_sha1_verify(rsa_public_key *key, sha1_ctx *hash, mpz_t signature);
+/* as above, in the buffers of the scratch instead of allocating. the key
+   must have been prepared. 0 or -EBADMSG. */
+int  rsa_sha1_verify_scratch(const rsa_public_key *key, sha1_ctx *hash, mpz_srcptr signature,
+                             libsign_scratch *scratch);
+
+void rsa_private_key_init(rsa_private_key *key);
+/* compute the size and the CRT parameters from d, p and q */
+int  rsa_private_key_prepare(rsa_private_key *key);
+void rsa_private_key_clear(rsa_private_key *key);
+/* sign a SHA-1 digest, the result is checked with the public key before
+   it is returned */
+int  rsa_sha1_sign_digest(const rsa_public_key *pub, const rsa_private_key *key,
+                          const uint8_t *digest, mpz_t signature);
 
 #ifdef __cplusplus
 }
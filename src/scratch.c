@@ -0,0 +1,85 @@
+#include "scratch.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+void scratch_init(libsign_scratch *scratch)
+{
+    memset(scratch, 0, sizeof(libsign_scratch));
+}
+
+void scratch_destroy(libsign_scratch *scratch)
+{
+    free(scratch->em);
+    if(scratch->limbs) {
+        mpz_clear(scratch->msg);
+        mpz_clear(scratch->result);
+    }
+    scratch_init(scratch);
+}
+
+int scratch_reserve(libsign_scratch *scratch, mp_bitcnt_t modulus_bits)
+{
+    mp_size_t limbs;
+    uint8_t *em;
+
+    limbs = (modulus_bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    if(limbs <= scratch->limbs)
+        return 0;
+
+    em = malloc(limbs * sizeof(mp_limb_t));
+    if(!em)
+        return -ENOMEM;
+    free(scratch->em);
+    scratch->em = em;
+
+    /* mpz_powm() and mpz_import() only allocate when their result has
+       fewer limbs than n, the temporaries of mpz_powm() are on the stack */
+    if(!scratch->limbs) {
+        mpz_init2(scratch->msg, limbs * GMP_NUMB_BITS);
+        mpz_init2(scratch->result, limbs * GMP_NUMB_BITS);
+    } else {
+        mpz_realloc2(scratch->msg, limbs * GMP_NUMB_BITS);
+        mpz_realloc2(scratch->result, limbs * GMP_NUMB_BITS);
+    }
+    LIBSIGN_STAT_ALLOC(LIBSIGN_STAT_RSA_SHA1_VERIFY);
+    LIBSIGN_STAT_ALLOC(LIBSIGN_STAT_RSA_SHA1_VERIFY);
+    LIBSIGN_STAT_ALLOC(LIBSIGN_STAT_RSA_SHA1_VERIFY);
+
+    scratch->limbs = limbs;
+
+    return 0;
+}
+
+int scratch_reserve_key(libsign_scratch *scratch, const libsign_public_key *pub)
+{
+    int ret;
+    uint8_t i;
+
+    ret = scratch_reserve(scratch, mpz_sizeinbase(pub->n, 2));
+
+    for(i = 0; i < pub->num_subkeys && ret == 0; i++)
+        ret = scratch_reserve(scratch, mpz_sizeinbase(pub->subkeys[i].n, 2));
+
+    return ret;
+}
+
+int scratch_reserve_keystore(libsign_scratch *scratch, const libsign_keystore *ks)
+{
+    int ret;
+    uint32_t i;
+
+    /* the subkeys have their own slots, only look at the primary keys */
+    for(i = 0; i < ks->num_slots; i++) {
+        if(!ks->slots[i].key_id || ks->slots[i].subkey)
+            continue;
+
+        ret = scratch_reserve_key(scratch, ks->slots[i].pub);
+        if(ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef __LIBSIGN_SCRATCH_H
+#define __LIBSIGN_SCRATCH_H
+
+#include <stdint.h>
+
+#include <gmp.h>
+
+#include "keystore.h"
+#include "public_key.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Buffers for the RSA operation of a verification, so a thread that keeps
+   one does not go to the allocator for every signature. They are sized
+   for the largest modulus seen so far, a key that needs more grows them
+   once. A scratch must only be used by one thread at a time. */
+typedef struct libsign_scratch {
+    /* limbs of the largest modulus, 0 until the integers are initialized */
+    mp_size_t limbs;
+
+    /* the encoded message (RFC 3447, 9.2), as octets and as an integer */
+    uint8_t *em;
+    mpz_t msg;
+    /* s^e mod n */
+    mpz_t result;
+} libsign_scratch;
+
+void scratch_init(libsign_scratch *scratch);
+void scratch_destroy(libsign_scratch *scratch);
+
+/* make room for a modulus of the given size in bits */
+int scratch_reserve(libsign_scratch *scratch, mp_bitcnt_t modulus_bits);
+/* for the key and all of its subkeys */
+int scratch_reserve_key(libsign_scratch *scratch, const libsign_public_key *pub);
+/* for every key in the keystore */
+int scratch_reserve_keystore(libsign_scratch *scratch, const libsign_keystore *ks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_SCRATCH_H */
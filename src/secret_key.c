@@ -0,0 +1,351 @@
+#include "secret_key.h"
+#include "mpi.h"
+#include "packet.h"
+#include "stream.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+static void part_init(libsign_secret_part *part)
+{
+    memset(part, 0, sizeof(libsign_secret_part));
+    rsa_public_key_init(&part->pub);
+    rsa_private_key_init(&part->key);
+}
+
+static void part_clear(libsign_secret_part *part)
+{
+    rsa_public_key_clear(&part->pub);
+    rsa_private_key_clear(&part->key);
+}
+
+void secret_key_init(libsign_secret_key *sec)
+{
+    memset(sec, 0, sizeof(libsign_secret_key));
+    public_key_init(&sec->pub);
+    part_init(&sec->primary);
+}
+
+void secret_key_destroy(libsign_secret_key *sec)
+{
+    int i;
+
+    public_key_destroy(&sec->pub);
+    part_clear(&sec->primary);
+
+    for(i = 0; i < sec->num_subkeys; i++)
+        part_clear(&sec->subkeys[i]);
+
+    free(sec->subkeys);
+}
+
+/* 5.5.2, the length of the public key at the start of a secret key packet */
+static int public_part_len(const uint8_t *body, uint32_t len, uint32_t *public_len)
+{
+    int ret, num_mpis, i;
+    const uint8_t *p = body, *mpi;
+    uint32_t mpi_len;
+
+    if(len < 6)
+        return -EINVAL;
+
+    /* v3 keys encrypt their MPIs differently */
+    if(body[0] != PGP_KEY_VER4)
+        return -ENOTSUP;
+
+    switch(body[5]) {
+    case PGP_RSA:
+    case PGP_RSA_ENCRYPT_ONLY:
+    case PGP_RSA_SIGN_ONLY:
+        num_mpis = 2;
+        break;
+    case PGP_ELGAMAL_ENCRYPT_ONLY:
+        num_mpis = 3;
+        break;
+    case PGP_DSA:
+        num_mpis = 4;
+        break;
+    default:
+        return -ENOTSUP;
+    }
+
+    p += 6;
+    len -= 6;
+    for(i = 0; i < num_mpis; i++) {
+        if((ret = mpi_view(&p, &len, &mpi, &mpi_len)) < 0)
+            return ret;
+    }
+
+    *public_len = p - body;
+
+    return 0;
+}
+
+/* 5.5.3, what follows the public key in a secret key packet */
+static int secret_part(libsign_secret_part *part, const uint8_t *p, uint32_t len,
+                       mpz_srcptr n, mpz_srcptr e)
+{
+    int ret;
+    const uint8_t *start, *u;
+    uint32_t u_len;
+    uint16_t checksum = 0;
+    mpz_t pq;
+
+    if(len < 1)
+        return -EINVAL;
+
+    /* a string-to-key usage other than 0 is a key protected by a passphrase,
+       or a stub without the secret */
+    if(*p++ != 0 || !PGP_RSA_SIGNS(part->pk_algo))
+        return 0;
+    len--;
+
+    /* d, p, q and u, which is p^-1 mod q and not needed */
+    start = p;
+    if((ret = mpi_to_mpz(&p, &len, &part->key.d)) < 0 ||
+       (ret = mpi_to_mpz(&p, &len, &part->key.p)) < 0 ||
+       (ret = mpi_to_mpz(&p, &len, &part->key.q)) < 0 ||
+       (ret = mpi_view(&p, &len, &u, &u_len)) < 0)
+        return ret;
+
+    /* the sum of the octets of the MPIs, mod 65536 */
+    if(len < 2)
+        return -EINVAL;
+    while(start < p)
+        checksum += *start++;
+    if(checksum != ((p[0] << 8) | p[1]))
+        return -EBADMSG;
+
+    mpz_init(pq);
+    mpz_mul(pq, part->key.p, part->key.q);
+    ret = mpz_cmp(pq, n) == 0 ? 0 : -EBADMSG;
+    mpz_clear(pq);
+    if(ret < 0)
+        return ret;
+
+    ret = rsa_private_key_prepare(&part->key);
+    if(ret < 0)
+        return ret;
+
+    mpz_set(part->pub.n, n);
+    mpz_set(part->pub.e, e);
+    part->pub.size = part->key.size;
+    part->available = 1;
+
+    return 0;
+}
+
+/* 5.5.1.3 */
+int process_secret_key_packet(const uint8_t **data, uint32_t *datalen,
+                              libsign_secret_key *ctx)
+{
+    int ret;
+    uint32_t public_len;
+
+    ret = public_part_len(*data, *datalen, &public_len);
+    if(ret < 0)
+        return ret;
+
+    /* the key ID and fingerprint are those of the public key alone */
+    ret = public_key_packet(&ctx->pub, PGP_TAG_PUBLIC_KEY, *data, public_len);
+    if(ret < 0)
+        return ret;
+
+    part_clear(&ctx->primary);
+    part_init(&ctx->primary);
+    ctx->primary.key_id = ctx->pub.key_id;
+    ctx->primary.pk_algo = ctx->pub.pk_algo;
+
+    ret = secret_part(&ctx->primary, *data + public_len, *datalen - public_len,
+                      ctx->pub.n, ctx->pub.e);
+    if(ret < 0)
+        return ret;
+
+    *data += *datalen;
+    *datalen = 0;
+
+    return 0;
+}
+
+/* 5.5.1.4 */
+int process_secret_key_subkey_packet(const uint8_t **data, uint32_t *datalen,
+                                     libsign_secret_key *ctx)
+{
+    int ret;
+    uint32_t public_len;
+    libsign_secret_part *subkeys, *part;
+    libsign_subkey *subkey;
+
+    ret = public_part_len(*data, *datalen, &public_len);
+    if(ret < 0)
+        return ret;
+
+    ret = public_key_packet(&ctx->pub, PGP_TAG_PUBLIC_SUBKEY, *data, public_len);
+    if(ret < 0)
+        return ret;
+
+    /* kept in step with the public subkeys */
+    subkeys = realloc(ctx->subkeys, (ctx->num_subkeys + 1) * sizeof(libsign_secret_part));
+    if(!subkeys)
+        return -ENOMEM;
+    ctx->subkeys = subkeys;
+
+    subkey = &ctx->pub.subkeys[ctx->pub.num_subkeys - 1];
+    part = &ctx->subkeys[ctx->num_subkeys++];
+    part_init(part);
+    part->key_id = subkey->key_id;
+    part->pk_algo = subkey->pk_algo;
+
+    ret = secret_part(part, *data + public_len, *datalen - public_len, subkey->n, subkey->e);
+    if(ret < 0)
+        return ret;
+
+    *data += *datalen;
+    *datalen = 0;
+
+    return 0;
+}
+
+/* handle one packet of a secret key file */
+static int secret_key_packet(void *opaque, int tag, const uint8_t *body, uint32_t len)
+{
+    libsign_secret_key *sec = opaque;
+
+    switch(tag) {
+    case PGP_TAG_SECRET_KEY:
+    case PGP_TAG_SECRET_SUBKEY:
+        /* too large for the parser's working buffer */
+        if(!body)
+            return -EMSGSIZE;
+        if(tag == PGP_TAG_SECRET_KEY)
+            return process_secret_key_packet(&body, &len, sec);
+        return process_secret_key_subkey_packet(&body, &len, sec);
+    case PGP_TAG_PUBLIC_KEY:
+    case PGP_TAG_PUBLIC_SUBKEY:
+        /* the secret subkeys would no longer match the public ones */
+        return -EINVAL;
+    }
+
+    /* user IDs and signatures */
+    return public_key_packet(&sec->pub, tag, body, len);
+}
+
+int parse_secret_key(libsign_secret_key *sec, const char *filename)
+{
+    int armored = 0, fd, ret = -EINVAL;
+    uint32_t filename_len;
+
+    filename_len = strlen(filename);
+
+    /* is this an ascii armored file? */
+    if(filename_len > 4 && strncmp(filename + (filename_len-4), ".asc", 4) == 0)
+        armored = 1;
+
+    fd = open(filename, O_RDONLY | O_BINARY);
+    if(fd == -1)
+        goto exit;
+
+    /* d, p and q go through the buffers of the parser */
+    ret = parse_packets_fd_secret(fd, armored, secret_key_packet, sec);
+
+    close(fd);
+exit:
+    return ret;
+}
+
+int parse_secret_key_buffer(libsign_secret_key *sec, const uint8_t *buffer, uint32_t datalen)
+{
+    int ret = -EINVAL;
+    uint32_t packet_size;
+
+    if(!datalen)
+        goto exit;
+
+    while(datalen) {
+        int tag = parse_packet_header(&buffer, &datalen, &packet_size);
+        if(tag < 0)
+            goto exit;
+
+        datalen -= packet_size;
+
+        ret = secret_key_packet(sec, tag, buffer, packet_size);
+        if(ret < 0)
+            goto exit;
+
+        buffer += packet_size;
+    }
+
+    ret = 0;
+
+exit:
+    return ret;
+}
+
+int secret_key_signer(libsign_secret_key *sec, libsign_key_id key_id,
+                      libsign_secret_part **part)
+{
+    int ret, i;
+    uint8_t key_flags = 0;
+    libsign_timestamp created = 0;
+    libsign_secret_part *found = NULL;
+
+    /* the flags come from the self-signatures once they have checked out */
+    if(!sec->pub.certs_checked && (ret = verify_certifications(&sec->pub, NULL)) < 0)
+        return ret;
+
+    if(!key_id) {
+        /* the newest subkey that may sign, as gnupg picks it */
+        for(i = 0; i < sec->num_subkeys; i++) {
+            if(!sec->subkeys[i].available ||
+               !(sec->pub.subkeys[i].key_flags & PGP_KEY_FLAG_SIGN))
+                continue;
+
+            if(!found || sec->pub.subkeys[i].created >= created) {
+                found = &sec->subkeys[i];
+                created = sec->pub.subkeys[i].created;
+            }
+        }
+
+        if(found) {
+            *part = found;
+            return 0;
+        }
+
+        key_id = sec->pub.key_id;
+    }
+
+    if(key_id && key_id == sec->pub.key_id) {
+        found = &sec->primary;
+        key_flags = sec->pub.key_flags;
+    }
+    else {
+        for(i = 0; i < sec->num_subkeys; i++) {
+            if(sec->subkeys[i].key_id == key_id) {
+                found = &sec->subkeys[i];
+                key_flags = sec->pub.subkeys[i].key_flags;
+                break;
+            }
+        }
+    }
+
+    if(!found || !found->available)
+        return -ENOKEY;
+
+    /* 5.2.3.21, keys whose flags are known must be allowed to sign */
+    if(key_flags && !(key_flags & PGP_KEY_FLAG_SIGN))
+        return -EKEYREJECTED;
+
+    *part = found;
+
+    return 0;
+}
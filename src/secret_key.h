@@ -0,0 +1,64 @@
+#ifndef __LIBSIGN_SECRET_KEY_H
+#define __LIBSIGN_SECRET_KEY_H
+
+#include <stdint.h>
+
+#include <gmp.h>
+
+#include "pgp.h"
+#include "public_key.h"
+#include "rsa.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 5.5.3, the secret part of the primary key or of a subkey */
+typedef struct libsign_secret_part {
+    libsign_key_id key_id;
+    enum pgp_public_key_algorithm pk_algo;
+    /* 0 when the secret is not there, for keys protected by a passphrase
+       and the stubs gnupg exports for keys kept offline */
+    int available;
+    /* the public key is kept along for the check after signing */
+    rsa_public_key pub;
+    /* with the CRT parameters computed when the key was parsed */
+    rsa_private_key key;
+} libsign_secret_part;
+
+/* A transferable secret key (11.2), only keys that are not protected by a
+   passphrase can be used. */
+typedef struct libsign_secret_key {
+    /* the public parts, user IDs and self-signatures as for a public key */
+    libsign_public_key pub;
+
+    libsign_secret_part primary;
+    /* in the order of pub.subkeys */
+    uint8_t num_subkeys;
+    libsign_secret_part *subkeys;
+} libsign_secret_key;
+
+void secret_key_init(libsign_secret_key *sec);
+void secret_key_destroy(libsign_secret_key *sec);
+
+/* a .asc file is taken to be armored */
+int parse_secret_key(libsign_secret_key *sec, const char *filename);
+int parse_secret_key_buffer(libsign_secret_key *sec, const uint8_t *buffer, uint32_t datalen);
+
+/* the part to sign with. the key or subkey with the given ID, or for 0 the
+   newest subkey that may sign, and the primary key if there is none.
+   -ENOKEY if there is no such key or its secret is not available,
+   -EKEYREJECTED if it may not sign. */
+int secret_key_signer(libsign_secret_key *sec, libsign_key_id key_id,
+                      libsign_secret_part **part);
+
+int process_secret_key_packet(const uint8_t **data, uint32_t *datalen,
+                              libsign_secret_key *ctx);
+int process_secret_key_subkey_packet(const uint8_t **data, uint32_t *datalen,
+                                     libsign_secret_key *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_SECRET_KEY_H */
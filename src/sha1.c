@@ -26,6 +26,7 @@
  */
 
 #include "sha1.h"
+#include "stats.h"
 
 #include <string.h>
 
@@ -117,7 +118,7 @@ void sha1_init(sha1_ctx *ctx) {
 }
 
 /* Run your data through this. */
-void sha1_update(sha1_ctx *ctx, size_t len, const uint8_t *data) {
+static void update(sha1_ctx *ctx, size_t len, const uint8_t *data) {
         unsigned int	i, j;
 
         j = (ctx->count[0] >> 3) & 63;
@@ -136,6 +137,14 @@ void sha1_update(sha1_ctx *ctx, size_t len, const uint8_t *data) {
         memcpy(&ctx->buffer[j], &data[i], len - i);
 }
 
+void sha1_update(sha1_ctx *ctx, size_t len, const uint8_t *data) {
+        LIBSIGN_STAT_BEGIN(start);
+
+        update(ctx, len, data);
+
+        LIBSIGN_STAT_END(LIBSIGN_STAT_SHA1_UPDATE, start, len);
+}
+
 
 /* Add padding and return the message digest. */
 void sha1_digest(sha1_ctx *ctx, uint8_t digest[]) {
@@ -146,12 +155,12 @@ void sha1_digest(sha1_ctx *ctx, uint8_t digest[]) {
             finalcount[i] = (uint8_t)((ctx->count[(i >= 4 ? 0 : 1)]
              >> ((3-(i & 3)) * 8) ) & 255);  /* Endian independent */
         }
-        sha1_update(ctx, 1, (uint8_t *)"\200");
+        update(ctx, 1, (uint8_t *)"\200");
         while ((ctx->count[0] & 504) != 448) {
-            sha1_update(ctx, 1, (uint8_t *)"\0");
+            update(ctx, 1, (uint8_t *)"\0");
         }
         /* Should cause a SHA1_Transform() */
-        sha1_update(ctx, 8, finalcount);
+        update(ctx, 8, finalcount);
         for (i = 0; i < SHA1_DIGEST_LENGTH; i++) {
             digest[i] = (uint8_t)
              ((ctx->state[i>>2] >> ((3-(i & 3)) * 8) ) & 255);
@@ -0,0 +1,347 @@
+#include "sign.h"
+#include "armor.h"
+#include "hash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+/* version, type, algorithms and the subpacket length, then the creation
+   time (5.2.3.4) and issuer (5.2.3.5) subpackets */
+#define SIGN_HASHED_LEN (6 + 6 + 10)
+
+int sign(libsign_secret_key *sec, libsign_signature *sig, const char *filename)
+{
+    int ret;
+    int fd = open(filename, O_RDONLY | O_BINARY);
+    if(fd == -1) {
+        return -EINVAL;
+    }
+
+    ret = sign_fd(sec, sig, fd);
+
+    close(fd);
+
+    return ret;
+}
+
+int sign_fd(libsign_secret_key *sec, libsign_signature *sig, int fd)
+{
+    int ret;
+    sha1_ctx hash;
+    libsign_hash_fanout fan;
+
+    sha1_init(&hash);
+    hash_fanout_init(&fan, 0);
+    hash_fanout_add_sha1(&fan, &hash);
+
+    ret = hash_fanout_fd(&fan, fd);
+    if(ret < 0)
+        return ret;
+
+    return sign_hash(sec, sig, &hash);
+}
+
+int sign_buffer(libsign_secret_key *sec, libsign_signature *sig, const uint8_t *data,
+                uint32_t datalen)
+{
+    sha1_ctx hash;
+
+    sha1_init(&hash);
+    sha1_update(&hash, datalen, data);
+
+    return sign_hash(sec, sig, &hash);
+}
+
+int sign_hash(libsign_secret_key *sec, libsign_signature *sig, sha1_ctx *hash)
+{
+    int ret, i;
+    uint8_t *hashed, *p, digest[SHA1_DIGEST_LENGTH];
+    libsign_secret_part *part;
+    libsign_timestamp created;
+
+    /* the signature MPI is written, it cannot live in an arena */
+    if(sig->arena)
+        return -EINVAL;
+
+    ret = secret_key_signer(sec, sig->issuer, &part);
+    if(ret < 0)
+        return ret;
+
+    created = sig->creation_time ? sig->creation_time : (libsign_timestamp)time(NULL);
+
+    hashed = malloc(SIGN_HASHED_LEN);
+    if(!hashed)
+        return -ENOMEM;
+
+    p = hashed;
+    *p++ = PGP_SIG_VER4;
+    *p++ = PGP_SIG_BINARY_DOCUMENT;
+    *p++ = PGP_RSA;
+    *p++ = PGP_SHA1;
+    *p++ = (SIGN_HASHED_LEN - 6) >> 8;
+    *p++ = SIGN_HASHED_LEN - 6;
+
+    *p++ = 5;
+    *p++ = PGP_SIG_CREATION_TIME;
+    for(i = 24; i >= 0; i -= 8)
+        *p++ = created >> i;
+
+    *p++ = 9;
+    *p++ = PGP_SIG_ISSUER;
+    for(i = 56; i >= 0; i -= 8)
+        *p++ = part->key_id >> i;
+
+    signature_hash_suffix(hash, hashed, SIGN_HASHED_LEN);
+    sha1_digest(hash, digest);
+
+    ret = rsa_sha1_sign_digest(&part->pub, &part->key, digest, sig->s);
+    if(ret < 0) {
+        free(hashed);
+        return ret;
+    }
+
+    free(sig->hashed_data);
+    sig->hashed_data = hashed;
+    sig->hashed_data_len = SIGN_HASHED_LEN;
+    sig->version = PGP_SIG_VER4;
+    sig->type = PGP_SIG_BINARY_DOCUMENT;
+    sig->pk_algo = PGP_RSA;
+    sig->hash_algo = PGP_SHA1;
+    sig->creation_time = created;
+    sig->issuer = part->key_id;
+    sig->key_flags = 0;
+    sig->key_expiration = 0;
+    sig->short_hash = (digest[0] << 8) | digest[1];
+
+    return 0;
+}
+
+static int write_signature(libsign_signature *sig, int armored, libsign_write_fn write,
+                           void *opaque)
+{
+    if(armored)
+        return signature_write_armor(sig, ARMOR_LINE_WIDTH, write, opaque);
+
+    return signature_write(sig, write, opaque);
+}
+
+int sign_init(libsign_sign_ctx *ctx, libsign_secret_key *sec, libsign_key_id key_id,
+              libsign_timestamp created)
+{
+    int ret;
+    libsign_secret_part *part;
+
+    ret = secret_key_signer(sec, key_id, &part);
+    if(ret < 0)
+        return ret;
+
+    ctx->sec = sec;
+    ctx->key_id = part->key_id;
+    ctx->created = created;
+    sha1_init(&ctx->hash);
+
+    return 0;
+}
+
+void sign_update(libsign_sign_ctx *ctx, const uint8_t *data, size_t len)
+{
+    sha1_update(&ctx->hash, len, data);
+}
+
+int sign_write(void *opaque, const uint8_t *data, size_t len)
+{
+    sign_update(opaque, data, len);
+
+    return 0;
+}
+
+int sign_final(libsign_sign_ctx *ctx, int armored, libsign_write_fn write, void *opaque)
+{
+    int ret;
+    libsign_signature sig;
+
+    signature_init(&sig);
+    sig.issuer = ctx->key_id;
+    sig.creation_time = ctx->created;
+
+    ret = sign_hash(ctx->sec, &sig, &ctx->hash);
+    if(ret == 0)
+        ret = write_signature(&sig, armored, write, opaque);
+
+    signature_destroy(&sig);
+
+    return ret;
+}
+
+typedef struct batch {
+    libsign_secret_key *sec;
+    libsign_key_id key_id;
+    libsign_timestamp created;
+    libsign_sign_job *jobs;
+    libsign_signature *sigs;
+    uint8_t *done;
+    uint32_t count;
+
+    /* next job to be claimed by a thread */
+    uint32_t next;
+
+    /* the signatures are written in order by one thread at a time, the one
+       holding the writer token. the lock guards done, next_write and the
+       token, the writes are made outside it */
+    pthread_mutex_t lock;
+    uint32_t next_write;
+    int writing;
+} batch;
+
+static int hash_job(libsign_sign_job *job, sha1_ctx *hash)
+{
+    uint8_t buffer[LIBSIGN_FANOUT_BLOCK_SIZE];
+    ssize_t len;
+
+    sha1_init(hash);
+
+    if(!job->read_fn) {
+        sha1_update(hash, job->datalen, job->data);
+        return 0;
+    }
+
+    while((len = job->read_fn(job->read_opaque, buffer, sizeof(buffer))) > 0)
+        sha1_update(hash, len, buffer);
+
+    return len < 0 ? (int)len : 0;
+}
+
+/* write the signatures of the jobs that are done and no longer wait for
+   one before them. called with the lock held, returns with it held. a
+   thread that finds the token taken leaves its signature to the writer,
+   which checks done again under the lock before it gives the token back */
+static void write_done(batch *b)
+{
+    libsign_sign_job *job;
+    libsign_signature *sig;
+
+    if(b->writing)
+        return;
+    b->writing = 1;
+
+    while(b->next_write < b->count && b->done[b->next_write]) {
+        job = &b->jobs[b->next_write];
+        sig = &b->sigs[b->next_write];
+        pthread_mutex_unlock(&b->lock);
+
+        if(job->result == 0)
+            job->result = write_signature(sig, job->armored, job->write, job->write_opaque);
+        signature_destroy(sig);
+
+        pthread_mutex_lock(&b->lock);
+        b->next_write++;
+    }
+
+    b->writing = 0;
+}
+
+static void *batch_worker(void *arg)
+{
+    batch *b = arg;
+    sha1_ctx hash;
+
+    for(;;) {
+        uint32_t i = __sync_fetch_and_add(&b->next, 1);
+        libsign_sign_job *job;
+        libsign_signature *sig;
+        if(i >= b->count)
+            break;
+
+        job = &b->jobs[i];
+        sig = &b->sigs[i];
+
+        sig->issuer = b->key_id;
+        sig->creation_time = b->created;
+
+        job->result = hash_job(job, &hash);
+        if(job->result == 0)
+            job->result = sign_hash(b->sec, sig, &hash);
+
+        pthread_mutex_lock(&b->lock);
+        b->done[i] = 1;
+        write_done(b);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    return NULL;
+}
+
+int libsign_sign_batch(libsign_secret_key *sec, libsign_key_id key_id, libsign_sign_job *jobs,
+                       uint32_t count, unsigned int threads)
+{
+    int ret;
+    pthread_t workers[64];
+    unsigned int i, started = 0;
+    libsign_secret_part *part;
+    batch b;
+
+    /* pick the key once, so every job is signed by the same one */
+    ret = secret_key_signer(sec, key_id, &part);
+    if(ret < 0)
+        return ret;
+
+    memset(&b, 0, sizeof(batch));
+    b.sec = sec;
+    b.key_id = part->key_id;
+    b.created = time(NULL);
+    b.jobs = jobs;
+    b.count = count;
+
+    b.sigs = malloc((count ? count : 1) * sizeof(libsign_signature));
+    b.done = calloc(count ? count : 1, 1);
+    if(!b.sigs || !b.done || pthread_mutex_init(&b.lock, NULL) != 0) {
+        ret = -ENOMEM;
+        goto exit;
+    }
+    /* each is destroyed once it has been written */
+    for(i = 0; i < count; i++)
+        signature_init(&b.sigs[i]);
+
+    if(!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? online : 1;
+    }
+    if(threads > count)
+        threads = count;
+    if(threads > sizeof(workers) / sizeof(workers[0]))
+        threads = sizeof(workers) / sizeof(workers[0]);
+
+    for(i = 1; i < threads; i++) {
+        if(pthread_create(&workers[started], NULL, batch_worker, &b) != 0)
+            break;
+        started++;
+    }
+
+    batch_worker(&b);
+
+    for(i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_mutex_destroy(&b.lock);
+
+    ret = 0;
+    for(i = 0; i < count && ret == 0; i++)
+        ret = jobs[i].result;
+
+exit:
+    free(b.sigs);
+    free(b.done);
+
+    return ret;
+}
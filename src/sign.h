@@ -0,0 +1,81 @@
+#ifndef __LIBSIGN_SIGNING_H
+#define __LIBSIGN_SIGNING_H
+
+#include <stdint.h>
+
+#include "secret_key.h"
+#include "sha1.h"
+#include "signature.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Make a v4 detached signature (5.2.3) of the binary document type with RSA
+   and SHA-1. The key is picked by secret_key_signer() from the issuer of
+   sig, 0 for the default, and the signature is made now unless its
+   creation time is set. Both go into the hashed subpackets. sig must have
+   been initialized with signature_init(), it can be written with
+   signature_write() or signature_write_armor() afterwards. */
+int sign(libsign_secret_key *sec, libsign_signature *sig, const char *filename);
+int sign_fd(libsign_secret_key *sec, libsign_signature *sig, int fd);
+int sign_buffer(libsign_secret_key *sec, libsign_signature *sig, const uint8_t *data,
+                uint32_t datalen);
+/* as above, for a hash of the data. the signature suffix is added to it. */
+int sign_hash(libsign_secret_key *sec, libsign_signature *sig, sha1_ctx *hash);
+
+/* A signature made while the data is produced. The data is hashed as it is
+   passed in, in pieces of any size, and never kept. */
+typedef struct libsign_sign_ctx {
+    libsign_secret_key *sec;
+    libsign_key_id key_id;
+    libsign_timestamp created;
+    sha1_ctx hash;
+} libsign_sign_ctx;
+
+/* start a signature by the key picked as for sign(). created 0 is the time
+   sign_final() is called. fails at once if the key cannot sign. */
+int sign_init(libsign_sign_ctx *ctx, libsign_secret_key *sec, libsign_key_id key_id,
+              libsign_timestamp created);
+void sign_update(libsign_sign_ctx *ctx, const uint8_t *data, size_t len);
+/* sign_update() as a libsign_write_fn, with the context as opaque */
+int sign_write(void *opaque, const uint8_t *data, size_t len);
+/* make the signature and write the packet, armored or not */
+int sign_final(libsign_sign_ctx *ctx, int armored, libsign_write_fn write, void *opaque);
+
+/* One artifact for libsign_sign_batch(). The data is read with read_fn, or
+   taken from data if there is none, and the signature is written to write
+   once it and the signatures of all the jobs before it have been. */
+typedef struct libsign_sign_job {
+    libsign_read_fn read_fn;
+    void *read_opaque;
+    const uint8_t *data;
+    uint32_t datalen;
+
+    libsign_write_fn write;
+    void *write_opaque;
+    /* armor the signature instead of writing a binary packet */
+    int armored;
+
+    /* the outcome, set by libsign_sign_batch() */
+    int result;
+} libsign_sign_job;
+
+/* Sign many artifacts with the same key. Each thread takes the next job,
+   hashes it and signs the hash, so whether the jobs are large (hashing) or
+   many small ones (the private key operation) the threads stay busy. The
+   key and its CRT parameters are shared, read only. The signatures are
+   written in the order of the jobs whatever the order they are done in,
+   from whichever thread finishes the one that was holding them up. All the
+   signatures get the same creation time. threads is the number of threads
+   to use in all, counting the caller, 0 for one per processor. returns the
+   first error of any job, see the result of each. */
+int libsign_sign_batch(libsign_secret_key *sec, libsign_key_id key_id, libsign_sign_job *jobs,
+                       uint32_t count, unsigned int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_SIGNING_H */
@@ -2,6 +2,9 @@
 #include "armor.h"
 #include "packet.h"
 #include "mpi.h"
+#include "probes.h"
+#include "stats.h"
+#include "stream.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -22,20 +25,44 @@ void signature_init(libsign_signature *sig)
     mpz_init(sig->s);
 }
 
+void signature_init_arena(libsign_signature *sig, libsign_arena *arena)
+{
+    memset(sig, 0, sizeof(libsign_signature));
+    mpz_roinit_n(sig->s, NULL, 0);
+    sig->arena = arena;
+}
+
 void signature_destroy(libsign_signature *sig)
 {
+    /* everything is released with the arena */
+    if(sig->arena)
+        return;
+
     free(sig->hashed_data);
     mpz_clear(sig->s);
 }
 
+/* handle one packet of a signature file */
+static int signature_packet(void *opaque, int tag, const uint8_t *body, uint32_t len)
+{
+    libsign_signature *sig = opaque;
+
+    switch(tag) {
+    case PGP_TAG_SIGNATURE:
+        /* too large for the parser's working buffer */
+        if(!body)
+            return -EMSGSIZE;
+        return process_signature_packet(&body, &len, sig);
+    }
+
+    return 0;
+}
+
 int parse_signature(libsign_signature *sig, const char *filename)
 {
-    /* open the file pointed to by filename and read contents into memory */
+    /* open the file pointed to by filename and parse it as it is read */
     int armored = 0, fd, ret = -EINVAL;
-    struct stat stbuf;
-    uint32_t filesize, filename_len, plain_len;
-    uint8_t *buffer, *plaintext;
-    const uint8_t *p;
+    uint32_t filename_len;
 
     /* examine the filename to see if the file is armored */
     filename_len = strlen(filename);
@@ -44,49 +71,23 @@ int parse_signature(libsign_signature *sig, const char *filename)
     if(filename_len > 4 && strncmp(filename + (filename_len-4), ".asc", 4) == 0)
         armored = 1;
 
+    LIBSIGN_PROBE3(parse_signature__entry, filename, 0, armored);
+
     fd = open(filename, O_RDONLY | O_BINARY);
     if(fd == -1) {
         goto exit;
     }
 
-    /* find size of file */
-    if(fstat(fd, &stbuf) == -1)
-        goto close_fd;
-
-    filesize = stbuf.st_size;
-    buffer = malloc(filesize);
-    if(!buffer)
-        goto close_fd;
-
-    /* read file into memory */
-    if(read(fd, buffer, filesize) != filesize)
-        goto free_buffer;
-
-    /* do we have to decode the armor? */
-    if(armored) {
-        if(decode_signature_armor(buffer, filesize, &plaintext, &plain_len) != 0)
-            goto free_buffer;
-        p = plaintext;
-        filesize = plain_len;
-    }
-    else
-        p = buffer;
-
-    ret = parse_signature_buffer(sig, p, filesize);
-
-    if(armored)
-        free(plaintext);
+    ret = parse_packets_fd(fd, armored, signature_packet, sig);
 
-free_buffer:
-    free(buffer);
-close_fd:
     close(fd);
 exit:
+    LIBSIGN_PROBE4(parse_signature__return, ret, sig->issuer, sig->pk_algo, sig->hash_algo);
+
     return ret;
 }
 
-int parse_signature_buffer(libsign_signature *sig, const uint8_t *buffer,
-                           uint32_t datalen)
+static int signature_buffer(libsign_signature *sig, const uint8_t *buffer, uint32_t datalen)
 {
     int ret = -EINVAL;
     uint32_t packet_size;
@@ -102,13 +103,11 @@ int parse_signature_buffer(libsign_signature *sig, const uint8_t *buffer,
 
         datalen -= packet_size;
 
-        switch(tag) {
-        case PGP_TAG_SIGNATURE:
-            ret = process_signature_packet(&buffer, &packet_size, sig);
-            if(ret < 0)
-                goto exit;
-            break;
-        }
+        ret = signature_packet(sig, tag, buffer, packet_size);
+        if(ret < 0)
+            goto exit;
+
+        buffer += packet_size;
     }
 
     ret = 0;
@@ -117,135 +116,321 @@ exit:
     return ret;
 }
 
+int parse_signature_buffer(libsign_signature *sig, const uint8_t *buffer,
+                           uint32_t datalen)
+{
+    int ret;
+
+    LIBSIGN_PROBE3(parse_signature__entry, NULL, datalen, 0);
+
+    ret = signature_buffer(sig, buffer, datalen);
+
+    LIBSIGN_PROBE4(parse_signature__return, ret, sig->issuer, sig->pk_algo, sig->hash_algo);
+
+    return ret;
+}
+
+static int check_signature_armor(const uint8_t *data, uint32_t datalen)
+{
+    /* (6.2) for signatures, the armor header line shall be
+      "-----BEGIN PGP SIGNATURE-----" */
+    if(datalen < 29)
+        return -EINVAL;
+
+    if(strncmp((char*)data, "-----BEGIN PGP SIGNATURE-----", 29) != 0)
+        return -EINVAL;
+
+    return 0;
+}
+
 int parse_signature_armor_buffer(libsign_signature *sig, const uint8_t *buffer,
                                  uint32_t datalen)
 {
     int ret = -EINVAL;
-    uint8_t *plaintext = NULL;
-    uint32_t plain_len;
+    uint8_t stack_plain[ARMOR_STACK_SIZE];
+    uint8_t *plaintext = stack_plain;
+    uint32_t plain_size, plain_len;
+
+    LIBSIGN_PROBE3(parse_signature__entry, NULL, datalen, 1);
 
-    ret = decode_signature_armor(buffer, datalen, &plaintext, &plain_len);
+    ret = check_signature_armor(buffer, datalen);
     if(ret < 0)
         goto exit;
 
-    ret = parse_signature_buffer(sig, plaintext, plain_len);
+    ret = decode_armor_size(buffer, datalen, &plain_size);
+    if(ret < 0)
+        goto exit;
 
+    /* only go to the heap for armor too large for the stack */
+    if(plain_size > sizeof(stack_plain)) {
+        plaintext = malloc(plain_size);
+        if(!plaintext) {
+            ret = -ENOMEM;
+            goto exit;
+        }
+        LIBSIGN_STAT_ALLOC(LIBSIGN_STAT_DECODE_ARMOR);
+    }
+
+    ret = decode_armor_buffer(buffer, datalen, plaintext, plain_size, &plain_len);
+    if(ret < 0)
+        goto free_plain;
+
+    ret = signature_buffer(sig, plaintext, plain_len);
+
+free_plain:
+    if(plaintext != stack_plain)
+        free(plaintext);
 exit:
-    free(plaintext);
+    LIBSIGN_PROBE4(parse_signature__return, ret, sig->issuer, sig->pk_algo, sig->hash_algo);
 
     return ret;
 }
 
-/* 5.2 */
-int process_signature_packet(const uint8_t **data, uint32_t *datalen,
-                             libsign_signature *ctx)
+int parse_signature_armor_inplace(libsign_signature *sig, uint8_t *buffer, uint32_t datalen)
 {
-    int ret = -EINVAL;
-    const uint8_t *p = *data;
-    uint32_t subdatalen, hashed_len, tmplen = *datalen;
-    uint8_t *hashed_data;
-    const uint8_t *hashed_data_start;
+    int ret;
+    uint32_t plain_len;
 
-    /* signature packet must be at least 12 bytes long */
-    if(tmplen < 12) {
-        goto exit;
-    }
+    LIBSIGN_PROBE3(parse_signature__entry, NULL, datalen, 1);
 
-    /* hashed data begins */
-    hashed_data_start = p;
+    ret = check_signature_armor(buffer, datalen);
+    if(ret < 0)
+        goto exit;
 
-    /* signature version */
-    ctx->version = *p++;
-    if(ctx->version != PGP_SIG_VER4) {
-        ret = -ENOTSUP;
+    ret = decode_armor_inplace(buffer, datalen, &plain_len);
+    if(ret < 0)
         goto exit;
-    }
 
-    /* type */
-    ctx->type = *p++;
-    /* public key algorithm */
-    ctx->pk_algo = *p++;
-    /* hash algorithm */
-    ctx->hash_algo = *p++;
-    tmplen -= 4;
+    ret = signature_buffer(sig, buffer, plain_len);
 
-    /* hashed subpackets */
-    subdatalen = *p++ << 8;
-    subdatalen |= *p++;
-    tmplen -= 2;
+exit:
+    LIBSIGN_PROBE4(parse_signature__return, ret, sig->issuer, sig->pk_algo, sig->hash_algo);
 
-    /* do we have enough data? */
-    if(tmplen < subdatalen) {
-        goto exit;
-    }
+    return ret;
+}
 
-    /* we now know the length of the hashed data.
-       (version + type + public key algorithm + length of hashed
-       subpackets + hashed subpackets). */
-    ctx->hashed_data_len = 6 + subdatalen;
+/* 5.2.3.1, only the subpackets the view has room for are looked at */
+static int view_subpackets(libsign_signature_view *view, const uint8_t *p, uint32_t len,
+                           int hashed)
+{
+    while(len) {
+        uint32_t sublen, header_len;
 
-    /* copy the hashed data into a new buffer so it will stick around after
-       parsing. */
-    ctx->hashed_data = malloc(ctx->hashed_data_len);
-    if(!ctx->hashed_data) {
-        ret = -ENOMEM;
-        goto exit;
-    }
-    hashed_len = ctx->hashed_data_len;
-    hashed_data = ctx->hashed_data;
-    while(hashed_len--)
-        *hashed_data++ = *hashed_data_start++;
-
-    if(subdatalen) {
-        if((ret = process_signature_subpackets(&p, &tmplen, subdatalen, ctx)))
-            goto free_hashed_data;
+        /* one, two or five octet length */
+        if(*p < 192) {
+            sublen = *p;
+            header_len = 1;
+        }
+        else if(*p < 255) {
+            if(len < 2)
+                return -EINVAL;
+            sublen = ((p[0] - 192) << 8) + p[1] + 192;
+            header_len = 2;
+        }
+        else {
+            if(len < 5)
+                return -EINVAL;
+            sublen = ((uint32_t)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+            header_len = 5;
+        }
+        p += header_len;
+        len -= header_len;
+
+        /* the length includes the type octet */
+        if(!sublen || sublen > len)
+            return -EINVAL;
+
+        switch(*p & 0x7f) {
+        case PGP_SIG_CREATION_TIME:
+            /* 5.2.3.4 - 4 octet time field */
+            if(sublen != 5)
+                return -EINVAL;
+            view->creation_time = ((uint32_t)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+            break;
+        case PGP_SIG_ISSUER:
+            /* 5.2.3.5 - 8 octet key id */
+            if(sublen != 9)
+                return -EINVAL;
+            view->issuer = ((uint64_t)p[1] << 56) | ((uint64_t)p[2] << 48) |
+                           ((uint64_t)p[3] << 40) | ((uint64_t)p[4] << 32) |
+                           ((uint64_t)p[5] << 24) | (p[6] << 16) | (p[7] << 8) | p[8];
+            break;
+        case PGP_SIG_KEY_EXPIRATION_TIME:
+            /* 5.2.3.6 - 4 octet time field */
+            if(sublen != 5)
+                return -EINVAL;
+            if(hashed)
+                view->key_expiration = ((uint32_t)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+            break;
+        case PGP_SIG_KEY_FLAGS:
+            /* 5.2.3.21 - any number of octets, only the first is defined.
+               flags anyone could have added afterwards are of no use. */
+            if(hashed && sublen > 1)
+                view->key_flags = p[1];
+            break;
+        case PGP_SIG_EMBEDDED_SIGNATURE:
+            /* 5.2.3.26 - a whole signature packet body. it is a signature
+               of its own, so it does not matter which area it is in. */
+            if(!view->embedded) {
+                view->embedded = p + 1;
+                view->embedded_len = sublen - 1;
+            }
+            break;
+        }
+
+        p += sublen;
+        len -= sublen;
     }
+
+    return 0;
+}
+
+/* 5.2 */
+int signature_view_parse(libsign_signature_view *view, const uint8_t *body, uint32_t len)
+{
+    int ret;
+    const uint8_t *p = body;
+    uint32_t subdatalen;
+
+    memset(view, 0, sizeof(libsign_signature_view));
+
+    /* signature packet must be at least 12 bytes long */
+    if(len < 12)
+        return -EINVAL;
+
+    /* hashed data begins */
+    view->hashed_data = p;
+
+    view->version = *p++;
+    if(view->version != PGP_SIG_VER4)
+        return -ENOTSUP;
+
+    view->type = *p++;
+    view->pk_algo = *p++;
+    view->hash_algo = *p++;
+
+    /* hashed subpackets */
+    subdatalen = (p[0] << 8) | p[1];
+    p += 2;
+    len -= 6;
+
+    /* the unhashed subpacket length must follow */
+    if(len < subdatalen + 2)
+        return -EINVAL;
+
+    /* version + type + public key algorithm + hash algorithm + length of
+       hashed subpackets + hashed subpackets */
+    view->hashed_data_len = 6 + subdatalen;
+
+    if((ret = view_subpackets(view, p, subdatalen, 1)) < 0)
+        return ret;
+    p += subdatalen;
+    len -= subdatalen;
     /* end of hashed data */
 
-    /* unhashed subpackets */
-    subdatalen = *p++ << 8;
-    subdatalen |= *p++;
-    tmplen -= 2;
+    /* unhashed subpackets, and the short hash after them */
+    subdatalen = (p[0] << 8) | p[1];
+    p += 2;
+    len -= 2;
 
-    /* do we have enough data? */
-    if(tmplen < subdatalen) {
-        goto free_hashed_data;
-    }
+    if(len < subdatalen + 2)
+        return -EINVAL;
 
-    if(subdatalen) {
-        if((ret = process_signature_subpackets(&p, &tmplen, subdatalen, ctx)))
-            goto free_hashed_data;
-    }
+    if((ret = view_subpackets(view, p, subdatalen, 0)) < 0)
+        return ret;
+    p += subdatalen;
+    len -= subdatalen;
 
-    /* short hash */
-    ctx->short_hash = *p++ << 8;
-    ctx->short_hash |= *p++;
-    tmplen -= 2;
+    view->short_hash = (p[0] << 8) | p[1];
+    p += 2;
+    len -= 2;
 
     /* algorithm specific data */
-    switch(ctx->pk_algo) {
+    switch(view->pk_algo) {
     case PGP_RSA:
+    case PGP_RSA_SIGN_ONLY:
         /* RSA signature value m ** d mod n. */
-        if(mpi_to_mpz(&p, &tmplen, &ctx->s) != 0)
-            goto free_hashed_data;
-
+        if((ret = mpi_view(&p, &len, &view->s, &view->s_len)) < 0)
+            return ret;
         break;
     default:
-        ret = -ENOTSUP;
-        goto free_hashed_data;
+        return -ENOTSUP;
     }
 
-    *datalen -= (p - *data);
-    *data = p;
+    view->len = p - body;
 
-    ret = 0;
+    return 0;
+}
 
-exit:
-    return ret;
+int parse_signature_view(libsign_signature_view *view, const uint8_t *buffer,
+                         uint32_t datalen)
+{
+    int ret;
+    libsign_packet_iter iter;
+    libsign_packet packet;
 
-free_hashed_data:
-    free(ctx->hashed_data);
-    return ret;
+    packet_iter_init(&iter, buffer, datalen);
+
+    while((ret = packet_iter_next(&iter, &packet)) == 0) {
+        if(packet.tag == PGP_TAG_SIGNATURE)
+            return signature_view_parse(view, packet.body, packet.len);
+    }
+
+    return ret == -ENOENT ? -EINVAL : ret;
+}
+
+int signature_from_view(libsign_signature *sig, const libsign_signature_view *view)
+{
+    const uint8_t *s = view->s;
+    uint32_t s_len = view->s_len;
+
+    sig->version = view->version;
+    sig->type = view->type;
+    sig->pk_algo = view->pk_algo;
+    sig->hash_algo = view->hash_algo;
+    sig->creation_time = view->creation_time;
+    sig->issuer = view->issuer;
+    sig->key_flags = view->key_flags;
+    sig->key_expiration = view->key_expiration;
+    sig->short_hash = view->short_hash;
+
+    /* copy the hashed data so it will stick around after parsing */
+    if(sig->arena)
+        sig->hashed_data = arena_alloc(sig->arena, view->hashed_data_len);
+    else {
+        free(sig->hashed_data);
+        sig->hashed_data = malloc(view->hashed_data_len);
+    }
+    if(!sig->hashed_data)
+        return -ENOMEM;
+    memcpy(sig->hashed_data, view->hashed_data, view->hashed_data_len);
+    sig->hashed_data_len = view->hashed_data_len;
+
+    if(sig->arena)
+        return mpi_to_mpz_arena(&s, &s_len, &sig->s, sig->arena);
+
+    return mpi_to_mpz(&s, &s_len, &sig->s);
+}
+
+/* 5.2 */
+int process_signature_packet(const uint8_t **data, uint32_t *datalen,
+                             libsign_signature *ctx)
+{
+    int ret;
+    libsign_signature_view view;
+
+    ret = signature_view_parse(&view, *data, *datalen);
+    if(ret < 0)
+        return ret;
+
+    ret = signature_from_view(ctx, &view);
+    if(ret < 0)
+        return ret;
+
+    *datalen -= view.len;
+    *data += view.len;
+
+    return 0;
 }
 
 int process_signature_subpackets(const uint8_t **data, uint32_t *datalen,
@@ -322,16 +507,221 @@ exit:
 int decode_signature_armor(const uint8_t *data, uint32_t datalen, uint8_t **plain_out,
                            uint32_t *plain_len)
 {
-    /* (6.2) for signatures, the armor header line shall be
-      "-----BEGIN PGP SIGNATURE-----" */
-    if(datalen < 29)
-        goto error;
+    int ret;
 
-    if(strncmp((char*)data, "-----BEGIN PGP SIGNATURE-----", 29) != 0)
-        goto error;
+    ret = check_signature_armor(data, datalen);
+    if(ret < 0)
+        return ret;
 
     return decode_armor(data, datalen, plain_out, plain_len);
+}
+
+static void suffix_trailer(uint8_t trailer[6], uint32_t hashed_data_len)
+{
+    /* version */
+    trailer[0] = 0x04;
+
+    trailer[1] = 0xff;
+
+    /* big-endian length of the hashed data from
+       the signature */
+    trailer[5] = hashed_data_len;
+    trailer[4] = hashed_data_len >> 8;
+    trailer[3] = hashed_data_len >> 16;
+    trailer[2] = hashed_data_len >> 24;
+}
+
+/* 5.2.4 */
+void signature_hash_suffix(sha1_ctx *hash, const uint8_t *hashed_data, uint32_t hashed_data_len)
+{
+    uint8_t trailer[6];
+
+    /* hash the hashed data from the signature */
+    sha1_update(hash, hashed_data_len, hashed_data);
+
+    /* then hash the trailer */
+    suffix_trailer(trailer, hashed_data_len);
+
+    sha1_update(hash, 6, trailer);
+}
+
+int signature_suffix(const libsign_signature *sig, uint8_t *buf, uint32_t size)
+{
+    uint32_t len;
+
+    if(sig->version != PGP_SIG_VER4)
+        return -EINVAL;
+
+    len = SIGNATURE_SUFFIX_LEN(sig->hashed_data_len);
+    if(size < len)
+        return -ENOSPC;
+
+    memcpy(buf, sig->hashed_data, sig->hashed_data_len);
+    suffix_trailer(buf + sig->hashed_data_len, sig->hashed_data_len);
+
+    return len;
+}
+
+/* is there a subpacket of the type among the hashed subpackets already? */
+static int hashed_subpacket(const libsign_signature *sig, int type)
+{
+    const uint8_t *p = sig->hashed_data + 6, *end = sig->hashed_data + sig->hashed_data_len;
+
+    while(p < end) {
+        uint32_t len;
+
+        /* 5.2.3.1 */
+        if(*p < 192)
+            len = *p++;
+        else if(*p < 255) {
+            if(end - p < 2)
+                break;
+            len = ((p[0] - 192) << 8) + p[1] + 192;
+            p += 2;
+        }
+        else {
+            if(end - p < 5)
+                break;
+            len = ((uint32_t)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+            p += 5;
+        }
+        if(!len || len > (uint32_t)(end - p))
+            break;
+
+        if((*p & 0x7f) == type)
+            return 1;
+        p += len;
+    }
+
+    return 0;
+}
+
+/* the parser only keeps the issuer of the unhashed subpackets, which is
+   all gnupg puts there besides the back-signature of a binding. returns the
+   length of the subpackets put in unhashed. */
+static uint32_t unhashed_issuer(const libsign_signature *sig, uint8_t unhashed[10])
+{
+    int i;
+    uint32_t len = 0;
+
+    if(sig->issuer && !hashed_subpacket(sig, PGP_SIG_ISSUER)) {
+        unhashed[len++] = 9;
+        unhashed[len++] = PGP_SIG_ISSUER;
+        for(i = 56; i >= 0; i -= 8)
+            unhashed[len++] = sig->issuer >> i;
+    }
+
+    return len;
+}
+
+/* the packet body of a signature as signature_body() writes it, without an
+   embedded signature */
+static uint32_t signature_body_len(libsign_signature *sig)
+{
+    uint8_t unhashed[10];
+
+    return sig->hashed_data_len + 2 + unhashed_issuer(sig, unhashed) + 2 + mpi_size(&sig->s);
+}
+
+/* 5.2.3, the body of the signature packet, with embedded in the unhashed
+   subpackets if it is not NULL */
+static int signature_body(libsign_signature *sig, libsign_signature *embedded,
+                          libsign_write_fn write, void *opaque)
+{
+    int ret;
+    uint8_t unhashed[2 + 10 + 6], short_hash[2];
+    uint32_t unhashed_len, embedded_len = 0;
+
+    unhashed_len = 2 + unhashed_issuer(sig, unhashed + 2);
+
+    /* 5.2.3.1, a five octet length, the type and the signature */
+    if(embedded) {
+        embedded_len = signature_body_len(embedded);
+        unhashed[unhashed_len++] = 0xff;
+        unhashed[unhashed_len++] = (embedded_len + 1) >> 24;
+        unhashed[unhashed_len++] = (embedded_len + 1) >> 16;
+        unhashed[unhashed_len++] = (embedded_len + 1) >> 8;
+        unhashed[unhashed_len++] = embedded_len + 1;
+        unhashed[unhashed_len++] = PGP_SIG_EMBEDDED_SIGNATURE;
+    }
+    if(unhashed_len - 2 + embedded_len > 0xffff)
+        return -EMSGSIZE;
+    unhashed[0] = (unhashed_len - 2 + embedded_len) >> 8;
+    unhashed[1] = unhashed_len - 2 + embedded_len;
+
+    short_hash[0] = sig->short_hash >> 8;
+    short_hash[1] = sig->short_hash;
+
+    if((ret = write(opaque, sig->hashed_data, sig->hashed_data_len)) < 0 ||
+       (ret = write(opaque, unhashed, unhashed_len)) < 0 ||
+       (embedded && (ret = signature_body(embedded, NULL, write, opaque)) < 0) ||
+       (ret = write(opaque, short_hash, sizeof(short_hash))) < 0 ||
+       (ret = mpz_to_mpi(&sig->s, write, opaque)) < 0)
+        return ret;
+
+    return 0;
+}
+
+static int signature_writable(const libsign_signature *sig)
+{
+    if(sig->version != PGP_SIG_VER4 || sig->pk_algo != PGP_RSA)
+        return -ENOTSUP;
+    if(!sig->hashed_data || sig->hashed_data_len < 6)
+        return -EINVAL;
+
+    return 0;
+}
+
+static int write_signature_packet(libsign_signature *sig, libsign_signature *embedded,
+                                  libsign_write_fn write, void *opaque)
+{
+    int ret;
+    uint8_t header[PACKET_HEADER_MAX];
+    uint32_t header_len, len;
+
+    if((ret = signature_writable(sig)) < 0 ||
+       (embedded && (ret = signature_writable(embedded)) < 0))
+        return ret;
+
+    len = signature_body_len(sig);
+    if(embedded)
+        len += 6 + signature_body_len(embedded);
+    header_len = packet_write_header(header, PGP_TAG_SIGNATURE, len);
+
+    if((ret = write(opaque, header, header_len)) < 0)
+        return ret;
+
+    return signature_body(sig, embedded, write, opaque);
+}
+
+int signature_write(libsign_signature *sig, libsign_write_fn write, void *opaque)
+{
+    return write_signature_packet(sig, NULL, write, opaque);
+}
+
+int signature_write_binding(libsign_signature *sig, libsign_signature *back,
+                            libsign_write_fn write, void *opaque)
+{
+    /* one that was hashed is written with the rest of the hashed data */
+    if(back && hashed_subpacket(sig, PGP_SIG_EMBEDDED_SIGNATURE))
+        back = NULL;
+
+    return write_signature_packet(sig, back, write, opaque);
+}
+
+int signature_write_armor(libsign_signature *sig, uint32_t line_width,
+                          libsign_write_fn write, void *opaque)
+{
+    int ret;
+    libsign_armor_encoder enc;
+
+    ret = armor_encoder_init(&enc, ARMOR_SIGNATURE, line_width, write, opaque);
+    if(ret < 0)
+        return ret;
+
+    ret = signature_write(sig, armor_encoder_write, &enc);
+    if(ret < 0)
+        return ret;
 
-error:
-    return -EINVAL;
+    return armor_encoder_finish(&enc);
 }
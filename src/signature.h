@@ -5,7 +5,10 @@
 
 #include <gmp.h>
 
+#include "arena.h"
 #include "pgp.h"
+#include "sha1.h"
+#include "stream.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,6 +23,10 @@ typedef struct libsign_signature
 
     libsign_timestamp creation_time;
     libsign_key_id issuer;
+    /* from the hashed subpackets only, 0 when there are none */
+    uint8_t key_flags;
+    /* seconds after the key's creation, 0 when it does not expire */
+    uint32_t key_expiration;
 
     uint8_t *hashed_data;
     uint32_t hashed_data_len;
@@ -27,9 +34,49 @@ typedef struct libsign_signature
     uint16_t short_hash;
 
     mpz_t s;
+
+    /* where everything parsed is allocated from, if not the heap */
+    libsign_arena *arena;
 } libsign_signature;
 
+/* A signature borrowed from the buffer it was parsed from, nothing is copied
+   and the MPI is only imported when a verification needs it. */
+typedef struct libsign_signature_view
+{
+    enum pgp_sig_version version;
+    enum pgp_signature_type type;
+    enum pgp_public_key_algorithm pk_algo;
+    enum pgp_hash_algorithm hash_algo;
+
+    libsign_timestamp creation_time;
+    libsign_key_id issuer;
+    /* from the hashed subpackets only, 0 when there are none */
+    uint8_t key_flags;
+    /* seconds after the key's creation, 0 when it does not expire */
+    uint32_t key_expiration;
+
+    const uint8_t *hashed_data;
+    uint32_t hashed_data_len;
+
+    uint16_t short_hash;
+
+    /* the signature MPI, length header included */
+    const uint8_t *s;
+    uint32_t s_len;
+
+    /* the body of the first embedded signature (5.2.3.26), NULL if none.
+       a subkey binding carries the subkey's back-signature there. */
+    const uint8_t *embedded;
+    uint32_t embedded_len;
+
+    /* octets of the packet body used */
+    uint32_t len;
+} libsign_signature_view;
+
 void signature_init(libsign_signature *sig);
+/* allocate everything parsed into the signature from the arena, see
+   public_key_init_arena() */
+void signature_init_arena(libsign_signature *sig, libsign_arena *arena);
 void signature_destroy(libsign_signature *sig);
 
 int parse_signature(libsign_signature *sig, const char *filename);
@@ -37,12 +84,43 @@ int parse_signature_buffer(libsign_signature *sig, const uint8_t *buffer,
                            uint32_t datalen);
 int parse_signature_armor_buffer(libsign_signature *sig, const uint8_t *buffer,
                                  uint32_t datalen);
+/* decode the armor over itself and parse it, buffer is clobbered */
+int parse_signature_armor_inplace(libsign_signature *sig, uint8_t *buffer, uint32_t datalen);
+
+/* parse a signature packet body, or the first signature packet in a buffer */
+int signature_view_parse(libsign_signature_view *view, const uint8_t *body, uint32_t len);
+int parse_signature_view(libsign_signature_view *view, const uint8_t *buffer,
+                         uint32_t datalen);
+/* copy a view into a signature that owns its data */
+int signature_from_view(libsign_signature *sig, const libsign_signature_view *view);
 
 int process_signature_packet(const uint8_t **data, uint32_t *datalen,
                              libsign_signature *ctx);
 int process_signature_subpackets(const uint8_t **data, uint32_t *datalen,
                                  int subdatalen, libsign_signature *ctx);
 
+/* hash the signature suffix, the hashed part of a v4 signature and its
+   trailer, into a hash of the signed data (5.2.4) */
+void signature_hash_suffix(sha1_ctx *hash, const uint8_t *hashed_data, uint32_t hashed_data_len);
+
+/* the octets following the data in the hash of a v4 signature */
+#define SIGNATURE_SUFFIX_LEN(hashed_data_len)   ((hashed_data_len) + 6)
+
+/* copy the signature suffix into buf, for hashing the data somewhere else.
+   returns its length, -ENOSPC if it does not fit in size, -EINVAL if the
+   signature is not v4. */
+int signature_suffix(const libsign_signature *sig, uint8_t *buf, uint32_t size);
+
+/* serialize the signature, as a binary packet or armored */
+int signature_write(libsign_signature *sig, libsign_write_fn write, void *opaque);
+/* a subkey binding, with the back-signature of the subkey embedded in the
+   unhashed subpackets (5.2.3.26) as gnupg puts it, unless it is among the
+   hashed ones already. back may be NULL. */
+int signature_write_binding(libsign_signature *sig, libsign_signature *back,
+                            libsign_write_fn write, void *opaque);
+int signature_write_armor(libsign_signature *sig, uint32_t line_width,
+                          libsign_write_fn write, void *opaque);
+
 int decode_signature_armor(const uint8_t *data, uint32_t datalen, uint8_t **plain_out,
                            uint32_t *plain_len);
 
@@ -0,0 +1,204 @@
+#include "stats.h"
+
+#include <errno.h>
+#include <string.h>
+
+static const char *stat_names[LIBSIGN_NUM_STATS] = {
+    "read",
+    "decode_armor",
+    "parse_packet_header",
+    "sha1_update",
+    "rsa_sha1_verify"
+};
+
+const char *libsign_stat_name(enum libsign_stat stat)
+{
+    if((unsigned int)stat >= LIBSIGN_NUM_STATS)
+        return NULL;
+
+    return stat_names[stat];
+}
+
+#ifdef LIBSIGN_STATS
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* the blocks of two threads never share a cache line */
+#define STATS_CACHE_LINE    64
+
+typedef struct stats_block {
+    libsign_stats stats;
+    /* the reset the counters were last cleared for */
+    uint64_t generation;
+    struct stats_block *next;
+} stats_block;
+
+/* the counters of the running threads, and the sum of those that exited */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static stats_block *blocks;
+static libsign_stats retired;
+/* bumped by every reset. only the owner of a block writes its counters, so
+   a reset does not clear them itself: the owner does when it sees a new
+   generation, and until then the block counts as zero. */
+static uint64_t generation;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t block_key;
+static __thread stats_block *local;
+
+/* the owner writes its counters with plain stores, the snapshot reads them
+   from another thread */
+static uint64_t load(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void bump(uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n(counter, load(counter) + value, __ATOMIC_RELAXED);
+}
+
+static void add_stats(libsign_stats *to, const libsign_stats *from)
+{
+    int i;
+
+    for(i = 0; i < LIBSIGN_NUM_STATS; i++) {
+        to->counters[i].calls += load(&from->counters[i].calls);
+        to->counters[i].bytes += load(&from->counters[i].bytes);
+        to->counters[i].nsec += load(&from->counters[i].nsec);
+        to->counters[i].allocations += load(&from->counters[i].allocations);
+    }
+}
+
+/* keep the counts of a thread that exits */
+static void thread_exit(void *arg)
+{
+    stats_block *block = arg, **p;
+
+    pthread_mutex_lock(&stats_lock);
+    for(p = &blocks; *p; p = &(*p)->next) {
+        if(*p == block) {
+            *p = block->next;
+            break;
+        }
+    }
+    if(__atomic_load_n(&block->generation, __ATOMIC_ACQUIRE) == generation)
+        add_stats(&retired, &block->stats);
+    pthread_mutex_unlock(&stats_lock);
+
+    free(block);
+}
+
+static void key_init(void)
+{
+    pthread_key_create(&block_key, thread_exit);
+}
+
+static stats_block *local_block(void)
+{
+    stats_block *block;
+    uint64_t current;
+    size_t size;
+
+    if(local) {
+        /* clear the counters after a reset, before counting again */
+        current = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+        if(local->generation != current) {
+            memset(&local->stats, 0, sizeof(libsign_stats));
+            __atomic_store_n(&local->generation, current, __ATOMIC_RELEASE);
+        }
+        return local;
+    }
+
+    pthread_once(&key_once, key_init);
+
+    size = (sizeof(stats_block) + STATS_CACHE_LINE - 1) & ~(size_t)(STATS_CACHE_LINE - 1);
+    block = aligned_alloc(STATS_CACHE_LINE, size);
+    if(!block)
+        return NULL;
+    memset(block, 0, size);
+
+    pthread_mutex_lock(&stats_lock);
+    block->generation = generation;
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&stats_lock);
+
+    pthread_setspecific(block_key, block);
+    local = block;
+
+    return block;
+}
+
+uint64_t libsign_stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void libsign_stats_add(enum libsign_stat stat, uint64_t bytes, uint64_t nsec)
+{
+    stats_block *block = local_block();
+    libsign_stat_counter *counter;
+
+    if(!block)
+        return;
+
+    counter = &block->stats.counters[stat];
+    bump(&counter->calls, 1);
+    bump(&counter->bytes, bytes);
+    bump(&counter->nsec, nsec);
+}
+
+void libsign_stats_alloc(enum libsign_stat stat)
+{
+    stats_block *block = local_block();
+
+    if(block)
+        bump(&block->stats.counters[stat].allocations, 1);
+}
+
+int libsign_stats_snapshot(libsign_stats *stats)
+{
+    stats_block *block;
+
+    memset(stats, 0, sizeof(libsign_stats));
+
+    pthread_mutex_lock(&stats_lock);
+    add_stats(stats, &retired);
+    for(block = blocks; block; block = block->next) {
+        if(__atomic_load_n(&block->generation, __ATOMIC_ACQUIRE) == generation)
+            add_stats(stats, &block->stats);
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    return 0;
+}
+
+void libsign_stats_reset(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    memset(&retired, 0, sizeof(libsign_stats));
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&stats_lock);
+}
+
+#else
+
+int libsign_stats_snapshot(libsign_stats *stats)
+{
+    memset(stats, 0, sizeof(libsign_stats));
+
+    return -ENOTSUP;
+}
+
+void libsign_stats_reset(void)
+{
+}
+
+#endif /* LIBSIGN_STATS */
@@ -0,0 +1,68 @@
+#ifndef __LIBSIGN_STATS_H
+#define __LIBSIGN_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the stages of parsing and verifying that are counted */
+enum libsign_stat {
+    LIBSIGN_STAT_READ,
+    LIBSIGN_STAT_DECODE_ARMOR,
+    LIBSIGN_STAT_PARSE_PACKET_HEADER,
+    LIBSIGN_STAT_SHA1_UPDATE,
+    LIBSIGN_STAT_RSA_SHA1_VERIFY,
+    LIBSIGN_NUM_STATS
+};
+
+typedef struct libsign_stat_counter {
+    uint64_t calls;
+    /* the data read, decoded, parsed or hashed */
+    uint64_t bytes;
+    uint64_t nsec;
+    /* heap allocations made by the library in the stage */
+    uint64_t allocations;
+} libsign_stat_counter;
+
+typedef struct libsign_stats {
+    libsign_stat_counter counters[LIBSIGN_NUM_STATS];
+} libsign_stats;
+
+/* Counters of each stage, when the library is built with LIBSIGN_STATS.
+   Every thread counts on its own, without locking or shared cache lines,
+   and the snapshot adds up those of all the threads, including the ones
+   that have exited. A thread counting while the snapshot is taken may be
+   caught halfway through a call. -ENOTSUP if the library is built without
+   them, stats is zeroed. */
+int libsign_stats_snapshot(libsign_stats *stats);
+/* start all the counters again from zero. each thread clears its own the
+   next time it counts, they read as zero until then. a call being counted
+   while the reset is made may be lost. */
+void libsign_stats_reset(void);
+/* e.g. "sha1_update" */
+const char *libsign_stat_name(enum libsign_stat stat);
+
+/* used by the library around the stages, nothing at all without
+   LIBSIGN_STATS */
+#ifdef LIBSIGN_STATS
+uint64_t libsign_stats_clock(void);
+void libsign_stats_add(enum libsign_stat stat, uint64_t bytes, uint64_t nsec);
+void libsign_stats_alloc(enum libsign_stat stat);
+
+#define LIBSIGN_STAT_BEGIN(start)            uint64_t start = libsign_stats_clock()
+#define LIBSIGN_STAT_END(stat, start, bytes) \
+    libsign_stats_add((stat), (bytes), libsign_stats_clock() - (start))
+#define LIBSIGN_STAT_ALLOC(stat)             libsign_stats_alloc(stat)
+#else
+#define LIBSIGN_STAT_BEGIN(start)            do {} while(0)
+#define LIBSIGN_STAT_END(stat, start, bytes) do {} while(0)
+#define LIBSIGN_STAT_ALLOC(stat)             do {} while(0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_STATS_H */
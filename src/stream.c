@@ -0,0 +1,558 @@
+#include "stream.h"
+#include "crc24.h"
+#include "packet.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+/* memset through a volatile pointer, so clearing a buffer that is about to
+   be freed or go out of scope is not optimized away */
+static void *(*const volatile wipe_memset)(void *, int, size_t) = memset;
+
+/* (6.2) every armor header line starts like this */
+static const char armor_begin[] = "-----BEGIN PGP ";
+
+void packet_stream_init(libsign_packet_stream *ps, int armored, uint8_t *work,
+                        uint32_t work_size, libsign_packet_fn packet, void *opaque)
+{
+    memset(ps, 0, sizeof(libsign_packet_stream));
+
+    ps->packet = packet;
+    ps->opaque = opaque;
+    ps->armored = armored;
+    ps->armor_state = ARMOR_HEADER_LINE;
+    base64_decoder_init(&ps->decoder);
+    ps->crc = CRC24_INIT;
+    ps->work = work;
+    ps->work_size = work_size;
+    ps->tags = LIBSIGN_ALL_TAGS;
+}
+
+void packet_stream_set_tags(libsign_packet_stream *ps, uint64_t tags)
+{
+    ps->tags = tags;
+}
+
+/* hand out the complete packets at the start of buffer, consumed is set to
+   the number of octets used up. */
+static int emit_packets(libsign_packet_stream *ps, const uint8_t *buffer, uint32_t len,
+                        uint32_t *consumed)
+{
+    int ret = 0;
+    uint32_t pos = 0;
+
+    while(pos < len && !ps->skip) {
+        uint32_t header_len, packet_size, avail = len - pos;
+        int tag = packet_header_peek(buffer + pos, avail, &header_len, &packet_size);
+        if(tag == -EAGAIN)
+            break;
+        if(tag < 0) {
+            ret = tag;
+            break;
+        }
+
+        /* packets that are not wanted, or could never fit in the working
+           buffer, are passed over wherever they happen to be */
+        if(!(ps->tags & LIBSIGN_TAG_BIT(tag)) || packet_size > ps->work_size - header_len) {
+            ps->num_packets++;
+            if(ps->tags & LIBSIGN_TAG_BIT(tag)) {
+                ret = ps->packet(ps->opaque, tag, NULL, packet_size);
+                if(ret < 0)
+                    break;
+                ret = 0;
+            }
+
+            if(packet_size <= avail - header_len)
+                pos += header_len + packet_size;
+            else {
+                ps->skip = packet_size - (avail - header_len);
+                pos = len;
+            }
+            continue;
+        }
+
+        if(packet_size > avail - header_len)
+            break;
+
+        ps->num_packets++;
+        ret = ps->packet(ps->opaque, tag, buffer + pos + header_len, packet_size);
+        if(ret < 0)
+            break;
+        ret = 0;
+
+        pos += header_len + packet_size;
+    }
+
+    *consumed = pos;
+
+    return ret;
+}
+
+/* take plain packet data, complete packets are handed out straight from data
+   when possible and the rest is kept in the working buffer */
+static int push_plain(libsign_packet_stream *ps, const uint8_t *data, size_t datalen)
+{
+    int ret;
+    uint32_t consumed;
+
+    while(datalen) {
+        uint32_t len;
+
+        if(ps->skip) {
+            len = datalen < ps->skip ? datalen : ps->skip;
+            ps->skip -= len;
+            data += len;
+            datalen -= len;
+            continue;
+        }
+
+        len = datalen > UINT32_MAX ? UINT32_MAX : datalen;
+
+        if(ps->work_len == 0) {
+            ret = emit_packets(ps, data, len, &consumed);
+            if(ret < 0)
+                return ret;
+
+            data += consumed;
+            datalen -= consumed;
+            if(ps->skip || consumed == len)
+                continue;
+            len -= consumed;
+        }
+
+        /* keep what is left of an incomplete packet */
+        if(len > ps->work_size - ps->work_len)
+            len = ps->work_size - ps->work_len;
+        memcpy(ps->work + ps->work_len, data, len);
+        ps->work_len += len;
+        data += len;
+        datalen -= len;
+
+        ret = emit_packets(ps, ps->work, ps->work_len, &consumed);
+        if(ret < 0)
+            return ret;
+
+        ps->work_len -= consumed;
+        memmove(ps->work, ps->work + consumed, ps->work_len);
+    }
+
+    return 0;
+}
+
+static int push_encoded(libsign_packet_stream *ps, const uint8_t *data, size_t datalen)
+{
+    int ret;
+    uint8_t plain[BASE64_DECODED_MAX(LIBSIGN_STREAM_READ_SIZE)];
+
+    while(datalen) {
+        size_t len = datalen < LIBSIGN_STREAM_READ_SIZE ? datalen : LIBSIGN_STREAM_READ_SIZE;
+        size_t plain_len;
+        LIBSIGN_STAT_BEGIN(start);
+
+        plain_len = base64_decode_update(&ps->decoder, data, len, plain);
+        ps->crc = crc24_update(ps->crc, plain_len, plain);
+
+        LIBSIGN_STAT_END(LIBSIGN_STAT_DECODE_ARMOR, start, len);
+
+        ret = push_plain(ps, plain, plain_len);
+        if(ps->wipe)
+            wipe_memset(plain, 0, plain_len);
+        if(ret < 0)
+            return ret;
+
+        data += len;
+        datalen -= len;
+    }
+
+    return 0;
+}
+
+/* (6.2) walk through the armor header line, the armor headers, the armored
+   data, the checksum and the tail. */
+static int feed_armor(libsign_packet_stream *ps, const uint8_t *p, const uint8_t *end)
+{
+    int ret;
+    const uint8_t *newline;
+
+    while(p < end) {
+        switch(ps->armor_state) {
+        case ARMOR_HEADER_LINE:
+            if(ps->line_pos < sizeof(armor_begin) - 1) {
+                if(*p++ != (uint8_t)armor_begin[ps->line_pos++])
+                    return -EINVAL;
+                break;
+            }
+
+            newline = memchr(p, '\n', end - p);
+            if(!newline)
+                return 0;
+
+            p = newline + 1;
+            ps->armor_state = ARMOR_HEADERS;
+            ps->line_empty = 1;
+            break;
+        case ARMOR_HEADERS:
+            /* the headers end with a blank line, with or without \r */
+            if(*p == '\n') {
+                if(ps->line_empty) {
+                    ps->armor_state = ARMOR_BODY;
+                    ps->line_pos = 0;
+                }
+                ps->line_empty = 1;
+            }
+            else if(*p != '\r')
+                ps->line_empty = 0;
+            p++;
+            break;
+        case ARMOR_BODY:
+            if(ps->line_pos == 0) {
+                /* the checksum line, the tail without one is not accepted */
+                if(*p == '=') {
+                    ps->armor_state = ARMOR_CHECKSUM;
+                    p++;
+                    break;
+                }
+                if(*p == '-')
+                    return -EINVAL;
+            }
+
+            /* decode up to and including the end of the line, the decoder
+               skips the line break */
+            newline = memchr(p, '\n', end - p);
+            if(newline) {
+                ret = push_encoded(ps, p, newline + 1 - p);
+                p = newline + 1;
+                ps->line_pos = 0;
+            }
+            else {
+                ret = push_encoded(ps, p, end - p);
+                p = end;
+                ps->line_pos = 1;
+            }
+            if(ret < 0)
+                return ret;
+            break;
+        case ARMOR_CHECKSUM:
+            if(*p == '\n') {
+                if(ps->line_pos != 4)
+                    return -EINVAL;
+                ps->armor_state = ARMOR_TAIL;
+            }
+            else if(*p != '\r') {
+                if(ps->line_pos == 4)
+                    return -EINVAL;
+                ps->checksum[ps->line_pos++] = *p;
+            }
+            p++;
+            break;
+        case ARMOR_TAIL:
+            /* the tail line and anything after it is of no interest */
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+int packet_stream_feed(libsign_packet_stream *ps, const uint8_t *data, size_t datalen)
+{
+    if(ps->armored)
+        return feed_armor(ps, data, data + datalen);
+
+    return push_plain(ps, data, datalen);
+}
+
+int packet_stream_finish(libsign_packet_stream *ps)
+{
+    if(ps->armored) {
+        uint8_t crc_plain[3];
+        uint32_t expected_crc24;
+
+        if(ps->armor_state == ARMOR_CHECKSUM && ps->line_pos == 4)
+            ps->armor_state = ARMOR_TAIL;
+        if(ps->armor_state != ARMOR_TAIL)
+            return -EINVAL;
+
+        if(base64_decode(ps->checksum, 4, crc_plain) != 3)
+            return -EINVAL;
+
+        expected_crc24 = (crc_plain[0] << 16) | (crc_plain[1] << 8) | crc_plain[2];
+        if(ps->crc != expected_crc24)
+            return -EINVAL;
+    }
+
+    /* the data must end on a packet boundary */
+    if(ps->work_len || ps->skip || !ps->num_packets)
+        return -EINVAL;
+
+    return 0;
+}
+
+ssize_t fd_read(void *opaque, uint8_t *buffer, size_t len)
+{
+    int fd = *(int*)opaque;
+
+    for(;;) {
+        ssize_t num;
+        LIBSIGN_STAT_BEGIN(start);
+
+        num = read(fd, buffer, len);
+        LIBSIGN_STAT_END(LIBSIGN_STAT_READ, start, num > 0 ? num : 0);
+        if(num >= 0)
+            return num;
+        if(errno != EINTR)
+            return -errno;
+    }
+}
+
+int parse_packets_callback(libsign_read_fn read_fn, void *read_opaque, int armored,
+                           libsign_packet_fn packet, void *opaque)
+{
+    return parse_packets_callback_tags(read_fn, read_opaque, armored, LIBSIGN_ALL_TAGS,
+                                       packet, opaque);
+}
+
+static int parse_packets(libsign_read_fn read_fn, void *read_opaque, int armored,
+                         uint64_t tags, int wipe, libsign_packet_fn packet, void *opaque)
+{
+    int ret;
+    ssize_t num;
+    uint8_t buffer[LIBSIGN_STREAM_READ_SIZE];
+    uint8_t *work;
+    libsign_packet_stream ps;
+
+    work = malloc(LIBSIGN_STREAM_WORK_SIZE);
+    if(!work)
+        return -ENOMEM;
+
+    packet_stream_init(&ps, armored, work, LIBSIGN_STREAM_WORK_SIZE, packet, opaque);
+    packet_stream_set_tags(&ps, tags);
+    ps.wipe = wipe;
+
+    while((num = read_fn(read_opaque, buffer, sizeof(buffer))) > 0) {
+        ret = packet_stream_feed(&ps, buffer, num);
+        if(ret < 0)
+            goto exit;
+    }
+
+    if(num < 0)
+        ret = num;
+    else
+        ret = packet_stream_finish(&ps);
+
+exit:
+    if(wipe) {
+        wipe_memset(buffer, 0, sizeof(buffer));
+        wipe_memset(work, 0, LIBSIGN_STREAM_WORK_SIZE);
+    }
+    free(work);
+
+    return ret;
+}
+
+int parse_packets_callback_tags(libsign_read_fn read_fn, void *read_opaque, int armored,
+                                uint64_t tags, libsign_packet_fn packet, void *opaque)
+{
+    return parse_packets(read_fn, read_opaque, armored, tags, 0, packet, opaque);
+}
+
+int parse_packets_fd(int fd, int armored, libsign_packet_fn packet, void *opaque)
+{
+    return parse_packets_callback(fd_read, &fd, armored, packet, opaque);
+}
+
+int parse_packets_fd_secret(int fd, int armored, libsign_packet_fn packet, void *opaque)
+{
+    return parse_packets(fd_read, &fd, armored, LIBSIGN_ALL_TAGS, 1, packet, opaque);
+}
+
+int parse_packets_fd_tags(int fd, int armored, uint64_t tags, libsign_packet_fn packet,
+                          void *opaque)
+{
+    return parse_packets_callback_tags(fd_read, &fd, armored, tags, packet, opaque);
+}
+
+void body_reader_init(libsign_body_reader *reader, libsign_body_fn body, void *opaque)
+{
+    memset(reader, 0, sizeof(libsign_body_reader));
+
+    reader->body = body;
+    reader->opaque = opaque;
+    reader->state = BODY_HEADER;
+}
+
+/* collect a header or length octet by octet until it can be parsed. the
+   octets are only copied when it is split between two pushes. */
+static int gather_length(libsign_body_reader *reader, const uint8_t **p, const uint8_t *end)
+{
+    const uint8_t *src = *p;
+    uint32_t avail = end - *p, used, len, header_len;
+    int ret, len_type;
+
+    if(reader->header_len) {
+        used = sizeof(reader->header) - reader->header_len;
+        if(used > avail)
+            used = avail;
+        memcpy(reader->header + reader->header_len, *p, used);
+        src = reader->header;
+        avail = reader->header_len + used;
+    }
+
+    if(reader->state == BODY_HEADER) {
+        ret = packet_header_peek_length(src, avail, &header_len, &len, &len_type);
+        if(ret >= 0) {
+            reader->tag = ret;
+            reader->flags = LIBSIGN_BODY_FIRST;
+        }
+    }
+    else {
+        ret = packet_length_peek(src, avail, &len, &len_type);
+        header_len = ret;
+    }
+
+    if(ret == -EAGAIN) {
+        /* keep what there is for the next push */
+        if(!reader->header_len) {
+            memcpy(reader->header, *p, avail);
+            reader->header_len = avail;
+        }
+        else
+            reader->header_len = avail;
+        *p = end;
+        return 0;
+    }
+    if(ret < 0)
+        return ret;
+
+    /* step over the octets of the header taken from this push */
+    *p += header_len - reader->header_len;
+    reader->header_len = 0;
+
+    reader->len_type = len_type;
+    reader->remaining = len;
+    reader->state = BODY_DATA;
+
+    return 0;
+}
+
+int body_reader_feed(libsign_body_reader *reader, const uint8_t *data, size_t datalen)
+{
+    int ret;
+    const uint8_t *p = data, *end = data + datalen;
+
+    while(p < end || reader->state == BODY_DATA) {
+        uint32_t n;
+        unsigned int flags;
+
+        if(reader->state != BODY_DATA) {
+            ret = gather_length(reader, &p, end);
+            if(ret < 0)
+                return ret;
+            continue;
+        }
+
+        if(reader->len_type == PACKET_LEN_INDETERMINATE) {
+            /* everything up to body_reader_finish() */
+            if(p == end)
+                break;
+            n = end - p > UINT32_MAX ? UINT32_MAX : end - p;
+            ret = reader->body(reader->opaque, reader->tag, p, n, reader->flags);
+            if(ret < 0)
+                return ret;
+            reader->flags = 0;
+            p += n;
+            continue;
+        }
+
+        n = (size_t)(end - p) < reader->remaining ? (uint32_t)(end - p) : reader->remaining;
+        flags = reader->flags;
+        if(n == reader->remaining && reader->len_type == PACKET_LEN_DEFINITE)
+            flags |= LIBSIGN_BODY_LAST;
+
+        /* nothing to hand out until more data arrives */
+        if(!n && !(flags & LIBSIGN_BODY_LAST)) {
+            if(reader->remaining)
+                break;
+            reader->state = BODY_LENGTH;
+            continue;
+        }
+
+        ret = reader->body(reader->opaque, reader->tag, p, n, flags);
+        if(ret < 0)
+            return ret;
+
+        reader->flags = 0;
+        reader->remaining -= n;
+        p += n;
+
+        if(!reader->remaining)
+            reader->state = flags & LIBSIGN_BODY_LAST ? BODY_HEADER : BODY_LENGTH;
+    }
+
+    return 0;
+}
+
+int body_reader_finish(libsign_body_reader *reader)
+{
+    if(reader->state == BODY_DATA && reader->len_type == PACKET_LEN_INDETERMINATE) {
+        reader->state = BODY_HEADER;
+        return reader->body(reader->opaque, reader->tag, NULL, 0,
+                            reader->flags | LIBSIGN_BODY_LAST);
+    }
+
+    if(reader->state != BODY_HEADER || reader->header_len)
+        return -EINVAL;
+
+    return 0;
+}
+
+int parse_bodies_callback(libsign_read_fn read_fn, void *read_opaque, libsign_body_fn body,
+                          void *opaque)
+{
+    int ret;
+    ssize_t num;
+    uint8_t buffer[LIBSIGN_STREAM_READ_SIZE];
+    libsign_body_reader reader;
+
+    body_reader_init(&reader, body, opaque);
+
+    while((num = read_fn(read_opaque, buffer, sizeof(buffer))) > 0) {
+        ret = body_reader_feed(&reader, buffer, num);
+        if(ret < 0)
+            return ret;
+    }
+
+    if(num < 0)
+        return num;
+
+    return body_reader_finish(&reader);
+}
+
+int parse_bodies_fd(int fd, libsign_body_fn body, void *opaque)
+{
+    return parse_bodies_callback(fd_read, &fd, body, opaque);
+}
+
+int fd_write(void *opaque, const uint8_t *buffer, size_t len)
+{
+    int fd = *(int*)opaque;
+
+    while(len) {
+        ssize_t num = write(fd, buffer, len);
+        if(num < 0) {
+            if(errno == EINTR)
+                continue;
+            return -errno;
+        }
+        buffer += num;
+        len -= num;
+    }
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#ifndef __LIBSIGN_STREAM_H
+#define __LIBSIGN_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "base64.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* packets are assembled in a working buffer of this size, larger packets
+   are skipped (see libsign_packet_fn) */
+#define LIBSIGN_STREAM_WORK_SIZE    (64 * 1024)
+/* size of the reads done by parse_packets_fd and parse_packets_callback */
+#define LIBSIGN_STREAM_READ_SIZE    4096
+
+/* read up to len octets into buffer, returns the number read, 0 at the end
+   of the data or a negative error */
+typedef ssize_t (*libsign_read_fn)(void *opaque, uint8_t *buffer, size_t len);
+/* write all of the len octets in buffer, returns 0 or a negative error */
+typedef int (*libsign_write_fn)(void *opaque, const uint8_t *buffer, size_t len);
+
+/* the bit of a tag in the mask of tags to hand out, see packet_stream_set_tags() */
+#define LIBSIGN_TAG_BIT(tag)    ((uint64_t)1 << (tag))
+#define LIBSIGN_ALL_TAGS        (~(uint64_t)0)
+
+/* called for every packet in the stream. body points into the working buffer
+   and is only valid during the call. if the packet did not fit into the
+   working buffer it is skipped and body is NULL. a negative return value
+   stops the parsing and is passed on to the caller. */
+typedef int (*libsign_packet_fn)(void *opaque, int tag, const uint8_t *body,
+                                 uint32_t len);
+
+enum packet_stream_armor_state {
+    ARMOR_HEADER_LINE,
+    ARMOR_HEADERS,
+    ARMOR_BODY,
+    ARMOR_CHECKSUM,
+    ARMOR_TAIL
+};
+
+/* An incremental packet parser. Data is pushed in pieces of any size; armor
+   is decoded, checksummed and split into packets in a single pass, using no
+   memory beyond the working buffer. When parsing armor the packets are
+   handed out before the checksum has been seen, so their contents must not
+   be trusted until packet_stream_finish() has returned 0. */
+typedef struct libsign_packet_stream {
+    libsign_packet_fn packet;
+    void *opaque;
+
+    int armored;
+    enum packet_stream_armor_state armor_state;
+    /* position in the current line, of the header line or the checksum */
+    uint32_t line_pos;
+    int line_empty;
+    base64_decoder decoder;
+    uint32_t crc;
+    uint8_t checksum[4];
+
+    /* the tags handed out, one bit per tag */
+    uint64_t tags;
+
+    uint8_t *work;
+    uint32_t work_size;
+    uint32_t work_len;
+    /* octets left of a packet too large for the working buffer, or of one
+       that is not wanted */
+    uint32_t skip;
+    uint32_t num_packets;
+
+    /* clear the decoded armor once it has been handed on, for secret keys */
+    int wipe;
+} libsign_packet_stream;
+
+void packet_stream_init(libsign_packet_stream *ps, int armored, uint8_t *work,
+                        uint32_t work_size, libsign_packet_fn packet, void *opaque);
+/* only hand out packets whose tag bit is set in tags. the others are passed
+   over by their length, their bodies are neither copied nor looked at. */
+void packet_stream_set_tags(libsign_packet_stream *ps, uint64_t tags);
+int packet_stream_feed(libsign_packet_stream *ps, const uint8_t *data, size_t datalen);
+/* check that the data ended on a packet boundary and that the armor checksum
+   matches */
+int packet_stream_finish(libsign_packet_stream *ps);
+
+int parse_packets_fd(int fd, int armored, libsign_packet_fn packet, void *opaque);
+int parse_packets_callback(libsign_read_fn read_fn, void *read_opaque, int armored,
+                           libsign_packet_fn packet, void *opaque);
+/* as parse_packets_fd, for secret keys: every buffer the packets went
+   through is cleared before it is let go */
+int parse_packets_fd_secret(int fd, int armored, libsign_packet_fn packet, void *opaque);
+/* as above, for the packets with the given tags only */
+int parse_packets_fd_tags(int fd, int armored, uint64_t tags, libsign_packet_fn packet,
+                          void *opaque);
+int parse_packets_callback_tags(libsign_read_fn read_fn, void *read_opaque, int armored,
+                                uint64_t tags, libsign_packet_fn packet, void *opaque);
+
+/* flags for libsign_body_fn */
+#define LIBSIGN_BODY_FIRST  0x01
+#define LIBSIGN_BODY_LAST   0x02
+
+/* called with each piece of a packet body as it arrives. the first piece of
+   a packet has LIBSIGN_BODY_FIRST set and the last LIBSIGN_BODY_LAST, which
+   may come with no data at all. a negative return value stops the parsing
+   and is passed on to the caller. */
+typedef int (*libsign_body_fn)(void *opaque, int tag, const uint8_t *data, uint32_t len,
+                               unsigned int flags);
+
+enum body_reader_state {
+    BODY_HEADER,
+    BODY_DATA,
+    BODY_LENGTH
+};
+
+/* Streams packet bodies of any length, including the partial and
+   indeterminate lengths used for data of unknown size. The bodies are never
+   collected, each piece is passed on straight from the data pushed in, so
+   the memory used does not depend on the size of the packets. Only binary
+   packets are taken, armor has to be removed first. */
+typedef struct libsign_body_reader {
+    libsign_body_fn body;
+    void *opaque;
+
+    enum body_reader_state state;
+    /* a header or partial length split between two pushes */
+    uint8_t header[6];
+    uint32_t header_len;
+
+    int tag;
+    int len_type;
+    unsigned int flags;
+    /* octets left of the current part of the body */
+    uint32_t remaining;
+} libsign_body_reader;
+
+void body_reader_init(libsign_body_reader *reader, libsign_body_fn body, void *opaque);
+int body_reader_feed(libsign_body_reader *reader, const uint8_t *data, size_t datalen);
+/* check that the data did not end in the middle of a packet */
+int body_reader_finish(libsign_body_reader *reader);
+
+int parse_bodies_fd(int fd, libsign_body_fn body, void *opaque);
+int parse_bodies_callback(libsign_read_fn read_fn, void *read_opaque, libsign_body_fn body,
+                          void *opaque);
+
+/* a libsign_read_fn and a libsign_write_fn for the file descriptor opaque
+   points to */
+ssize_t fd_read(void *opaque, uint8_t *buffer, size_t len);
+int fd_write(void *opaque, const uint8_t *buffer, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_STREAM_H */
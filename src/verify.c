@@ -8,6 +8,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "mpi.h"
+#include "probes.h"
 #include "rsa.h"
 
 #ifndef _MSC_VER
@@ -15,44 +17,324 @@
 #define O_BINARY 0
 #endif
 
-int verify(libsign_public_key *public_key, libsign_signature *signature, const char *filename)
+/* the key named by the issuer of a signature (5.2.3.5), the primary key
+   (NULL) or one of its subkeys. a signature without an issuer is taken to be
+   made by the primary key. */
+static int issuer_subkey(libsign_public_key *pub, libsign_key_id issuer,
+                         libsign_subkey **subkey)
 {
-    /* TODO: check key id for public key and signature here */
-    switch(public_key->pk_algo) {
-    case PGP_RSA:
-        switch(signature->hash_algo) {
-        case PGP_SHA1:
-            return rsa_sha1_verify_file(public_key, signature, filename);
-            break;
-        default:
-            return -ENOTSUP;
-            break;
-        }
-        break;
-    default:
-        return -ENOTSUP;
-        break;
+    *subkey = NULL;
+
+    if(!issuer || issuer == pub->key_id)
+        return 0;
+
+    *subkey = public_key_subkey(pub, issuer);
+
+    return *subkey ? 0 : -ENOKEY;
+}
+
+/* the key material of the primary key or the subkey, if it may sign and had
+   not expired when the signature was made */
+static int signing_key(libsign_public_key *pub, libsign_subkey *subkey, libsign_timestamp created,
+                       enum pgp_public_key_algorithm *pk_algo, mpz_srcptr *n, mpz_srcptr *e)
+{
+    int ret;
+
+    /* the self-signatures are checked the first time they are needed. a key
+       shared between threads has been through verify_certifications()
+       before, as the keystores do. */
+    if(!pub->certs_checked && (ret = verify_certifications(pub, NULL)) < 0)
+        return ret;
+
+    /* 5.2.3.6, the subkeys go with the primary key */
+    if(pub->expires && created >= pub->expires)
+        return -EKEYEXPIRED;
+
+    if(!subkey) {
+        /* 5.2.3.21, a key whose flags are known must be allowed to sign */
+        if(pub->key_flags && !(pub->key_flags & PGP_KEY_FLAG_SIGN))
+            return -EKEYREJECTED;
+
+        *pk_algo = pub->pk_algo;
+        *n = pub->n;
+        *e = pub->e;
+
+        return 0;
     }
+
+    /* 5.2.1, only a subkey bound both ways signs for the primary key */
+    ret = public_key_subkey_signs(subkey, created);
+    if(ret < 0)
+        return ret;
+
+    *pk_algo = subkey->pk_algo;
+    *n = subkey->n;
+    *e = subkey->e;
+
+    return 0;
+}
+
+static int check_algorithms(libsign_public_key *public_key, libsign_subkey *subkey,
+                            libsign_signature *signature)
+{
+    int ret;
+    enum pgp_public_key_algorithm pk_algo;
+    mpz_srcptr n, e;
+
+    ret = signing_key(public_key, subkey, signature->creation_time, &pk_algo, &n, &e);
+    if(ret < 0)
+        return ret;
+
+    if(!PGP_RSA_SIGNS(pk_algo) || signature->hash_algo != PGP_SHA1)
+        return -ENOTSUP;
+
+    return 0;
+}
+
+/* and check the result against the signature */
+static int rsa_sha1_verify_suffix(rsa_public_key *key, const uint8_t *hashed_data,
+                                  uint32_t hashed_data_len, mpz_t s, sha1_ctx *hash,
+                                  libsign_scratch *scratch)
+{
+    int ret;
+
+    ret = rsa_public_key_prepare(key);
+    if(ret < 0)
+        return ret;
+
+    signature_hash_suffix(hash, hashed_data, hashed_data_len);
+
+    if(scratch)
+        return rsa_sha1_verify_scratch(key, hash, s, scratch);
+
+    return rsa_sha1_verify(key, hash, s);
+}
+
+static int rsa_sha1_verify_hash(libsign_public_key *pub_ctx, libsign_subkey *subkey,
+                                libsign_signature *sig_ctx, sha1_ctx *hash,
+                                libsign_scratch *scratch)
+{
+    int ret;
+    struct rsa_public_key key;
+    enum pgp_public_key_algorithm pk_algo;
+    mpz_srcptr n, e;
+
+    if(sig_ctx->version != PGP_SIG_VER4)
+        return -EINVAL;
+
+    ret = signing_key(pub_ctx, subkey, sig_ctx->creation_time, &pk_algo, &n, &e);
+    if(ret < 0)
+        return ret;
+    if(!PGP_RSA_SIGNS(pk_algo))
+        return -ENOTSUP;
+
+    /* only read, so the limbs of the key are used where they are */
+    mpz_roinit_n(key.n, mpz_limbs_read(n), mpz_size(n));
+    mpz_roinit_n(key.e, mpz_limbs_read(e), mpz_size(e));
+
+    return rsa_sha1_verify_suffix(&key, sig_ctx->hashed_data, sig_ctx->hashed_data_len,
+                                  sig_ctx->s, hash, scratch);
+}
+
+/* the MPIs of the views are imported here, the first time they are needed */
+static int rsa_sha1_verify_view_hash(const libsign_key_view *key_view,
+                                     const libsign_signature_view *sig_view, sha1_ctx *hash)
+{
+    int ret;
+    const uint8_t *mpi;
+    uint32_t mpi_len;
+    struct rsa_public_key key;
+    mpz_t s;
+
+    if(!PGP_RSA_SIGNS(key_view->pk_algo) || !PGP_RSA_SIGNS(sig_view->pk_algo) ||
+       sig_view->hash_algo != PGP_SHA1)
+        return -ENOTSUP;
+    if(sig_view->version != PGP_SIG_VER4)
+        return -EINVAL;
+
+    rsa_public_key_init(&key);
+    mpz_init(s);
+
+    mpi = key_view->n;
+    mpi_len = key_view->n_len;
+    if((ret = mpi_to_mpz(&mpi, &mpi_len, &key.n)) < 0)
+        goto exit;
+    mpi = key_view->e;
+    mpi_len = key_view->e_len;
+    if((ret = mpi_to_mpz(&mpi, &mpi_len, &key.e)) < 0)
+        goto exit;
+    mpi = sig_view->s;
+    mpi_len = sig_view->s_len;
+    if((ret = mpi_to_mpz(&mpi, &mpi_len, &s)) < 0)
+        goto exit;
+
+    ret = rsa_sha1_verify_suffix(&key, sig_view->hashed_data, sig_view->hashed_data_len,
+                                 s, hash, NULL);
+
+exit:
+    mpz_clear(s);
+    rsa_public_key_clear(&key);
+
+    return ret;
+}
+
+static int hash_fd(int fd, sha1_ctx *hash)
+{
+    libsign_hash_fanout fan;
+
+    sha1_init(hash);
+    hash_fanout_init(&fan, 0);
+    hash_fanout_add_sha1(&fan, hash);
+
+    return hash_fanout_fd(&fan, fd);
+}
+
+/* once the key, or the subkey, that made the signature has been found */
+static int verify_subkey_file(libsign_public_key *pub, libsign_subkey *subkey,
+                              libsign_signature *sig, const char *filename,
+                              libsign_scratch *scratch)
+{
+    int ret, fd;
+    sha1_ctx hash;
+
+    ret = check_algorithms(pub, subkey, sig);
+    if(ret < 0)
+        return ret;
+
+    fd = open(filename, O_RDONLY | O_BINARY);
+    if(fd == -1)
+        return -EINVAL;
+
+    ret = hash_fd(fd, &hash);
+
+    close(fd);
+
+    if(ret < 0)
+        return ret;
+
+    return rsa_sha1_verify_hash(pub, subkey, sig, &hash, scratch);
+}
+
+static int verify_subkey_data(libsign_public_key *pub, libsign_subkey *subkey,
+                              libsign_signature *sig, const uint8_t *data, uint32_t datalen,
+                              libsign_scratch *scratch)
+{
+    int ret;
+    sha1_ctx hash;
+
+    ret = check_algorithms(pub, subkey, sig);
+    if(ret < 0)
+        return ret;
+
+    sha1_init(&hash);
+    sha1_update(&hash, datalen, data);
+
+    return rsa_sha1_verify_hash(pub, subkey, sig, &hash, scratch);
+}
+
+int verify(libsign_public_key *public_key, libsign_signature *signature, const char *filename)
+{
+    return verify_scratch(public_key, signature, filename, NULL);
 }
 
 int verify_buffer(libsign_public_key *public_key, libsign_signature *signature,
                   const uint8_t *data, uint32_t datalen)
 {
-    /* TODO: check that the key id matches here */
-    switch(public_key->pk_algo) {
-    case PGP_RSA:
-        switch(signature->hash_algo) {
-        case PGP_SHA1:
-            return rsa_sha1_verify_data(public_key, signature, data, datalen);
-            break;
-        default:
-            return -ENOTSUP;
-            break;
-        }
-    default:
-        return -ENOTSUP;
-        break;
+    return verify_buffer_scratch(public_key, signature, data, datalen, NULL);
+}
+
+int verify_scratch(libsign_public_key *public_key, libsign_signature *signature,
+                   const char *filename, libsign_scratch *scratch)
+{
+    int ret;
+    libsign_subkey *subkey;
+
+    LIBSIGN_PROBE3(verify__entry, signature->issuer, filename, 0);
+
+    ret = issuer_subkey(public_key, signature->issuer, &subkey);
+    if(ret == 0)
+        ret = verify_subkey_file(public_key, subkey, signature, filename, scratch);
+
+    LIBSIGN_PROBE2(verify__return, signature->issuer, ret);
+
+    return ret;
+}
+
+int verify_buffer_scratch(libsign_public_key *public_key, libsign_signature *signature,
+                          const uint8_t *data, uint32_t datalen, libsign_scratch *scratch)
+{
+    int ret;
+    libsign_subkey *subkey;
+
+    LIBSIGN_PROBE3(verify__entry, signature->issuer, NULL, datalen);
+
+    ret = issuer_subkey(public_key, signature->issuer, &subkey);
+    if(ret == 0)
+        ret = verify_subkey_data(public_key, subkey, signature, data, datalen, scratch);
+
+    LIBSIGN_PROBE2(verify__return, signature->issuer, ret);
+
+    return ret;
+}
+
+int libsign_verify_midstate(libsign_public_key *public_key, libsign_signature *signature,
+                            const sha1_ctx *hash, libsign_scratch *scratch)
+{
+    int ret;
+    sha1_ctx copy;
+    libsign_subkey *subkey;
+
+    LIBSIGN_PROBE3(verify__entry, signature->issuer, NULL,
+                   ((uint64_t)hash->count[1] << 32 | hash->count[0]) >> 3);
+
+    ret = issuer_subkey(public_key, signature->issuer, &subkey);
+    if(ret == 0)
+        ret = check_algorithms(public_key, subkey, signature);
+    if(ret == 0) {
+        copy = *hash;
+        ret = rsa_sha1_verify_hash(public_key, subkey, signature, &copy, scratch);
     }
+
+    LIBSIGN_PROBE2(verify__return, signature->issuer, ret);
+
+    return ret;
+}
+
+/* the keystore finds the subkey along with the key, it is not looked for
+   again */
+int verify_keystore(libsign_keystore *ks, libsign_signature *signature, const char *filename)
+{
+    int ret = -ENOKEY;
+    libsign_public_key *pub;
+    libsign_subkey *subkey;
+
+    LIBSIGN_PROBE3(verify__entry, signature->issuer, filename, 0);
+
+    pub = keystore_find(ks, signature->issuer, &subkey);
+    if(pub)
+        ret = verify_subkey_file(pub, subkey, signature, filename, NULL);
+
+    LIBSIGN_PROBE2(verify__return, signature->issuer, ret);
+
+    return ret;
+}
+
+int verify_keystore_buffer(libsign_keystore *ks, libsign_signature *signature,
+                           const uint8_t *data, uint32_t datalen)
+{
+    int ret = -ENOKEY;
+    libsign_public_key *pub;
+    libsign_subkey *subkey;
+
+    LIBSIGN_PROBE3(verify__entry, signature->issuer, NULL, datalen);
+
+    pub = keystore_find(ks, signature->issuer, &subkey);
+    if(pub)
+        ret = verify_subkey_data(pub, subkey, signature, data, datalen, NULL);
+
+    LIBSIGN_PROBE2(verify__return, signature->issuer, ret);
+
+    return ret;
 }
 
 int rsa_sha1_verify_file(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
@@ -76,106 +358,567 @@ int rsa_sha1_verify_fd(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
                        int fd)
 {
     /* hash the data from the given fd and verify the result */
-    int ret = -EINVAL;
-    int num = 0;
-    uint8_t buffer[512];
-    struct sha1_ctx hash;
-    struct rsa_public_key key;
+    int ret;
+    sha1_ctx hash;
+    libsign_subkey *subkey;
 
-    rsa_public_key_init(&key);
+    ret = issuer_subkey(pub_ctx, sig_ctx->issuer, &subkey);
+    if(ret < 0)
+        return ret;
 
-    mpz_set(key.n, pub_ctx->n);
-    mpz_set(key.e, pub_ctx->e);
+    ret = hash_fd(fd, &hash);
+    if(ret < 0)
+        return ret;
+
+    return rsa_sha1_verify_hash(pub_ctx, subkey, sig_ctx, &hash, NULL);
+}
 
-    rsa_public_key_prepare(&key);
+/* 5.2.4 */
+int rsa_sha1_verify_data(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
+                          const uint8_t *data, uint32_t datalen)
+{
+    int ret;
+    sha1_ctx hash;
+    libsign_subkey *subkey;
 
-    /* hash the data */
+    ret = issuer_subkey(pub_ctx, sig_ctx->issuer, &subkey);
+    if(ret < 0)
+        return ret;
+
+    /* first hash the data */
     sha1_init(&hash);
-    while((num = read(fd, buffer, 512)) > 0)
-        sha1_update(&hash, num, buffer);
+    sha1_update(&hash, datalen, data);
 
-    if(num < 0)
-        goto exit;
+    return rsa_sha1_verify_hash(pub_ctx, subkey, sig_ctx, &hash, NULL);
+}
 
-    /* hash the hashed data from the signature */
-    sha1_update(&hash, sig_ctx->hashed_data_len,
-                sig_ctx->hashed_data);
+int verify_many(libsign_public_key **keys, libsign_signature **sigs, int *results,
+                unsigned int count, const char *filename, libsign_hash_fanout *extra)
+{
+    int ret;
+    unsigned int i;
+    int fd = open(filename, O_RDONLY | O_BINARY);
+    if(fd == -1) {
+        for(i = 0; i < count; i++)
+            results[i] = -EINVAL;
+        return -EINVAL;
+    }
 
-    /* then hash the trailer */
-    if(sig_ctx->version == PGP_SIG_VER4) {
-        uint8_t trailer[6];
-        /* version */
-        trailer[0] = 0x04;
+    ret = verify_many_fd(keys, sigs, results, count, fd, extra);
 
-        trailer[1] = 0xff;
+    close(fd);
 
-        /* big-endian length of the hashed data from
-           the signature */
-        trailer[5] = sig_ctx->hashed_data_len;
-        trailer[4] = sig_ctx->hashed_data_len >> 8;
-        trailer[3] = sig_ctx->hashed_data_len >> 16;
-        trailer[2] = sig_ctx->hashed_data_len >> 24;
+    return ret;
+}
 
-        sha1_update(&hash, 6, trailer);
+int verify_many_fd(libsign_public_key **keys, libsign_signature **sigs, int *results,
+                   unsigned int count, int fd, libsign_hash_fanout *extra)
+{
+    int ret, need_sha1 = 0;
+    unsigned int i;
+    sha1_ctx sha1;
+    libsign_hash_fanout fan;
+    libsign_subkey *subkey;
+
+    if(extra)
+        fan = *extra;
+    else
+        hash_fanout_init(&fan, 0);
+
+    /* every signature over the same hash algorithm shares one engine, the
+       per-signature suffix is only hashed once the data has been read. */
+    for(i = 0; i < count; i++) {
+        results[i] = issuer_subkey(keys[i], sigs[i]->issuer, &subkey);
+        if(results[i] == 0)
+            results[i] = check_algorithms(keys[i], subkey, sigs[i]);
+        if(results[i] == 0 && sigs[i]->hash_algo == PGP_SHA1)
+            need_sha1 = 1;
     }
-    else {
-        goto exit;
+
+    if(need_sha1) {
+        sha1_init(&sha1);
+        if((ret = hash_fanout_add_sha1(&fan, &sha1)) < 0)
+            goto fail;
     }
 
-    ret = rsa_sha1_verify(&key, &hash, sig_ctx->s);
+    ret = hash_fanout_fd(&fan, fd);
+    if(ret < 0)
+        goto fail;
+
+    for(i = 0; i < count; i++) {
+        if(results[i] == 0) {
+            sha1_ctx hash = sha1;
+            issuer_subkey(keys[i], sigs[i]->issuer, &subkey);
+            results[i] = rsa_sha1_verify_hash(keys[i], subkey, sigs[i], &hash, NULL);
+        }
+        if(results[i] && !ret)
+            ret = results[i];
+    }
+
+    return ret;
+
+fail:
+    /* the data was never hashed, none of the signatures that were still
+       waiting for it can be said to be good. */
+    for(i = 0; i < count; i++) {
+        if(results[i] == 0)
+            results[i] = ret;
+    }
+
+    return ret;
+}
+
+void cert_cache_init(libsign_cert_cache *cache)
+{
+    memset(cache, 0, sizeof(libsign_cert_cache));
+}
+
+void cert_cache_destroy(libsign_cert_cache *cache)
+{
+    free(cache->slots);
+    cert_cache_init(cache);
+}
+
+/* the IDs are hashes, their first octets do as an index */
+static libsign_cert_cache_entry *cache_slot(libsign_cert_cache_entry *slots,
+                                            uint32_t num_slots, const uint8_t *id)
+{
+    uint32_t i = (((uint32_t)id[0] << 24) | (id[1] << 16) | (id[2] << 8) | id[3]) & (num_slots - 1);
+
+    while(slots[i].status && memcmp(slots[i].id, id, SHA1_DIGEST_LENGTH) != 0)
+        i = (i + 1) & (num_slots - 1);
+
+    return &slots[i];
+}
+
+static int cache_add(libsign_cert_cache *cache, const uint8_t *id, uint8_t status)
+{
+    uint32_t i, num_slots;
+    libsign_cert_cache_entry *slots, *slot;
+
+    if(cache->count + 1 > cache->num_slots / 2) {
+        num_slots = cache->num_slots ? cache->num_slots * 2 : LIBSIGN_CERT_CACHE_MIN_SLOTS;
+        slots = calloc(num_slots, sizeof(libsign_cert_cache_entry));
+        if(!slots)
+            return -ENOMEM;
+
+        for(i = 0; i < cache->num_slots; i++) {
+            if(cache->slots[i].status)
+                *cache_slot(slots, num_slots, cache->slots[i].id) = cache->slots[i];
+        }
+
+        free(cache->slots);
+        cache->slots = slots;
+        cache->num_slots = num_slots;
+    }
+
+    slot = cache_slot(cache->slots, cache->num_slots, id);
+    if(!slot->status)
+        cache->count++;
+    memcpy(slot->id, id, SHA1_DIGEST_LENGTH);
+    slot->status = status;
+
+    return 0;
+}
+
+/* a certification is known by the hash of the data it signs, which covers
+   the key, and its signature */
+static void certification_id(const sha1_ctx *hash, mpz_t s, uint8_t id[SHA1_DIGEST_LENGTH])
+{
+    uint8_t digest[SHA1_DIGEST_LENGTH], mpi[MPI_MAX_SIZE];
+    size_t count;
+    sha1_ctx ctx = *hash;
+
+    sha1_digest(&ctx, digest);
+    mpz_export(mpi, &count, 1, 1, 1, 0, s);
+
+    sha1_init(&ctx);
+    sha1_update(&ctx, sizeof(digest), digest);
+    sha1_update(&ctx, count, mpi);
+    sha1_digest(&ctx, id);
+}
+
+/* 5.2.3.3, the flags and expiration time of a key are those of its newest
+   self-signature, or binding for a subkey, of the ones that checked out. a
+   subkey with none that did keeps the status of its last binding. */
+static void take_certifications(libsign_public_key *pub)
+{
+    int found = 0;
+    uint32_t i;
+    uint8_t s;
+    libsign_timestamp newest = 0;
+    libsign_subkey *subkey;
+
+    for(s = 0; s < pub->num_subkeys; s++) {
+        subkey = &pub->subkeys[s];
+        subkey->binding = LIBSIGN_CERT_UNCHECKED;
+        subkey->back_signature = LIBSIGN_CERT_UNCHECKED;
+        subkey->key_flags = 0;
+        subkey->expires = 0;
+    }
+
+    for(i = 0; i < pub->num_certs; i++) {
+        const libsign_certification *cert = &pub->certs[i];
+        const libsign_signature *sig = &cert->sig;
+
+        if(sig->type == PGP_SIG_SUBKEY_BINDING) {
+            subkey = &pub->subkeys[cert->target];
+            if(cert->status != LIBSIGN_CERT_VALID) {
+                if(subkey->binding != LIBSIGN_CERT_VALID)
+                    subkey->binding = cert->status;
+                continue;
+            }
+            if(subkey->binding == LIBSIGN_CERT_VALID && sig->creation_time < subkey->bound)
+                continue;
+
+            subkey->binding = LIBSIGN_CERT_VALID;
+            subkey->back_signature = cert->back_status;
+            subkey->bound = sig->creation_time;
+            subkey->key_flags = sig->key_flags;
+            subkey->expires = public_key_expires(subkey->created, sig->key_expiration);
+            continue;
+        }
+
+        if(cert->status != LIBSIGN_CERT_VALID || (found && sig->creation_time < newest))
+            continue;
+
+        found = 1;
+        newest = sig->creation_time;
+        pub->key_flags = sig->key_flags;
+        pub->expires = public_key_expires(pub->created, sig->key_expiration);
+    }
+}
+
+/* check a signature over midstate by key, or take its status from the cache.
+   key is NULL if it could not be prepared. returns the status, or a negative
+   error if it could not be added to the cache. */
+static int check_certification(struct rsa_public_key *key, enum pgp_public_key_algorithm pk_algo,
+                               const sha1_ctx *midstate, libsign_signature *sig,
+                               libsign_cert_cache *cache, int *checked)
+{
+    int ret, status;
+    uint8_t id[SHA1_DIGEST_LENGTH];
+    sha1_ctx hash;
+    libsign_cert_cache_entry *slot;
+
+    if(!key || !PGP_RSA_SIGNS(pk_algo) || !PGP_RSA_SIGNS(sig->pk_algo) ||
+       sig->hash_algo != PGP_SHA1 || sig->version != PGP_SIG_VER4 ||
+       mpz_sizeinbase(sig->s, 2) > 8 * (MPI_MAX_SIZE - 2))
+        return LIBSIGN_CERT_UNSUPPORTED;
+
+    hash = *midstate;
+    signature_hash_suffix(&hash, sig->hashed_data, sig->hashed_data_len);
+
+    if(cache) {
+        certification_id(&hash, sig->s, id);
+        if(cache->num_slots) {
+            slot = cache_slot(cache->slots, cache->num_slots, id);
+            if(slot->status)
+                return slot->status;
+        }
+    }
+
+    status = rsa_sha1_verify(key, &hash, sig->s) == 0 ? LIBSIGN_CERT_VALID
+                                                      : LIBSIGN_CERT_INVALID;
+    (*checked)++;
+
+    if(cache && (ret = cache_add(cache, id, status)) < 0)
+        return ret;
+
+    return status;
+}
+
+/* the back-signature of a binding is made by the subkey over the same data */
+static int check_back_signature(libsign_public_key *pub, libsign_certification *cert,
+                                libsign_cert_cache *cache, int *checked)
+{
+    int ret;
+    libsign_subkey *subkey = &pub->subkeys[cert->target];
+    struct rsa_public_key key;
+
+    rsa_public_key_init(&key);
+    mpz_set(key.n, subkey->n);
+    mpz_set(key.e, subkey->e);
+
+    ret = check_certification(rsa_public_key_prepare(&key) == 0 ? &key : NULL, subkey->pk_algo,
+                              &cert->midstate, &cert->back, cache, checked);
 
-exit:
     rsa_public_key_clear(&key);
 
     return ret;
 }
 
-/* 5.2.4 */
-int rsa_sha1_verify_data(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
-                          const uint8_t *data, uint32_t datalen)
+int verify_certifications(libsign_public_key *pub, libsign_cert_cache *cache)
 {
-    int ret = -EINVAL;
-    struct sha1_ctx hash;
+    int ret = 0, checked = 0, prepared;
+    uint32_t i;
     struct rsa_public_key key;
 
     rsa_public_key_init(&key);
+    mpz_set(key.n, pub->n);
+    mpz_set(key.e, pub->e);
+    /* there is nothing to check with a key too small to be prepared */
+    prepared = rsa_public_key_prepare(&key) == 0;
+
+    for(i = 0; i < pub->num_certs; i++) {
+        libsign_certification *cert = &pub->certs[i];
+
+        /* there is no key to check those made by other keys with */
+        if(cert->sig.issuer && cert->sig.issuer != pub->key_id)
+            continue;
+
+        if(cert->status == LIBSIGN_CERT_UNCHECKED) {
+            ret = check_certification(prepared ? &key : NULL, pub->pk_algo, &cert->midstate,
+                                      &cert->sig, cache, &checked);
+            if(ret < 0)
+                goto exit;
+            cert->status = ret;
+        }
 
-    mpz_set(key.n, pub_ctx->n);
-    mpz_set(key.e, pub_ctx->e);
+        /* only a binding that checks out has its back-signature checked */
+        if(cert->status == LIBSIGN_CERT_VALID && cert->back_status == LIBSIGN_CERT_UNCHECKED &&
+           cert->back.type == PGP_SIG_PRIMARY_KEY_BINDING) {
+            ret = check_back_signature(pub, cert, cache, &checked);
+            if(ret < 0)
+                goto exit;
+            cert->back_status = ret;
+        }
+    }
 
-    rsa_public_key_prepare(&key);
+    ret = checked;
+    take_certifications(pub);
+    pub->certs_checked = 1;
+
+exit:
+    rsa_public_key_clear(&key);
+
+    return ret;
+}
+
+/* the key, or the subkey, is found before the data is hashed */
+int verify_view_buffer(libsign_key_view *key, const libsign_signature_view *sig,
+                       const uint8_t *data, uint32_t datalen)
+{
+    int ret;
+    sha1_ctx hash;
+    libsign_key_view signer;
+
+    ret = key_view_signer(key, sig->issuer, sig->creation_time, &signer);
+    if(ret < 0)
+        return ret;
 
-    /* first hash the data */
     sha1_init(&hash);
     sha1_update(&hash, datalen, data);
-    /* hash the hashed data from the signature */
-    sha1_update(&hash, sig_ctx->hashed_data_len,
-                sig_ctx->hashed_data);
-    /* then hash the trailer */
-    if(sig_ctx->version == PGP_SIG_VER4) {
-        uint8_t trailer[6];
-        /* version */
-        trailer[0] = 0x04;
-
-        trailer[1] = 0xff;
-
-        /* big-endian length of the hashed data from
-           the signature */
-        trailer[5] = sig_ctx->hashed_data_len;
-        trailer[4] = sig_ctx->hashed_data_len >> 8;
-        trailer[3] = sig_ctx->hashed_data_len >> 16;
-        trailer[2] = sig_ctx->hashed_data_len >> 24;
-
-        sha1_update(&hash, 6, trailer);
-    }
-    else {
+
+    return rsa_sha1_verify_view_hash(&signer, sig, &hash);
+}
+
+int verify_view_fd(libsign_key_view *key, const libsign_signature_view *sig, int fd)
+{
+    int ret;
+    sha1_ctx hash;
+    libsign_key_view signer;
+
+    if(sig->hash_algo != PGP_SHA1)
+        return -ENOTSUP;
+
+    ret = key_view_signer(key, sig->issuer, sig->creation_time, &signer);
+    if(ret < 0)
+        return ret;
+
+    ret = hash_fd(fd, &hash);
+    if(ret < 0)
+        return ret;
+
+    return rsa_sha1_verify_view_hash(&signer, sig, &hash);
+}
+
+/* one-pass signature and signature packets are collected up to this size */
+#define MESSAGE_PACKET_MAX  4096
+
+typedef struct message_state {
+    libsign_public_key *pub;
+    libsign_write_fn write;
+    void *opaque;
+
+    sha1_ctx hash;
+    unsigned int num_one_pass;
+    unsigned int num_sigs;
+    /* 0 before the literal data packet, 1 in it and 2 after it */
+    int literal;
+    /* position in the literal data header, and its length once known */
+    uint32_t literal_pos;
+    uint32_t literal_header_len;
+
+    uint8_t packet[MESSAGE_PACKET_MAX];
+    uint32_t packet_len;
+
+    int result;
+} message_state;
+
+/* 5.4 */
+static int message_one_pass(message_state *state)
+{
+    const uint8_t *p = state->packet;
+
+    if(state->packet_len != 13 || p[0] != 3)
+        return -EINVAL;
+    /* the signatures must all come before the data */
+    if(state->literal)
+        return -EINVAL;
+
+    /* binary documents signed with RSA over SHA-1 only */
+    if(p[1] != PGP_SIG_BINARY_DOCUMENT || p[2] != PGP_SHA1 || !PGP_RSA_SIGNS(p[3]))
+        return -ENOTSUP;
+
+    state->num_one_pass++;
+
+    return 0;
+}
+
+static int message_signature(message_state *state)
+{
+    int ret;
+    sha1_ctx hash;
+    libsign_signature_view view;
+    libsign_signature sig;
+    libsign_subkey *subkey;
+
+    if(state->literal != 2)
+        return -EINVAL;
+
+    ret = signature_view_parse(&view, state->packet, state->packet_len);
+    if(ret < 0)
+        return ret;
+    if(view.type != PGP_SIG_BINARY_DOCUMENT || view.hash_algo != PGP_SHA1 ||
+       !PGP_RSA_SIGNS(view.pk_algo))
+        return -ENOTSUP;
+
+    state->num_sigs++;
+
+    signature_init(&sig);
+    ret = signature_from_view(&sig, &view);
+    if(ret == 0) {
+        /* any of the signatures may be the one made by our key */
+        hash = state->hash;
+        if(issuer_subkey(state->pub, sig.issuer, &subkey) == 0 &&
+           rsa_sha1_verify_hash(state->pub, subkey, &sig, &hash, NULL) == 0)
+            state->result = 0;
+    }
+    signature_destroy(&sig);
+
+    return ret;
+}
+
+/* 5.9, the data is hashed and passed on as it goes by */
+static int message_literal(message_state *state, const uint8_t *data, uint32_t len,
+                           unsigned int flags)
+{
+    int ret;
+
+    if(flags & LIBSIGN_BODY_FIRST) {
+        if(state->literal || !state->num_one_pass)
+            return -EINVAL;
+        state->literal = 1;
+        state->literal_pos = 0;
+        /* format, file name length, file name and date */
+        state->literal_header_len = 6;
+    }
+
+    while(len && state->literal_pos < state->literal_header_len) {
+        if(state->literal_pos == 1)
+            state->literal_header_len += *data;
+        state->literal_pos++;
+        data++;
+        len--;
+    }
+
+    if(len) {
+        sha1_update(&state->hash, len, data);
+        if(state->write && (ret = state->write(state->opaque, data, len)) < 0)
+            return ret;
+    }
+
+    if(flags & LIBSIGN_BODY_LAST) {
+        if(state->literal_pos < state->literal_header_len)
+            return -EINVAL;
+        state->literal = 2;
+    }
+
+    return 0;
+}
+
+static int message_body(void *opaque, int tag, const uint8_t *data, uint32_t len,
+                        unsigned int flags)
+{
+    message_state *state = opaque;
+
+    switch(tag) {
+    case PGP_TAG_ONE_PASS_SIGNATURE:
+    case PGP_TAG_SIGNATURE:
+        if(flags & LIBSIGN_BODY_FIRST)
+            state->packet_len = 0;
+        if(len > sizeof(state->packet) - state->packet_len)
+            return -EMSGSIZE;
+        memcpy(state->packet + state->packet_len, data, len);
+        state->packet_len += len;
+
+        if(!(flags & LIBSIGN_BODY_LAST))
+            return 0;
+        if(tag == PGP_TAG_ONE_PASS_SIGNATURE)
+            return message_one_pass(state);
+        return message_signature(state);
+    case PGP_TAG_LITERAL_DATA:
+        return message_literal(state, data, len, flags);
+    case PGP_TAG_MARKER_PACKET:
+        return 0;
+    case PGP_TAG_COMPRESSED_DATA:
+        /* there is no decompressor to hand the data to */
+        return -ENOTSUP;
+    default:
+        return -EINVAL;
+    }
+}
+
+int verify_message_callback(libsign_public_key *pub, libsign_read_fn read_fn,
+                            void *read_opaque, libsign_write_fn write, void *opaque)
+{
+    int ret;
+    message_state *state;
+
+    if(!PGP_RSA_SIGNS(pub->pk_algo))
+        return -ENOTSUP;
+
+    state = malloc(sizeof(message_state));
+    if(!state)
+        return -ENOMEM;
+
+    memset(state, 0, sizeof(message_state));
+    state->pub = pub;
+    state->write = write;
+    state->opaque = opaque;
+    state->result = -EBADMSG;
+    sha1_init(&state->hash);
+
+    ret = parse_bodies_callback(read_fn, read_opaque, message_body, state);
+    if(ret < 0)
+        goto exit;
+
+    /* 11.3, every one-pass signature packet has its signature packet */
+    if(state->literal != 2 || !state->num_sigs || state->num_sigs != state->num_one_pass) {
+        ret = -EINVAL;
         goto exit;
     }
 
-    ret = rsa_sha1_verify(&key, &hash, sig_ctx->s);
+    ret = state->result;
 
 exit:
-    rsa_public_key_clear(&key);
+    free(state);
 
     return ret;
 }
+
+int verify_message_fd(libsign_public_key *pub, int fd, libsign_write_fn write, void *opaque)
+{
+    return verify_message_callback(pub, fd_read, &fd, write, opaque);
+}
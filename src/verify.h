@@ -1,17 +1,43 @@
 #ifndef __LIBSIGN_VERIFY_H
 #define __LIBSIGN_VERIFY_H
 
+#include "hash.h"
+#include "keystore.h"
 #include "public_key.h"
+#include "scratch.h"
 #include "signature.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* the signature is checked against the key or the subkey named by its
+   issuer. -ENOKEY if it is neither, -EKEYREJECTED if that key may not sign
+   or is a subkey whose binding (with its back-signature) did not check out,
+   -EKEYEXPIRED if the signature was made once the key had expired. */
 int verify(libsign_public_key *public_key, libsign_signature *signature, const char *filename);
 int verify_buffer(libsign_public_key *public_key, libsign_signature *signature,
                   const uint8_t *data, uint32_t datalen);
 
+/* as above, with the RSA operation done in the buffers of a scratch kept by
+   the calling thread. once the scratch is large enough for the key, see
+   scratch_reserve_key(), the verification makes no allocations. */
+int verify_scratch(libsign_public_key *public_key, libsign_signature *signature,
+                   const char *filename, libsign_scratch *scratch);
+int verify_buffer_scratch(libsign_public_key *public_key, libsign_signature *signature,
+                          const uint8_t *data, uint32_t datalen, libsign_scratch *scratch);
+
+/* Complete a verification from a hash of the data done by the caller, e.g.
+   as the data was written. The signature suffix (see signature_suffix()) is
+   added to a copy of hash, which is left as it is. The scratch may be NULL. */
+int libsign_verify_midstate(libsign_public_key *public_key, libsign_signature *signature,
+                            const sha1_ctx *hash, libsign_scratch *scratch);
+
+/* as above, with the key looked up by the issuer of the signature */
+int verify_keystore(libsign_keystore *ks, libsign_signature *signature, const char *filename);
+int verify_keystore_buffer(libsign_keystore *ks, libsign_signature *signature,
+                           const uint8_t *data, uint32_t datalen);
+
 int rsa_sha1_verify_file(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
                          const char *filename);
 int rsa_sha1_verify_fd(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
@@ -19,6 +45,62 @@ int rsa_sha1_verify_fd(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
 int rsa_sha1_verify_data(libsign_public_key *pub_ctx, libsign_signature *sig_ctx,
                           const uint8_t *data, uint32_t datalen);
 
+/* verify several signatures over the same file with a single read of the data.
+   any engines in extra (e.g. a content digest) are fed the same blocks.
+   results receives the outcome for each signature. */
+int verify_many(libsign_public_key **keys, libsign_signature **sigs, int *results,
+                unsigned int count, const char *filename, libsign_hash_fanout *extra);
+int verify_many_fd(libsign_public_key **keys, libsign_signature **sigs, int *results,
+                   unsigned int count, int fd, libsign_hash_fanout *extra);
+
+/* verify a one-pass signed message (11.3), as made by gpg --sign, while it
+   is read. the literal data is hashed as it streams by whatever the packet
+   lengths, so the memory used does not depend on the size of the message.
+   if write is given the literal data is passed to it as well, and must not
+   be trusted until this has returned 0. compressed messages are not
+   supported (-ENOTSUP). */
+int verify_message_fd(libsign_public_key *pub, int fd, libsign_write_fn write, void *opaque);
+int verify_message_callback(libsign_public_key *pub, libsign_read_fn read_fn,
+                            void *read_opaque, libsign_write_fn write, void *opaque);
+
+/* the cache keeps this many results at first, and doubles when half full */
+#define LIBSIGN_CERT_CACHE_MIN_SLOTS 256
+
+typedef struct libsign_cert_cache_entry {
+    uint8_t id[SHA1_DIGEST_LENGTH];
+    /* LIBSIGN_CERT_VALID or LIBSIGN_CERT_INVALID, 0 for a free slot */
+    uint8_t status;
+} libsign_cert_cache_entry;
+
+/* Results of certification checks for the keys of a keyring. A keyring
+   parsed again after a change only has the signatures that are new checked,
+   the rest are known by the hash of what they sign and their signature. */
+typedef struct libsign_cert_cache {
+    libsign_cert_cache_entry *slots;
+    uint32_t num_slots;
+    uint32_t count;
+} libsign_cert_cache;
+
+void cert_cache_init(libsign_cert_cache *cache);
+void cert_cache_destroy(libsign_cert_cache *cache);
+
+/* check the self-signatures kept by the parser that have not been checked
+   yet, the subkey bindings with their back-signatures among them, and set
+   their status. the key and user ID part of the hash was done when the key
+   was parsed, each signature only adds its own suffix. the cache may be
+   NULL. the key flags and expiration times of the primary key and of each
+   subkey are then taken from the newest self-signature or binding over it
+   that is valid. verify() does this the first time it uses the key, a key
+   shared between threads must have been through it before. returns the
+   number of signatures whose RSA check had to be done. */
+int verify_certifications(libsign_public_key *pub, libsign_cert_cache *cache);
+
+/* verify straight from views, without parsing into keys and signatures. the
+   signing key is chosen by the issuer as above, see key_view_signer(). */
+int verify_view_buffer(libsign_key_view *key, const libsign_signature_view *sig,
+                       const uint8_t *data, uint32_t datalen);
+int verify_view_fd(libsign_key_view *key, const libsign_signature_view *sig, int fd);
+
 #ifdef __cplusplus
 }
 #endif
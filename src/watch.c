@@ -0,0 +1,385 @@
+#include "watch.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR)
+
+/* the names of the files to look at again, each once */
+typedef struct changes {
+    char **names;
+    uint32_t count;
+    uint32_t size;
+} changes;
+
+static void changes_destroy(changes *c)
+{
+    uint32_t i;
+
+    for(i = 0; i < c->count; i++)
+        free(c->names[i]);
+    free(c->names);
+}
+
+static int changes_add(changes *c, const char *name)
+{
+    uint32_t i;
+    char **names;
+
+    if(name[0] == '.' || name[0] == '\0')
+        return 0;
+
+    for(i = 0; i < c->count; i++) {
+        if(strcmp(c->names[i], name) == 0)
+            return 0;
+    }
+
+    if(c->count == c->size) {
+        uint32_t size = c->size ? c->size * 2 : 16;
+
+        names = realloc(c->names, size * sizeof(char*));
+        if(!names)
+            return -ENOMEM;
+        c->names = names;
+        c->size = size;
+    }
+
+    c->names[c->count] = strdup(name);
+    if(!c->names[c->count])
+        return -ENOMEM;
+    c->count++;
+
+    return 0;
+}
+
+/* every file in the directory, and every file known to be there before */
+static int changes_rescan(libsign_keystore_watch *watch, changes *c)
+{
+    int ret = 0;
+    uint32_t i;
+    DIR *dir;
+    struct dirent *entry;
+
+    dir = opendir(watch->directory);
+    if(!dir)
+        return -errno;
+
+    while(ret == 0 && (entry = readdir(dir)))
+        ret = changes_add(c, entry->d_name);
+    closedir(dir);
+
+    for(i = 0; ret == 0 && i < watch->num_files; i++)
+        ret = changes_add(c, watch->files[i].name);
+
+    return ret;
+}
+
+static libsign_keystore_file *find_file(libsign_keystore_watch *watch, const char *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < watch->num_files; i++) {
+        if(strcmp(watch->files[i].name, name) == 0)
+            return &watch->files[i];
+    }
+
+    return NULL;
+}
+
+static libsign_keystore_file *new_file(libsign_keystore_watch *watch, const char *name)
+{
+    libsign_keystore_file *files, *file;
+
+    if(watch->num_files == watch->files_size) {
+        uint32_t size = watch->files_size ? watch->files_size * 2 : 16;
+
+        files = realloc(watch->files, size * sizeof(libsign_keystore_file));
+        if(!files)
+            return NULL;
+        watch->files = files;
+        watch->files_size = size;
+    }
+
+    file = &watch->files[watch->num_files];
+    memset(file, 0, sizeof(libsign_keystore_file));
+    file->name = strdup(name);
+    if(!file->name)
+        return NULL;
+    watch->num_files++;
+
+    return file;
+}
+
+/* the first key ID of pub that gen already has */
+static libsign_key_id taken_key_id(libsign_keystore_generation *gen,
+                                   const libsign_public_key *pub)
+{
+    int i;
+
+    if(keystore_find(&gen->index, pub->key_id, NULL))
+        return pub->key_id;
+    for(i = 0; i < pub->num_subkeys; i++) {
+        if(keystore_find(&gen->index, pub->subkeys[i].key_id, NULL))
+            return pub->subkeys[i].key_id;
+    }
+
+    return 0;
+}
+
+static int has_key_id(const libsign_public_key *pub, libsign_key_id key_id)
+{
+    int i;
+
+    if(pub->key_id == key_id)
+        return 1;
+    for(i = 0; i < pub->num_subkeys; i++) {
+        if(pub->subkeys[i].key_id == key_id)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* parse the file into a new key and add it to gen. a file that cannot be
+   parsed, or whose key is already in gen from another file, is kept with no
+   key. */
+static int load_file(libsign_keystore_watch *watch, libsign_keystore_generation *gen,
+                     libsign_keystore_file *file, const char *path)
+{
+    int ret = -EINVAL;
+    libsign_keystore_key *key;
+
+    file->conflict = 0;
+    file->retry = 0;
+
+    key = keystore_key_new();
+    if(!key)
+        return -ENOMEM;
+
+    if(parse_public_key_profile(&key->pub, path, watch->profile) == 0 &&
+       verify_certifications(&key->pub, &watch->certs) >= 0)
+        ret = keystore_generation_add(gen, key);
+
+    if(ret == 0)
+        file->key = key;
+    else {
+        if(ret == -EEXIST)
+            file->conflict = taken_key_id(gen, &key->pub);
+        keystore_key_put(key);
+    }
+
+    return 0;
+}
+
+/* take the old key of the file out of gen, and put in what the file holds
+   now. the files kept out by the key taken out are marked, and retry set,
+   to parse them again. */
+static int update_file(libsign_keystore_watch *watch, libsign_keystore_generation *gen,
+                       const char *name, int *retry)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    uint32_t i;
+    libsign_keystore_file *file = find_file(watch, name);
+
+    if(file && file->key) {
+        for(i = 0; i < watch->num_files; i++) {
+            if(!watch->files[i].key && watch->files[i].conflict &&
+               has_key_id(&file->key->pub, watch->files[i].conflict)) {
+                watch->files[i].retry = 1;
+                *retry = 1;
+            }
+        }
+
+        keystore_generation_remove(gen, file->key);
+        keystore_key_put(file->key);
+        file->key = NULL;
+    }
+
+    if(snprintf(path, sizeof(path), "%s/%s", watch->directory, name) >= (int)sizeof(path))
+        return -ENAMETOOLONG;
+
+    if(stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if(file) {
+            free(file->name);
+            *file = watch->files[--watch->num_files];
+        }
+        return 0;
+    }
+
+    if(!file && !(file = new_file(watch, name)))
+        return -ENOMEM;
+
+    return load_file(watch, gen, file, path);
+}
+
+/* the files kept out by a key that has been taken out are parsed again,
+   once the changed files have all had their turn */
+static int retry_keyless(libsign_keystore_watch *watch, libsign_keystore_generation *gen)
+{
+    int ret;
+    uint32_t i;
+    char path[PATH_MAX];
+
+    for(i = 0; i < watch->num_files; i++) {
+        if(watch->files[i].key || !watch->files[i].retry)
+            continue;
+
+        if(snprintf(path, sizeof(path), "%s/%s", watch->directory,
+                    watch->files[i].name) >= (int)sizeof(path))
+            continue;
+
+        ret = load_file(watch, gen, &watch->files[i], path);
+        if(ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* build the next generation from the current one and publish it */
+static int apply(libsign_keystore_watch *watch, changes *c)
+{
+    int ret = 0, retry = 0;
+    uint32_t i;
+    libsign_keystore_generation *gen;
+
+    gen = keystore_generation_copy(watch->sks->current);
+    if(!gen)
+        return -ENOMEM;
+
+    for(i = 0; ret == 0 && i < c->count; i++)
+        ret = update_file(watch, gen, c->names[i], &retry);
+    if(ret == 0 && retry)
+        ret = retry_keyless(watch, gen);
+
+    /* what was applied is kept, the files table already follows it */
+    shared_keystore_publish(watch->sks, gen);
+
+    return ret < 0 ? ret : (int)c->count;
+}
+
+int keystore_watch_init(libsign_keystore_watch *watch, libsign_shared_keystore *sks,
+                        const char *directory, unsigned int profile)
+{
+    int ret;
+    changes c;
+
+    memset(watch, 0, sizeof(libsign_keystore_watch));
+    memset(&c, 0, sizeof(c));
+    cert_cache_init(&watch->certs);
+    watch->sks = sks;
+    watch->profile = profile;
+    watch->fd = -1;
+    watch->wd = -1;
+
+    watch->directory = strdup(directory);
+    if(!watch->directory) {
+        ret = -ENOMEM;
+        goto exit;
+    }
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watch->fd < 0) {
+        ret = -errno;
+        goto exit;
+    }
+
+    /* watch first, so nothing written during the scan goes unnoticed */
+    watch->wd = inotify_add_watch(watch->fd, directory, WATCH_EVENTS);
+    if(watch->wd < 0) {
+        ret = -errno;
+        goto exit;
+    }
+
+    ret = changes_rescan(watch, &c);
+    if(ret == 0)
+        ret = apply(watch, &c);
+
+exit:
+    changes_destroy(&c);
+    if(ret < 0)
+        keystore_watch_destroy(watch);
+
+    return ret < 0 ? ret : 0;
+}
+
+void keystore_watch_destroy(libsign_keystore_watch *watch)
+{
+    uint32_t i;
+
+    for(i = 0; i < watch->num_files; i++) {
+        if(watch->files[i].key)
+            keystore_key_put(watch->files[i].key);
+        free(watch->files[i].name);
+    }
+    free(watch->files);
+    free(watch->directory);
+    cert_cache_destroy(&watch->certs);
+
+    if(watch->fd >= 0)
+        close(watch->fd);
+
+    memset(watch, 0, sizeof(libsign_keystore_watch));
+    watch->fd = -1;
+    watch->wd = -1;
+}
+
+int keystore_watch_fd(const libsign_keystore_watch *watch)
+{
+    return watch->fd;
+}
+
+int keystore_watch_process(libsign_keystore_watch *watch)
+{
+    int ret = 0, rescan = 0;
+    ssize_t len;
+    uint8_t buffer[LIBSIGN_WATCH_BUFFER_SIZE]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    uint8_t *p;
+    changes c;
+
+    memset(&c, 0, sizeof(c));
+
+    for(;;) {
+        len = read(watch->fd, buffer, sizeof(buffer));
+        if(len < 0 && errno == EINTR)
+            continue;
+        if(len < 0 && errno == EAGAIN)
+            break;
+        if(len <= 0) {
+            ret = len < 0 ? -errno : -EIO;
+            goto exit;
+        }
+
+        for(p = buffer; p < buffer + len; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event*)p;
+
+            /* events were lost, any file may have changed */
+            if(event->mask & IN_Q_OVERFLOW)
+                rescan = 1;
+            else if(event->len && !(event->mask & IN_ISDIR) &&
+                    (ret = changes_add(&c, event->name)) < 0)
+                goto exit;
+        }
+    }
+
+    if(rescan && (ret = changes_rescan(watch, &c)) < 0)
+        goto exit;
+
+    if(c.count)
+        ret = apply(watch, &c);
+
+exit:
+    changes_destroy(&c);
+
+    return ret;
+}
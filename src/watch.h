@@ -0,0 +1,66 @@
+#ifndef __LIBSIGN_WATCH_H
+#define __LIBSIGN_WATCH_H
+
+#include <stdint.h>
+
+#include "keystore.h"
+#include "verify.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* room for the events read at once, at least one with the longest name */
+#define LIBSIGN_WATCH_BUFFER_SIZE   4096
+
+typedef struct libsign_keystore_file {
+    char *name;
+    /* NULL while the file holds no key that could be added */
+    libsign_keystore_key *key;
+    /* while that is because another file's key has one of its key IDs, that
+       ID. the file is parsed again once the key with it is taken out. */
+    libsign_key_id conflict;
+    int retry;
+} libsign_keystore_file;
+
+/* Keeps a shared keystore in step with a directory of key files, one key
+   per file. inotify reports the files written, moved or removed, and only
+   those are parsed again: the next generation is a copy of the current one
+   with their keys taken out and put back in, published as usual. Files
+   starting with a dot are left alone, so editors and tools writing to a
+   temporary file and renaming it over the old one are picked up once.
+   The watch must be the only writer of the keystore. */
+typedef struct libsign_keystore_watch {
+    libsign_shared_keystore *sks;
+    char *directory;
+    unsigned int profile;
+
+    int fd;
+    int wd;
+
+    libsign_keystore_file *files;
+    uint32_t num_files;
+    uint32_t files_size;
+
+    /* a file written again only has its new certifications checked */
+    libsign_cert_cache certs;
+} libsign_keystore_watch;
+
+/* start watching the directory and publish a generation with every key in
+   it. profile is passed on to parse_public_key_profile(). */
+int keystore_watch_init(libsign_keystore_watch *watch, libsign_shared_keystore *sks,
+                        const char *directory, unsigned int profile);
+void keystore_watch_destroy(libsign_keystore_watch *watch);
+
+/* a descriptor that becomes readable when there are changes to process */
+int keystore_watch_fd(const libsign_keystore_watch *watch);
+/* apply the changes reported so far without blocking. returns the number of
+   files parsed again or removed, 0 if there was nothing to do, or a
+   negative error. */
+int keystore_watch_process(libsign_keystore_watch *watch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBSIGN_WATCH_H */
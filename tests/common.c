@@ -0,0 +1,70 @@
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+int read_file_buffer(const char *filename, uint8_t *buffer, size_t size, size_t *len)
+{
+    int fd, ret = 0;
+    struct stat st;
+    ssize_t num;
+
+    *len = 0;
+
+    fd = open(filename, O_RDONLY | O_BINARY);
+    if(fd < 0)
+        return -errno;
+
+    if(fstat(fd, &st) < 0) {
+        ret = -errno;
+        goto exit;
+    }
+    if((size_t)st.st_size > size) {
+        ret = -EFBIG;
+        goto exit;
+    }
+
+    num = read(fd, buffer, st.st_size);
+    if(num != st.st_size) {
+        ret = num < 0 ? -errno : -EIO;
+        goto exit;
+    }
+
+    *len = num;
+
+exit:
+    close(fd);
+
+    return ret;
+}
+
+uint8_t *read_file(const char *filename, size_t *len)
+{
+    struct stat st;
+    uint8_t *buffer;
+
+    *len = 0;
+
+    if(stat(filename, &st) < 0)
+        return NULL;
+
+    buffer = malloc(st.st_size + 1);
+    if(!buffer)
+        return NULL;
+
+    if(read_file_buffer(filename, buffer, st.st_size, len) < 0) {
+        free(buffer);
+        return NULL;
+    }
+    buffer[*len] = '\0';
+
+    return buffer;
+}
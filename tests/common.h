@@ -0,0 +1,13 @@
+#ifndef __LIBSIGN_TESTS_COMMON_H
+#define __LIBSIGN_TESTS_COMMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the whole of a file, from malloc and followed by a NUL. NULL if it cannot
+   be read, len is 0 then. */
+uint8_t *read_file(const char *filename, size_t *len);
+/* as above, into a buffer of the caller. -EFBIG if it does not fit. */
+int read_file_buffer(const char *filename, uint8_t *buffer, size_t size, size_t *len);
+
+#endif /* __LIBSIGN_TESTS_COMMON_H */
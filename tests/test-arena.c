@@ -0,0 +1,107 @@
+#include "arena.h"
+#include "public_key.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROUNDS 64
+
+static int check_alloc(void)
+{
+    libsign_arena arena;
+    uint8_t *small, *large, *after;
+    int i, ret = -1;
+
+    arena_init(&arena);
+
+    for(i = 1; i < 100; i++) {
+        small = arena_alloc(&arena, i);
+        if(!small || ((uintptr_t)small & (LIBSIGN_ARENA_ALIGN - 1)) != 0)
+            goto exit;
+        memset(small, i, i);
+    }
+
+    /* larger than any size class */
+    large = arena_alloc(&arena, 2 * LIBSIGN_ARENA_MAX_BLOCK);
+    if(!large || ((uintptr_t)large & (LIBSIGN_ARENA_ALIGN - 1)) != 0)
+        goto exit;
+    memset(large, 0xff, 2 * LIBSIGN_ARENA_MAX_BLOCK);
+
+    /* the space left in the first block is still used */
+    after = arena_alloc(&arena, 16);
+    if(!after || after != small + 112)
+        goto exit;
+
+    /* only the large block is kept */
+    arena_reset(&arena);
+    if(arena_size(&arena) < 2 * LIBSIGN_ARENA_MAX_BLOCK ||
+       arena_size(&arena) > 2 * LIBSIGN_ARENA_MAX_BLOCK + 4096)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    arena_destroy(&arena);
+
+    return ret;
+}
+
+int main()
+{
+    int ret = -1, i;
+    size_t size = 0;
+    libsign_arena arena;
+    libsign_public_key pub, expected;
+    libsign_signature sig;
+
+    arena_init(&arena);
+    public_key_init(&expected);
+
+    if(check_alloc() < 0) {
+        fprintf(stderr, "allocation checks failed\n");
+        goto exit;
+    }
+
+    if(parse_public_key(&expected, "files/pubkey.key") < 0)
+        goto exit;
+
+    for(i = 0; i < ROUNDS; i++) {
+        public_key_init_arena(&pub, &arena);
+        signature_init_arena(&sig, &arena);
+
+        if(parse_public_key(&pub, "files/pubkey.key") < 0 ||
+           parse_signature(&sig, "files/vmImage.sig") < 0)
+            goto exit;
+
+        if(mpz_cmp(pub.n, expected.n) != 0 || mpz_cmp(pub.e, expected.e) != 0 ||
+           pub.num_userids != 1 || strcmp(pub.userids[0].userid, expected.userids[0].userid) != 0)
+            goto exit;
+
+        if(i == 0 && verify(&pub, &sig, "files/vmImage") != 0) {
+            fprintf(stderr, "arena backed key and signature did not verify\n");
+            goto exit;
+        }
+
+        public_key_destroy(&pub);
+        signature_destroy(&sig);
+
+        /* parsing the same files again takes no more memory */
+        if(i == 1)
+            size = arena_size(&arena);
+        else if(i > 1 && arena_size(&arena) != size)
+            goto exit;
+
+        arena_reset(&arena);
+    }
+
+    ret = 0;
+
+exit:
+    arena_destroy(&arena);
+    public_key_destroy(&expected);
+
+    return ret;
+}
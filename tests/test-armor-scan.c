@@ -0,0 +1,126 @@
+#include "armor.h"
+#include "public_key.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+#define NUM_KEYS 2
+
+typedef struct scan_state {
+    libsign_public_key keys[NUM_KEYS];
+    int count;
+} scan_state;
+
+static int scan_block(void *opaque, const libsign_armor_block *block,
+                      const uint8_t *plain, uint32_t plain_len)
+{
+    scan_state *state = opaque;
+
+    if(block->type_len != 16 || memcmp(block->type, "PUBLIC KEY BLOCK", 16) != 0)
+        return -EINVAL;
+    if(state->count == NUM_KEYS)
+        return -ENOSPC;
+
+    return parse_public_key_buffer(&state->keys[state->count++], plain, plain_len);
+}
+
+static int count_block(void *opaque, const libsign_armor_block *block,
+                       const uint8_t *plain, uint32_t plain_len)
+{
+    (void)block;
+    (void)plain;
+    (void)plain_len;
+    (*(int*)opaque)++;
+
+    return 0;
+}
+
+int main()
+{
+    int ret = -1, fd, i, count = 0;
+    struct stat st;
+    uint8_t *buffer = NULL;
+    static const char prefix[] = "keys exported for the build hosts\n\n";
+    uint32_t len;
+    scan_state state;
+    libsign_public_key expected[NUM_KEYS], first;
+
+    state.count = 0;
+    for(i = 0; i < NUM_KEYS; i++) {
+        public_key_init(&state.keys[i]);
+        public_key_init(&expected[i]);
+    }
+    public_key_init(&first);
+
+    if(parse_public_key(&expected[0], "files/pubkey.key") < 0 ||
+       parse_public_key(&expected[1], "files/testkey.key") < 0)
+        goto exit;
+
+    fd = open("files/keyring.asc", O_RDONLY | O_BINARY);
+    if(fd < 0)
+        goto exit;
+    if(fstat(fd, &st) < 0) {
+        close(fd);
+        goto exit;
+    }
+
+    /* some text ahead of the first block is ignored */
+    len = sizeof(prefix) - 1 + st.st_size;
+    buffer = malloc(len);
+    if(!buffer) {
+        close(fd);
+        goto exit;
+    }
+    memcpy(buffer, prefix, sizeof(prefix) - 1);
+    if(read(fd, buffer + sizeof(prefix) - 1, st.st_size) != st.st_size) {
+        close(fd);
+        goto exit;
+    }
+    close(fd);
+
+    ret = armor_scan(buffer, len, THREADS, scan_block, &state);
+    if(ret < 0)
+        goto exit;
+
+    ret = -1;
+    if(state.count != NUM_KEYS)
+        goto exit;
+    for(i = 0; i < NUM_KEYS; i++) {
+        if(mpz_cmp(state.keys[i].n, expected[i].n) != 0 ||
+           state.keys[i].created != expected[i].created)
+            goto exit;
+    }
+
+    /* the single block parser takes the first key of the keyring */
+    if(parse_public_key_armor_buffer(&first, buffer + sizeof(prefix) - 1, st.st_size) < 0)
+        goto exit;
+    if(mpz_cmp(first.n, expected[0].n) != 0)
+        goto exit;
+
+    /* a corrupted second block is reported */
+    buffer[len - 200] ^= 0x01;
+    if(armor_scan(buffer, len, THREADS, count_block, &count) == 0 || count > 1)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    free(buffer);
+    for(i = 0; i < NUM_KEYS; i++) {
+        public_key_destroy(&state.keys[i]);
+        public_key_destroy(&expected[i]);
+    }
+    public_key_destroy(&first);
+
+    return ret;
+}
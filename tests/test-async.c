@@ -0,0 +1,122 @@
+#include "async.h"
+#include "common.h"
+#include "public_key.h"
+#include "signature.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define NUM_JOBS        40
+#define MAX_IN_FLIGHT   8
+
+int main()
+{
+    int ret = -1, epfd = -1, i, n, submitted = 0, collected = 0, returned[NUM_JOBS];
+    static uint8_t manifest[4096];
+    size_t manifest_len = 0;
+    libsign_public_key pub, testkey;
+    libsign_signature sig, manifest_sig;
+    libsign_verify_job jobs[NUM_JOBS], *done[3];
+    libsign_async async;
+    struct epoll_event ev;
+
+    public_key_init(&pub);
+    public_key_init(&testkey);
+    signature_init(&sig);
+    signature_init(&manifest_sig);
+    memset(jobs, 0, sizeof(jobs));
+    memset(returned, 0, sizeof(returned));
+
+    if(parse_public_key(&pub, "files/pubkey.key") < 0 ||
+       parse_public_key(&testkey, "files/testkey.key") < 0 ||
+       parse_signature(&sig, "files/vmImage.sig") < 0 ||
+       parse_signature(&manifest_sig, "files/vmImage.manifest.sig") < 0 ||
+       read_file_buffer("files/vmImage.manifest", manifest, sizeof(manifest), &manifest_len) < 0)
+        goto exit;
+
+    for(i = 0; i < NUM_JOBS; i++) {
+        jobs[i].opaque = &returned[i];
+        if(i % 5 == 0) {
+            jobs[i].pub = &pub;
+            jobs[i].sig = &sig;
+            jobs[i].filename = "files/vmImage";
+        }
+        else {
+            /* every seventh one is short of its last octet */
+            jobs[i].pub = &testkey;
+            jobs[i].sig = &manifest_sig;
+            jobs[i].data = manifest;
+            jobs[i].datalen = i % 7 == 3 ? manifest_len - 1 : manifest_len;
+        }
+    }
+
+    if(libsign_async_init(&async, 3, MAX_IN_FLIGHT) < 0)
+        goto exit;
+
+    epfd = epoll_create1(0);
+    ev.events = EPOLLIN;
+    ev.data.ptr = &async;
+    if(epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, libsign_async_fd(&async), &ev) < 0)
+        goto destroy;
+
+    while(collected < NUM_JOBS) {
+        /* as many as are let in */
+        while(submitted < NUM_JOBS) {
+            int result = libsign_async_submit(&async, &jobs[submitted]);
+            if(result == -EAGAIN)
+                break;
+            if(result < 0)
+                goto destroy;
+            submitted++;
+        }
+        if(submitted - collected > MAX_IN_FLIGHT)
+            goto destroy;
+
+        if(epoll_wait(epfd, &ev, 1, 5000) != 1) {
+            fprintf(stderr, "no completions after %d of %d jobs\n", collected, NUM_JOBS);
+            goto destroy;
+        }
+
+        /* fewer at a time than may be done, the rest keep it readable */
+        while((n = libsign_poll_completions(&async, done, 3)) > 0) {
+            for(i = 0; i < n; i++)
+                (*(int*)done[i]->opaque)++;
+            collected += n;
+        }
+        if(n < 0)
+            goto destroy;
+    }
+
+    /* nothing more to come */
+    if(epoll_wait(epfd, &ev, 1, 0) != 0 || libsign_poll_completions(&async, done, 3) != 0)
+        goto destroy;
+
+    for(i = 0; i < NUM_JOBS; i++) {
+        int bad = i % 5 != 0 && i % 7 == 3;
+
+        if(returned[i] != 1 || (bad ? jobs[i].result == 0 : jobs[i].result != 0)) {
+            fprintf(stderr, "job %d came back %d times with %d\n", i, returned[i],
+                    jobs[i].result);
+            goto destroy;
+        }
+    }
+
+    ret = 0;
+
+destroy:
+    libsign_async_destroy(&async);
+
+exit:
+    if(epfd >= 0)
+        close(epfd);
+    public_key_destroy(&pub);
+    public_key_destroy(&testkey);
+    signature_destroy(&sig);
+    signature_destroy(&manifest_sig);
+
+    return ret;
+}
@@ -0,0 +1,143 @@
+#include "base64.h"
+#include "b64/cdecode.h"
+#include "b64/cencode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PLAIN 4096
+
+/* encode with libb64 and then rewrite the line breaks, width 0 keeps the
+   libb64 output as is */
+static size_t encode(const uint8_t *plain, size_t len, char *out, int width, const char *eol)
+{
+    base64_encodestate state;
+    char *tmp = malloc(len * 2 + 16);
+    size_t i, n, col = 0, o = 0;
+
+    base64_init_encodestate(&state);
+    n = base64_encode_block((const char*)plain, len, tmp, &state);
+    n += base64_encode_blockend(tmp + n, &state);
+
+    for(i = 0; i < n; i++) {
+        if(width && tmp[i] == '\n')
+            continue;
+        out[o++] = tmp[i];
+        if(width && ++col == (size_t)width) {
+            memcpy(out + o, eol, strlen(eol));
+            o += strlen(eol);
+            col = 0;
+        }
+    }
+
+    free(tmp);
+
+    return o;
+}
+
+static int check(const char *encoded, size_t len)
+{
+    static const enum base64_impl impls[] = {
+        BASE64_IMPL_SCALAR, BASE64_IMPL_SSSE3, BASE64_IMPL_AVX2
+    };
+    uint8_t expected[MAX_PLAIN * 2], actual[MAX_PLAIN * 2];
+    base64_decodestate reference;
+    size_t i, expected_len;
+
+    base64_init_decodestate(&reference);
+    expected_len = base64_decode_block(encoded, len, (char*)expected, &reference);
+
+    for(i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        base64_decoder state;
+        size_t split, actual_len;
+
+        /* not every processor has every implementation */
+        if(base64_set_impl(impls[i]) < 0)
+            continue;
+
+        actual_len = base64_decode((const uint8_t*)encoded, len, actual);
+        if(actual_len != expected_len || memcmp(actual, expected, expected_len) != 0) {
+            fprintf(stderr, "impl %d: mismatch for input of length %zu\n", impls[i], len);
+            return -1;
+        }
+
+        /* the same input fed in two arbitrary pieces */
+        split = len ? (size_t)rand() % len : 0;
+        base64_decoder_init(&state);
+        actual_len = base64_decode_update(&state, (const uint8_t*)encoded, split, actual);
+        actual_len += base64_decode_update(&state, (const uint8_t*)encoded + split,
+                                           len - split, actual + actual_len);
+        if(actual_len != expected_len || memcmp(actual, expected, expected_len) != 0) {
+            fprintf(stderr, "impl %d: mismatch for input of length %zu split at %zu\n",
+                    impls[i], len, split);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int check_encode(const uint8_t *plain, size_t len)
+{
+    static const enum base64_impl impls[] = {
+        BASE64_IMPL_SCALAR, BASE64_IMPL_SSSE3, BASE64_IMPL_AVX2
+    };
+    char expected[MAX_PLAIN * 2];
+    uint8_t actual[MAX_PLAIN * 2];
+    size_t i, expected_len, actual_len;
+
+    /* a width libb64 never reaches just drops its line breaks */
+    expected_len = encode(plain, len, expected, MAX_PLAIN * 2, "");
+
+    for(i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if(base64_set_impl(impls[i]) < 0)
+            continue;
+
+        actual_len = base64_encode(plain, len, actual);
+        if(actual_len != expected_len || actual_len != BASE64_ENCODED_LEN(len) ||
+           memcmp(actual, expected, expected_len) != 0) {
+            fprintf(stderr, "impl %d: encoding mismatch for input of length %zu\n",
+                    impls[i], len);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main()
+{
+    static uint8_t plain[MAX_PLAIN];
+    static char encoded[MAX_PLAIN * 3];
+    size_t i, len, n;
+    int ret = 0;
+
+    srand(4880);
+
+    for(len = 0; len < MAX_PLAIN && ret == 0; len += 1 + len / 8) {
+        for(i = 0; i < len; i++)
+            plain[i] = rand();
+
+        ret |= check_encode(plain, len);
+
+        /* libb64 line width, armor line widths with both line endings */
+        n = encode(plain, len, encoded, 0, "");
+        ret |= check(encoded, n);
+        n = encode(plain, len, encoded, 64, "\n");
+        ret |= check(encoded, n);
+        n = encode(plain, len, encoded, 76, "\r\n");
+        ret |= check(encoded, n);
+        n = encode(plain, len, encoded, 13, "\n");
+        ret |= check(encoded, n);
+
+        /* stray characters outside the alphabet anywhere in the input */
+        for(i = 0; i < n / 16; i++)
+            encoded[rand() % n] = "=\n -*\x80\xff"[rand() % 7];
+        ret |= check(encoded, n);
+    }
+
+    base64_set_impl(BASE64_IMPL_AUTO);
+
+    return ret;
+}
@@ -0,0 +1,105 @@
+#include "common.h"
+#include "public_key.h"
+#include "verify.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main()
+{
+    int ret = -1, checked;
+    uint8_t *key_data, *uid;
+    size_t key_len;
+    libsign_public_key pub, again, changed, test, partial;
+    libsign_cert_cache cache;
+
+    public_key_init(&pub);
+    public_key_init(&again);
+    public_key_init(&changed);
+    public_key_init(&test);
+    public_key_init(&partial);
+    cert_cache_init(&cache);
+
+    key_data = read_file("files/pubkey.key", &key_len);
+    if(!key_data)
+        goto exit;
+
+    /* a positive certification of the user ID and a subkey binding, neither
+       checked as the key is parsed */
+    if(parse_public_key(&pub, "files/pubkey.key") < 0 || pub.num_certs != 2 ||
+       pub.certs[0].sig.type != PGP_SIG_POSITIVE_CERT || pub.certs[0].target != 0 ||
+       pub.certs[1].sig.type != PGP_SIG_SUBKEY_BINDING || pub.certs[1].target != 0 ||
+       pub.certs[0].status != LIBSIGN_CERT_UNCHECKED ||
+       pub.certs[1].status != LIBSIGN_CERT_UNCHECKED ||
+       pub.subkeys[0].binding != LIBSIGN_CERT_UNCHECKED)
+        goto exit;
+
+    checked = verify_certifications(&pub, &cache);
+    if(checked != 2 || pub.certs[0].status != LIBSIGN_CERT_VALID ||
+       pub.subkeys[0].binding != LIBSIGN_CERT_VALID ||
+       pub.certs[1].status != LIBSIGN_CERT_VALID ||
+       pub.key_flags != (PGP_KEY_FLAG_CERTIFY | PGP_KEY_FLAG_SIGN)) {
+        fprintf(stderr, "self-signatures did not verify: %d\n", checked);
+        goto exit;
+    }
+
+    /* the results stay with the key */
+    if(verify_certifications(&pub, &cache) != 0)
+        goto exit;
+
+    /* and with the cache, for the same keyring parsed again */
+    if(parse_public_key(&again, "files/pubkey.key") < 0 ||
+       verify_certifications(&again, &cache) != 0 ||
+       again.certs[0].status != LIBSIGN_CERT_VALID || again.certs[1].status != LIBSIGN_CERT_VALID)
+        goto exit;
+
+    /* a changed user ID only has its certification checked, which fails */
+    for(uid = key_data; uid + 7 <= key_data + key_len; uid++) {
+        if(memcmp(uid, "Foo Bar", 7) == 0)
+            break;
+    }
+    if(uid + 7 > key_data + key_len)
+        goto exit;
+    uid[0] = 'G';
+    if(parse_public_key_buffer(&changed, key_data, key_len) < 0 ||
+       verify_certifications(&changed, &cache) != 1 ||
+       changed.certs[0].status != LIBSIGN_CERT_INVALID ||
+       changed.certs[1].status != LIBSIGN_CERT_VALID)
+        goto exit;
+    /* and its flags are not taken */
+    if(changed.key_flags || changed.subkeys[0].key_flags != pub.subkeys[0].key_flags)
+        goto exit;
+
+    /* there is no engine for SHA-512 */
+    if(parse_public_key(&test, "files/testkey-sha512.key") < 0 || test.num_certs != 2 ||
+       verify_certifications(&test, NULL) != 0 ||
+       test.certs[0].status != LIBSIGN_CERT_UNSUPPORTED ||
+       test.certs[1].status != LIBSIGN_CERT_UNSUPPORTED ||
+       test.subkeys[0].binding != LIBSIGN_CERT_UNSUPPORTED)
+        goto exit;
+
+    /* without user IDs the certification of one is still kept, and the
+       results come from the cache */
+    if(parse_public_key_profile(&partial, "files/pubkey.key", LIBSIGN_PARSE_KEYS) < 0 ||
+       partial.num_certs != 2 || partial.certs[0].target != -1 ||
+       partial.certs[1].sig.type != PGP_SIG_SUBKEY_BINDING ||
+       verify_certifications(&partial, &cache) != 0 ||
+       partial.certs[0].status != LIBSIGN_CERT_VALID ||
+       partial.certs[1].status != LIBSIGN_CERT_VALID ||
+       partial.key_flags != pub.key_flags)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    free(key_data);
+    public_key_destroy(&pub);
+    public_key_destroy(&again);
+    public_key_destroy(&changed);
+    public_key_destroy(&test);
+    public_key_destroy(&partial);
+    cert_cache_destroy(&cache);
+
+    return ret;
+}
@@ -0,0 +1,62 @@
+#include "crc24.h"
+#include "pgp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_DATA 8192
+
+int main()
+{
+    static const enum crc24_impl impls[] = {
+        CRC24_IMPL_SLICE8, CRC24_IMPL_PCLMUL
+    };
+    static uint8_t data[MAX_DATA];
+    size_t i, j, len;
+    int ret = 0;
+
+    srand(4880);
+    for(i = 0; i < MAX_DATA; i++)
+        data[i] = rand();
+
+    /* the check value of the RFC CRC24 for "123456789" */
+    if(pgp_crc24(9, (const uint8_t*)"123456789") != 0x21CF02) {
+        fprintf(stderr, "wrong check value\n");
+        return -1;
+    }
+
+    for(len = 0; len < MAX_DATA && ret == 0; len += 1 + len / 4) {
+        uint32_t expected;
+
+        crc24_set_impl(CRC24_IMPL_BITWISE);
+        expected = crc24_update(CRC24_INIT, len, data);
+
+        for(i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+            uint32_t crc;
+            size_t split = len ? (size_t)rand() % len : 0;
+
+            if(crc24_set_impl(impls[i]) < 0)
+                continue;
+
+            if(crc24_update(CRC24_INIT, len, data) != expected) {
+                fprintf(stderr, "impl %d: mismatch for length %zu\n", impls[i], len);
+                ret = -1;
+            }
+
+            /* incrementally, in pieces of random size */
+            crc = CRC24_INIT;
+            for(j = 0; j < len; j += split + 1) {
+                size_t piece = (len - j < split + 1) ? len - j : split + 1;
+                crc = crc24_update(crc, piece, data + j);
+            }
+            if(crc != expected) {
+                fprintf(stderr, "impl %d: incremental mismatch for length %zu\n", impls[i], len);
+                ret = -1;
+            }
+        }
+    }
+
+    crc24_set_impl(CRC24_IMPL_AUTO);
+
+    return ret;
+}
@@ -0,0 +1,218 @@
+#include "common.h"
+#include "public_key.h"
+#include "stream.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+#define MESSAGE_DATA_LEN 20000
+
+typedef struct collected {
+    int tags[8];
+    uint8_t bodies[8][256];
+    uint32_t lens[8];
+    int count;
+    int open;
+} collected;
+
+typedef struct membuf {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+} membuf;
+
+static int collect(void *opaque, int tag, const uint8_t *data, uint32_t len,
+                   unsigned int flags)
+{
+    collected *c = opaque;
+
+    if(flags & LIBSIGN_BODY_FIRST) {
+        if(c->open || c->count == 8)
+            return -EINVAL;
+        c->tags[c->count] = tag;
+        c->lens[c->count] = 0;
+        c->open = 1;
+    }
+    if(!c->open || c->lens[c->count] + len > sizeof(c->bodies[0]))
+        return -EINVAL;
+
+    memcpy(c->bodies[c->count] + c->lens[c->count], data, len);
+    c->lens[c->count] += len;
+
+    if(flags & LIBSIGN_BODY_LAST) {
+        c->open = 0;
+        c->count++;
+    }
+
+    return 0;
+}
+
+/* partial lengths, an empty packet, a two octet length and an indeterminate
+   length, fed in pieces of the given size */
+static int check_bodies(size_t piece)
+{
+    uint8_t stream[512], *p = stream;
+    size_t pos, len;
+    int i;
+    collected c;
+    libsign_body_reader reader;
+
+    /* new format literal data in parts of 4, 2 and 3 octets */
+    *p++ = 0xc0 | 11;
+    *p++ = 0xe0 | 2;
+    memcpy(p, "abcd", 4);
+    p += 4;
+    *p++ = 0xe0 | 1;
+    memcpy(p, "ef", 2);
+    p += 2;
+    *p++ = 3;
+    memcpy(p, "ghi", 3);
+    p += 3;
+    /* old format signature with no body */
+    *p++ = 0x80 | (2 << 2);
+    *p++ = 0;
+    /* new format user ID of 200 octets */
+    *p++ = 0xc0 | 13;
+    *p++ = ((200 - 192) >> 8) + 192;
+    *p++ = 200 - 192;
+    for(i = 0; i < 200; i++)
+        *p++ = i;
+    /* old format compressed data running to the end */
+    *p++ = 0x80 | (8 << 2) | 3;
+    memcpy(p, "to the end", 10);
+    p += 10;
+    len = p - stream;
+
+    memset(&c, 0, sizeof(c));
+    body_reader_init(&reader, collect, &c);
+    for(pos = 0; pos < len; pos += piece) {
+        if(body_reader_feed(&reader, stream + pos, pos + piece < len ? piece : len - pos) < 0)
+            return -1;
+    }
+    if(body_reader_finish(&reader) < 0)
+        return -1;
+
+    if(c.count != 4 ||
+       c.tags[0] != 11 || c.lens[0] != 9 || memcmp(c.bodies[0], "abcdefghi", 9) != 0 ||
+       c.tags[1] != 2 || c.lens[1] != 0 ||
+       c.tags[2] != 13 || c.lens[2] != 200 || c.bodies[2][199] != 199 ||
+       c.tags[3] != 8 || c.lens[3] != 10 || memcmp(c.bodies[3], "to the end", 10) != 0)
+        return -1;
+
+    /* a truncated packet is an error */
+    memset(&c, 0, sizeof(c));
+    body_reader_init(&reader, collect, &c);
+    if(body_reader_feed(&reader, stream, 8) < 0 || body_reader_finish(&reader) == 0)
+        return -1;
+
+    return 0;
+}
+
+/* hands out the data in pieces of odd sizes */
+static ssize_t mem_read(void *opaque, uint8_t *buffer, size_t len)
+{
+    membuf *buf = opaque;
+    size_t n = 1 + rand() % 3000;
+
+    if(n > len)
+        n = len;
+    if(n > buf->len - buf->pos)
+        n = buf->len - buf->pos;
+
+    memcpy(buffer, buf->data + buf->pos, n);
+    buf->pos += n;
+
+    return n;
+}
+
+static int compare_write(void *opaque, const uint8_t *buffer, size_t len)
+{
+    membuf *expected = opaque;
+
+    if(len > expected->len - expected->pos ||
+       memcmp(expected->data + expected->pos, buffer, len) != 0)
+        return -EINVAL;
+    expected->pos += len;
+
+    return 0;
+}
+
+int main()
+{
+    int ret = -1, fd;
+    size_t message_len, image_len;
+    uint8_t *message = NULL, *image = NULL;
+    membuf in, expected;
+    libsign_public_key pub, other;
+
+    public_key_init(&pub);
+    public_key_init(&other);
+    srand(4880);
+
+    if(check_bodies(1) < 0 || check_bodies(5) < 0 || check_bodies(4096) < 0)
+        goto exit;
+
+    if(parse_public_key(&pub, "files/testkey.key") < 0 ||
+       parse_public_key(&other, "files/pubkey.key") < 0)
+        goto exit;
+
+    message = read_file("files/message.gpg", &message_len);
+    image = read_file("files/vmImage", &image_len);
+    if(!message || !image || image_len < MESSAGE_DATA_LEN)
+        goto exit;
+
+    /* the message signs the start of the image */
+    fd = open("files/message.gpg", O_RDONLY | O_BINARY);
+    if(fd < 0)
+        goto exit;
+    expected.data = image;
+    expected.len = MESSAGE_DATA_LEN;
+    expected.pos = 0;
+    ret = verify_message_fd(&pub, fd, compare_write, &expected);
+    close(fd);
+    if(ret != 0 || expected.pos != MESSAGE_DATA_LEN) {
+        fprintf(stderr, "message did not verify: %d\n", ret);
+        ret = -1;
+        goto exit;
+    }
+    ret = -1;
+
+    /* in pieces that split the partial lengths anywhere */
+    in.data = message;
+    in.len = message_len;
+    in.pos = 0;
+    if(verify_message_callback(&pub, mem_read, &in, NULL, NULL) != 0)
+        goto exit;
+
+    /* the wrong key */
+    in.pos = 0;
+    if(verify_message_callback(&other, mem_read, &in, NULL, NULL) != -EBADMSG)
+        goto exit;
+
+    /* changed data */
+    message[message_len / 2] ^= 0x01;
+    in.pos = 0;
+    if(verify_message_callback(&pub, mem_read, &in, NULL, NULL) != -EBADMSG)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    free(message);
+    free(image);
+    public_key_destroy(&pub);
+    public_key_destroy(&other);
+
+    return ret;
+}
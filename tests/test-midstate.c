@@ -0,0 +1,93 @@
+#include "common.h"
+#include "hash.h"
+#include "public_key.h"
+#include "scratch.h"
+#include "sha1.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main()
+{
+    int ret = -1, len;
+    uint8_t *data = NULL, suffix[1024];
+    uint8_t expected[SHA1_DIGEST_LENGTH], digest[SHA1_DIGEST_LENGTH];
+    size_t datalen = 0, prefix;
+    libsign_public_key pub;
+    libsign_signature sig, subkey_sig;
+    libsign_scratch scratch;
+    sha1_ctx hash, saved, engine, imported;
+
+    public_key_init(&pub);
+    signature_init(&sig);
+    signature_init(&subkey_sig);
+    scratch_init(&scratch);
+
+    if(parse_public_key(&pub, "files/pubkey.key") < 0 ||
+       parse_signature(&sig, "files/vmImage.sig") < 0 ||
+       parse_signature(&subkey_sig, "files/vmImage-subkey.sig") < 0 ||
+       !(data = read_file("files/vmImage", &datalen)))
+        goto exit;
+
+    /* the data hashed by the caller, which keeps its hash */
+    sha1_init(&hash);
+    sha1_update(&hash, datalen, data);
+    saved = hash;
+
+    if(libsign_verify_midstate(&pub, &sig, &hash, NULL) != 0 ||
+       libsign_verify_midstate(&pub, &sig, &hash, &scratch) != 0 ||
+       memcmp(&hash, &saved, sizeof(sha1_ctx)) != 0)
+        goto exit;
+
+    /* the chaining value of another implementation, after whole blocks */
+    prefix = datalen / 3 - (datalen / 3) % SHA1_BLOCK_LENGTH;
+    sha1_init(&engine);
+    sha1_update(&engine, prefix, data);
+
+    if(hash_sha1_import(&imported, engine.state, prefix) < 0)
+        goto exit;
+    sha1_update(&imported, datalen - prefix, data + prefix);
+    if(libsign_verify_midstate(&pub, &sig, &imported, &scratch) != 0)
+        goto exit;
+
+    if(hash_sha1_import(&imported, engine.state, prefix + 1) != -EINVAL)
+        goto exit;
+
+    /* the suffix is what verify() adds to the hash of the data */
+    len = signature_suffix(&sig, suffix, sizeof(suffix));
+    if(len != (int)SIGNATURE_SUFFIX_LEN(sig.hashed_data_len) ||
+       signature_suffix(&sig, suffix, len - 1) != -ENOSPC)
+        goto exit;
+
+    saved = hash;
+    signature_hash_suffix(&saved, sig.hashed_data, sig.hashed_data_len);
+    sha1_digest(&saved, expected);
+
+    sha1_update(&hash, len, suffix);
+    sha1_digest(&hash, digest);
+    if(memcmp(digest, expected, SHA1_DIGEST_LENGTH) != 0)
+        goto exit;
+
+    /* other data, or another key */
+    sha1_init(&hash);
+    sha1_update(&hash, datalen - 1, data);
+    if(libsign_verify_midstate(&pub, &sig, &hash, &scratch) != -EBADMSG ||
+       libsign_verify_midstate(&pub, &sig, &hash, NULL) != -EBADMSG ||
+       libsign_verify_midstate(&pub, &subkey_sig, &imported, NULL) != -ENOKEY)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    free(data);
+    scratch_destroy(&scratch);
+    public_key_destroy(&pub);
+    signature_destroy(&sig);
+    signature_destroy(&subkey_sig);
+
+    return ret;
+}
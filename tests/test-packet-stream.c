@@ -0,0 +1,134 @@
+#include "stream.h"
+#include "pgp.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+typedef struct packet_log {
+    int tags[16];
+    uint32_t lens[16];
+    int skipped;
+    int count;
+} packet_log;
+
+static int log_packet(void *opaque, int tag, const uint8_t *body, uint32_t len)
+{
+    packet_log *log = opaque;
+
+    if(log->count == 16)
+        return -1;
+
+    log->tags[log->count] = tag;
+    log->lens[log->count] = len;
+    log->count++;
+    if(!body)
+        log->skipped++;
+
+    return 0;
+}
+
+/* feed the file in pieces of the given size, 0 means random sizes */
+static int parse(const uint8_t *data, uint32_t len, int armored, uint32_t work_size,
+                 uint32_t piece, packet_log *log)
+{
+    int ret;
+    uint32_t pos = 0;
+    uint8_t *work = malloc(work_size);
+    libsign_packet_stream ps;
+
+    memset(log, 0, sizeof(packet_log));
+    packet_stream_init(&ps, armored, work, work_size, log_packet, log);
+
+    while(pos < len) {
+        uint32_t n = piece ? piece : 1 + (uint32_t)rand() % 200;
+        if(n > len - pos)
+            n = len - pos;
+
+        ret = packet_stream_feed(&ps, data + pos, n);
+        if(ret < 0)
+            goto exit;
+        pos += n;
+    }
+
+    ret = packet_stream_finish(&ps);
+
+exit:
+    free(work);
+
+    return ret;
+}
+
+int main()
+{
+    static const int expected_tags[] = {
+        PGP_TAG_PUBLIC_KEY, PGP_TAG_USERID, PGP_TAG_SIGNATURE,
+        PGP_TAG_PUBLIC_SUBKEY, PGP_TAG_SIGNATURE
+    };
+    int ret = -1, fd, i;
+    struct stat stbuf;
+    uint32_t filesize;
+    uint8_t *buffer = NULL;
+    packet_log log;
+
+    srand(4880);
+
+    fd = open(KEYFILE, O_RDONLY | O_BINARY);
+    if(fd == -1)
+        goto exit;
+
+    if(fstat(fd, &stbuf) == -1)
+        goto exit;
+
+    filesize = stbuf.st_size;
+    buffer = malloc(filesize);
+    if(!buffer || read(fd, buffer, filesize) != filesize)
+        goto exit;
+
+    /* whole file, one octet at a time and random pieces */
+    if(parse(buffer, filesize, ARMORED, LIBSIGN_STREAM_WORK_SIZE, filesize, &log) < 0)
+        goto exit;
+    if(parse(buffer, filesize, ARMORED, LIBSIGN_STREAM_WORK_SIZE, 1, &log) < 0)
+        goto exit;
+    if(parse(buffer, filesize, ARMORED, LIBSIGN_STREAM_WORK_SIZE, 0, &log) < 0)
+        goto exit;
+
+    if(log.count != 5 || log.skipped)
+        goto exit;
+    for(i = 0; i < 5; i++)
+        if(log.tags[i] != expected_tags[i])
+            goto exit;
+
+    /* the signatures do not fit in a 540 octet buffer, the keys do */
+    if(parse(buffer, filesize, ARMORED, 540, 0, &log) < 0)
+        goto exit;
+    if(log.count != 5 || log.skipped != 2 || log.lens[2] != 568)
+        goto exit;
+
+    /* the file cut short */
+    if(parse(buffer, filesize - 200, ARMORED, LIBSIGN_STREAM_WORK_SIZE, 0, &log) == 0)
+        goto exit;
+
+    /* a damaged packet is caught by the armor checksum */
+    if(ARMORED) {
+        buffer[200] = buffer[200] == 'A' ? 'B' : 'A';
+        if(parse(buffer, filesize, ARMORED, LIBSIGN_STREAM_WORK_SIZE, 0, &log) == 0)
+            goto exit;
+    }
+
+    ret = 0;
+exit:
+    if(fd >= 0)
+        close(fd);
+    free(buffer);
+
+    return ret;
+}
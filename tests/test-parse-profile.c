@@ -0,0 +1,183 @@
+#include "common.h"
+#include "public_key.h"
+#include "stream.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+#define PRIMARY_EXPIRES 2051265600
+#define SUBKEY_EXPIRES  1893499200
+
+static int count_packet(void *opaque, int tag, const uint8_t *body, uint32_t len)
+{
+    (void)body;
+    (void)len;
+    if(tag != PGP_TAG_SIGNATURE)
+        return -EINVAL;
+    (*(int*)opaque)++;
+
+    return 0;
+}
+
+/* the profile decides what comes with the key material. the flags and
+   expiration times of the key and the subkey come with every profile, once
+   the self-signatures have been checked. */
+static int check_profile(libsign_public_key *pub, unsigned int profile)
+{
+    if(mpz_sizeinbase(pub->n, 2) != 1024 || pub->num_subkeys != 1 ||
+       mpz_sizeinbase(pub->subkeys[0].n, 2) != 1024 ||
+       pub->subkeys[0].key_id != 0xA5DF6CACC4DB71CAULL)
+        return -1;
+
+    if((profile & LIBSIGN_PARSE_USERIDS) ? pub->num_userids != 1 : pub->num_userids != 0)
+        return -1;
+
+    /* the certification of the user ID is kept without it */
+    if(pub->num_certs != 2 || pub->subkeys[0].key_flags)
+        return -1;
+
+    /* the certification, the binding and its back-signature */
+    if(pub->key_flags || pub->expires || verify_certifications(pub, NULL) != 3)
+        return -1;
+
+    if(pub->subkeys[0].key_flags != PGP_KEY_FLAG_SIGN ||
+       pub->subkeys[0].expires != SUBKEY_EXPIRES ||
+       pub->subkeys[0].binding != LIBSIGN_CERT_VALID ||
+       pub->subkeys[0].back_signature != LIBSIGN_CERT_VALID)
+        return -1;
+
+    if(pub->key_flags != (PGP_KEY_FLAG_CERTIFY | PGP_KEY_FLAG_SIGN) ||
+       pub->expires != PRIMARY_EXPIRES)
+        return -1;
+
+    return 0;
+}
+
+int main()
+{
+    static const unsigned int profiles[] = {
+        LIBSIGN_PARSE_KEYS, LIBSIGN_PARSE_USERIDS, LIBSIGN_PARSE_CERTIFICATIONS,
+        LIBSIGN_PARSE_USERIDS | LIBSIGN_PARSE_CERTIFICATIONS, LIBSIGN_PARSE_ALL
+    };
+    int ret = -1, fd, count = 0;
+    unsigned int i;
+    uint8_t *key_data, *armor;
+    size_t key_len, armor_len;
+    libsign_public_key pub;
+    libsign_signature sig;
+
+    signature_init(&sig);
+    key_data = read_file("files/expiring.key", &key_len);
+    armor = read_file("files/keyring.asc", &armor_len);
+    if(!key_data || !armor)
+        goto exit;
+
+    for(i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        public_key_init(&pub);
+        ret = parse_public_key_profile(&pub, "files/expiring.key", profiles[i]);
+        if(ret == 0)
+            ret = check_profile(&pub, profiles[i]);
+        public_key_destroy(&pub);
+        if(ret < 0) {
+            fprintf(stderr, "file parsed with profile %#x differs\n", profiles[i]);
+            goto exit;
+        }
+
+        public_key_init(&pub);
+        ret = parse_public_key_buffer_profile(&pub, key_data, key_len, profiles[i]);
+        if(ret == 0)
+            ret = check_profile(&pub, profiles[i]);
+        public_key_destroy(&pub);
+        if(ret < 0) {
+            fprintf(stderr, "buffer parsed with profile %#x differs\n", profiles[i]);
+            goto exit;
+        }
+    }
+    ret = -1;
+
+    /* a key only parsed has its expiration time checked as it is used */
+    public_key_init(&pub);
+    if(parse_public_key(&pub, "files/expiring.key") < 0 ||
+       parse_signature(&sig, "files/vmImage.sig") < 0) {
+        public_key_destroy(&pub);
+        goto exit;
+    }
+    sig.issuer = pub.key_id;
+    sig.creation_time = PRIMARY_EXPIRES;
+    if(verify(&pub, &sig, "files/vmImage") != -EKEYEXPIRED || pub.expires != PRIMARY_EXPIRES) {
+        public_key_destroy(&pub);
+        goto exit;
+    }
+    public_key_destroy(&pub);
+    signature_destroy(&sig);
+    signature_init(&sig);
+
+    /* the key material alone is enough to verify */
+    public_key_init(&pub);
+    if(parse_public_key_armor_buffer_profile(&pub, armor, armor_len, LIBSIGN_PARSE_KEYS) < 0 ||
+       parse_signature(&sig, "files/vmImage.sig") < 0 ||
+       pub.num_userids != 0 || verify(&pub, &sig, "files/vmImage") != 0) {
+        public_key_destroy(&pub);
+        goto exit;
+    }
+
+    /* and the flags of the subkeys still keep an encryption subkey from
+       signing */
+    sig.issuer = pub.subkeys[0].key_id;
+    if(pub.subkeys[0].key_flags != (PGP_KEY_FLAG_ENCRYPT_COMMS | PGP_KEY_FLAG_ENCRYPT_STORAGE) ||
+       verify(&pub, &sig, "files/vmImage") != -EKEYREJECTED) {
+        public_key_destroy(&pub);
+        goto exit;
+    }
+    sig.issuer = pub.key_id;
+
+    /* nor does a key sign once it has expired */
+    pub.expires = sig.creation_time;
+    if(verify(&pub, &sig, "files/vmImage") != -EKEYEXPIRED) {
+        public_key_destroy(&pub);
+        goto exit;
+    }
+    pub.expires = sig.creation_time + 1;
+    if(verify(&pub, &sig, "files/vmImage") != 0) {
+        public_key_destroy(&pub);
+        goto exit;
+    }
+    public_key_destroy(&pub);
+
+    /* an expiration time past 2106 does not wrap to one in the past */
+    if(public_key_expires(PRIMARY_EXPIRES, 0) != 0 ||
+       public_key_expires(PRIMARY_EXPIRES, 60) != PRIMARY_EXPIRES + 60 ||
+       public_key_expires(PRIMARY_EXPIRES, UINT32_MAX) != UINT32_MAX)
+        goto exit;
+
+    /* the stream only hands out the tags asked for */
+    fd = open("files/pubkey.key", O_RDONLY | O_BINARY);
+    if(fd < 0)
+        goto exit;
+    ret = parse_packets_fd_tags(fd, 0, LIBSIGN_TAG_BIT(PGP_TAG_SIGNATURE), count_packet, &count);
+    close(fd);
+    if(ret < 0 || count != 2) {
+        ret = -1;
+        goto exit;
+    }
+
+    ret = 0;
+
+exit:
+    free(key_data);
+    free(armor);
+    signature_destroy(&sig);
+
+    return ret;
+}
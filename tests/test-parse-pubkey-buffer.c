@@ -50,7 +50,11 @@ int main()
         goto free_buffer;
 
     if(armored)
+#ifdef INPLACE
+        ret = parse_public_key_armor_inplace(&pub, buffer, filesize);
+#else
         ret = parse_public_key_armor_buffer(&pub, buffer, filesize);
+#endif
     else
         ret = parse_public_key_buffer(&pub, buffer, filesize);
 
@@ -50,7 +50,11 @@ int main()
         goto free_buffer;
 
     if(armored)
+#ifdef INPLACE
+        ret = parse_signature_armor_inplace(&sig, buffer, filesize);
+#else
         ret = parse_signature_armor_buffer(&sig, buffer, filesize);
+#endif
     else
         ret = parse_signature_buffer(&sig, buffer, filesize);
 
@@ -0,0 +1,124 @@
+#include "common.h"
+#include "keystore.h"
+#include "public_key.h"
+#include "scratch.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* every allocation GMP makes goes through these */
+static unsigned int gmp_allocations;
+
+static void *count_alloc(size_t size)
+{
+    gmp_allocations++;
+    return malloc(size);
+}
+
+static void *count_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    (void)old_size;
+    gmp_allocations++;
+    return realloc(ptr, new_size);
+}
+
+static void count_free(void *ptr, size_t size)
+{
+    (void)size;
+    free(ptr);
+}
+
+int main()
+{
+    int ret = -1, i;
+    static uint8_t manifest[4096];
+    size_t manifest_len = 0;
+    mp_size_t limbs;
+    libsign_public_key pub, testkey;
+    libsign_signature sig, subkey_sig, manifest_sig;
+    libsign_keystore ks;
+    libsign_scratch scratch, fresh;
+
+    public_key_init(&pub);
+    public_key_init(&testkey);
+    signature_init(&sig);
+    signature_init(&subkey_sig);
+    signature_init(&manifest_sig);
+    keystore_init(&ks);
+    scratch_init(&scratch);
+    scratch_init(&fresh);
+
+    mp_set_memory_functions(count_alloc, count_realloc, count_free);
+
+    if(parse_public_key(&pub, "files/pubkey.key") < 0 ||
+       parse_public_key(&testkey, "files/testkey.key") < 0 ||
+       parse_signature(&sig, "files/vmImage.sig") < 0 ||
+       parse_signature(&subkey_sig, "files/vmImage-subkey.sig") < 0 ||
+       parse_signature(&manifest_sig, "files/vmImage.manifest.sig") < 0 ||
+       read_file_buffer("files/vmImage.manifest", manifest, sizeof(manifest), &manifest_len) < 0)
+        goto exit;
+
+    if(keystore_add(&ks, &pub) < 0 || keystore_add(&ks, &testkey) < 0)
+        goto exit;
+
+    /* sized for the largest of the keys */
+    if(scratch_reserve_keystore(&scratch, &ks) < 0 || scratch.limbs <= 0 ||
+       scratch.limbs * GMP_NUMB_BITS < (mp_size_t)mpz_sizeinbase(pub.n, 2) ||
+       scratch.limbs * GMP_NUMB_BITS < (mp_size_t)mpz_sizeinbase(testkey.n, 2))
+        goto exit;
+    limbs = scratch.limbs;
+
+    /* the integers are GMP's, sized once */
+    gmp_allocations = 0;
+    if(scratch_reserve_keystore(&scratch, &ks) < 0 || gmp_allocations ||
+       scratch.msg->_mp_alloc < limbs || scratch.result->_mp_alloc < limbs)
+        goto exit;
+
+    if(verify_scratch(&pub, &sig, "files/vmImage", &scratch) != 0 ||
+       verify_scratch(&testkey, &subkey_sig, "files/vmImage", &scratch) != 0)
+        goto exit;
+
+    /* the steady state does not allocate */
+    gmp_allocations = 0;
+    for(i = 0; i < 16; i++) {
+        if(verify_buffer_scratch(&testkey, &manifest_sig, manifest, manifest_len,
+                                 &scratch) != 0 ||
+           verify_scratch(&pub, &sig, "files/vmImage", &scratch) != 0)
+            goto exit;
+    }
+    if(gmp_allocations || scratch.limbs != limbs) {
+        fprintf(stderr, "%u allocations while verifying\n", gmp_allocations);
+        goto exit;
+    }
+
+    /* a bad signature is the same error with or without a scratch */
+    if(verify_buffer_scratch(&testkey, &manifest_sig, manifest, manifest_len - 1,
+                             &scratch) != -EBADMSG ||
+       verify_buffer(&testkey, &manifest_sig, manifest, manifest_len - 1) != -EBADMSG)
+        goto exit;
+    if(verify_scratch(&pub, &subkey_sig, "files/vmImage", &scratch) != -ENOKEY)
+        goto exit;
+
+    /* a scratch that was never reserved grows on the first use */
+    if(verify_buffer_scratch(&testkey, &manifest_sig, manifest, manifest_len, &fresh) != 0 ||
+       fresh.limbs <= 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    scratch_destroy(&scratch);
+    scratch_destroy(&fresh);
+    keystore_destroy(&ks);
+    public_key_destroy(&pub);
+    public_key_destroy(&testkey);
+    signature_destroy(&sig);
+    signature_destroy(&subkey_sig);
+    signature_destroy(&manifest_sig);
+
+    return ret;
+}
@@ -0,0 +1,189 @@
+#include "keystore.h"
+#include "public_key.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_READERS 8
+#define PUBLISHES   200
+
+#define TEST_KEY_ID     0x154A0F514623B164ULL
+#define TEST_SUBKEY_ID  0x72AA0618D219A4C6ULL
+#define PUBKEY_ID       0x1EB5F06127342502ULL
+#define EXPIRING_ID     0x34D3FC216966F4E4ULL
+
+static const uint8_t subkey_fpr[PGP_FINGERPRINT_LEN] = {
+    0xf1, 0x43, 0xc0, 0x63, 0x48, 0x4f, 0xd7, 0x43, 0xf8, 0x17,
+    0xb4, 0x2d, 0x72, 0xaa, 0x06, 0x18, 0xd2, 0x19, 0xa4, 0xc6
+};
+
+struct reader_args {
+    libsign_shared_keystore *sks;
+    int *stop;
+    int errors;
+    unsigned long lookups;
+};
+
+/* every generation has the test key, and either pubkey.key or expiring.key */
+static void *reader(void *opaque)
+{
+    struct reader_args *args = opaque;
+    libsign_keystore_reader *slot;
+    libsign_keystore_generation *gen;
+    libsign_public_key *pub, *pubkey, *expiring;
+    libsign_subkey *subkey;
+
+    slot = shared_keystore_reader(args->sks);
+    if(!slot) {
+        args->errors++;
+        return NULL;
+    }
+
+    while(!__atomic_load_n(args->stop, __ATOMIC_RELAXED)) {
+        gen = shared_keystore_enter(args->sks, slot);
+
+        pub = keystore_find(&gen->index, TEST_SUBKEY_ID, &subkey);
+        if(!pub || !subkey || pub->key_id != TEST_KEY_ID ||
+           mpz_sizeinbase(subkey->n, 2) != 2048)
+            args->errors++;
+
+        pubkey = keystore_find(&gen->index, PUBKEY_ID, NULL);
+        expiring = keystore_find(&gen->index, EXPIRING_ID, NULL);
+        if((pubkey == NULL) == (expiring == NULL) || gen->num_keys != 2)
+            args->errors++;
+        if(pubkey && (pubkey->num_userids != 1 ||
+                      strcmp(pubkey->userids[0].userid, "Foo Bar <foo@bar.com>") != 0))
+            args->errors++;
+        if(expiring && expiring->expires != 2051265600)
+            args->errors++;
+
+        shared_keystore_leave(slot);
+        args->lookups++;
+    }
+
+    shared_keystore_reader_release(slot);
+
+    return NULL;
+}
+
+static libsign_keystore_generation *generation(const char *other)
+{
+    libsign_keystore_generation *gen = keystore_generation_new();
+
+    if(!gen)
+        return NULL;
+
+    if(keystore_generation_load(gen, "files/testkey.key", LIBSIGN_PARSE_ALL) < 0 ||
+       keystore_generation_load(gen, other, LIBSIGN_PARSE_ALL) < 0) {
+        keystore_generation_free(gen);
+        return NULL;
+    }
+
+    return gen;
+}
+
+int main()
+{
+    int ret = -1, i, started = 0;
+    int stop = 0;
+    pthread_t threads[NUM_READERS];
+    struct reader_args args[NUM_READERS];
+    libsign_shared_keystore sks;
+    libsign_keystore_generation *gen, *held;
+    libsign_keystore_reader *slot;
+    libsign_public_key *pub;
+    libsign_subkey *subkey;
+
+    gen = generation("files/pubkey.key");
+    if(!gen || shared_keystore_init(&sks, gen) < 0)
+        return -1;
+
+    /* lookups by fingerprint go through the key ID */
+    pub = keystore_find_fingerprint(&gen->index, subkey_fpr, &subkey);
+    if(!pub || pub->key_id != TEST_KEY_ID || !subkey || subkey->key_id != TEST_SUBKEY_ID)
+        goto exit;
+    if(keystore_find_fingerprint(&gen->index, pub->fingerprint, &subkey) != pub || subkey)
+        goto exit;
+    if(keystore_find_fingerprint(&gen->index, gen->keys[1]->pub.fingerprint, NULL) !=
+       &gen->keys[1]->pub)
+        goto exit;
+    /* the same key ID with another fingerprint */
+    {
+        uint8_t fpr[PGP_FINGERPRINT_LEN];
+
+        memcpy(fpr, subkey_fpr, PGP_FINGERPRINT_LEN);
+        fpr[0] ^= 0xff;
+        if(keystore_find_fingerprint(&gen->index, fpr, NULL))
+            goto exit;
+    }
+
+    /* a key is only in a generation once */
+    if(keystore_generation_add(gen, gen->keys[0]) != -EEXIST || gen->num_keys != 2)
+        goto exit;
+
+    memset(args, 0, sizeof(args));
+    for(i = 0; i < NUM_READERS; i++) {
+        args[i].sks = &sks;
+        args[i].stop = &stop;
+        if(pthread_create(&threads[i], NULL, reader, &args[i]) != 0)
+            goto exit;
+        started++;
+    }
+
+    for(i = 0; i < PUBLISHES; i++) {
+        gen = generation(i % 2 ? "files/pubkey.key" : "files/expiring.key");
+        if(!gen || shared_keystore_publish(&sks, gen) < 0) {
+            keystore_generation_free(gen);
+            goto exit;
+        }
+    }
+
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for(i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    started = 0;
+
+    for(i = 0; i < NUM_READERS; i++) {
+        if(args[i].errors) {
+            fprintf(stderr, "reader %d saw %d inconsistent lookups\n", i, args[i].errors);
+            goto exit;
+        }
+    }
+
+    /* with the readers gone every replaced generation can be freed */
+    if(shared_keystore_reclaim(&sks) != 0)
+        goto exit;
+
+    /* a reference held after leaving keeps the generation */
+    slot = shared_keystore_reader(&sks);
+    if(!slot)
+        goto exit;
+    held = shared_keystore_enter(&sks, slot);
+    keystore_generation_get(held);
+    shared_keystore_leave(slot);
+    shared_keystore_reader_release(slot);
+
+    gen = generation("files/expiring.key");
+    if(!gen || shared_keystore_publish(&sks, gen) < 0) {
+        keystore_generation_free(gen);
+        goto exit;
+    }
+    if(shared_keystore_reclaim(&sks) != 1 || !keystore_find(&held->index, TEST_KEY_ID, NULL))
+        goto exit;
+
+    keystore_generation_put(held);
+    if(shared_keystore_reclaim(&sks) != 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for(i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    shared_keystore_destroy(&sks);
+
+    return ret;
+}
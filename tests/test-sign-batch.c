@@ -0,0 +1,182 @@
+#include "public_key.h"
+#include "secret_key.h"
+#include "sign.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+#define NUM_JOBS        48
+#define FAILING_JOB     29
+#define TEST_SUBKEY_ID  0x72AA0618D219A4C6ULL
+
+typedef struct sink {
+    uint8_t data[1024];
+    size_t len;
+    int index;
+    /* the order the jobs were written in, shared by all the sinks */
+    int *order;
+    int *num_order;
+} sink;
+
+static int sink_write(void *opaque, const uint8_t *buffer, size_t len)
+{
+    sink *out = opaque;
+
+    if(len > sizeof(out->data) - out->len)
+        return -ENOSPC;
+
+    if(!out->len)
+        out->order[(*out->num_order)++] = out->index;
+
+    memcpy(out->data + out->len, buffer, len);
+    out->len += len;
+
+    return 0;
+}
+
+static ssize_t failing_read(void *opaque, uint8_t *buffer, size_t len)
+{
+    (void)opaque;
+    (void)buffer;
+    (void)len;
+
+    return -EIO;
+}
+
+static int run(libsign_secret_key *sec, libsign_public_key *pub, const uint8_t *data,
+               unsigned int threads)
+{
+    int ret = -1, i, order[NUM_JOBS], num_order = 0, fds[NUM_JOBS];
+    static sink sinks[NUM_JOBS];
+    libsign_sign_job jobs[NUM_JOBS];
+    libsign_signature sig;
+
+    memset(jobs, 0, sizeof(jobs));
+    memset(sinks, 0, sizeof(sinks));
+
+    for(i = 0; i < NUM_JOBS; i++) {
+        fds[i] = -1;
+        sinks[i].index = i;
+        sinks[i].order = order;
+        sinks[i].num_order = &num_order;
+
+        jobs[i].write = sink_write;
+        jobs[i].write_opaque = &sinks[i];
+        jobs[i].armored = i % 3 == 0;
+
+        if(i == FAILING_JOB)
+            jobs[i].read_fn = failing_read;
+        else if(i % 8 == 7) {
+            /* a large file now and then, among the small buffers */
+            fds[i] = open("files/vmImage", O_RDONLY | O_BINARY);
+            if(fds[i] < 0)
+                goto exit;
+            jobs[i].read_fn = fd_read;
+            jobs[i].read_opaque = &fds[i];
+        }
+        else {
+            jobs[i].data = data;
+            jobs[i].datalen = 1 + i * 37;
+        }
+    }
+
+    if(libsign_sign_batch(sec, 0, jobs, NUM_JOBS, threads) != -EIO)
+        goto exit;
+
+    /* written in the order of the jobs, the one that failed is skipped */
+    if(num_order != NUM_JOBS - 1)
+        goto exit;
+    for(i = 1; i < num_order; i++) {
+        if(order[i] <= order[i - 1])
+            goto exit;
+    }
+
+    for(i = 0; i < NUM_JOBS; i++) {
+        int result;
+
+        if(i == FAILING_JOB) {
+            if(jobs[i].result != -EIO || sinks[i].len)
+                goto exit;
+            continue;
+        }
+        if(jobs[i].result != 0)
+            goto exit;
+
+        signature_init(&sig);
+        if(jobs[i].armored)
+            result = parse_signature_armor_buffer(&sig, sinks[i].data, sinks[i].len);
+        else
+            result = parse_signature_buffer(&sig, sinks[i].data, sinks[i].len);
+
+        if(result == 0 && sig.issuer != TEST_SUBKEY_ID)
+            result = -EINVAL;
+        if(result == 0) {
+            if(fds[i] >= 0)
+                result = verify(pub, &sig, "files/vmImage");
+            else
+                result = verify_buffer(pub, &sig, data, jobs[i].datalen);
+        }
+        signature_destroy(&sig);
+
+        if(result != 0) {
+            fprintf(stderr, "signature of job %d did not verify: %d\n", i, result);
+            goto exit;
+        }
+    }
+
+    ret = 0;
+
+exit:
+    for(i = 0; i < NUM_JOBS; i++) {
+        if(fds[i] >= 0)
+            close(fds[i]);
+    }
+
+    return ret;
+}
+
+int main()
+{
+    int ret = -1, i;
+    static uint8_t data[NUM_JOBS * 37];
+    libsign_secret_key sec;
+    libsign_public_key pub;
+
+    secret_key_init(&sec);
+    public_key_init(&pub);
+
+    for(i = 0; i < (int)sizeof(data); i++)
+        data[i] = i * 7;
+
+    if(parse_secret_key(&sec, "files/testkey.sec") < 0 ||
+       parse_public_key(&pub, "files/testkey.key") < 0)
+        goto exit;
+
+    if(run(&sec, &pub, data, 4) < 0 || run(&sec, &pub, data, 1) < 0 ||
+       run(&sec, &pub, data, 0) < 0)
+        goto exit;
+
+    /* a key that cannot sign is refused before any job is started */
+    if(libsign_sign_batch(&sec, 0x1EB5F06127342502ULL, NULL, 0, 0) != -ENOKEY)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    secret_key_destroy(&sec);
+    public_key_destroy(&pub);
+
+    return ret;
+}
@@ -0,0 +1,127 @@
+#include "public_key.h"
+#include "secret_key.h"
+#include "sign.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+#define TEST_KEY_ID     0x154A0F514623B164ULL
+#define TEST_SUBKEY_ID  0x72AA0618D219A4C6ULL
+#define CREATED         1800000000
+
+typedef struct membuf {
+    uint8_t data[4096];
+    size_t len;
+} membuf;
+
+static int mem_write(void *opaque, const uint8_t *buffer, size_t len)
+{
+    membuf *buf = opaque;
+
+    if(len > sizeof(buf->data) - buf->len)
+        return -ENOSPC;
+
+    memcpy(buf->data + buf->len, buffer, len);
+    buf->len += len;
+
+    return 0;
+}
+
+/* feed the file to the signer in pieces of growing, odd sizes, as a
+   producer writing it out would */
+static int stream_file(libsign_sign_ctx *ctx, const char *filename)
+{
+    int fd, ret = 0;
+    size_t chunk = 1;
+    ssize_t len;
+    uint8_t buffer[8192];
+
+    fd = open(filename, O_RDONLY | O_BINARY);
+    if(fd < 0)
+        return -errno;
+
+    while((len = read(fd, buffer, chunk)) > 0) {
+        if((ret = sign_write(ctx, buffer, len)) < 0)
+            break;
+        chunk = chunk * 3 + 1;
+        if(chunk > sizeof(buffer))
+            chunk = 7;
+    }
+    if(len < 0)
+        ret = -errno;
+
+    close(fd);
+
+    return ret;
+}
+
+int main()
+{
+    int ret = -1;
+    static membuf binary, armored;
+    libsign_secret_key sec;
+    libsign_public_key pub;
+    libsign_signature whole, parsed;
+    libsign_sign_ctx ctx;
+
+    secret_key_init(&sec);
+    public_key_init(&pub);
+    signature_init(&whole);
+    signature_init(&parsed);
+
+    if(parse_secret_key(&sec, "files/testkey.sec") < 0 ||
+       parse_public_key(&pub, "files/testkey.key") < 0)
+        goto exit;
+
+    /* a key that cannot sign is refused before any data is hashed */
+    if(sign_init(&ctx, &sec, 0x1EB5F06127342502ULL, 0) != -ENOKEY)
+        goto exit;
+
+    if(sign_init(&ctx, &sec, 0, CREATED) < 0 || stream_file(&ctx, "files/vmImage") < 0 ||
+       sign_final(&ctx, 0, mem_write, &binary) < 0)
+        goto exit;
+
+    /* the same as signing the whole file */
+    whole.creation_time = CREATED;
+    if(sign(&sec, &whole, "files/vmImage") < 0 ||
+       parse_signature_buffer(&parsed, binary.data, binary.len) < 0 ||
+       mpz_cmp(parsed.s, whole.s) != 0 || parsed.issuer != TEST_SUBKEY_ID ||
+       parsed.creation_time != CREATED || verify(&pub, &parsed, "files/vmImage") != 0)
+        goto exit;
+    signature_destroy(&parsed);
+    signature_init(&parsed);
+
+    /* armored, by the primary key and made now */
+    if(sign_init(&ctx, &sec, TEST_KEY_ID, 0) < 0 || stream_file(&ctx, "files/vmImage") < 0 ||
+       sign_final(&ctx, 1, mem_write, &armored) < 0)
+        goto exit;
+
+    if(armored.len < 36 ||
+       strncmp((char*)armored.data, "-----BEGIN PGP SIGNATURE-----", 29) != 0 ||
+       parse_signature_armor_buffer(&parsed, armored.data, armored.len) < 0 ||
+       parsed.issuer != TEST_KEY_ID || !parsed.creation_time ||
+       verify(&pub, &parsed, "files/vmImage") != 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    secret_key_destroy(&sec);
+    public_key_destroy(&pub);
+    signature_destroy(&whole);
+    signature_destroy(&parsed);
+
+    return ret;
+}
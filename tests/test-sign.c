@@ -0,0 +1,183 @@
+#include "common.h"
+#include "public_key.h"
+#include "secret_key.h"
+#include "sign.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_KEY_ID     0x154A0F514623B164ULL
+#define TEST_SUBKEY_ID  0x72AA0618D219A4C6ULL
+#define CREATED         1800000000
+
+typedef struct membuf {
+    uint8_t data[16384];
+    size_t len;
+} membuf;
+
+static int mem_write(void *opaque, const uint8_t *buffer, size_t len)
+{
+    membuf *buf = opaque;
+
+    if(len > sizeof(buf->data) - buf->len)
+        return -ENOSPC;
+
+    memcpy(buf->data + buf->len, buffer, len);
+    buf->len += len;
+
+    return 0;
+}
+
+/* a secret key whose secret MPIs do not add up to the checksum */
+static int check_checksum(const membuf *key)
+{
+    int ret;
+    static uint8_t corrupt[sizeof(key->data)];
+    libsign_secret_key sec;
+
+    /* the last octet of u in the first secret key packet, just before the
+       checksum (3 octets of header, 920 of body) */
+    memcpy(corrupt, key->data, key->len);
+    corrupt[3 + 920 - 3] ^= 0x01;
+
+    secret_key_init(&sec);
+    ret = parse_secret_key_buffer(&sec, corrupt, key->len);
+    secret_key_destroy(&sec);
+
+    return ret == -EBADMSG ? 0 : -1;
+}
+
+/* the same key marked RSA sign-only (9.1), it still signs and verifies */
+static int check_sign_only(const membuf *key, const membuf *file)
+{
+    int ret = -1;
+    static uint8_t sign_only[sizeof(key->data)];
+    libsign_secret_key sec;
+    libsign_signature sig;
+
+    /* the algorithm octet of the first secret key packet */
+    memcpy(sign_only, key->data, key->len);
+    sign_only[3 + 5] = PGP_RSA_SIGN_ONLY;
+
+    secret_key_init(&sec);
+    signature_init(&sig);
+
+    if(parse_secret_key_buffer(&sec, sign_only, key->len) < 0 ||
+       sec.pub.pk_algo != PGP_RSA_SIGN_ONLY || !sec.primary.available)
+        goto exit;
+
+    sig.issuer = sec.pub.key_id;
+    if(sign_buffer(&sec, &sig, file->data, file->len) < 0 ||
+       verify_buffer(&sec.pub, &sig, file->data, file->len) != 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    secret_key_destroy(&sec);
+    signature_destroy(&sig);
+
+    return ret;
+}
+
+int main()
+{
+    int ret = -1, result;
+    static membuf file, key, out;
+    libsign_secret_key sec, sec_buffer;
+    libsign_secret_part *part;
+    libsign_public_key pub;
+    libsign_signature sig, again, parsed;
+
+    secret_key_init(&sec);
+    secret_key_init(&sec_buffer);
+    public_key_init(&pub);
+    signature_init(&sig);
+    signature_init(&again);
+    signature_init(&parsed);
+
+    if(parse_secret_key(&sec, "files/testkey.sec") < 0 ||
+       parse_public_key(&pub, "files/testkey.key") < 0 ||
+       read_file_buffer("files/vmImage.manifest", file.data, sizeof(file.data), &file.len) < 0 ||
+       read_file_buffer("files/testkey.sec", key.data, sizeof(key.data), &key.len) < 0)
+        goto exit;
+
+    /* the public parts are those of the public key */
+    if(sec.pub.key_id != TEST_KEY_ID || sec.num_subkeys != 1 ||
+       sec.subkeys[0].key_id != TEST_SUBKEY_ID ||
+       memcmp(sec.pub.fingerprint, pub.fingerprint, PGP_FINGERPRINT_LEN) != 0 ||
+       mpz_cmp(sec.pub.n, pub.n) != 0 || sec.pub.num_userids != 1 ||
+       !sec.primary.available || !sec.subkeys[0].available ||
+       sec.subkeys[0].key.size != 256)
+        goto exit;
+
+    if(parse_secret_key_buffer(&sec_buffer, key.data, key.len) < 0 ||
+       mpz_cmp(sec_buffer.subkeys[0].key.qinv, sec.subkeys[0].key.qinv) != 0)
+        goto exit;
+
+    if(check_checksum(&key) < 0) {
+        fprintf(stderr, "bad checksum was not noticed\n");
+        goto exit;
+    }
+    if(check_sign_only(&key, &file) < 0) {
+        fprintf(stderr, "sign-only key did not sign\n");
+        goto exit;
+    }
+
+    /* the signing subkey is picked by default */
+    if(secret_key_signer(&sec, 0, &part) < 0 || part != &sec.subkeys[0])
+        goto exit;
+    if(secret_key_signer(&sec, 0x1EB5F06127342502ULL, &part) != -ENOKEY)
+        goto exit;
+
+    sig.creation_time = CREATED;
+    if(sign_buffer(&sec, &sig, file.data, file.len) < 0)
+        goto exit;
+    if(sig.issuer != TEST_SUBKEY_ID || sig.creation_time != CREATED)
+        goto exit;
+
+    result = verify(&pub, &sig, "files/vmImage.manifest");
+    if(result != 0) {
+        fprintf(stderr, "signature by the subkey did not verify: %d\n", result);
+        goto exit;
+    }
+    if(verify_buffer(&pub, &sig, file.data, file.len - 1) == 0)
+        goto exit;
+
+    /* the same signature again, from the file */
+    again.creation_time = CREATED;
+    if(sign(&sec, &again, "files/vmImage.manifest") < 0 || mpz_cmp(again.s, sig.s) != 0 ||
+       again.short_hash != sig.short_hash)
+        goto exit;
+
+    /* written out and parsed back */
+    if(signature_write(&sig, mem_write, &out) < 0 ||
+       parse_signature_buffer(&parsed, out.data, out.len) < 0 ||
+       parsed.issuer != TEST_SUBKEY_ID || parsed.creation_time != CREATED ||
+       verify_buffer(&pub, &parsed, file.data, file.len) != 0)
+        goto exit;
+
+    /* and by the primary key */
+    signature_destroy(&again);
+    signature_init(&again);
+    again.issuer = TEST_KEY_ID;
+    if(sign(&sec, &again, "files/vmImage") < 0 || again.issuer != TEST_KEY_ID ||
+       !again.creation_time || verify(&pub, &again, "files/vmImage") != 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    secret_key_destroy(&sec);
+    secret_key_destroy(&sec_buffer);
+    public_key_destroy(&pub);
+    signature_destroy(&sig);
+    signature_destroy(&again);
+    signature_destroy(&parsed);
+
+    return ret;
+}
@@ -0,0 +1,114 @@
+#include "public_key.h"
+#include "signature.h"
+#include "stats.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef LIBSIGN_STATS
+typedef struct check {
+    libsign_public_key *pub;
+    libsign_signature *sig;
+    int result;
+} check;
+
+static void *verify_thread(void *arg)
+{
+    check *c = arg;
+
+    c->result = verify(c->pub, c->sig, "files/vmImage");
+
+    return NULL;
+}
+#endif
+
+int main()
+{
+    int ret = -1, i;
+    libsign_public_key pub;
+    libsign_signature sig;
+    libsign_stats stats;
+#ifdef LIBSIGN_STATS
+    struct stat st;
+    pthread_t thread;
+    check c;
+#endif
+
+    public_key_init(&pub);
+    signature_init(&sig);
+
+    for(i = 0; i < LIBSIGN_NUM_STATS; i++) {
+        if(!libsign_stat_name(i))
+            goto exit;
+    }
+    if(strcmp(libsign_stat_name(LIBSIGN_STAT_SHA1_UPDATE), "sha1_update") != 0)
+        goto exit;
+
+#ifndef LIBSIGN_STATS
+    /* nothing is counted */
+    if(libsign_stats_snapshot(&stats) != -ENOTSUP)
+        goto exit;
+    for(i = 0; i < LIBSIGN_NUM_STATS; i++) {
+        if(stats.counters[i].calls)
+            goto exit;
+    }
+#else
+    /* the key is shared with the thread, its certifications are checked
+       before either verifies with it */
+    if(parse_public_key(&pub, "files/pubkey.asc") < 0 ||
+       verify_certifications(&pub, NULL) < 0 ||
+       parse_signature(&sig, "files/vmImage.asc") < 0 || stat("files/vmImage", &st) < 0)
+        goto exit;
+
+    libsign_stats_reset();
+
+    /* once here, and once in a thread that is gone by the snapshot */
+    c.pub = &pub;
+    c.sig = &sig;
+    if(verify(&pub, &sig, "files/vmImage") != 0 ||
+       pthread_create(&thread, NULL, verify_thread, &c) != 0)
+        goto exit;
+    pthread_join(thread, NULL);
+    if(c.result != 0)
+        goto exit;
+
+    if(libsign_stats_snapshot(&stats) < 0)
+        goto exit;
+
+    for(i = 0; i < LIBSIGN_NUM_STATS; i++)
+        printf("%-20s %8llu calls %10llu bytes %10llu nsec %4llu allocations\n",
+               libsign_stat_name(i), (unsigned long long)stats.counters[i].calls,
+               (unsigned long long)stats.counters[i].bytes,
+               (unsigned long long)stats.counters[i].nsec,
+               (unsigned long long)stats.counters[i].allocations);
+
+    if(stats.counters[LIBSIGN_STAT_RSA_SHA1_VERIFY].calls != 2 ||
+       !stats.counters[LIBSIGN_STAT_RSA_SHA1_VERIFY].allocations ||
+       stats.counters[LIBSIGN_STAT_READ].bytes != 2 * (uint64_t)st.st_size ||
+       stats.counters[LIBSIGN_STAT_SHA1_UPDATE].bytes < 2 * (uint64_t)st.st_size ||
+       !stats.counters[LIBSIGN_STAT_SHA1_UPDATE].nsec)
+        goto exit;
+
+    /* the armor and packets of the key and signature, parsed again */
+    libsign_stats_reset();
+    signature_destroy(&sig);
+    signature_init(&sig);
+    if(parse_signature(&sig, "files/vmImage.asc") < 0 || libsign_stats_snapshot(&stats) < 0 ||
+       !stats.counters[LIBSIGN_STAT_DECODE_ARMOR].calls ||
+       !stats.counters[LIBSIGN_STAT_PARSE_PACKET_HEADER].calls ||
+       stats.counters[LIBSIGN_STAT_RSA_SHA1_VERIFY].calls)
+        goto exit;
+#endif
+
+    ret = 0;
+
+exit:
+    public_key_destroy(&pub);
+    signature_destroy(&sig);
+
+    return ret;
+}
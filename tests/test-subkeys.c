@@ -0,0 +1,196 @@
+#include "common.h"
+#include "keystore.h"
+#include "packet.h"
+#include "public_key.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t primary_fpr[PGP_FINGERPRINT_LEN] = {
+    0xda, 0x38, 0xa5, 0x09, 0x3f, 0xd1, 0x9e, 0x94, 0x9c, 0xb8,
+    0x4d, 0x14, 0x15, 0x4a, 0x0f, 0x51, 0x46, 0x23, 0xb1, 0x64
+};
+static const uint8_t subkey_fpr[PGP_FINGERPRINT_LEN] = {
+    0xf1, 0x43, 0xc0, 0x63, 0x48, 0x4f, 0xd7, 0x43, 0xf8, 0x17,
+    0xb4, 0x2d, 0x72, 0xaa, 0x06, 0x18, 0xd2, 0x19, 0xa4, 0xc6
+};
+
+/* parse the key with its subkey binding left out, or with the binding's
+   signature corrupted */
+static int unbound_key(libsign_public_key *pub, const uint8_t *key_data, size_t key_len,
+                       int corrupt)
+{
+    uint8_t buffer[4096];
+    uint32_t len = 0, size;
+    libsign_packet_iter iter;
+    libsign_packet packet;
+
+    packet_iter_init(&iter, key_data, key_len);
+    while(packet_iter_next(&iter, &packet) == 0) {
+        int binding = packet.tag == PGP_TAG_SIGNATURE && packet.len > 1 &&
+                      packet.body[1] == PGP_SIG_SUBKEY_BINDING;
+
+        if(binding && !corrupt)
+            continue;
+
+        size = packet.header_len + packet.len;
+        if(size > sizeof(buffer) - len)
+            return -EMSGSIZE;
+        memcpy(buffer + len, packet.body - packet.header_len, size);
+        len += size;
+
+        /* the last octet of the signature MPI */
+        if(binding)
+            buffer[len - 1] ^= 0x01;
+    }
+
+    return parse_public_key_buffer(pub, buffer, len);
+}
+
+int main()
+{
+    int ret = -1, result;
+    uint8_t *key_data = NULL;
+    size_t key_len;
+    libsign_public_key test, other, unbound, corrupted, sha512, *found;
+    libsign_signature sig, subkey_sig;
+    libsign_subkey *subkey;
+    libsign_keystore ks;
+    libsign_arena arena;
+
+    public_key_init(&test);
+    public_key_init(&other);
+    public_key_init(&unbound);
+    public_key_init(&corrupted);
+    public_key_init(&sha512);
+    signature_init(&sig);
+    signature_init(&subkey_sig);
+    keystore_init(&ks);
+    arena_init(&arena);
+
+    if(parse_public_key(&test, "files/testkey.key") < 0 ||
+       parse_public_key(&other, "files/pubkey.key") < 0 ||
+       parse_signature(&sig, "files/vmImage.sig") < 0 ||
+       parse_signature(&subkey_sig, "files/vmImage-subkey.sig") < 0)
+        goto exit;
+
+    /* nothing is checked as the keys are parsed */
+    if(test.subkeys[0].binding != LIBSIGN_CERT_UNCHECKED || test.subkeys[0].key_flags ||
+       other.subkeys[0].binding != LIBSIGN_CERT_UNCHECKED)
+        goto exit;
+
+    /* key IDs, fingerprints and the flags from the self-signatures, once
+       they have been checked: the certification, the binding and its
+       back-signature, and for the other key a binding without one */
+    if(test.key_flags || verify_certifications(&test, NULL) != 3 ||
+       verify_certifications(&other, NULL) != 2)
+        goto exit;
+    if(test.key_id != 0x154A0F514623B164ULL ||
+       memcmp(test.fingerprint, primary_fpr, PGP_FINGERPRINT_LEN) != 0 ||
+       test.key_flags != (PGP_KEY_FLAG_CERTIFY | PGP_KEY_FLAG_SIGN))
+        goto exit;
+    if(test.num_subkeys != 1 || test.subkeys[0].key_id != 0x72AA0618D219A4C6ULL ||
+       memcmp(test.subkeys[0].fingerprint, subkey_fpr, PGP_FINGERPRINT_LEN) != 0 ||
+       test.subkeys[0].key_flags != PGP_KEY_FLAG_SIGN ||
+       mpz_sizeinbase(test.subkeys[0].n, 2) != 2048)
+        goto exit;
+    if(other.key_id != 0x1EB5F06127342502ULL || other.num_subkeys != 1 ||
+       other.subkeys[0].key_id != 0x47B4AF6A10406B63ULL ||
+       other.subkeys[0].key_flags != (PGP_KEY_FLAG_ENCRYPT_COMMS | PGP_KEY_FLAG_ENCRYPT_STORAGE))
+        goto exit;
+
+    /* the signature made by the subkey is checked against the subkey */
+    if(subkey_sig.issuer != test.subkeys[0].key_id)
+        goto exit;
+    result = verify(&test, &subkey_sig, "files/vmImage");
+    if(result != 0) {
+        fprintf(stderr, "subkey signature did not verify: %d\n", result);
+        goto exit;
+    }
+    if(verify(&other, &subkey_sig, "files/vmImage") != -ENOKEY)
+        goto exit;
+
+    /* an encryption subkey may not sign */
+    sig.issuer = other.subkeys[0].key_id;
+    if(verify(&other, &sig, "files/vmImage") != -EKEYREJECTED)
+        goto exit;
+    sig.issuer = other.key_id;
+
+    /* only the signing subkey has signed its binding back */
+    if(test.subkeys[0].binding != LIBSIGN_CERT_VALID ||
+       test.subkeys[0].back_signature != LIBSIGN_CERT_VALID ||
+       other.subkeys[0].binding != LIBSIGN_CERT_VALID ||
+       other.subkeys[0].back_signature != LIBSIGN_CERT_UNCHECKED)
+        goto exit;
+
+    /* a subkey without a binding that checks out does not sign for the key */
+    key_data = read_file("files/testkey.key", &key_len);
+    if(!key_data ||
+       unbound_key(&unbound, key_data, key_len, 0) < 0 || unbound.num_subkeys != 1 ||
+       unbound.subkeys[0].binding != LIBSIGN_CERT_UNCHECKED || unbound.subkeys[0].key_flags ||
+       verify(&unbound, &subkey_sig, "files/vmImage") != -EKEYREJECTED)
+        goto exit;
+    /* the bindings are checked the first time the key is used */
+    if(unbound_key(&corrupted, key_data, key_len, 1) < 0 || corrupted.num_subkeys != 1 ||
+       verify(&corrupted, &subkey_sig, "files/vmImage") != -EKEYREJECTED ||
+       corrupted.subkeys[0].binding != LIBSIGN_CERT_INVALID)
+        goto exit;
+    /* nor does one bound over a hash there is no engine for */
+    if(parse_public_key(&sha512, "files/testkey-sha512.key") < 0 ||
+       verify(&sha512, &subkey_sig, "files/vmImage") != -EKEYREJECTED ||
+       sha512.subkeys[0].binding != LIBSIGN_CERT_UNSUPPORTED)
+        goto exit;
+
+    /* one lookup finds the key whichever of its keys made the signature */
+    if(keystore_add(&ks, &test) < 0 || keystore_add(&ks, &other) < 0)
+        goto exit;
+    if(keystore_add(&ks, &other) != -EEXIST || ks.count != 4)
+        goto exit;
+
+    found = keystore_find(&ks, 0x47B4AF6A10406B63ULL, &subkey);
+    if(found != &other || subkey != &other.subkeys[0])
+        goto exit;
+    found = keystore_find(&ks, test.key_id, &subkey);
+    if(found != &test || subkey)
+        goto exit;
+    if(keystore_find(&ks, 0x0123456789abcdefULL, NULL))
+        goto exit;
+
+    if(verify_keystore(&ks, &sig, "files/vmImage") != 0 ||
+       verify_keystore(&ks, &subkey_sig, "files/vmImage") != 0)
+        goto exit;
+    /* and the subkey it was found by is the one checked */
+    sig.issuer = other.subkeys[0].key_id;
+    if(verify_keystore(&ks, &sig, "files/vmImage") != -EKEYREJECTED ||
+       verify_keystore_buffer(&ks, &sig, (const uint8_t*)"", 0) != -EKEYREJECTED)
+        goto exit;
+    sig.issuer = other.key_id;
+
+    /* subkeys are kept in the arena as well */
+    keystore_destroy(&ks);
+    public_key_destroy(&test);
+    public_key_init_arena(&test, &arena);
+    if(parse_public_key(&test, "files/testkey.key") < 0 ||
+       verify(&test, &subkey_sig, "files/vmImage") != 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    free(key_data);
+    keystore_destroy(&ks);
+    public_key_destroy(&test);
+    public_key_destroy(&other);
+    public_key_destroy(&unbound);
+    public_key_destroy(&corrupted);
+    public_key_destroy(&sha512);
+    signature_destroy(&sig);
+    signature_destroy(&subkey_sig);
+    arena_destroy(&arena);
+
+    return ret;
+}
@@ -0,0 +1,115 @@
+#include "common.h"
+#include "manifest.h"
+#include "public_key.h"
+#include "signature.h"
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+int main()
+{
+    int ret = -1, fd = -1, corrupt_fd = -1;
+    size_t manifest_len, image_len;
+    uint8_t *manifest = NULL, *image = NULL, *buffer = NULL;
+
+    libsign_signature sig;
+    libsign_public_key pub;
+    libsign_verified_reader reader, corrupt;
+
+    signature_init(&sig);
+    public_key_init(&pub);
+    memset(&reader, 0, sizeof(reader));
+    memset(&corrupt, 0, sizeof(corrupt));
+
+    if(parse_public_key(&pub, "files/testkey.key") < 0)
+        goto exit;
+
+    if(parse_signature(&sig, "files/vmImage.manifest.sig") < 0)
+        goto exit;
+
+    manifest = read_file("files/vmImage.manifest", &manifest_len);
+    image = read_file("files/vmImage", &image_len);
+    buffer = malloc(image_len);
+    if(!manifest || !image || !buffer)
+        goto exit;
+
+    fd = open("files/vmImage", O_RDONLY | O_BINARY);
+    if(fd < 0)
+        goto exit;
+
+    ret = verified_reader_open(&reader, &pub, &sig, manifest, manifest_len, fd, THREADS);
+    if(ret < 0)
+        goto exit;
+
+    /* a read within a single chunk only checks that chunk */
+    ret = -1;
+    if(verified_reader_pread(&reader, buffer, 1000, 70000) != 1000)
+        goto exit;
+    if(memcmp(buffer, image + 70000, 1000) != 0)
+        goto exit;
+    if(!verified_reader_chunk_verified(&reader, 1) || verified_reader_chunk_verified(&reader, 0))
+        goto exit;
+
+    /* unaligned read spanning many chunks */
+    if(verified_reader_pread(&reader, buffer, 500000, 12345) != 500000)
+        goto exit;
+    if(memcmp(buffer, image + 12345, 500000) != 0)
+        goto exit;
+
+    /* the whole image, reads past the end are truncated */
+    if(verified_reader_pread(&reader, buffer, image_len + 100, 0) != (ssize_t)image_len)
+        goto exit;
+    if(memcmp(buffer, image, image_len) != 0)
+        goto exit;
+
+    /* flip a bit in the fourth chunk of a copy */
+    corrupt_fd = open("files/vmImage.corrupt", O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if(corrupt_fd < 0)
+        goto exit;
+    image[3 * 65536 + 17] ^= 0x10;
+    if(write(corrupt_fd, image, image_len) != (ssize_t)image_len)
+        goto exit;
+
+    if(verified_reader_open(&corrupt, &pub, &sig, manifest, manifest_len, corrupt_fd, THREADS) < 0)
+        goto exit;
+
+    if(verified_reader_pread(&corrupt, buffer, 65536, 0) != 65536)
+        goto exit;
+    if(verified_reader_pread(&corrupt, buffer, 200000, 65536) != -EBADMSG)
+        goto exit;
+
+    /* a manifest that does not match its signature is rejected */
+    manifest[30] ^= 0x01;
+    verified_reader_close(&corrupt);
+    if(verified_reader_open(&corrupt, &pub, &sig, manifest, manifest_len, corrupt_fd, THREADS) == 0)
+        goto exit;
+
+    ret = 0;
+exit:
+    verified_reader_close(&reader);
+    verified_reader_close(&corrupt);
+    if(fd >= 0)
+        close(fd);
+    if(corrupt_fd >= 0) {
+        close(corrupt_fd);
+        unlink("files/vmImage.corrupt");
+    }
+
+    signature_destroy(&sig);
+    public_key_destroy(&pub);
+    free(manifest);
+    free(image);
+    free(buffer);
+
+    return ret;
+}
@@ -0,0 +1,93 @@
+#include "verify.h"
+#include "hash.h"
+#include "signature.h"
+#include "public_key.h"
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+int main()
+{
+    int ret, fd = -1, results[2];
+    struct stat st;
+    uint8_t *data = NULL;
+    uint8_t digest[SHA1_DIGEST_LENGTH], expected[SHA1_DIGEST_LENGTH];
+    sha1_ctx content, reference;
+    libsign_hash_fanout fan;
+
+    libsign_signature sig, sig_armor;
+    libsign_public_key pub;
+    libsign_public_key *keys[2] = { &pub, &pub };
+    libsign_signature *sigs[2] = { &sig, &sig_armor };
+
+    signature_init(&sig);
+    signature_init(&sig_armor);
+    public_key_init(&pub);
+
+    ret = parse_public_key(&pub, "files/pubkey.key");
+    if(ret < 0)
+        goto exit;
+
+    ret = parse_signature(&sig, "files/vmImage.sig");
+    if(ret < 0)
+        goto exit;
+
+    ret = parse_signature(&sig_armor, "files/vmImage.asc");
+    if(ret < 0)
+        goto exit;
+
+    /* both signatures and a content digest from one pass */
+    sha1_init(&content);
+    hash_fanout_init(&fan, FANOUT_FLAGS);
+    hash_fanout_add_sha1(&fan, &content);
+
+    ret = verify_many(keys, sigs, results, 2, "files/vmImage", &fan);
+    if(ret != 0 || results[0] != 0 || results[1] != 0)
+        goto exit;
+
+    sha1_digest(&content, digest);
+
+    /* compare the content digest with a plain hash of the file */
+    ret = -1;
+    fd = open("files/vmImage", O_RDONLY | O_BINARY);
+    if(fd < 0)
+        goto exit;
+
+    if(fstat(fd, &st) < 0)
+        goto exit;
+
+    data = malloc(st.st_size);
+    if(!data) {
+        ret = -errno;
+        goto exit;
+    }
+
+    if(read(fd, data, st.st_size) != st.st_size)
+        goto exit;
+
+    sha1_init(&reference);
+    sha1_update(&reference, st.st_size, data);
+    sha1_digest(&reference, expected);
+
+    ret = memcmp(digest, expected, SHA1_DIGEST_LENGTH) != 0;
+exit:
+    if(fd >= 0)
+        close(fd);
+
+    signature_destroy(&sig);
+    signature_destroy(&sig_armor);
+    public_key_destroy(&pub);
+    free(data);
+
+    return ret;
+}
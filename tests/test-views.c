@@ -0,0 +1,123 @@
+#include "common.h"
+#include "packet.h"
+#include "public_key.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+int main()
+{
+    int ret = -1, fd, result;
+    static const int tags[] = {
+        PGP_TAG_PUBLIC_KEY, PGP_TAG_USERID, PGP_TAG_SIGNATURE,
+        PGP_TAG_PUBLIC_SUBKEY, PGP_TAG_SIGNATURE
+    };
+    uint8_t *key_data, *sig_data, *image, *test_data, *subkey_sig_data;
+    size_t key_len, sig_len, image_len, test_len, subkey_sig_len;
+    uint32_t uid_len, i = 0;
+    const uint8_t *uid;
+    libsign_packet_iter iter;
+    libsign_packet packet;
+    libsign_key_view key, test;
+    libsign_signature_view sig, subkey_sig, other;
+
+    key_data = read_file("files/pubkey.key", &key_len);
+    sig_data = read_file("files/vmImage.sig", &sig_len);
+    image = read_file("files/vmImage", &image_len);
+    test_data = read_file("files/testkey.key", &test_len);
+    subkey_sig_data = read_file("files/vmImage-subkey.sig", &subkey_sig_len);
+    if(!key_data || !sig_data || !image || !test_data || !subkey_sig_data)
+        goto exit;
+
+    /* the packets of the key, in order */
+    packet_iter_init(&iter, key_data, key_len);
+    while(packet_iter_next(&iter, &packet) == 0) {
+        if(i == sizeof(tags) / sizeof(tags[0]) || packet.tag != tags[i++])
+            goto exit;
+        if(packet.body + packet.len > key_data + key_len)
+            goto exit;
+    }
+    if(i != sizeof(tags) / sizeof(tags[0]))
+        goto exit;
+
+    if(parse_key_view(&key, key_data, key_len) < 0 ||
+       parse_signature_view(&sig, sig_data, sig_len) < 0)
+        goto exit;
+
+    /* everything points into the buffers */
+    if(key.n < key_data || key.n >= key_data + key_len ||
+       sig.hashed_data < sig_data || sig.hashed_data >= sig_data + sig_len)
+        goto exit;
+
+    if(key.num_userids != 1 || key_view_userid(&key, 0, &uid, &uid_len) < 0 ||
+       uid_len != 21 || memcmp(uid, "Foo Bar <foo@bar.com>", 21) != 0)
+        goto exit;
+    if(key_view_userid(&key, 1, &uid, &uid_len) != -ENOENT)
+        goto exit;
+    if(key.packets + key.packets_len != key_data + key_len)
+        goto exit;
+
+    if(sig.issuer != 0x1EB5F06127342502ULL || sig.hash_algo != PGP_SHA1)
+        goto exit;
+
+    if(verify_view_buffer(&key, &sig, image, image_len) != 0)
+        goto exit;
+
+    fd = open("files/vmImage", O_RDONLY | O_BINARY);
+    if(fd < 0)
+        goto exit;
+    result = verify_view_fd(&key, &sig, fd);
+    close(fd);
+    if(result != 0)
+        goto exit;
+
+    /* the issuer picks the key, an encryption subkey may not sign */
+    other = sig;
+    other.issuer = 0x0123456789abcdefULL;
+    if(verify_view_buffer(&key, &other, image, image_len) != -ENOKEY)
+        goto exit;
+    other.issuer = 0x47B4AF6A10406B63ULL;
+    if(verify_view_buffer(&key, &other, image, image_len) != -EKEYREJECTED)
+        goto exit;
+
+    /* and a signing subkey is checked with its own key material */
+    if(parse_key_view(&test, test_data, test_len) < 0 ||
+       parse_signature_view(&subkey_sig, subkey_sig_data, subkey_sig_len) < 0 ||
+       subkey_sig.issuer != 0x72AA0618D219A4C6ULL)
+        goto exit;
+    if(verify_view_buffer(&test, &subkey_sig, image, image_len) != 0 ||
+       verify_view_buffer(&key, &subkey_sig, image, image_len) != -ENOKEY)
+        goto exit;
+
+    /* the binding is kept in the view for the next verification */
+    if(test.subkey.key_id != subkey_sig.issuer || test.subkey.binding != LIBSIGN_CERT_VALID ||
+       verify_view_buffer(&test, &subkey_sig, image, image_len) != 0)
+        goto exit;
+
+    image[image_len / 2] ^= 0x01;
+    if(verify_view_buffer(&key, &sig, image, image_len) == 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    free(key_data);
+    free(sig_data);
+    free(image);
+    free(test_data);
+    free(subkey_sig_data);
+
+    return ret;
+}
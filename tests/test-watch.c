@@ -0,0 +1,192 @@
+#include "keystore.h"
+#include "watch.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_KEY_ID     0x154A0F514623B164ULL
+#define PUBKEY_ID       0x1EB5F06127342502ULL
+#define EXPIRING_ID     0x34D3FC216966F4E4ULL
+
+static char directory[] = "watch-XXXXXX";
+
+static int copy_file(const char *from, const char *name)
+{
+    char path[256];
+    uint8_t buffer[4096];
+    ssize_t len;
+    int in, out, ret = -1;
+
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+
+    in = open(from, O_RDONLY);
+    out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(in < 0 || out < 0)
+        goto exit;
+
+    while((len = read(in, buffer, sizeof(buffer))) > 0) {
+        if(write(out, buffer, len) != len)
+            goto exit;
+    }
+    ret = len < 0 ? -1 : 0;
+
+exit:
+    if(in >= 0)
+        close(in);
+    if(out >= 0)
+        close(out);
+
+    return ret;
+}
+
+static void remove_file(const char *name)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    unlink(path);
+}
+
+static int rename_file(const char *from, const char *to)
+{
+    char old_path[256], new_path[256];
+
+    snprintf(old_path, sizeof(old_path), "%s/%s", directory, from);
+    snprintf(new_path, sizeof(new_path), "%s/%s", directory, to);
+
+    return rename(old_path, new_path);
+}
+
+/* wait for the changes to be reported, and apply them */
+static int process(libsign_keystore_watch *watch)
+{
+    struct pollfd pfd = { .fd = keystore_watch_fd(watch), .events = POLLIN };
+
+    if(poll(&pfd, 1, 1000) != 1)
+        return -1;
+
+    return keystore_watch_process(watch);
+}
+
+static libsign_public_key *lookup(libsign_shared_keystore *sks, libsign_key_id key_id)
+{
+    libsign_keystore_reader *reader = shared_keystore_reader(sks);
+    libsign_keystore_generation *gen;
+    libsign_public_key *pub;
+
+    gen = shared_keystore_enter(sks, reader);
+    pub = keystore_find(&gen->index, key_id, NULL);
+    shared_keystore_leave(reader);
+    shared_keystore_reader_release(reader);
+
+    return pub;
+}
+
+/* the key ID that keeps a file out of the keystore, 0 if none does */
+static libsign_key_id conflict(libsign_keystore_watch *watch, const char *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < watch->num_files; i++) {
+        if(strcmp(watch->files[i].name, name) == 0)
+            return watch->files[i].conflict;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    int ret = -1, watching = 0;
+    libsign_shared_keystore sks;
+    libsign_keystore_watch watch;
+    libsign_public_key *test;
+
+    if(!mkdtemp(directory) || shared_keystore_init(&sks, NULL) < 0)
+        return -1;
+
+    if(copy_file("files/pubkey.key", "pubkey.key") < 0)
+        goto exit;
+
+    /* the files already there are loaded at once */
+    if(keystore_watch_init(&watch, &sks, directory, LIBSIGN_PARSE_ALL) < 0)
+        goto exit;
+    watching = 1;
+    if(!lookup(&sks, PUBKEY_ID) || sks.current->num_keys != 1)
+        goto exit;
+
+    /* a new file, written under a hidden name and moved in place */
+    if(copy_file("files/testkey.key", ".testkey.key.tmp") < 0 ||
+       rename_file(".testkey.key.tmp", "testkey.key") < 0)
+        goto exit;
+    if(process(&watch) != 1)
+        goto exit;
+    test = lookup(&sks, TEST_KEY_ID);
+    if(!test || !lookup(&sks, PUBKEY_ID) || sks.current->num_keys != 2)
+        goto exit;
+
+    /* a file written over, the other key is left as it was */
+    if(copy_file("files/expiring.key", "pubkey.key") < 0)
+        goto exit;
+    if(process(&watch) != 1)
+        goto exit;
+    if(lookup(&sks, PUBKEY_ID) || !lookup(&sks, EXPIRING_ID) ||
+       lookup(&sks, TEST_KEY_ID) != test || sks.current->num_keys != 2)
+        goto exit;
+
+    /* a file that is no key, and a key already in another file */
+    if(copy_file("files/vmImage", "garbage.key") < 0 ||
+       copy_file("files/testkey.key", "duplicate.key") < 0)
+        goto exit;
+    if(process(&watch) != 2)
+        goto exit;
+    if(lookup(&sks, TEST_KEY_ID) != test || sks.current->num_keys != 2 || watch.num_files != 4)
+        goto exit;
+    if(conflict(&watch, "duplicate.key") != TEST_KEY_ID || conflict(&watch, "garbage.key"))
+        goto exit;
+
+    /* removed files take their keys with them, and the duplicate goes in
+       for the key that is gone */
+    remove_file("testkey.key");
+    remove_file("garbage.key");
+    if(process(&watch) != 2)
+        goto exit;
+    test = lookup(&sks, TEST_KEY_ID);
+    if(!test || !lookup(&sks, EXPIRING_ID) || sks.current->num_keys != 2 ||
+       watch.num_files != 2 || conflict(&watch, "duplicate.key"))
+        goto exit;
+
+    remove_file("duplicate.key");
+    if(process(&watch) != 1)
+        goto exit;
+    if(lookup(&sks, TEST_KEY_ID) || !lookup(&sks, EXPIRING_ID) || sks.current->num_keys != 1 ||
+       watch.num_files != 1)
+        goto exit;
+
+    /* nothing to do */
+    if(keystore_watch_process(&watch) != 0)
+        goto exit;
+
+    if(shared_keystore_reclaim(&sks) != 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    if(watching)
+        keystore_watch_destroy(&watch);
+    shared_keystore_destroy(&sks);
+
+    remove_file("pubkey.key");
+    remove_file("testkey.key");
+    remove_file("garbage.key");
+    remove_file("duplicate.key");
+    remove_file(".testkey.key.tmp");
+    rmdir(directory);
+
+    return ret;
+}
@@ -0,0 +1,122 @@
+#include "armor.h"
+#include "common.h"
+#include "public_key.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct membuf {
+    uint8_t data[16384];
+    size_t len;
+} membuf;
+
+static int mem_write(void *opaque, const uint8_t *buffer, size_t len)
+{
+    membuf *buf = opaque;
+
+    if(len > sizeof(buf->data) - buf->len)
+        return -ENOSPC;
+
+    memcpy(buf->data + buf->len, buffer, len);
+    buf->len += len;
+
+    return 0;
+}
+
+int main()
+{
+    int ret = -1, i;
+    static membuf file, out;
+    libsign_signature sig, sig2;
+    libsign_signature subkey_sig;
+    libsign_public_key pub, pub2, test, test2;
+
+    signature_init(&sig);
+    signature_init(&sig2);
+    signature_init(&subkey_sig);
+    public_key_init(&pub);
+    public_key_init(&pub2);
+    public_key_init(&test);
+    public_key_init(&test2);
+
+    if(parse_signature(&sig, "files/vmImage.sig") < 0 ||
+       parse_public_key(&pub, "files/pubkey.key") < 0)
+        goto exit;
+
+    /* the signature is written back exactly as gnupg wrote it */
+    if(read_file_buffer("files/vmImage.sig", file.data, sizeof(file.data), &file.len) < 0)
+        goto exit;
+    if(signature_write(&sig, mem_write, &out) < 0)
+        goto exit;
+    if(out.len != file.len || memcmp(out.data, file.data, file.len) != 0) {
+        fprintf(stderr, "binary signature differs\n");
+        goto exit;
+    }
+
+    /* armored at a narrow line width, and parsed again */
+    out.len = 0;
+    if(signature_write_armor(&sig, 40, mem_write, &out) < 0)
+        goto exit;
+    if(parse_signature_armor_buffer(&sig2, out.data, out.len) < 0)
+        goto exit;
+    if(sig2.issuer != sig.issuer || mpz_cmp(sig2.s, sig.s) != 0)
+        goto exit;
+
+    /* the key, through the armor as well */
+    out.len = 0;
+    if(public_key_write_armor(&pub, 0, mem_write, &out) < 0)
+        goto exit;
+    if(parse_public_key_armor_buffer(&pub2, out.data, out.len) < 0)
+        goto exit;
+    if(mpz_cmp(pub.n, pub2.n) != 0 || mpz_cmp(pub.e, pub2.e) != 0 ||
+       pub.created != pub2.created || pub.num_userids != pub2.num_userids)
+        goto exit;
+    for(i = 0; i < pub.num_userids; i++) {
+        if(pub.userids[i].len != pub2.userids[i].len ||
+           memcmp(pub.userids[i].userid, pub2.userids[i].userid, pub.userids[i].len) != 0)
+            goto exit;
+    }
+
+    if(verify(&pub2, &sig2, "files/vmImage") != 0)
+        goto exit;
+
+    /* the self-signatures and the signing subkey with its binding come
+       along, and check out as they did */
+    out.len = 0;
+    if(parse_public_key(&test, "files/testkey.key") < 0 ||
+       parse_signature(&subkey_sig, "files/vmImage-subkey.sig") < 0 ||
+       public_key_write(&test, mem_write, &out) < 0 ||
+       parse_public_key_buffer(&test2, out.data, out.len) < 0)
+        goto exit;
+    if(test2.num_subkeys != 1 || test2.num_certs != test.num_certs ||
+       mpz_cmp(test.subkeys[0].n, test2.subkeys[0].n) != 0 ||
+       verify_certifications(&test2, NULL) != 3 ||
+       test2.subkeys[0].binding != LIBSIGN_CERT_VALID ||
+       test2.subkeys[0].back_signature != LIBSIGN_CERT_VALID ||
+       verify(&test2, &subkey_sig, "files/vmImage") != 0) {
+        fprintf(stderr, "key written with its subkey differs\n");
+        goto exit;
+    }
+
+    /* a line width that does not split into whole groups */
+    out.len = 0;
+    if(libsign_encode_armor(ARMOR_MESSAGE, file.data, file.len, 30, mem_write, &out) != -EINVAL)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    signature_destroy(&sig);
+    signature_destroy(&sig2);
+    signature_destroy(&subkey_sig);
+    public_key_destroy(&pub);
+    public_key_destroy(&pub2);
+    public_key_destroy(&test);
+    public_key_destroy(&test2);
+
+    return ret;
+}
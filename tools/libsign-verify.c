@@ -0,0 +1,544 @@
+/* Verify the detached signatures of a tree of files. Every file with a .sig
+   or .asc file next to it is checked against the keys given with -k, on a
+   pool of threads, and one line is printed for each file. */
+
+#include "armor.h"
+#include "keystore.h"
+#include "public_key.h"
+#include "scratch.h"
+#include "signature.h"
+#include "verify.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_KEYRINGS    16
+#define MAX_THREADS     64
+
+enum status {
+    STATUS_GOOD,
+    STATUS_BAD,
+    STATUS_ERROR,
+    /* a file without a signature, a signature without a file */
+    STATUS_UNSIGNED,
+    STATUS_ORPHAN,
+    NUM_STATUS
+};
+
+static const char *status_names[NUM_STATUS] = {
+    "good", "bad", "error", "unsigned", "orphan"
+};
+
+typedef struct entry {
+    char *path;
+    /* the signature, NULL for unsigned files */
+    char *sidecar;
+    off_t size;
+
+    enum status status;
+    int result;
+    libsign_key_id issuer;
+    uint64_t usec;
+} entry;
+
+typedef struct tree {
+    entry *entries;
+    uint32_t count;
+    uint32_t size;
+} tree;
+
+typedef struct pool {
+    tree *files;
+    libsign_keystore *ks;
+    /* indexes of the entries, largest file first */
+    uint32_t *order;
+    uint32_t next;
+} pool;
+
+static uint64_t now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t len = strlen(name), suffix_len = strlen(suffix);
+
+    return len > suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+static int is_sidecar(const char *name)
+{
+    return has_suffix(name, ".sig") || has_suffix(name, ".asc");
+}
+
+static int is_file(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static int tree_add(tree *files, char *path, char *sidecar, off_t size, enum status status)
+{
+    entry *e;
+
+    if(files->count == files->size) {
+        uint32_t size = files->size ? files->size * 2 : 64;
+
+        e = realloc(files->entries, size * sizeof(entry));
+        if(!e)
+            return -ENOMEM;
+        files->entries = e;
+        files->size = size;
+    }
+
+    e = &files->entries[files->count++];
+    memset(e, 0, sizeof(entry));
+    e->path = path;
+    e->sidecar = sidecar;
+    e->size = size;
+    e->status = status;
+
+    return 0;
+}
+
+static char *join(const char *a, const char *sep, const char *b)
+{
+    size_t len = strlen(a) + strlen(sep) + strlen(b) + 1;
+    char *s = malloc(len);
+
+    if(s)
+        snprintf(s, len, "%s%s%s", a, sep, b);
+
+    return s;
+}
+
+/* a file and each of its signatures, or a signature whose file is missing */
+static int add_file(tree *files, const char *path, off_t size)
+{
+    static const char *suffixes[] = { ".sig", ".asc" };
+    int ret = 0, signed_file = 0;
+    unsigned int i;
+    char *copy, *sidecar, *base;
+
+    if(is_sidecar(path)) {
+        base = strdup(path);
+        if(!base)
+            return -ENOMEM;
+        base[strlen(base) - 4] = '\0';
+
+        ret = is_file(base);
+        free(base);
+        if(ret)
+            return 0;
+
+        copy = strdup(path);
+        if(!copy)
+            return -ENOMEM;
+        return tree_add(files, copy, NULL, size, STATUS_ORPHAN);
+    }
+
+    for(i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]) && ret == 0; i++) {
+        sidecar = join(path, "", suffixes[i]);
+        if(!sidecar)
+            return -ENOMEM;
+        if(!is_file(sidecar)) {
+            free(sidecar);
+            continue;
+        }
+
+        copy = strdup(path);
+        if(!copy) {
+            free(sidecar);
+            return -ENOMEM;
+        }
+        ret = tree_add(files, copy, sidecar, size, STATUS_ERROR);
+        signed_file = 1;
+    }
+
+    if(ret == 0 && !signed_file) {
+        copy = strdup(path);
+        if(!copy)
+            return -ENOMEM;
+        ret = tree_add(files, copy, NULL, size, STATUS_UNSIGNED);
+    }
+
+    return ret;
+}
+
+static int walk(tree *files, const char *directory)
+{
+    int ret = 0;
+    DIR *dir;
+    struct dirent *de;
+    struct stat st;
+    char *path;
+
+    dir = opendir(directory);
+    if(!dir)
+        return -errno;
+
+    while(ret == 0 && (de = readdir(dir))) {
+        if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+
+        path = join(directory, "/", de->d_name);
+        if(!path) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        /* symbolic links to directories are not followed */
+        if(lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+            ret = walk(files, path);
+        else if(stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            ret = add_file(files, path, st.st_size);
+
+        free(path);
+    }
+
+    closedir(dir);
+
+    return ret;
+}
+
+static void tree_destroy(tree *files)
+{
+    uint32_t i;
+
+    for(i = 0; i < files->count; i++) {
+        free(files->entries[i].path);
+        free(files->entries[i].sidecar);
+    }
+    free(files->entries);
+}
+
+/* data is NULL and len 0 unless the whole file was read */
+static int read_file(const char *filename, uint8_t **data, uint32_t *len)
+{
+    int fd, ret = 0;
+    struct stat st;
+    ssize_t num;
+
+    *data = NULL;
+    *len = 0;
+
+    fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return -errno;
+
+    if(fstat(fd, &st) < 0 || !(*data = malloc(st.st_size ? st.st_size : 1))) {
+        close(fd);
+        return -ENOMEM;
+    }
+
+    num = read(fd, *data, st.st_size);
+    if(num != st.st_size) {
+        free(*data);
+        *data = NULL;
+        ret = -EIO;
+    }
+    else
+        *len = num;
+
+    close(fd);
+
+    return ret;
+}
+
+/* every key in a keyring, binary or armored (.asc) */
+static int load_keyring(libsign_public_key **keys, uint32_t *num_keys, const char *filename)
+{
+    int ret;
+    uint8_t *data, *plain = NULL;
+    const uint8_t *p;
+    uint32_t len, left;
+    libsign_key_view view;
+    libsign_public_key *pub, *grown;
+
+    ret = read_file(filename, &data, &len);
+    if(ret < 0)
+        return ret;
+
+    p = data;
+    left = len;
+    if(has_suffix(filename, ".asc")) {
+        ret = decode_armor(data, len, &plain, &left);
+        if(ret < 0)
+            goto exit;
+        p = plain;
+    }
+
+    /* each key runs up to the next one */
+    while(left && (ret = parse_key_view(&view, p, left)) == 0) {
+        uint32_t key_len = view.packets + view.packets_len - p;
+
+        grown = realloc(*keys, (*num_keys + 1) * sizeof(libsign_public_key));
+        if(!grown) {
+            ret = -ENOMEM;
+            break;
+        }
+        *keys = grown;
+
+        pub = &(*keys)[*num_keys];
+        public_key_init(pub);
+        ret = parse_public_key_buffer(pub, p, key_len);
+        /* checked here, the threads verifying with the key must find it
+           done and not each try to do it (see verify_certifications()) */
+        if(ret == 0 && (ret = verify_certifications(pub, NULL)) > 0)
+            ret = 0;
+        if(ret < 0) {
+            public_key_destroy(pub);
+            break;
+        }
+        (*num_keys)++;
+
+        p += key_len;
+        left -= key_len;
+    }
+
+exit:
+    free(plain);
+    free(data);
+
+    return ret;
+}
+
+static void verify_entry(entry *e, libsign_keystore *ks, libsign_scratch *scratch)
+{
+    libsign_signature sig;
+    libsign_public_key *pub;
+    uint64_t start = now_usec();
+
+    signature_init(&sig);
+
+    e->result = parse_signature(&sig, e->sidecar);
+    if(e->result == 0) {
+        e->issuer = sig.issuer;
+        pub = keystore_find(ks, sig.issuer, NULL);
+        e->result = pub ? verify_scratch(pub, &sig, e->path, scratch) : -ENOKEY;
+    }
+
+    signature_destroy(&sig);
+
+    e->usec = now_usec() - start;
+    if(e->result == 0)
+        e->status = STATUS_GOOD;
+    /* the signature did not match, anything else kept it from being checked */
+    else if(e->result == -EBADMSG || e->result > 0)
+        e->status = STATUS_BAD;
+    else
+        e->status = STATUS_ERROR;
+}
+
+static void *pool_worker(void *arg)
+{
+    pool *p = arg;
+    libsign_scratch scratch;
+
+    scratch_init(&scratch);
+    scratch_reserve_keystore(&scratch, p->ks);
+
+    for(;;) {
+        uint32_t i = __sync_fetch_and_add(&p->next, 1);
+        entry *e;
+        if(i >= p->files->count)
+            break;
+
+        e = &p->files->entries[p->order[i]];
+        if(e->sidecar)
+            verify_entry(e, p->ks, &scratch);
+    }
+
+    scratch_destroy(&scratch);
+
+    return NULL;
+}
+
+static tree *sort_files;
+
+static int by_size(const void *a, const void *b)
+{
+    const entry *ea = &sort_files->entries[*(const uint32_t*)a];
+    const entry *eb = &sort_files->entries[*(const uint32_t*)b];
+
+    if(ea->size != eb->size)
+        return ea->size < eb->size ? 1 : -1;
+
+    return 0;
+}
+
+static int by_path(const void *a, const void *b)
+{
+    const entry *ea = a, *eb = b;
+    int ret = strcmp(ea->path, eb->path);
+
+    if(ret == 0 && ea->sidecar && eb->sidecar)
+        ret = strcmp(ea->sidecar, eb->sidecar);
+
+    return ret;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-u] -k keyring [-k keyring ...] directory\n"
+                    "\n"
+                    "Uses one thread per processor unless -j is given, at most %d.\n"
+                    "\n"
+                    "Prints a tab separated line for each file:\n"
+                    "  status, result, issuer, size, microseconds, file, signature\n"
+                    "where status is good, bad, error, unsigned or orphan, then a summary.\n"
+                    "Exits with 1 if any signature is bad or could not be checked, or if\n"
+                    "a file is unsigned or a signature has no file, unless -u is given.\n",
+            name, MAX_THREADS);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 2, opt, allow_unsigned = 0;
+    unsigned int threads = 0, started = 0, i, num_keyrings = 0;
+    unsigned long value;
+    char *end;
+    uint32_t j, num_keys = 0, counts[NUM_STATUS];
+    const char *keyrings[MAX_KEYRINGS];
+    pthread_t workers[MAX_THREADS];
+    uint64_t start, total = 0;
+    libsign_public_key *keys = NULL;
+    libsign_keystore ks;
+    tree files;
+    pool p;
+
+    keystore_init(&ks);
+    memset(&files, 0, sizeof(tree));
+    memset(&p, 0, sizeof(pool));
+    memset(counts, 0, sizeof(counts));
+
+    while((opt = getopt(argc, argv, "j:k:uh")) != -1) {
+        switch(opt) {
+        case 'j':
+            errno = 0;
+            value = strtoul(optarg, &end, 10);
+            if(errno || end == optarg || *end || optarg[0] == '-' || !value) {
+                fprintf(stderr, "-j takes a number of threads, not %s\n", optarg);
+                return 2;
+            }
+            threads = value > MAX_THREADS ? MAX_THREADS : value;
+            break;
+        case 'u':
+            allow_unsigned = 1;
+            break;
+        case 'k':
+            if(num_keyrings == MAX_KEYRINGS) {
+                fprintf(stderr, "at most %d keyrings\n", MAX_KEYRINGS);
+                return 2;
+            }
+            keyrings[num_keyrings++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(optind != argc - 1 || !num_keyrings) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    for(i = 0; i < num_keyrings; i++) {
+        int result = load_keyring(&keys, &num_keys, keyrings[i]);
+        if(result < 0) {
+            fprintf(stderr, "%s: %s\n", keyrings[i], strerror(-result));
+            goto exit;
+        }
+    }
+    /* added once the array no longer moves */
+    for(j = 0; j < num_keys; j++) {
+        int result = keystore_add(&ks, &keys[j]);
+        if(result < 0 && result != -EEXIST)
+            goto exit;
+    }
+
+    start = now_usec();
+
+    opt = walk(&files, argv[optind]);
+    if(opt < 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(-opt));
+        goto exit;
+    }
+
+    /* the largest files are started first, so that one of them is not left
+       to run on its own at the end while the other threads are idle */
+    p.files = &files;
+    p.ks = &ks;
+    p.order = malloc((files.count ? files.count : 1) * sizeof(uint32_t));
+    if(!p.order)
+        goto exit;
+    for(j = 0; j < files.count; j++)
+        p.order[j] = j;
+    sort_files = &files;
+    qsort(p.order, files.count, sizeof(uint32_t), by_size);
+
+    if(!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? online : 1;
+    }
+    if(threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    for(i = 1; i < threads; i++) {
+        if(pthread_create(&workers[started], NULL, pool_worker, &p) != 0)
+            break;
+        started++;
+    }
+
+    pool_worker(&p);
+
+    for(i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    total = now_usec() - start;
+
+    qsort(files.entries, files.count, sizeof(entry), by_path);
+
+    for(j = 0; j < files.count; j++) {
+        entry *e = &files.entries[j];
+
+        printf("%s\t%d\t%016" PRIX64 "\t%lld\t%" PRIu64 "\t%s\t%s\n",
+               status_names[e->status], e->result, (uint64_t)e->issuer, (long long)e->size,
+               e->usec, e->path, e->sidecar ? e->sidecar : "-");
+        counts[e->status]++;
+    }
+
+    printf("summary\tgood=%u\tbad=%u\terror=%u\tunsigned=%u\torphan=%u\tthreads=%u\t"
+           "usec=%" PRIu64 "\n", counts[STATUS_GOOD], counts[STATUS_BAD], counts[STATUS_ERROR],
+           counts[STATUS_UNSIGNED], counts[STATUS_ORPHAN], started + 1, total);
+
+    ret = counts[STATUS_BAD] || counts[STATUS_ERROR] ? 1 : 0;
+    if(!allow_unsigned && (counts[STATUS_UNSIGNED] || counts[STATUS_ORPHAN]))
+        ret = 1;
+
+exit:
+    free(p.order);
+    tree_destroy(&files);
+    keystore_destroy(&ks);
+    for(j = 0; j < num_keys; j++)
+        public_key_destroy(&keys[j]);
+    free(keys);
+
+    return ret;
+}